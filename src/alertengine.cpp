@@ -0,0 +1,402 @@
+#include "alertengine.h"
+#include <QFile>
+#include <QTextStream>
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+struct Name {
+    const char *name;
+    int value;
+};
+
+const Name kMetrics[] = {
+    { "downlink", TelemetryStore::Downlink },
+    { "uplink", TelemetryStore::Uplink },
+    { "latency", TelemetryStore::Latency },
+    { "drop_rate", TelemetryStore::DropRate },
+    { "snr", TelemetryStore::Snr },
+};
+
+const Name kStats[] = {
+    { "min", AlertRule::Min },
+    { "max", AlertRule::Max },
+    { "mean", AlertRule::Mean },
+    { "p50", AlertRule::P50 },
+    { "p95", AlertRule::P95 },
+    { "p99", AlertRule::P99 },
+};
+
+const Name kWindows[] = {
+    { "1m", TelemetryStore::OneMinute },
+    { "15m", TelemetryStore::FifteenMinutes },
+    { "1h", TelemetryStore::OneHour },
+};
+
+const Name kComparisons[] = {
+    { ">", AlertRule::Above },
+    { ">=", AlertRule::AtLeast },
+    { "<", AlertRule::Below },
+    { "<=", AlertRule::AtMost },
+};
+
+const Name kAlerts[] = {
+    { "motors_stuck", DishSnapshot::MotorsStuck },
+    { "thermal_throttle", DishSnapshot::ThermalThrottle },
+    { "thermal_shutdown", DishSnapshot::ThermalShutdown },
+    { "mast_not_near_vertical", DishSnapshot::MastNotNearVertical },
+    { "unexpected_location", DishSnapshot::UnexpectedLocation },
+    { "slow_ethernet_speeds", DishSnapshot::SlowEthernetSpeeds },
+};
+
+const char *const kDefaultRules[] = {
+    "motors_stuck: alert.motors_stuck > 0",
+    "thermal_throttle: alert.thermal_throttle > 0",
+    "thermal_shutdown: alert.thermal_shutdown > 0",
+    "mast_not_near_vertical: alert.mast_not_near_vertical > 0",
+    "unexpected_location: alert.unexpected_location > 0",
+    "slow_ethernet_speeds: alert.slow_ethernet_speeds > 0",
+    "disconnected: connected < 1 for 30s",
+    "high_latency: latency.p95.1m > 80 for 2m clear 60",
+    "packet_loss: drop_rate.mean.1m > 2% for 1m clear 1%",
+    "obstructed: obstructed.15m > 5% for 5m clear 2%",
+};
+
+template <size_t N>
+bool lookup(const Name (&names)[N], const QString &name, int *value)
+{
+    for (const Name &each : names) {
+        if (name == each.name) {
+            *value = each.value;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool fail(QString *error, const QString &message)
+{
+    if (error) {
+        *error = message;
+    }
+    return false;
+}
+
+bool parseThreshold(QString text, float *value)
+{
+    double scale = 1.0;
+    if (text.endsWith("%")) {
+        text.chop(1);
+        scale = 0.01;
+    }
+    bool ok = false;
+    *value = static_cast<float>(text.toDouble(&ok) * scale);
+    return ok;
+}
+
+bool parseDuration(QString text, qint64 *ms)
+{
+    qint64 scale = 1000;
+    if (text.endsWith("h")) {
+        scale = 3600 * 1000;
+    } else if (text.endsWith("m")) {
+        scale = 60 * 1000;
+    }
+    if (text.endsWith("h") || text.endsWith("m") || text.endsWith("s")) {
+        text.chop(1);
+    }
+    bool ok = false;
+    const double value = text.toDouble(&ok);
+    *ms = static_cast<qint64>(value * static_cast<double>(scale));
+    return ok && value >= 0.0;
+}
+
+bool parseSource(const QString &text, AlertRule *rule)
+{
+    const QStringList parts = text.split('.');
+    int value = 0;
+
+    if (parts.size() == 1) {
+        if (text == "fraction_obstructed") {
+            rule->source = AlertRule::FractionObstructed;
+        } else if (text == "currently_obstructed") {
+            rule->source = AlertRule::CurrentlyObstructed;
+        } else if (text == "connected") {
+            rule->source = AlertRule::Connected;
+        } else if (text == "obstructed") {
+            rule->source = AlertRule::ObstructedFraction;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    if (parts[0] == "alert") {
+        if (parts.size() != 2 || !lookup(kAlerts, parts[1], &value)) {
+            return false;
+        }
+        rule->source = AlertRule::DishAlert;
+        rule->alert = static_cast<unsigned>(value);
+        return true;
+    }
+
+    if (parts[0] == "obstructed") {
+        if (parts.size() != 2 || !lookup(kWindows, parts[1], &value)) {
+            return false;
+        }
+        rule->source = AlertRule::ObstructedFraction;
+        rule->window = static_cast<TelemetryStore::Window>(value);
+        return true;
+    }
+
+    if (parts.size() > 3 || !lookup(kMetrics, parts[0], &value)) {
+        return false;
+    }
+    rule->source = AlertRule::Aggregate;
+    rule->metric = static_cast<TelemetryStore::Metric>(value);
+    if (!lookup(kStats, parts[1], &value)) {
+        return false;
+    }
+    rule->stat = static_cast<AlertRule::Stat>(value);
+    if (parts.size() == 3) {
+        if (!lookup(kWindows, parts[2], &value)) {
+            return false;
+        }
+        rule->window = static_cast<TelemetryStore::Window>(value);
+    }
+    return true;
+}
+
+float statValue(const TelemetryStore::Aggregate &aggregate, AlertRule::Stat stat)
+{
+    switch (stat) {
+    case AlertRule::Min:
+        return aggregate.min;
+    case AlertRule::Max:
+        return aggregate.max;
+    case AlertRule::Mean:
+        return aggregate.mean;
+    case AlertRule::P50:
+        return aggregate.p50;
+    case AlertRule::P95:
+        return aggregate.p95;
+    case AlertRule::P99:
+        return aggregate.p99;
+    }
+    return aggregate.mean;
+}
+
+bool compare(AlertRule::Comparison comparison, float value, float threshold)
+{
+    switch (comparison) {
+    case AlertRule::Above:
+        return value > threshold;
+    case AlertRule::AtLeast:
+        return value >= threshold;
+    case AlertRule::Below:
+        return value < threshold;
+    case AlertRule::AtMost:
+        return value <= threshold;
+    }
+    return false;
+}
+
+// Whether the rule has something to look at in this snapshot, and what
+bool currentValue(const AlertRule &rule, const DishSnapshot &snapshot, const TelemetryStore &store, float *value)
+{
+    switch (rule.source) {
+    case AlertRule::Aggregate: {
+        if (snapshot.newHistorySamples == 0) {
+            return false;
+        }
+        const TelemetryStore::Aggregate &aggregate = store.aggregate(rule.metric, rule.window);
+        if (aggregate.count == 0) {
+            return false;
+        }
+        *value = statValue(aggregate, rule.stat);
+        return true;
+    }
+    case AlertRule::ObstructedFraction:
+        if (snapshot.newHistorySamples == 0 || store.isEmpty()) {
+            return false;
+        }
+        *value = store.obstructedFraction(rule.window);
+        return true;
+    case AlertRule::Connected:
+        *value = snapshot.connected ? 1.0f : 0.0f;
+        return true;
+    case AlertRule::FractionObstructed:
+    case AlertRule::CurrentlyObstructed:
+    case AlertRule::DishAlert:
+        // What a dish said before it went away is no news
+        if (!snapshot.connected || !snapshot.hasStatus) {
+            return false;
+        }
+        break;
+    }
+
+    if (rule.source == AlertRule::FractionObstructed) {
+        *value = snapshot.fractionObstructed;
+    } else if (rule.source == AlertRule::CurrentlyObstructed) {
+        *value = snapshot.currentlyObstructed ? 1.0f : 0.0f;
+    } else {
+        *value = (snapshot.alerts & rule.alert) ? 1.0f : 0.0f;
+    }
+    return true;
+}
+
+}
+
+bool AlertRule::parse(const QString &line, AlertRule *rule, QString *error)
+{
+    const int colon = static_cast<int>(line.indexOf(':'));
+    if (colon <= 0) {
+        return fail(error, QString("expected name: value op threshold"));
+    }
+
+    AlertRule parsed;
+    parsed.name = line.left(colon).trimmed();
+    parsed.text = line.mid(colon + 1).simplified();
+    const QStringList words = parsed.text.split(' ');
+    if (words.size() < 3) {
+        return fail(error, QString("expected value op threshold after %1:").arg(parsed.name));
+    }
+
+    int comparison = 0;
+    if (!parseSource(words[0], &parsed)) {
+        return fail(error, QString("unknown value %1").arg(words[0]));
+    }
+    if (!lookup(kComparisons, words[1], &comparison)) {
+        return fail(error, QString("unknown comparison %1").arg(words[1]));
+    }
+    parsed.comparison = static_cast<Comparison>(comparison);
+    if (!parseThreshold(words[2], &parsed.threshold)) {
+        return fail(error, QString("bad threshold %1").arg(words[2]));
+    }
+    parsed.clearThreshold = parsed.threshold;
+
+    for (int i = 3; i < words.size(); i += 2) {
+        if (i + 1 == words.size()) {
+            return fail(error, QString("%1 needs a value").arg(words[i]));
+        }
+        if (words[i] == "for") {
+            if (!parseDuration(words[i + 1], &parsed.forMs)) {
+                return fail(error, QString("bad duration %1").arg(words[i + 1]));
+            }
+        } else if (words[i] == "clear") {
+            if (!parseThreshold(words[i + 1], &parsed.clearThreshold)) {
+                return fail(error, QString("bad clear threshold %1").arg(words[i + 1]));
+            }
+        } else {
+            return fail(error, QString("unexpected %1").arg(words[i]));
+        }
+    }
+
+    // A clear threshold beyond the firing one would clear while firing
+    const bool rising = parsed.comparison == Above || parsed.comparison == AtLeast;
+    if (rising ? parsed.clearThreshold > parsed.threshold : parsed.clearThreshold < parsed.threshold) {
+        return fail(error, QString("clear threshold of %1 is past its threshold").arg(parsed.name));
+    }
+
+    *rule = std::move(parsed);
+    return true;
+}
+
+bool AlertRule::parseList(const QStringList &lines, std::vector<AlertRule> *rules, QString *error)
+{
+    std::vector<AlertRule> parsed;
+    for (int i = 0; i < lines.size(); ++i) {
+        const QString line = lines[i].trimmed();
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+        AlertRule rule;
+        QString message;
+        if (!parse(line, &rule, &message)) {
+            return fail(error, QString("line %1: %2").arg(i + 1).arg(message));
+        }
+        parsed.push_back(std::move(rule));
+    }
+    *rules = std::move(parsed);
+    return true;
+}
+
+bool AlertRule::readFile(const QString &path, std::vector<AlertRule> *rules, QString *error)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return fail(error, file.errorString());
+    }
+
+    QStringList lines;
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        lines.append(in.readLine());
+    }
+    return parseList(lines, rules, error);
+}
+
+std::vector<AlertRule> AlertRule::defaults()
+{
+    QStringList lines;
+    for (const char *line : kDefaultRules) {
+        lines.append(line);
+    }
+    std::vector<AlertRule> rules;
+    parseList(lines, &rules);
+    return rules;
+}
+
+AlertEngine::AlertEngine(std::vector<AlertRule> rules)
+    : rules_(std::move(rules)), states_(rules_.size())
+{
+}
+
+int AlertEngine::firingCount() const
+{
+    return static_cast<int>(std::count_if(states_.begin(), states_.end(), [](const State &state) {
+        return state.firing;
+    }));
+}
+
+void AlertEngine::evaluate(const DishSnapshot &snapshot, const TelemetryStore &store, std::vector<Transition> *out)
+{
+    const qint64 now = snapshot.timestampMs;
+    for (size_t i = 0; i < rules_.size(); ++i) {
+        const AlertRule &rule = rules_[i];
+        State &state = states_[i];
+        float value = 0.0f;
+        if (!currentValue(rule, snapshot, store, &value)) {
+            continue;
+        }
+
+        if (state.firing) {
+            // Hysteresis: past the clear threshold, not just the firing one
+            if (!compare(rule.comparison, value, rule.clearThreshold)) {
+                state.firing = false;
+                out->push_back({ static_cast<int>(i), false, value, now });
+            }
+            continue;
+        }
+
+        if (!compare(rule.comparison, value, rule.threshold)) {
+            state.pending = false;
+            continue;
+        }
+        if (!state.pending) {
+            state.pending = true;
+            state.sinceMs = now;
+        }
+        if (now - state.sinceMs >= rule.forMs) {
+            state.firing = true;
+            state.pending = false;
+            out->push_back({ static_cast<int>(i), true, value, now });
+        }
+    }
+}
+
+void AlertEngine::reset()
+{
+    states_.assign(rules_.size(), State());
+}
@@ -0,0 +1,126 @@
+#ifndef ALERTENGINE_H
+#define ALERTENGINE_H
+
+#include <QString>
+#include <QStringList>
+#include <vector>
+#include "dishsnapshot.h"
+#include "telemetrystore.h"
+
+// One declarative alert rule, written as
+//
+//     name: value op threshold [for duration] [clear threshold]
+//
+// for example
+//
+//     high_latency: latency.p95.1m > 80 for 2m clear 60
+//     drop_rate: drop_rate.mean.1m > 2% for 1m
+//     thermal_throttle: alert.thermal_throttle > 0
+//
+// The value is one of
+//   <metric>.<stat>[.<window>]  a TelemetryStore aggregate: metric is
+//                               downlink, uplink, latency, drop_rate or snr,
+//                               stat min, max, mean, p50, p95 or p99, and
+//                               window 1m (the default), 15m or 1h
+//   obstructed[.<window>]       fraction of samples obstructed
+//   fraction_obstructed         the dish's own obstruction estimate
+//   currently_obstructed, connected, alert.<name>
+//                               1 or 0, alert names as in DishAlerts
+//
+// op is >, >=, < or <=; thresholds may end in % and durations in s, m or h.
+// A rule fires once its condition has held for the duration, and clears
+// when the value has moved past the clear threshold, which defaults to the
+// threshold itself and must not lie beyond it.
+struct AlertRule
+{
+    enum Source {
+        Aggregate,
+        ObstructedFraction,
+        FractionObstructed,
+        CurrentlyObstructed,
+        Connected,
+        DishAlert
+    };
+
+    enum Stat {
+        Min,
+        Max,
+        Mean,
+        P50,
+        P95,
+        P99
+    };
+
+    enum Comparison {
+        Above,
+        AtLeast,
+        Below,
+        AtMost
+    };
+
+    QString name;
+    QString text;  // as written, for notifications
+    Source source = Aggregate;
+    TelemetryStore::Metric metric = TelemetryStore::Latency;
+    TelemetryStore::Window window = TelemetryStore::OneMinute;
+    Stat stat = Mean;
+    unsigned alert = 0;  // DishSnapshot::Alert, for DishAlert
+    Comparison comparison = Above;
+    float threshold = 0.0f;
+    float clearThreshold = 0.0f;
+    qint64 forMs = 0;
+
+    // Returns false and sets *error if line isn't a rule
+    static bool parse(const QString &line, AlertRule *rule, QString *error = nullptr);
+
+    // One rule per line; blank lines and lines starting with '#' are
+    // ignored. Returns false and sets *error on the first bad line.
+    static bool parseList(const QStringList &lines, std::vector<AlertRule> *rules, QString *error = nullptr);
+    static bool readFile(const QString &path, std::vector<AlertRule> *rules, QString *error = nullptr);
+
+    // What the dish itself flags, plus the rules of thumb we alert on when
+    // no rules file is given
+    static std::vector<AlertRule> defaults();
+};
+
+// Evaluates a set of rules for one dish.
+//
+// Aggregate rules read the TelemetryStore's rolling windows, which are
+// maintained as samples are appended, so a rule costs the same no matter
+// how long its window is. They are only looked at when a cycle appended
+// samples; the others on every snapshot with the state they depend on.
+// Times are the snapshots' own timestamps.
+class AlertEngine
+{
+public:
+    struct Transition {
+        int rule;  // index into rules()
+        bool firing;
+        float value;
+        qint64 timestampMs;
+    };
+
+    explicit AlertEngine(std::vector<AlertRule> rules = std::vector<AlertRule>());
+
+    const std::vector<AlertRule> &rules() const { return rules_; }
+    bool isFiring(int rule) const { return states_[rule].firing; }
+    int firingCount() const;
+
+    // Appends every rule that fired or cleared as of snapshot to *out
+    void evaluate(const DishSnapshot &snapshot, const TelemetryStore &store, std::vector<Transition> *out);
+
+    // Forgets what has fired, e.g. once the dish went away
+    void reset();
+
+private:
+    struct State {
+        bool firing = false;
+        bool pending = false;
+        qint64 sinceMs = 0;  // condition true since, while pending
+    };
+
+    std::vector<AlertRule> rules_;
+    std::vector<State> states_;
+};
+
+#endif // ALERTENGINE_H
@@ -0,0 +1,108 @@
+#include "alertmonitor.h"
+#include "fleetmanager.h"
+#include "starlinkclient.h"
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <utility>
+
+namespace {
+
+// A webhook that doesn't answer must not pile up requests behind it
+constexpr int kWebhookTimeoutMs = 10000;
+constexpr int kMaxPendingWebhooks = 32;
+
+}
+
+AlertMonitor::AlertMonitor(std::vector<AlertRule> rules, QObject *parent)
+    : QObject(parent), rules_(std::move(rules))
+{
+}
+
+void AlertMonitor::watch(StarlinkClient *client)
+{
+    connect(client, &StarlinkClient::snapshotUpdated, this, [this, client](const DishSnapshot &snapshot) {
+        evaluate(client, snapshot);
+    });
+}
+
+void AlertMonitor::watch(FleetManager *fleet)
+{
+    connect(fleet, &FleetManager::dishUpdated, this, [this, fleet](int index, const DishSnapshot &snapshot) {
+        evaluate(fleet->client(index), snapshot);
+    });
+}
+
+int AlertMonitor::firingCount() const
+{
+    int firing = 0;
+    for (const auto &entry : engines_) {
+        firing += entry.second.firingCount();
+    }
+    return firing;
+}
+
+void AlertMonitor::evaluate(StarlinkClient *client, const DishSnapshot &snapshot)
+{
+    auto it = engines_.find(client);
+    if (it == engines_.end()) {
+        it = engines_.emplace(client, AlertEngine(rules_)).first;
+        // Whatever was firing for a dish that is gone goes with it
+        connect(client, &QObject::destroyed, this, [this, client]() {
+            engines_.erase(client);
+        });
+    }
+
+    transitions_.clear();
+    it->second.evaluate(snapshot, client->telemetry(), &transitions_);
+    for (const AlertEngine::Transition &transition : transitions_) {
+        const AlertRule &rule = rules_[transition.rule];
+        Alert alert;
+        alert.target = client->target();
+        alert.rule = rule.name;
+        alert.condition = rule.text;
+        alert.firing = transition.firing;
+        alert.value = transition.value;
+        alert.timestampMs = transition.timestampMs;
+
+        emit alertChanged(alert);
+        if (!webhook_.isEmpty()) {
+            postWebhook(alert);
+        }
+    }
+}
+
+void AlertMonitor::postWebhook(const Alert &alert)
+{
+    if (pendingWebhooks_ >= kMaxPendingWebhooks) {
+        qWarning("Dropping alert %s for %s: webhook isn't keeping up", qPrintable(alert.rule), qPrintable(alert.target));
+        return;
+    }
+    if (!network_) {
+        network_ = new QNetworkAccessManager(this);
+    }
+
+    QJsonObject body;
+    body["target"] = alert.target;
+    body["rule"] = alert.rule;
+    body["condition"] = alert.condition;
+    body["state"] = alert.firing ? "firing" : "resolved";
+    body["value"] = static_cast<double>(alert.value);
+    body["timestamp_ms"] = alert.timestampMs;
+
+    QNetworkRequest request(webhook_);
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+    request.setTransferTimeout(kWebhookTimeoutMs);
+
+    ++pendingWebhooks_;
+    QNetworkReply *reply = network_->post(request, QJsonDocument(body).toJson(QJsonDocument::Compact));
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+        --pendingWebhooks_;
+        if (reply->error() != QNetworkReply::NoError) {
+            qWarning("Alert webhook failed: %s", qPrintable(reply->errorString()));
+        }
+        reply->deleteLater();
+    });
+}
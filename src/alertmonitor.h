@@ -0,0 +1,64 @@
+#ifndef ALERTMONITOR_H
+#define ALERTMONITOR_H
+
+#include <QObject>
+#include <QString>
+#include <QUrl>
+#include <unordered_map>
+#include <vector>
+#include "alertengine.h"
+#include "dishsnapshot.h"
+
+class FleetManager;
+class QNetworkAccessManager;
+class StarlinkClient;
+
+// Runs the same alert rules for every dish it watches, each dish with its
+// own AlertEngine, and reports whenever one of them fires or clears: as a
+// signal for the tray or log, and optionally as a JSON POST to a webhook.
+class AlertMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Alert {
+        QString target;
+        QString rule;
+        QString condition;  // the rule as written
+        bool firing = false;
+        float value = 0.0f;
+        qint64 timestampMs = 0;
+    };
+
+    explicit AlertMonitor(std::vector<AlertRule> rules, QObject *parent = nullptr);
+
+    const std::vector<AlertRule> &rules() const { return rules_; }
+
+    // Follows one client's snapshots, or every dish of a fleet as its
+    // targets come and go
+    void watch(StarlinkClient *client);
+    void watch(FleetManager *fleet);
+
+    // Every alert is also POSTed here; an empty url turns that off
+    void setWebhook(const QUrl &url) { webhook_ = url; }
+    QUrl webhook() const { return webhook_; }
+
+    int firingCount() const;
+
+signals:
+    void alertChanged(const AlertMonitor::Alert &alert);
+
+private:
+    void evaluate(StarlinkClient *client, const DishSnapshot &snapshot);
+    void postWebhook(const Alert &alert);
+
+    std::vector<AlertRule> rules_;
+    std::unordered_map<StarlinkClient *, AlertEngine> engines_;
+    std::vector<AlertEngine::Transition> transitions_;
+
+    QUrl webhook_;
+    QNetworkAccessManager *network_ = nullptr;
+    int pendingWebhooks_ = 0;
+};
+
+#endif // ALERTMONITOR_H
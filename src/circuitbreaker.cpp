@@ -0,0 +1,48 @@
+#include "circuitbreaker.h"
+#include <algorithm>
+
+namespace {
+
+constexpr int kFailureThreshold = 3;
+constexpr qint64 kFirstCooldownMs = 5 * 1000;
+constexpr qint64 kMaxCooldownMs = 5 * 60 * 1000;
+
+}
+
+bool CircuitBreaker::allowRequest(qint64 nowMs)
+{
+    if (state_ == State::Open && nowMs >= retryAtMs_) {
+        state_ = State::HalfOpen;
+    }
+    return state_ != State::Open;
+}
+
+void CircuitBreaker::recordSuccess()
+{
+    state_ = State::Closed;
+    failures_ = 0;
+    cooldownMs_ = 0;
+}
+
+void CircuitBreaker::recordFailure(qint64 nowMs)
+{
+    ++failures_;
+
+    if (state_ == State::HalfOpen) {
+        cooldownMs_ = std::min(cooldownMs_ * 2, kMaxCooldownMs);
+    } else if (state_ == State::Closed && failures_ >= kFailureThreshold) {
+        cooldownMs_ = kFirstCooldownMs;
+    } else {
+        return;
+    }
+
+    state_ = State::Open;
+    retryAtMs_ = nowMs + cooldownMs_;
+}
+
+void CircuitBreaker::channelReady()
+{
+    if (state_ == State::Open) {
+        state_ = State::HalfOpen;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef CIRCUITBREAKER_H
+#define CIRCUITBREAKER_H
+
+#include <QtGlobal>
+
+// Stops a client from sending requests to a dish that keeps failing.
+//
+// Closed is normal operation. After a few cycles in a row fail because the
+// dish is unreachable the breaker opens and nothing is sent until a
+// cool-down passes; then it goes half-open and lets a single probe through.
+// A good probe closes it again, a failed one reopens it with twice the
+// cool-down. channelReady() skips the rest of the cool-down as soon as gRPC
+// reports the connection is back.
+//
+// Times are PollScheduler::now() milliseconds.
+class CircuitBreaker
+{
+public:
+    enum class State {
+        Closed,
+        Open,
+        HalfOpen
+    };
+
+    State state() const { return state_; }
+
+    // Whether a cycle may go out at nowMs. An open breaker whose cool-down
+    // has passed turns half-open here, and the cycle should then be a probe.
+    bool allowRequest(qint64 nowMs);
+
+    void recordSuccess();
+    void recordFailure(qint64 nowMs);
+    void channelReady();
+
+    // When an open breaker will next let a probe through, 0 otherwise
+    qint64 retryAtMs() const { return state_ == State::Open ? retryAtMs_ : 0; }
+    int consecutiveFailures() const { return failures_; }
+
+private:
+    State state_ = State::Closed;
+    int failures_ = 0;
+    qint64 cooldownMs_ = 0;
+    qint64 retryAtMs_ = 0;
+};
+
+#endif // CIRCUITBREAKER_H
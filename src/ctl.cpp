@@ -0,0 +1,265 @@
+#include "fleetmanager.h"
+#include "logexporter.h"
+#include "segmentlog.h"
+#include "starlinkclient.h"
+#include "transportpool.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QThread>
+#include <QTimer>
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// Every request has a deadline well below this; it only covers a dish
+// that never answers the channel at all
+constexpr int kStatusTimeoutMs = 10 * 1000;
+
+// Milliseconds since the epoch, or an ISO 8601 date or date and time in
+// local time unless it says otherwise
+bool parseTime(const QString &value, int64_t *ms)
+{
+    bool ok = false;
+    const qint64 number = value.toLongLong(&ok);
+    if (ok) {
+        *ms = number;
+        return true;
+    }
+    const QDateTime time = QDateTime::fromString(value, Qt::ISODate);
+    if (!time.isValid()) {
+        return false;
+    }
+    *ms = time.toMSecsSinceEpoch();
+    return true;
+}
+
+QStringList targetsFrom(const QCommandLineParser &parser, const QCommandLineOption &targetOption,
+                        const QCommandLineOption &targetsOption, bool *ok)
+{
+    *ok = true;
+    QStringList targets = parser.values(targetOption);
+    if (parser.isSet(targetsOption)) {
+        QString error;
+        const QStringList listed = FleetManager::readTargets(parser.value(targetsOption), &error);
+        if (listed.isEmpty()) {
+            qCritical("No targets in %s: %s", qPrintable(parser.value(targetsOption)),
+                      qPrintable(error.isEmpty() ? QString("file is empty") : error));
+            *ok = false;
+        }
+        targets += listed;
+    }
+    return targets;
+}
+
+const char *dishStateName(int state)
+{
+    switch (state) {
+    case SpaceX::API::Device::CONNECTED:
+        return "connected";
+    case SpaceX::API::Device::SEARCHING:
+        return "searching";
+    case SpaceX::API::Device::BOOTING:
+        return "booting";
+    default:
+        return "unknown";
+    }
+}
+
+// Asks every dish for its status at once and prints one line each, in the
+// order given, once all have answered or failed
+int status(QCoreApplication &app, const QStringList &targets, int threads)
+{
+    auto pool = std::make_shared<TransportPool>(std::max(1, std::min(threads, static_cast<int>(targets.size()))));
+    std::vector<std::unique_ptr<StarlinkClient>> clients;
+    std::vector<DishSnapshot> snapshots(targets.size());
+    std::vector<bool> answered(targets.size(), false);
+    int pending = static_cast<int>(targets.size());
+
+    for (int i = 0; i < targets.size(); ++i) {
+        auto client = std::make_unique<StarlinkClient>(targets.at(i), pool);
+        client->scheduler().setEnabled(PollScheduler::Location, false);
+        client->scheduler().setEnabled(PollScheduler::History, false);
+        client->scheduler().setEnabled(PollScheduler::ObstructionMap, false);
+        client->scheduler().setEnabled(PollScheduler::Context, false);
+        client->scheduler().expedite(PollScheduler::now());
+        client->read(PollScheduler::Status, 0, &app, [&, i](const DishSnapshot &snapshot) {
+            snapshots[i] = snapshot;
+            answered[i] = true;
+            if (--pending == 0) {
+                app.quit();
+            }
+        });
+        clients.push_back(std::move(client));
+    }
+
+    QTimer::singleShot(kStatusTimeoutMs, &app, &QCoreApplication::quit);
+    app.exec();
+
+    std::printf("target\tstate\tdevice\tdown_mbps\tup_mbps\tlatency_ms\tsnr\tobstructed\talerts\n");
+    int unreachable = 0;
+    for (int i = 0; i < targets.size(); ++i) {
+        const DishSnapshot &snapshot = snapshots[i];
+        if (!answered[i] || !snapshot.connected) {
+            std::printf("%s\tunreachable\n", qPrintable(targets.at(i)));
+            ++unreachable;
+            continue;
+        }
+        std::printf("%s\t%s\t%s\t%.1f\t%.1f\t%.0f\t%.1f\t%.3f\t%#x\n", qPrintable(targets.at(i)),
+                    snapshot.hasStatus ? dishStateName(snapshot.dishState) : "unknown",
+                    snapshot.deviceId.isEmpty() ? "-" : qPrintable(snapshot.deviceId),
+                    static_cast<double>(snapshot.downloadMbps), static_cast<double>(snapshot.uploadMbps),
+                    static_cast<double>(snapshot.latencyMs), static_cast<double>(snapshot.snr),
+                    static_cast<double>(snapshot.fractionObstructed), snapshot.alerts);
+    }
+    return unreachable == 0 ? 0 : 2;
+}
+
+// Each target's log under dataDir, or every dish directory there
+int exportLogs(const QString &dataDir, const QStringList &targets, const LogExporter::Options &options,
+               const QString &outputPath)
+{
+    std::vector<std::pair<QString, QString>> dishes;
+    if (targets.isEmpty()) {
+        const QStringList names = QDir(dataDir).entryList(QStringList(), QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name);
+        for (const QString &name : names) {
+            dishes.emplace_back(name, QDir(dataDir).filePath(name));
+        }
+    } else {
+        for (const QString &target : targets) {
+            dishes.emplace_back(target, FleetManager::dishDirectory(dataDir, target));
+        }
+    }
+
+    std::vector<std::unique_ptr<SegmentLog>> logs;
+    std::vector<LogExporter::Source> sources;
+    for (const auto &dish : dishes) {
+        auto log = std::make_unique<SegmentLog>(dish.second);
+        QString error;
+        if (!log->openReadOnly(&error)) {
+            qWarning("Skipping %s: %s", qPrintable(dish.first), qPrintable(error));
+            continue;
+        }
+        sources.push_back({ dish.first, log.get() });
+        logs.push_back(std::move(log));
+    }
+    if (sources.empty()) {
+        qCritical("No history under %s", qPrintable(dataDir));
+        return 1;
+    }
+
+    QFile out(outputPath);
+    const bool opened = outputPath.isEmpty() ? out.open(stdout, QIODevice::WriteOnly)
+                                             : out.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    if (!opened) {
+        qCritical("Can't write %s: %s", qPrintable(outputPath), qPrintable(out.errorString()));
+        return 1;
+    }
+
+    LogExporter exporter(options);
+    QString error;
+    const bool ok = exporter.run(sources, &out, &error);
+    out.close();
+    if (!ok) {
+        qCritical("Export failed: %s", qPrintable(error));
+        return 1;
+    }
+    qInfo("Exported %zu records from %zu dishes (%zu bytes, %d threads)", exporter.records(), sources.size(),
+          exporter.bytes(), exporter.threadCount());
+    return 0;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    a.setApplicationName("starlink-ctl");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Queries Starlink dishes and exports their stored history.\n\n"
+                                     "Commands:\n"
+                                     "  status  Print the current state of each dish\n"
+                                     "  export  Write stored history as CSV or line protocol");
+    parser.addHelpOption();
+    parser.addPositionalArgument("command", "status or export.");
+    QCommandLineOption targetsOption("targets", "Every dish listed in <file>, one host:port per line.", "file");
+    QCommandLineOption targetOption("target", "The dish at <host:port>; may be repeated.", "host:port");
+    QCommandLineOption threadsOption("threads", "Use <count> threads for requests or decoding (default one per core).", "count", "0");
+    QCommandLineOption dataDirOption("data-dir", "export: the history directory starlink-monitord was given.", "dir");
+    QCommandLineOption fromOption("from", "export: start at <time>, in ms since the epoch or ISO 8601 (default the beginning).", "time");
+    QCommandLineOption toOption("to", "export: stop before <time> (default the end).", "time");
+    QCommandLineOption formatOption("format", "export: csv or line (InfluxDB line protocol; default csv).", "format", "csv");
+    QCommandLineOption outputOption("output", "export: write to <file> instead of standard output.", "file");
+    parser.addOption(targetsOption);
+    parser.addOption(targetOption);
+    parser.addOption(threadsOption);
+    parser.addOption(dataDirOption);
+    parser.addOption(fromOption);
+    parser.addOption(toOption);
+    parser.addOption(formatOption);
+    parser.addOption(outputOption);
+    parser.process(a);
+
+    const QStringList positional = parser.positionalArguments();
+    if (positional.size() != 1) {
+        parser.showHelp(1);
+    }
+    const QString command = positional.first();
+
+    bool ok = false;
+    const int threads = parser.value(threadsOption).toInt(&ok);
+    if (!ok || threads < 0) {
+        qCritical("Invalid thread count: %s", qPrintable(parser.value(threadsOption)));
+        return 1;
+    }
+    QStringList targets = targetsFrom(parser, targetOption, targetsOption, &ok);
+    if (!ok) {
+        return 1;
+    }
+
+    if (command == "status") {
+        if (targets.isEmpty()) {
+            targets.append("192.168.100.1:9200");
+        }
+        // Replies are small; a thread per core is plenty for any fleet
+        const int poolThreads = threads > 0 ? threads : std::max(1, QThread::idealThreadCount());
+        return status(a, targets, poolThreads);
+    }
+
+    if (command == "export") {
+        if (!parser.isSet(dataDirOption)) {
+            qCritical("export needs --data-dir");
+            return 1;
+        }
+        LogExporter::Options options;
+        options.threads = threads;
+        options.fromMs = std::numeric_limits<int64_t>::min();
+        options.toMs = std::numeric_limits<int64_t>::max();
+        if (parser.isSet(fromOption) && !parseTime(parser.value(fromOption), &options.fromMs)) {
+            qCritical("Invalid start time: %s", qPrintable(parser.value(fromOption)));
+            return 1;
+        }
+        if (parser.isSet(toOption)) {
+            if (!parseTime(parser.value(toOption), &options.toMs)) {
+                qCritical("Invalid end time: %s", qPrintable(parser.value(toOption)));
+                return 1;
+            }
+            --options.toMs;  // the exporter's range is inclusive
+        }
+        if (!LogExporter::parseFormat(parser.value(formatOption), &options.format)) {
+            qCritical("Unknown format: %s", qPrintable(parser.value(formatOption)));
+            return 1;
+        }
+        return exportLogs(parser.value(dataDirOption), targets, options, parser.value(outputOption));
+    }
+
+    qCritical("Unknown command: %s", qPrintable(command));
+    return 1;
+}
@@ -0,0 +1,62 @@
+#ifndef DISHSNAPSHOT_H
+#define DISHSNAPSHOT_H
+
+#include <QMetaType>
+#include <QString>
+
+// Everything known about a dish as of one poll cycle. A cycle only sends the
+// requests that were due, so location and device info may date from an
+// earlier cycle; connection state and throughput always come from this one
+// or the most recent cycle that asked for them.
+struct DishSnapshot
+{
+    qint64 timestampMs = 0;
+
+    bool connected = false;
+    QString deviceId;
+    QString hardwareVersion;
+
+    // From the last get_status answer. alerts is a mask of Alert flags.
+    enum Alert {
+        MotorsStuck = 1 << 0,
+        ThermalThrottle = 1 << 1,
+        ThermalShutdown = 1 << 2,
+        MastNotNearVertical = 1 << 3,
+        UnexpectedLocation = 1 << 4,
+        SlowEthernetSpeeds = 1 << 5
+    };
+    bool hasStatus = false;
+    int dishState = 0;  // SpaceX::API::Device::DishState
+    unsigned alerts = 0;
+    bool currentlyObstructed = false;
+    float fractionObstructed = 0.0f;
+    float snr = 0.0f;
+    // Why a reachable dish refused get_status this cycle; empty if it
+    // answered
+    QString statusError;
+
+    bool hasLocation = false;
+    double lat = 0.0;
+    double lon = 0.0;
+    double alt = 0.0;
+
+    // From the last dish_get_context answer. Dishes sharing an ID share
+    // that piece of the network path; 0 means unknown.
+    bool hasContext = false;
+    quint32 cellId = 0;
+    quint32 popRackId = 0;
+    quint32 gatewayId = 0;
+    bool onBackupBeam = false;
+
+    bool hasSpeed = false;
+    float downloadMbps = 0.0f;
+    float uploadMbps = 0.0f;
+    float latencyMs = 0.0f;
+
+    // History samples this cycle added to the client's TelemetryStore
+    int newHistorySamples = 0;
+};
+
+Q_DECLARE_METATYPE(DishSnapshot)
+
+#endif // DISHSNAPSHOT_H
@@ -0,0 +1,175 @@
+#include "fleetmanager.h"
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+// Dishes that fall due within one tick are polled together
+constexpr int kTickMs = 100;
+// Upper bound on a timer wait, so new targets and foreground switches are
+// picked up promptly
+constexpr int kMaxWaitMs = 1000;
+constexpr int kStartSpreadMs = 5000;
+constexpr int kMaxPoolThreads = 4;
+
+}
+
+FleetManager::FleetManager(QObject *parent)
+    : QObject(parent)
+{
+    const int threads = std::clamp(static_cast<int>(std::thread::hardware_concurrency()), 1, kMaxPoolThreads);
+    pool_ = std::make_shared<TransportPool>(threads);
+
+    tickTimer_ = new QTimer(this);
+    tickTimer_->setSingleShot(true);
+    tickTimer_->setTimerType(Qt::CoarseTimer);
+    connect(tickTimer_, &QTimer::timeout, this, &FleetManager::pollDue);
+}
+
+FleetManager::~FleetManager()
+{
+    // Clients must be gone before the pool they complete on
+    stop();
+    qDeleteAll(clients_);
+    clients_.clear();
+}
+
+QStringList FleetManager::readTargets(const QString &path, QString *error, QHash<QString, QString> *sites)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        if (error) {
+            *error = file.errorString();
+        }
+        return QStringList();
+    }
+
+    QStringList targets;
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        const QString line = in.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+        const QStringList fields = line.simplified().split(' ');
+        targets.append(fields.first());
+        if (sites && fields.size() > 1) {
+            sites->insert(fields.first(), fields.at(1));
+        }
+    }
+    return targets;
+}
+
+QString FleetManager::dishDirectory(const QString &root, const QString &target)
+{
+    // host:port isn't a valid file name everywhere
+    QString name = target;
+    for (QChar &c : name) {
+        if (!c.isLetterOrNumber() && c != '.' && c != '-') {
+            c = '_';
+        }
+    }
+    return QDir(root).filePath(name);
+}
+
+void FleetManager::setTargets(const QStringList &targets)
+{
+    qDeleteAll(clients_);
+    clients_.clear();
+    snapshots_.assign(targets.size(), DishSnapshot());
+    connectedCount_ = 0;
+
+    for (int i = 0; i < targets.size(); ++i) {
+        auto *client = new StarlinkClient(targets.at(i), pool_);
+        client->setHistoryCapacity(kHistoryCapacity);
+        client->setTransport(transport_);
+        if (!storageDirectory_.isEmpty()) {
+            QString error;
+            if (!client->setLogDirectory(dishDirectory(storageDirectory_, targets.at(i)), &error)) {
+                qWarning("Not keeping history for %s: %s", qPrintable(targets.at(i)), qPrintable(error));
+            }
+        }
+        connect(client, &StarlinkClient::snapshotUpdated, this, [this, i](const DishSnapshot &snapshot) {
+            handleSnapshot(i, snapshot);
+        });
+        // Whatever the state cache had, until the dish answers
+        snapshots_[i] = client->snapshot();
+        clients_.push_back(client);
+    }
+
+    emit targetsChanged();
+    emit summaryChanged(connectedCount_, dishCount());
+}
+
+QStringList FleetManager::targets() const
+{
+    QStringList result;
+    for (StarlinkClient *client : clients_) {
+        result.append(client->target());
+    }
+    return result;
+}
+
+void FleetManager::start()
+{
+    const qint64 now = PollScheduler::now();
+    const int count = dishCount();
+    for (int i = 0; i < count; ++i) {
+        clients_[i]->scheduler().reset(now + static_cast<qint64>(i) * kStartSpreadMs / count);
+    }
+    // From the event loop, like StarlinkClient::startMonitoring()
+    tickTimer_->start(0);
+}
+
+void FleetManager::stop()
+{
+    tickTimer_->stop();
+}
+
+void FleetManager::setBackground(bool background)
+{
+    for (StarlinkClient *client : clients_) {
+        client->setBackground(background);
+    }
+    if (tickTimer_->isActive()) {
+        pollDue();
+    }
+}
+
+void FleetManager::pollDue()
+{
+    // Requests already sent settle on their own; a dish that is still busy
+    // simply stays due until the next pass
+    const qint64 now = PollScheduler::now();
+    for (StarlinkClient *client : clients_) {
+        if (client->nextPollMs() <= now) {
+            client->pollDue(now);
+        }
+    }
+    armTimer();
+}
+
+void FleetManager::armTimer()
+{
+    qint64 next = PollScheduler::now() + kMaxWaitMs;
+    for (StarlinkClient *client : clients_) {
+        next = std::min(next, client->nextPollMs());
+    }
+    const qint64 wait = next - PollScheduler::now();
+    tickTimer_->start(static_cast<int>(std::clamp<qint64>(wait, kTickMs, kMaxWaitMs)));
+}
+
+void FleetManager::handleSnapshot(int index, const DishSnapshot &snapshot)
+{
+    const bool wasConnected = snapshots_[index].connected;
+    snapshots_[index] = snapshot;
+    emit dishUpdated(index, snapshot);
+
+    if (snapshot.connected != wasConnected) {
+        connectedCount_ += snapshot.connected ? 1 : -1;
+        emit summaryChanged(connectedCount_, dishCount());
+    }
+}
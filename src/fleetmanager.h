@@ -0,0 +1,95 @@
+#ifndef FLEETMANAGER_H
+#define FLEETMANAGER_H
+
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include <memory>
+#include <vector>
+#include "dishsnapshot.h"
+#include "starlinkclient.h"
+#include "transportpool.h"
+
+// Monitors many dishes from one process.
+//
+// Every client shares one TransportPool, so the whole fleet runs on a few
+// completion queue threads, and polls are driven by a single timer that
+// wakes when the earliest dish is due. Each dish keeps its own PollScheduler;
+// their first polls are staggered across a few seconds so the fleet never
+// polls in lockstep.
+class FleetManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Per-dish history kept in fleet mode; the single-dish default would
+    // cost several MB per terminal
+    static constexpr size_t kHistoryCapacity = 6 * 3600;
+
+    explicit FleetManager(QObject *parent = nullptr);
+    ~FleetManager();
+
+    // One host:port per line, optionally followed by whitespace and the
+    // name of the site the dish is at, which goes into *sites; blank lines
+    // and lines starting with '#' are ignored. Returns an empty list and
+    // sets *error if the file can't be read.
+    static QStringList readTargets(const QString &path, QString *error = nullptr,
+                                   QHash<QString, QString> *sites = nullptr);
+
+    // Where each dish's SegmentLog lives, one subdirectory per target.
+    // Takes effect with the next setTargets(); empty keeps history in
+    // memory only.
+    void setStorageDirectory(const QString &directory) { storageDirectory_ = directory; }
+    QString storageDirectory() const { return storageDirectory_; }
+    static QString dishDirectory(const QString &root, const QString &target);
+
+    // How every client talks to its dish; takes effect with the next
+    // setTargets()
+    void setTransport(StarlinkClient::Transport transport) { transport_ = transport; }
+    StarlinkClient::Transport transport() const { return transport_; }
+
+    // Replaces the fleet; clients for the previous targets are destroyed
+    void setTargets(const QStringList &targets);
+    QStringList targets() const;
+
+    void start();
+    void stop();
+
+    // Hidden in the tray; see PollScheduler::setBackground()
+    void setBackground(bool background);
+
+    // For other clients that should run on the fleet's threads
+    std::shared_ptr<TransportPool> pool() const { return pool_; }
+
+    int dishCount() const { return static_cast<int>(clients_.size()); }
+    int connectedCount() const { return connectedCount_; }
+    StarlinkClient *client(int index) const { return clients_[index]; }
+    const DishSnapshot &snapshot(int index) const { return snapshots_[index]; }
+
+signals:
+    // The set of dishes was replaced; indices from before are meaningless
+    void targetsChanged();
+    void dishUpdated(int index, const DishSnapshot &snapshot);
+    void summaryChanged(int connected, int total);
+
+private slots:
+    void pollDue();
+
+private:
+    void handleSnapshot(int index, const DishSnapshot &snapshot);
+
+    std::shared_ptr<TransportPool> pool_;
+    QString storageDirectory_;
+    StarlinkClient::Transport transport_ = StarlinkClient::Transport::Unary;
+    std::vector<StarlinkClient *> clients_;
+    std::vector<DishSnapshot> snapshots_;
+    int connectedCount_ = 0;
+
+    void armTimer();
+
+    QTimer *tickTimer_;
+};
+
+#endif // FLEETMANAGER_H
@@ -0,0 +1,322 @@
+#include "historycodec.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+// Bits are written most significant first
+class BitWriter
+{
+public:
+    explicit BitWriter(std::vector<uint8_t> *out) : out_(out) {}
+    ~BitWriter() { flush(); }
+
+    void write(uint64_t value, int bits)
+    {
+        while (bits > 0) {
+            const int take = std::min(bits, 8 - used_);
+            const uint64_t chunk = (value >> (bits - take)) & ((uint64_t(1) << take) - 1);
+            current_ = static_cast<uint8_t>(current_ | (chunk << (8 - used_ - take)));
+            used_ += take;
+            bits -= take;
+            if (used_ == 8) {
+                out_->push_back(current_);
+                current_ = 0;
+                used_ = 0;
+            }
+        }
+    }
+
+    void writeBit(bool bit) { write(bit ? 1 : 0, 1); }
+
+    void flush()
+    {
+        if (used_ > 0) {
+            out_->push_back(current_);
+            current_ = 0;
+            used_ = 0;
+        }
+    }
+
+private:
+    std::vector<uint8_t> *out_;
+    uint8_t current_ = 0;
+    int used_ = 0;
+};
+
+class BitReader
+{
+public:
+    BitReader(const uint8_t *data, size_t size) : data_(data), bits_(size * 8) {}
+
+    // Reading past the end returns zero and sets overrun()
+    uint64_t read(int bits)
+    {
+        uint64_t value = 0;
+        while (bits > 0) {
+            if (position_ >= bits_) {
+                overrun_ = true;
+                return 0;
+            }
+            const int offset = static_cast<int>(position_ % 8);
+            const int take = std::min(bits, 8 - offset);
+            const uint8_t byte = data_[position_ / 8];
+            const uint64_t chunk = (byte >> (8 - offset - take)) & ((1u << take) - 1);
+            value = (value << take) | chunk;
+            position_ += take;
+            bits -= take;
+        }
+        return value;
+    }
+
+    bool readBit() { return read(1) != 0; }
+    bool overrun() const { return overrun_; }
+
+private:
+    const uint8_t *data_;
+    size_t bits_;
+    size_t position_ = 0;
+    bool overrun_ = false;
+};
+
+// The dish samples once a second, so that is the delta we expect to repeat
+constexpr int64_t kExpectedDeltaMs = 1000;
+
+void writeTimestampDelta(BitWriter *writer, int64_t deltaOfDelta)
+{
+    if (deltaOfDelta == 0) {
+        writer->write(0b0, 1);
+    } else if (deltaOfDelta >= -63 && deltaOfDelta <= 64) {
+        writer->write(0b10, 2);
+        writer->write(static_cast<uint64_t>(deltaOfDelta + 63), 7);
+    } else if (deltaOfDelta >= -255 && deltaOfDelta <= 256) {
+        writer->write(0b110, 3);
+        writer->write(static_cast<uint64_t>(deltaOfDelta + 255), 9);
+    } else if (deltaOfDelta >= -2047 && deltaOfDelta <= 2048) {
+        writer->write(0b1110, 4);
+        writer->write(static_cast<uint64_t>(deltaOfDelta + 2047), 12);
+    } else {
+        writer->write(0b1111, 4);
+        writer->write(static_cast<uint64_t>(deltaOfDelta), 64);
+    }
+}
+
+int64_t readTimestampDelta(BitReader *reader)
+{
+    if (!reader->readBit()) {
+        return 0;
+    }
+    if (!reader->readBit()) {
+        return static_cast<int64_t>(reader->read(7)) - 63;
+    }
+    if (!reader->readBit()) {
+        return static_cast<int64_t>(reader->read(9)) - 255;
+    }
+    if (!reader->readBit()) {
+        return static_cast<int64_t>(reader->read(12)) - 2047;
+    }
+    return static_cast<int64_t>(reader->read(64));
+}
+
+uint32_t floatBits(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+float bitsFloat(uint32_t bits)
+{
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Gorilla's XOR scheme for one column. The previous value's window of
+// meaningful bits is reused while the new difference fits inside it.
+void writeColumn(BitWriter *writer, const float *values, size_t count)
+{
+    uint32_t previous = floatBits(values[0]);
+    writer->write(previous, 32);
+
+    int leading = -1;
+    int trailing = 0;
+    for (size_t i = 1; i < count; ++i) {
+        const uint32_t bits = floatBits(values[i]);
+        const uint32_t diff = bits ^ previous;
+        previous = bits;
+
+        if (diff == 0) {
+            writer->write(0b0, 1);
+            continue;
+        }
+
+        const int newLeading = std::min(__builtin_clz(diff), 31);
+        const int newTrailing = __builtin_ctz(diff);
+        if (leading >= 0 && newLeading >= leading && newTrailing >= trailing) {
+            writer->write(0b10, 2);
+            writer->write(diff >> trailing, 32 - leading - trailing);
+            continue;
+        }
+
+        leading = newLeading;
+        trailing = newTrailing;
+        const int meaningful = 32 - leading - trailing;
+        writer->write(0b11, 2);
+        writer->write(static_cast<uint64_t>(leading), 5);
+        writer->write(static_cast<uint64_t>(meaningful - 1), 5);
+        writer->write(diff >> trailing, meaningful);
+    }
+}
+
+void readColumn(BitReader *reader, float *values, size_t count)
+{
+    uint32_t previous = static_cast<uint32_t>(reader->read(32));
+    values[0] = bitsFloat(previous);
+
+    int leading = 0;
+    int trailing = 0;
+    for (size_t i = 1; i < count; ++i) {
+        if (reader->readBit()) {
+            if (reader->readBit()) {
+                leading = static_cast<int>(reader->read(5));
+                const int meaningful = static_cast<int>(reader->read(5)) + 1;
+                trailing = 32 - leading - meaningful;
+            }
+            // A corrupt block could describe a window wider than 32 bits
+            const int meaningful = 32 - leading - trailing;
+            if (trailing < 0 || meaningful <= 0) {
+                values[i] = std::numeric_limits<float>::quiet_NaN();
+                continue;
+            }
+            previous ^= static_cast<uint32_t>(reader->read(meaningful)) << trailing;
+        }
+        values[i] = bitsFloat(previous);
+    }
+}
+
+void writeGamma(BitWriter *writer, uint64_t value)
+{
+    const int bits = 64 - __builtin_clzll(value);
+    writer->write(0, bits - 1);
+    writer->write(value, bits);
+}
+
+uint64_t readGamma(BitReader *reader)
+{
+    int zeros = 0;
+    while (!reader->readBit()) {
+        if (reader->overrun() || ++zeros > 63) {
+            return 0;
+        }
+    }
+    return (uint64_t(1) << zeros) | reader->read(zeros);
+}
+
+}
+
+void HistoryCodec::encodeBlock(const SegmentLog::Span &span, std::vector<uint8_t> *out)
+{
+    if (span.count == 0) {
+        return;
+    }
+
+    BitWriter writer(out);
+    const size_t first = span.first;
+    const size_t count = span.count;
+
+    int64_t previous = span.timestampAt(first);
+    writer.write(static_cast<uint64_t>(previous), 64);
+    int64_t previousDelta = kExpectedDeltaMs;
+    for (size_t i = first + 1; i < first + count; ++i) {
+        const int64_t timestamp = span.timestampAt(i);
+        const int64_t delta = timestamp - previous;
+        writeTimestampDelta(&writer, delta - previousDelta);
+        previous = timestamp;
+        previousDelta = delta;
+    }
+
+    for (const float *column : span.columns) {
+        writeColumn(&writer, column + first, count);
+    }
+
+    // Runs alternate starting from the first record's value
+    bool value = span.obstructedAt(first);
+    writer.writeBit(value);
+    uint64_t run = 0;
+    for (size_t i = first; i < first + count; ++i) {
+        if (span.obstructedAt(i) == value) {
+            ++run;
+            continue;
+        }
+        writeGamma(&writer, run);
+        value = !value;
+        run = 1;
+    }
+    writeGamma(&writer, run);
+}
+
+bool HistoryCodec::DecodedBlock::decode(const uint8_t *data, size_t size, size_t count)
+{
+    offsets_.clear();
+    if (count == 0) {
+        return true;
+    }
+
+    BitReader reader(data, size);
+
+    baseTimestampMs_ = static_cast<int64_t>(reader.read(64));
+    offsets_.resize(count);
+    offsets_[0] = 0;
+    int64_t previous = baseTimestampMs_;
+    int64_t previousDelta = kExpectedDeltaMs;
+    for (size_t i = 1; i < count; ++i) {
+        const int64_t delta = previousDelta + readTimestampDelta(&reader);
+        previous += delta;
+        previousDelta = delta;
+        offsets_[i] = static_cast<uint32_t>(previous - baseTimestampMs_);
+    }
+
+    for (std::vector<float> &column : columns_) {
+        column.resize(count);
+        readColumn(&reader, column.data(), count);
+    }
+
+    obstructed_.assign((count + 63) / 64, 0);
+    bool value = reader.readBit();
+    size_t at = 0;
+    while (at < count) {
+        const uint64_t run = readGamma(&reader);
+        if (run == 0 || run > count - at) {
+            return false;
+        }
+        if (value) {
+            for (size_t i = at; i < at + run; ++i) {
+                obstructed_[i / 64] |= uint64_t(1) << (i % 64);
+            }
+        }
+        at += run;
+        value = !value;
+    }
+
+    if (reader.overrun()) {
+        offsets_.clear();
+        return false;
+    }
+    return true;
+}
+
+SegmentLog::Span HistoryCodec::DecodedBlock::span(size_t first, size_t count) const
+{
+    SegmentLog::Span span;
+    span.baseTimestampMs = baseTimestampMs_;
+    span.timestampOffsets = offsets_.data();
+    for (int m = 0; m < TelemetryStore::MetricCount; ++m) {
+        span.columns[m] = columns_[m].data();
+    }
+    span.obstructed = obstructed_.data();
+    span.first = first;
+    span.count = count;
+    return span;
+}
@@ -0,0 +1,53 @@
+#ifndef HISTORYCODEC_H
+#define HISTORYCODEC_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "segmentlog.h"
+#include "telemetrystore.h"
+
+// Compact encoding for blocks of history records, after Facebook's Gorilla:
+//
+//  - timestamps as delta-of-delta against a 1 s cadence, so a steady 1 Hz
+//    series costs one bit per sample
+//  - each float column XORed with its previous value, storing only the
+//    meaningful bits of the difference; slowly changing series like SNR
+//    and latency shrink to a few bits per sample, repeats to one
+//  - the obstruction bitset as run lengths, Elias-gamma coded, since it is
+//    almost always false
+//
+// Every block is self-contained, so a reader only decodes the blocks that
+// overlap the range it wants.
+namespace HistoryCodec {
+
+// Appends the encoding of records [span.first, span.first + span.count)
+void encodeBlock(const SegmentLog::Span &span, std::vector<uint8_t> *out);
+
+// A decoded block, reused between decodes so steady-state reads don't
+// allocate
+class DecodedBlock
+{
+public:
+    // count is the number of records the block was encoded with
+    bool decode(const uint8_t *data, size_t size, size_t count);
+
+    size_t size() const { return offsets_.size(); }
+
+    // Records [first, first + count) of the block, offsets relative to its
+    // first timestamp
+    SegmentLog::Span span(size_t first, size_t count) const;
+    int64_t baseTimestampMs() const { return baseTimestampMs_; }
+    const uint32_t *timestampOffsets() const { return offsets_.data(); }
+
+private:
+    int64_t baseTimestampMs_ = 0;
+    std::vector<uint32_t> offsets_;
+    std::array<std::vector<float>, TelemetryStore::MetricCount> columns_;
+    std::vector<uint64_t> obstructed_;
+};
+
+}
+
+#endif // HISTORYCODEC_H
@@ -0,0 +1,173 @@
+#include "historydecoder.h"
+#include "wirescanner.h"
+#include "spacex/api/device/dish.pb.h"
+#include <algorithm>
+#include <type_traits>
+
+namespace {
+
+// Rings are either RepeatedFields or PackedFloats/PackedBools
+template <typename Ring>
+auto ringValue(const Ring &ring, uint64_t index) -> std::decay_t<decltype(ring.Get(0))>
+{
+    // Firmware occasionally omits a series or ships it shorter than the others
+    if (ring.empty()) {
+        return std::decay_t<decltype(ring.Get(0))>();
+    }
+    return ring.Get(static_cast<int>(index % static_cast<uint64_t>(ring.size())));
+}
+
+// Calls reduce(data, length) for the one or two contiguous ring spans that
+// hold samples [first, first + count)
+template <typename T, typename Reduce>
+void forEachSpan(const google::protobuf::RepeatedField<T> &ring, uint64_t first, uint64_t count, Reduce reduce)
+{
+    const uint64_t size = static_cast<uint64_t>(ring.size());
+    if (size == 0 || count == 0) {
+        return;
+    }
+    count = std::min(count, size);
+
+    const uint64_t start = first % size;
+    const uint64_t head = std::min(count, size - start);
+    reduce(ring.data() + start, static_cast<size_t>(head));
+    if (head < count) {
+        reduce(ring.data(), static_cast<size_t>(count - head));
+    }
+}
+
+Kernels::Summary summarizeRing(const google::protobuf::RepeatedField<float> &ring, uint64_t first, uint64_t count,
+                               std::vector<float> *)
+{
+    Kernels::Summary summary;
+    forEachSpan(ring, first, count, [&summary](const float *data, size_t length) {
+        summary.merge(Kernels::summarize(data, length));
+    });
+    return summary;
+}
+
+Kernels::Summary summarizeRing(const PackedFloats &ring, uint64_t first, uint64_t count, std::vector<float> *scratch)
+{
+    const uint64_t size = static_cast<uint64_t>(ring.size());
+    if (size == 0 || count == 0) {
+        return Kernels::Summary();
+    }
+    count = std::min(count, size);
+
+    // Only the new samples are ever copied out of the reply
+    scratch->resize(static_cast<size_t>(count));
+    const uint64_t start = first % size;
+    const uint64_t head = std::min(count, size - start);
+    ring.copy(static_cast<int>(start), static_cast<int>(head), scratch->data());
+    if (head < count) {
+        ring.copy(0, static_cast<int>(count - head), scratch->data() + head);
+    }
+    return Kernels::summarize(scratch->data(), scratch->size());
+}
+
+size_t countObstructed(const google::protobuf::RepeatedField<bool> &ring, uint64_t first, uint64_t count)
+{
+    size_t obstructed = 0;
+    forEachSpan(ring, first, count, [&obstructed](const bool *data, size_t length) {
+        obstructed += Kernels::countTrue(data, length);
+    });
+    return obstructed;
+}
+
+size_t countObstructed(const PackedBools &ring, uint64_t first, uint64_t count)
+{
+    const uint64_t size = static_cast<uint64_t>(ring.size());
+    if (size == 0 || count == 0) {
+        return 0;
+    }
+    count = std::min(count, size);
+
+    const uint64_t start = first % size;
+    const uint64_t head = std::min(count, size - start);
+    size_t obstructed = ring.countTrue(static_cast<int>(start), static_cast<int>(head));
+    if (head < count) {
+        obstructed += ring.countTrue(0, static_cast<int>(count - head));
+    }
+    return obstructed;
+}
+
+}
+
+size_t HistoryDecoder::decode(const SpaceX::API::Device::DishGetHistoryResponse &history,
+                              std::vector<HistorySample> *out)
+{
+    return decodeRings(history, out);
+}
+
+size_t HistoryDecoder::decode(const HistoryView &history, std::vector<HistorySample> *out)
+{
+    return decodeRings(history, out);
+}
+
+template <typename History>
+size_t HistoryDecoder::decodeRings(const History &history, std::vector<HistorySample> *out)
+{
+    out->clear();
+    batch_ = BatchSummary();
+
+    // The shortest non-empty series bounds how far back every field is valid
+    int ringSize = 0;
+    for (int size : { history.downlink_throughput_bps().size(),
+                      history.uplink_throughput_bps().size(),
+                      history.pop_ping_latency_ms().size(),
+                      history.pop_ping_drop_rate().size(),
+                      history.snr().size() }) {
+        if (size > 0 && (ringSize == 0 || size < ringSize)) {
+            ringSize = size;
+        }
+    }
+    if (ringSize == 0) {
+        return 0;
+    }
+    ringSize_ = ringSize;
+
+    const uint64_t current = history.current();
+
+    // A counter that went backwards means the dish rebooted
+    if (primed_ && current < lastCurrent_) {
+        primed_ = false;
+    }
+
+    // On the first poll everything still in the ring is new
+    uint64_t fresh = primed_ ? current - lastCurrent_ : current;
+    fresh = std::min<uint64_t>(fresh, static_cast<uint64_t>(ringSize));
+
+    lastCurrent_ = current;
+    primed_ = true;
+
+    const uint64_t first = current - fresh;
+    batch_.downlinkBps = summarizeRing(history.downlink_throughput_bps(), first, fresh, &scratch_);
+    batch_.uplinkBps = summarizeRing(history.uplink_throughput_bps(), first, fresh, &scratch_);
+    batch_.latencyMs = summarizeRing(history.pop_ping_latency_ms(), first, fresh, &scratch_);
+    batch_.dropRate = summarizeRing(history.pop_ping_drop_rate(), first, fresh, &scratch_);
+    batch_.snr = summarizeRing(history.snr(), first, fresh, &scratch_);
+    batch_.obstructed = countObstructed(history.obstructed(), first, fresh);
+
+    out->reserve(fresh);
+    for (uint64_t index = first; index < current; ++index) {
+        HistorySample sample;
+        sample.index = index;
+        sample.downlinkBps = ringValue(history.downlink_throughput_bps(), index);
+        sample.uplinkBps = ringValue(history.uplink_throughput_bps(), index);
+        sample.latencyMs = ringValue(history.pop_ping_latency_ms(), index);
+        sample.dropRate = ringValue(history.pop_ping_drop_rate(), index);
+        sample.snr = ringValue(history.snr(), index);
+        sample.obstructed = ringValue(history.obstructed(), index);
+        sample.scheduled = ringValue(history.scheduled(), index);
+        out->push_back(sample);
+    }
+
+    return out->size();
+}
+
+void HistoryDecoder::reset()
+{
+    lastCurrent_ = 0;
+    ringSize_ = 0;
+    primed_ = false;
+}
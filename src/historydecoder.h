@@ -0,0 +1,81 @@
+#ifndef HISTORYDECODER_H
+#define HISTORYDECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "kernels.h"
+
+namespace SpaceX {
+namespace API {
+namespace Device {
+class DishGetHistoryResponse;
+}
+}
+}
+struct HistoryView;
+
+// One second of dish history, pulled out of the DishGetHistoryResponse ring
+// buffers. index is the dish's absolute sample counter, so consecutive
+// samples have consecutive indices across polls.
+struct HistorySample
+{
+    uint64_t index = 0;
+    float downlinkBps = 0.0f;
+    float uplinkBps = 0.0f;
+    float latencyMs = 0.0f;
+    float dropRate = 0.0f;
+    float snr = 0.0f;
+    bool obstructed = false;
+    bool scheduled = false;
+};
+
+// Turns successive DishGetHistoryResponse polls into a stream of samples.
+//
+// The dish keeps its history in fixed-size ring buffers and reports in
+// `current` how many samples it has written in total; the newest one lives at
+// (current - 1) % size. The decoder remembers the last `current` it saw and
+// only reads the slots written since then, so a poll costs O(new samples)
+// rather than O(ring size).
+class HistoryDecoder
+{
+public:
+    // Reductions over the samples returned by the last decode(), computed
+    // straight from the response's ring buffers
+    struct BatchSummary {
+        Kernels::Summary downlinkBps;
+        Kernels::Summary uplinkBps;
+        Kernels::Summary latencyMs;
+        Kernels::Summary dropRate;
+        Kernels::Summary snr;
+        size_t obstructed = 0;
+    };
+
+    // Appends every sample not delivered by an earlier call to *out (which is
+    // cleared first), oldest first. Returns the number of samples appended.
+    size_t decode(const SpaceX::API::Device::DishGetHistoryResponse &history,
+                  std::vector<HistorySample> *out);
+    // The same straight from the wire, reading only the new samples
+    size_t decode(const HistoryView &history, std::vector<HistorySample> *out);
+
+    // Forget the cursor, e.g. after switching to a different dish
+    void reset();
+
+    uint64_t lastCurrent() const { return lastCurrent_; }
+    // Length of the dish's rings as of the last decode(), 0 before that
+    int ringSize() const { return ringSize_; }
+    const BatchSummary &lastBatch() const { return batch_; }
+
+private:
+    template <typename History>
+    size_t decodeRings(const History &history, std::vector<HistorySample> *out);
+
+    BatchSummary batch_;
+    // Unaligned wire floats are copied here before they are summarised
+    std::vector<float> scratch_;
+    uint64_t lastCurrent_ = 0;
+    int ringSize_ = 0;
+    bool primed_ = false;
+};
+
+#endif // HISTORYDECODER_H
@@ -0,0 +1,240 @@
+#include "instrumentation.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+constexpr uint64_t kMaxValueNs = (uint64_t(1) << LatencyHistogram::kMaxValueBits) - 1;
+
+// A snapshot with no paint this soon after it changed nothing on screen, or
+// went to a hidden window
+constexpr int64_t kMaxPaintDelayNs = 1000 * 1000 * 1000;
+
+const char *const kRequestNames[PollScheduler::RequestCount] = {
+    "status",
+    "device_info",
+    "location",
+    "history",
+    "obstruction_map",
+    "context",
+};
+
+const char *const kStageNames[Instrumentation::StageCount] = {
+    "round_trip",
+    "serialize",
+    "queue_wait",
+    "apply",
+    "parse",
+};
+
+int highestBit(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+    while (value >>= 1) {
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+}
+
+int LatencyHistogram::bucket(uint64_t ns)
+{
+    ns = std::min(ns, kMaxValueNs);
+    if (ns < 2 * kSubBuckets) {
+        return static_cast<int>(ns);
+    }
+    // The top kSubBucketBits + 1 bits pick the bucket: the leading one
+    // says which power of two, the rest where in it
+    const int shift = highestBit(ns) - kSubBucketBits;
+    return 2 * kSubBuckets + (shift - 1) * kSubBuckets + static_cast<int>((ns >> shift) - kSubBuckets);
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(int bucket)
+{
+    if (bucket < 2 * kSubBuckets) {
+        return static_cast<uint64_t>(bucket);
+    }
+    const int offset = bucket - 2 * kSubBuckets;
+    const int shift = offset / kSubBuckets + 1;
+    const uint64_t sub = static_cast<uint64_t>(offset % kSubBuckets + kSubBuckets);
+    return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(int64_t ns)
+{
+    const uint64_t value = static_cast<uint64_t>(std::max<int64_t>(ns, 0));
+    counts_[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sumNs_.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t max = maxNs_.load(std::memory_order_relaxed);
+    while (value > max && !maxNs_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::snapshot(Snapshot *out) const
+{
+    // Totals first, so they never run ahead of the buckets they summarise
+    out->count = count_.load(std::memory_order_relaxed);
+    out->sumNs = sumNs_.load(std::memory_order_relaxed);
+    out->maxNs = maxNs_.load(std::memory_order_relaxed);
+    for (int i = 0; i < kBucketCount; ++i) {
+        out->counts[i] = counts_[i].load(std::memory_order_relaxed);
+    }
+}
+
+uint64_t LatencyHistogram::Snapshot::quantile(double q) const
+{
+    uint64_t total = 0;
+    for (uint64_t c : counts) {
+        total += c;
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * static_cast<double>(total))));
+    uint64_t seen = 0;
+    for (int i = 0; i < kBucketCount; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return std::min(bucketUpperBound(i), maxNs);
+        }
+    }
+    return maxNs;
+}
+
+Instrumentation &Instrumentation::global()
+{
+    static Instrumentation instance;
+    return instance;
+}
+
+int64_t Instrumentation::nowNs()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+const char *Instrumentation::requestName(PollScheduler::Request request)
+{
+    return kRequestNames[request];
+}
+
+const char *Instrumentation::stageName(Stage stage)
+{
+    return kStageNames[stage];
+}
+
+Instrumentation::Instrumentation()
+{
+}
+
+Instrumentation::~Instrumentation()
+{
+}
+
+void Instrumentation::record(PollScheduler::Request request, Stage stage, int64_t startNs, int64_t endNs)
+{
+    histograms_[request][stage].record(endNs - startNs);
+    if (tracing_.load(std::memory_order_acquire)) {
+        trace(kRequestNames[request], kStageNames[stage], startNs, endNs);
+    }
+}
+
+void Instrumentation::dispatched()
+{
+    // Only the oldest snapshot still waiting for a paint counts
+    int64_t expected = 0;
+    dispatchedNs_.compare_exchange_strong(expected, nowNs(), std::memory_order_relaxed);
+}
+
+void Instrumentation::painted()
+{
+    const int64_t dispatched = dispatchedNs_.exchange(0, std::memory_order_relaxed);
+    if (dispatched == 0) {
+        return;
+    }
+    const int64_t now = nowNs();
+    if (now - dispatched > kMaxPaintDelayNs) {
+        return;
+    }
+    paint_.record(now - dispatched);
+    if (tracing_.load(std::memory_order_acquire)) {
+        trace("snapshot", "paint", dispatched, now);
+    }
+}
+
+void Instrumentation::setTracing(bool enabled)
+{
+    // The ring is never freed once allocated, so writers that saw tracing
+    // on just before it was turned off still have somewhere to write
+    if (enabled && !traceRing_) {
+        traceRing_.reset(new TraceEvent[kTraceCapacity]);
+    }
+    tracing_.store(enabled, std::memory_order_release);
+}
+
+uint32_t Instrumentation::threadNumber()
+{
+    static std::atomic<uint32_t> next {1};
+    thread_local const uint32_t number = next.fetch_add(1, std::memory_order_relaxed);
+    return number;
+}
+
+void Instrumentation::trace(const char *name, const char *category, int64_t startNs, int64_t endNs)
+{
+    const uint64_t index = traceHead_.fetch_add(1, std::memory_order_relaxed);
+    TraceEvent &event = traceRing_[index % kTraceCapacity];
+
+    event.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    event.name.store(name, std::memory_order_relaxed);
+    event.category.store(category, std::memory_order_relaxed);
+    event.startNs.store(startNs, std::memory_order_relaxed);
+    event.durationNs.store(endNs - startNs, std::memory_order_relaxed);
+    event.thread.store(threadNumber(), std::memory_order_relaxed);
+    event.sequence.store(2 * index + 2, std::memory_order_release);
+}
+
+void Instrumentation::appendChromeTrace(std::string *out) const
+{
+    out->append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    if (traceRing_) {
+        const uint64_t head = traceHead_.load(std::memory_order_acquire);
+        const uint64_t first = head > kTraceCapacity ? head - kTraceCapacity : 0;
+        bool separator = false;
+        char line[192];
+
+        for (uint64_t index = first; index < head; ++index) {
+            const TraceEvent &event = traceRing_[index % kTraceCapacity];
+            const uint64_t sequence = event.sequence.load(std::memory_order_acquire);
+            const char *name = event.name.load(std::memory_order_relaxed);
+            const char *category = event.category.load(std::memory_order_relaxed);
+            const int64_t startNs = event.startNs.load(std::memory_order_relaxed);
+            const int64_t durationNs = event.durationNs.load(std::memory_order_relaxed);
+            const uint32_t thread = event.thread.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            // Still being written, or already overwritten by a newer event
+            if (sequence != 2 * index + 2 || event.sequence.load(std::memory_order_relaxed) != sequence) {
+                continue;
+            }
+
+            const int length = std::snprintf(line, sizeof(line),
+                                             "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+                                             "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                                             separator ? "," : "", name, category, startNs / 1000.0,
+                                             durationNs / 1000.0, thread);
+            out->append(line, static_cast<size_t>(std::min<int>(length, sizeof(line) - 1)));
+            separator = true;
+        }
+    }
+    out->append("\n]}\n");
+}
@@ -0,0 +1,128 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "pollscheduler.h"
+
+// Latency histogram in the spirit of HdrHistogram: values below 64 ns get a
+// bucket each, above that every power of two is split into 32 buckets, so a
+// quantile is within about 3% of the truth anywhere from nanoseconds to a
+// minute. record() is a couple of relaxed atomic adds and safe to call from
+// any number of threads at once.
+class LatencyHistogram
+{
+public:
+    static constexpr int kSubBucketBits = 5;
+    static constexpr int kSubBuckets = 1 << kSubBucketBits;
+    // 2^36 ns is about 69 s; anything slower lands in the last bucket
+    static constexpr int kMaxValueBits = 36;
+    static constexpr int kBucketCount = 2 * kSubBuckets + (kMaxValueBits - kSubBucketBits - 1) * kSubBuckets;
+
+    // A consistent enough copy for reporting. Concurrent records may be split
+    // between the counts and the totals, never lost.
+    struct Snapshot {
+        std::array<uint64_t, kBucketCount> counts {};
+        uint64_t count = 0;
+        uint64_t sumNs = 0;
+        uint64_t maxNs = 0;
+
+        // Upper edge of the bucket holding quantile q, in nanoseconds
+        uint64_t quantile(double q) const;
+    };
+
+    void record(int64_t ns);
+    void snapshot(Snapshot *out) const;
+
+    static int bucket(uint64_t ns);
+    static uint64_t bucketUpperBound(int bucket);
+
+private:
+    std::array<std::atomic<uint64_t>, kBucketCount> counts_ {};
+    std::atomic<uint64_t> count_ {0};
+    std::atomic<uint64_t> sumNs_ {0};
+    std::atomic<uint64_t> maxNs_ {0};
+};
+
+// Where every StarlinkClient in the process spends its time, per request
+// kind and stage, plus how long a published snapshot takes to reach the
+// screen. Histograms are always on. Tracing additionally keeps the most
+// recent events in a fixed ring for a Chrome trace / Perfetto dump; while it
+// is off, a call costs one relaxed load more than the histogram alone.
+class Instrumentation
+{
+public:
+    enum Stage {
+        RoundTrip,  // request sent until gRPC hands back the reply
+        Serialize,  // building the request and handing it to gRPC
+        QueueWait,  // completion posted until the client thread picks it up
+        Apply,      // reply folded into the snapshot, store and log
+        Parse,      // part of Apply for replies that arrive as raw bytes;
+                    // gRPC parses the others inside RoundTrip
+        StageCount
+    };
+
+    static constexpr size_t kTraceCapacity = 64 * 1024;
+
+    static Instrumentation &global();
+
+    // Monotonic, shared by every stage
+    static int64_t nowNs();
+
+    static const char *requestName(PollScheduler::Request request);
+    static const char *stageName(Stage stage);
+
+    Instrumentation();
+    ~Instrumentation();
+
+    Instrumentation(const Instrumentation &) = delete;
+    Instrumentation &operator=(const Instrumentation &) = delete;
+
+    void record(PollScheduler::Request request, Stage stage, int64_t startNs, int64_t endNs);
+
+    // A snapshot went out; the next painted() closes the interval, unless
+    // that is so late the snapshot can't have been what caused it. Snapshots
+    // published before that paint are covered by it.
+    void dispatched();
+    void painted();
+
+    const LatencyHistogram &histogram(PollScheduler::Request request, Stage stage) const
+    {
+        return histograms_[request][stage];
+    }
+    const LatencyHistogram &paintHistogram() const { return paint_; }
+
+    void setTracing(bool enabled);
+    bool isTracing() const { return tracing_.load(std::memory_order_relaxed); }
+
+    // The trace ring as Chrome's JSON trace format, oldest event first
+    void appendChromeTrace(std::string *out) const;
+
+private:
+    // Seqlock per slot: odd while being written, 2 * (index + 1) once done
+    struct TraceEvent {
+        std::atomic<uint64_t> sequence {0};
+        std::atomic<const char *> name {nullptr};
+        std::atomic<const char *> category {nullptr};
+        std::atomic<int64_t> startNs {0};
+        std::atomic<int64_t> durationNs {0};
+        std::atomic<uint32_t> thread {0};
+    };
+
+    void trace(const char *name, const char *category, int64_t startNs, int64_t endNs);
+    static uint32_t threadNumber();
+
+    std::array<std::array<LatencyHistogram, StageCount>, PollScheduler::RequestCount> histograms_;
+    LatencyHistogram paint_;
+    std::atomic<int64_t> dispatchedNs_ {0};
+
+    std::atomic<bool> tracing_ {false};
+    std::atomic<uint64_t> traceHead_ {0};
+    std::unique_ptr<TraceEvent[]> traceRing_;
+};
+
+#endif // INSTRUMENTATION_H
@@ -0,0 +1,384 @@
+#include "kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define KERNELS_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define KERNELS_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace Kernels {
+
+void Summary::merge(const Summary &other)
+{
+    if (other.count == 0) {
+        return;
+    }
+    if (count == 0) {
+        *this = other;
+        return;
+    }
+    count += other.count;
+    sum += other.sum;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+}
+
+namespace {
+
+// Endpoints of the obstruction map palette
+constexpr float kClearRgb[3] = { 30.0f, 136.0f, 229.0f };
+constexpr float kBlockedRgb[3] = { 211.0f, 47.0f, 47.0f };
+constexpr uint32_t kOpaque = 0xff000000u;
+
+Summary summarizeScalar(const float *values, size_t count)
+{
+    Summary summary;
+    float lo = std::numeric_limits<float>::infinity();
+    float hi = -std::numeric_limits<float>::infinity();
+
+    for (size_t i = 0; i < count; ++i) {
+        const float value = values[i];
+        if (std::isnan(value)) {
+            continue;
+        }
+        ++summary.count;
+        summary.sum += value;
+        lo = std::min(lo, value);
+        hi = std::max(hi, value);
+    }
+
+    if (summary.count) {
+        summary.min = lo;
+        summary.max = hi;
+    }
+    return summary;
+}
+
+size_t countAtLeastScalar(const float *values, size_t count, float threshold)
+{
+    size_t hits = 0;
+    for (size_t i = 0; i < count; ++i) {
+        hits += values[i] >= threshold;
+    }
+    return hits;
+}
+
+size_t countTrueScalar(const bool *values, size_t count)
+{
+    size_t hits = 0;
+    for (size_t i = 0; i < count; ++i) {
+        hits += values[i];
+    }
+    return hits;
+}
+
+void snrToArgbScalar(const float *snr, size_t count, uint32_t *out)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const float value = snr[i];
+        if (!(value >= 0.0f)) {
+            out[i] = 0;
+            continue;
+        }
+        const float t = std::min(value, 1.0f);
+        uint32_t pixel = kOpaque;
+        for (int c = 0; c < 3; ++c) {
+            const float channel = kBlockedRgb[c] + t * (kClearRgb[c] - kBlockedRgb[c]);
+            pixel |= static_cast<uint32_t>(channel + 0.5f) << (16 - 8 * c);
+        }
+        out[i] = pixel;
+    }
+}
+
+#ifdef KERNELS_HAVE_AVX2
+
+__attribute__((target("avx2,popcnt")))
+Summary summarizeAvx2(const float *values, size_t count)
+{
+    __m256d sumLo = _mm256_setzero_pd();
+    __m256d sumHi = _mm256_setzero_pd();
+    __m256 lo = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    __m256 hi = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    size_t valid = 0;
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 x = _mm256_loadu_ps(values + i);
+        const __m256 ordered = _mm256_cmp_ps(x, x, _CMP_ORD_Q);
+        valid += static_cast<size_t>(__builtin_popcount(_mm256_movemask_ps(ordered)));
+
+        // Accumulate in double so a day of 1e8 bps samples keeps its precision
+        const __m256 masked = _mm256_and_ps(x, ordered);
+        sumLo = _mm256_add_pd(sumLo, _mm256_cvtps_pd(_mm256_castps256_ps128(masked)));
+        sumHi = _mm256_add_pd(sumHi, _mm256_cvtps_pd(_mm256_extractf128_ps(masked, 1)));
+
+        // min/max return the second operand when either is NaN
+        lo = _mm256_min_ps(x, lo);
+        hi = _mm256_max_ps(x, hi);
+    }
+
+    alignas(32) double sums[4];
+    alignas(32) float mins[8];
+    alignas(32) float maxs[8];
+    _mm256_store_pd(sums, _mm256_add_pd(sumLo, sumHi));
+    _mm256_store_ps(mins, lo);
+    _mm256_store_ps(maxs, hi);
+
+    Summary summary;
+    summary.count = valid;
+    summary.sum = sums[0] + sums[1] + sums[2] + sums[3];
+    summary.min = *std::min_element(mins, mins + 8);
+    summary.max = *std::max_element(maxs, maxs + 8);
+    if (valid == 0) {
+        summary = Summary();
+    }
+
+    summary.merge(summarizeScalar(values + i, count - i));
+    return summary;
+}
+
+__attribute__((target("avx2,popcnt")))
+size_t countAtLeastAvx2(const float *values, size_t count, float threshold)
+{
+    const __m256 limit = _mm256_set1_ps(threshold);
+    size_t hits = 0;
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 x = _mm256_loadu_ps(values + i);
+        hits += static_cast<size_t>(__builtin_popcount(_mm256_movemask_ps(_mm256_cmp_ps(x, limit, _CMP_GE_OQ))));
+    }
+    return hits + countAtLeastScalar(values + i, count - i, threshold);
+}
+
+__attribute__((target("avx2,popcnt")))
+size_t countTrueAvx2(const bool *values, size_t count)
+{
+    const auto *bytes = reinterpret_cast<const uint8_t *>(values);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i total = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes + i));
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(x, zero));
+    }
+
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), total);
+    return static_cast<size_t>(lanes[0] + lanes[1] + lanes[2] + lanes[3])
+         + countTrueScalar(values + i, count - i);
+}
+
+__attribute__((target("avx2,popcnt")))
+void snrToArgbAvx2(const float *snr, size_t count, uint32_t *out)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    __m256 base[3];
+    __m256 span[3];
+    for (int c = 0; c < 3; ++c) {
+        base[c] = _mm256_set1_ps(kBlockedRgb[c]);
+        span[c] = _mm256_set1_ps(kClearRgb[c] - kBlockedRgb[c]);
+    }
+    const __m256i opaque = _mm256_set1_epi32(static_cast<int>(kOpaque));
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 x = _mm256_loadu_ps(snr + i);
+        // False for NaN as well as for negative values
+        const __m256i valid = _mm256_castps_si256(_mm256_cmp_ps(x, zero, _CMP_GE_OQ));
+        const __m256 t = _mm256_min_ps(_mm256_max_ps(x, zero), one);
+
+        const __m256i r = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_add_ps(base[0], _mm256_mul_ps(t, span[0])), half));
+        const __m256i g = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_add_ps(base[1], _mm256_mul_ps(t, span[1])), half));
+        const __m256i b = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_add_ps(base[2], _mm256_mul_ps(t, span[2])), half));
+
+        __m256i pixel = _mm256_or_si256(opaque, _mm256_slli_epi32(r, 16));
+        pixel = _mm256_or_si256(pixel, _mm256_slli_epi32(g, 8));
+        pixel = _mm256_or_si256(pixel, b);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_and_si256(pixel, valid));
+    }
+    snrToArgbScalar(snr + i, count - i, out + i);
+}
+
+#endif // KERNELS_HAVE_AVX2
+
+#ifdef KERNELS_HAVE_NEON
+
+Summary summarizeNeon(const float *values, size_t count)
+{
+    float64x2_t sumLo = vdupq_n_f64(0.0);
+    float64x2_t sumHi = vdupq_n_f64(0.0);
+    float32x4_t lo = vdupq_n_f32(std::numeric_limits<float>::infinity());
+    float32x4_t hi = vdupq_n_f32(-std::numeric_limits<float>::infinity());
+    uint32x4_t valid = vdupq_n_u32(0);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const float32x4_t x = vld1q_f32(values + i);
+        const uint32x4_t ordered = vceqq_f32(x, x);
+        valid = vaddq_u32(valid, vshrq_n_u32(ordered, 31));
+
+        const float32x4_t masked = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(x), ordered));
+        sumLo = vaddq_f64(sumLo, vcvt_f64_f32(vget_low_f32(masked)));
+        sumHi = vaddq_f64(sumHi, vcvt_high_f64_f32(masked));
+
+        // The "nm" variants ignore a NaN operand
+        lo = vminnmq_f32(lo, x);
+        hi = vmaxnmq_f32(hi, x);
+    }
+
+    Summary summary;
+    summary.count = vaddvq_u32(valid);
+    summary.sum = vaddvq_f64(vaddq_f64(sumLo, sumHi));
+    summary.min = vminnmvq_f32(lo);
+    summary.max = vmaxnmvq_f32(hi);
+    if (summary.count == 0) {
+        summary = Summary();
+    }
+
+    summary.merge(summarizeScalar(values + i, count - i));
+    return summary;
+}
+
+size_t countAtLeastNeon(const float *values, size_t count, float threshold)
+{
+    const float32x4_t limit = vdupq_n_f32(threshold);
+    uint32x4_t hits = vdupq_n_u32(0);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        hits = vaddq_u32(hits, vshrq_n_u32(vcgeq_f32(vld1q_f32(values + i), limit), 31));
+    }
+    return vaddvq_u32(hits) + countAtLeastScalar(values + i, count - i, threshold);
+}
+
+size_t countTrueNeon(const bool *values, size_t count)
+{
+    const auto *bytes = reinterpret_cast<const uint8_t *>(values);
+    size_t hits = 0;
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        hits += vaddvq_u8(vld1q_u8(bytes + i));
+    }
+    return hits + countTrueScalar(values + i, count - i);
+}
+
+void snrToArgbNeon(const float *snr, size_t count, uint32_t *out)
+{
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t half = vdupq_n_f32(0.5f);
+    const uint32x4_t opaque = vdupq_n_u32(kOpaque);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const float32x4_t x = vld1q_f32(snr + i);
+        const uint32x4_t valid = vcgeq_f32(x, zero);
+        const float32x4_t t = vminq_f32(vmaxq_f32(x, zero), one);
+
+        uint32x4_t channels[3];
+        for (int c = 0; c < 3; ++c) {
+            const float32x4_t value = vmlaq_n_f32(vdupq_n_f32(kBlockedRgb[c]), t, kClearRgb[c] - kBlockedRgb[c]);
+            channels[c] = vcvtq_u32_f32(vaddq_f32(value, half));
+        }
+
+        uint32x4_t pixel = vorrq_u32(opaque, vshlq_n_u32(channels[0], 16));
+        pixel = vorrq_u32(pixel, vshlq_n_u32(channels[1], 8));
+        pixel = vorrq_u32(pixel, channels[2]);
+        vst1q_u32(out + i, vandq_u32(pixel, valid));
+    }
+    snrToArgbScalar(snr + i, count - i, out + i);
+}
+
+#endif // KERNELS_HAVE_NEON
+
+struct Table {
+    const char *name;
+    Summary (*summarize)(const float *, size_t);
+    size_t (*countAtLeast)(const float *, size_t, float);
+    size_t (*countTrue)(const bool *, size_t);
+    void (*snrToArgb)(const float *, size_t, uint32_t *);
+};
+
+Table select()
+{
+#ifdef KERNELS_HAVE_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        return { "avx2", summarizeAvx2, countAtLeastAvx2, countTrueAvx2, snrToArgbAvx2 };
+    }
+#endif
+#ifdef KERNELS_HAVE_NEON
+    return { "neon", summarizeNeon, countAtLeastNeon, countTrueNeon, snrToArgbNeon };
+#endif
+    return { "scalar", summarizeScalar, countAtLeastScalar, countTrueScalar, snrToArgbScalar };
+}
+
+const Table &table()
+{
+    static const Table selected = select();
+    return selected;
+}
+
+}
+
+Summary summarize(const float *values, size_t count)
+{
+    return table().summarize(values, count);
+}
+
+size_t countAtLeast(const float *values, size_t count, float threshold)
+{
+    return table().countAtLeast(values, count, threshold);
+}
+
+size_t countTrue(const bool *values, size_t count)
+{
+    return table().countTrue(values, count);
+}
+
+void snrToArgb(const float *snr, size_t count, uint32_t *out)
+{
+    table().snrToArgb(snr, count, out);
+}
+
+void quantiles(const float *values, size_t count, const double *qs, float *out,
+               size_t quantileCount, std::vector<float> *scratch)
+{
+    scratch->clear();
+    for (size_t i = 0; i < count; ++i) {
+        if (!std::isnan(values[i])) {
+            scratch->push_back(values[i]);
+        }
+    }
+
+    for (size_t q = 0; q < quantileCount; ++q) {
+        if (scratch->empty()) {
+            out[q] = 0.0f;
+            continue;
+        }
+        const size_t rank = std::max<size_t>(1, static_cast<size_t>(std::ceil(qs[q] * scratch->size())));
+        auto nth = scratch->begin() + static_cast<std::ptrdiff_t>(std::min(rank, scratch->size()) - 1);
+        std::nth_element(scratch->begin(), nth, scratch->end());
+        out[q] = *nth;
+    }
+}
+
+const char *implementation()
+{
+    return table().name;
+}
+
+}
@@ -0,0 +1,52 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Reductions over the float and bool arrays that make up dish history
+// (RepeatedField<float>::data(), TelemetryStore columns, ...).
+//
+// Each kernel has an AVX2 path on x86, a NEON path on AArch64 and a scalar
+// fallback; the x86 choice is made once at runtime from the CPU's feature
+// flags, so one binary runs everywhere. NaN marks a missing sample and is
+// skipped by every kernel.
+namespace Kernels {
+
+struct Summary {
+    size_t count = 0;   // non-NaN values seen
+    double sum = 0.0;
+    float min = 0.0f;
+    float max = 0.0f;
+
+    float mean() const { return count ? static_cast<float>(sum / count) : 0.0f; }
+    void merge(const Summary &other);
+};
+
+// Count, sum, min and max in one pass. A drop-rate series sums to the number
+// of seconds lost, since each sample covers one second.
+Summary summarize(const float *values, size_t count);
+
+// Number of values >= threshold, e.g. seconds of full outage with threshold 1
+size_t countAtLeast(const float *values, size_t count, float threshold);
+
+// Number of true entries, e.g. obstructed samples from a repeated bool
+size_t countTrue(const bool *values, size_t count);
+
+// Nearest-rank quantiles (q in [0, 1]) of the non-NaN values. scratch is
+// reused between calls so steady-state use does not allocate.
+void quantiles(const float *values, size_t count, const double *qs, float *out,
+               size_t quantileCount, std::vector<float> *scratch);
+
+// Obstruction map SNR values to 0xAARRGGBB pixels (QImage::Format_ARGB32),
+// shading from red at 0 to blue at 1. Cells without data (negative or NaN)
+// become fully transparent.
+void snrToArgb(const float *snr, size_t count, uint32_t *out);
+
+// "avx2", "neon" or "scalar"
+const char *implementation();
+
+}
+
+#endif // KERNELS_H
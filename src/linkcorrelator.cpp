@@ -0,0 +1,103 @@
+#include "linkcorrelator.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+LinkCorrelator::Report LinkCorrelator::correlate(const TelemetryStore &dish, const TelemetryStore &router,
+                                                 int64_t fromMs, int64_t toMs) const
+{
+    Report report;
+    report.correlation = std::numeric_limits<float>::quiet_NaN();
+    const int64_t bucketMs = std::max<int64_t>(options_.bucketMs, 1000);
+    if (toMs <= fromMs) {
+        return report;
+    }
+
+    double sumRouter = 0.0;
+    double sumDish = 0.0;
+    double sumRouterSquared = 0.0;
+    double sumDishSquared = 0.0;
+    double sumProduct = 0.0;
+    int judged = 0;
+
+    const size_t minSamples = static_cast<size_t>(std::max(options_.minSamples, 1));
+    for (int64_t start = TelemetryStore::alignDown(fromMs, bucketMs); start < toMs; start += bucketMs) {
+        // Inclusive at both ends, so the next bucket starts a millisecond on
+        const Kernels::Summary routerLoss = router.summarizeBetween(TelemetryStore::DropRate, start, start + bucketMs - 1);
+        const Kernels::Summary dishLoss = dish.summarizeBetween(TelemetryStore::DropRate, start, start + bucketMs - 1);
+
+        Bucket bucket;
+        bucket.startMs = start;
+        bucket.routerDropRate = routerLoss.mean();
+        bucket.dishDropRate = dishLoss.mean();
+        bucket.routerSamples = routerLoss.count;
+        bucket.dishSamples = dishLoss.count;
+
+        if (routerLoss.count >= minSamples && dishLoss.count >= minSamples) {
+            const bool lan = bucket.routerDropRate - bucket.dishDropRate >= options_.lossThreshold;
+            const bool satellite = bucket.dishDropRate >= options_.lossThreshold;
+            if (lan && satellite) {
+                bucket.bottleneck = Both;
+                ++report.bothBuckets;
+            } else if (lan) {
+                bucket.bottleneck = Lan;
+                ++report.lanBuckets;
+            } else if (satellite) {
+                bucket.bottleneck = Satellite;
+                ++report.satelliteBuckets;
+            } else {
+                bucket.bottleneck = Healthy;
+                ++report.healthyBuckets;
+            }
+
+            const double r = bucket.routerDropRate;
+            const double d = bucket.dishDropRate;
+            sumRouter += r;
+            sumDish += d;
+            sumRouterSquared += r * r;
+            sumDishSquared += d * d;
+            sumProduct += r * d;
+            ++judged;
+        }
+        report.buckets.push_back(bucket);
+    }
+
+    if (judged >= 2) {
+        const double covariance = sumProduct - sumRouter * sumDish / judged;
+        const double routerVariance = sumRouterSquared - sumRouter * sumRouter / judged;
+        const double dishVariance = sumDishSquared - sumDish * sumDish / judged;
+        if (routerVariance > 0.0 && dishVariance > 0.0) {
+            report.correlation = static_cast<float>(covariance / std::sqrt(routerVariance * dishVariance));
+        }
+    }
+
+    if (judged > 0) {
+        const int lan = report.lanBuckets + report.bothBuckets;
+        const int satellite = report.satelliteBuckets + report.bothBuckets;
+        if (lan == 0 && satellite == 0) {
+            report.overall = Healthy;
+        } else if (report.bothBuckets > std::max(report.lanBuckets, report.satelliteBuckets)) {
+            report.overall = Both;
+        } else {
+            report.overall = report.lanBuckets >= report.satelliteBuckets ? Lan : Satellite;
+        }
+    }
+    return report;
+}
+
+const char *LinkCorrelator::bottleneckName(Bottleneck bottleneck)
+{
+    switch (bottleneck) {
+    case Healthy:
+        return "healthy";
+    case Lan:
+        return "lan";
+    case Satellite:
+        return "satellite";
+    case Both:
+        return "both";
+    case NoData:
+        break;
+    }
+    return "no data";
+}
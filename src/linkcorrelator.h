@@ -0,0 +1,74 @@
+#ifndef LINKCORRELATOR_H
+#define LINKCORRELATOR_H
+
+#include <cstdint>
+#include <vector>
+#include "telemetrystore.h"
+
+// Tells LAN trouble from satellite trouble, from the ping loss the router
+// and the dish each record.
+//
+// The router pings the internet through the dish, so its loss includes
+// the dish's pop_ping_drop_rate; only what it loses on top of that is
+// lost on the LAN side. Both histories are cut into the same wall-clock
+// buckets, aligned to multiples of the bucket length so reports taken at
+// different times line up. Each bucket is then judged on its own, and the
+// two series' correlation over all buckets says how much of the router's
+// loss the dish explains.
+class LinkCorrelator
+{
+public:
+    enum Bottleneck {
+        NoData,
+        Healthy,
+        Lan,
+        Satellite,
+        Both
+    };
+
+    struct Options {
+        int64_t bucketMs = 60 * 1000;
+        // Loss at or above this counts as a problem, for the dish and for
+        // the router's excess over the dish alike
+        float lossThreshold = 0.02f;
+        // A bucket needs this many samples from each side to be judged
+        int minSamples = 10;
+    };
+
+    struct Bucket {
+        int64_t startMs = 0;
+        float routerDropRate = 0.0f;
+        float dishDropRate = 0.0f;
+        size_t routerSamples = 0;
+        size_t dishSamples = 0;
+        Bottleneck bottleneck = NoData;
+    };
+
+    struct Report {
+        std::vector<Bucket> buckets;
+        // Pearson correlation of the judged buckets, NaN with fewer than
+        // two or when either side never varies
+        float correlation = 0.0f;
+        int healthyBuckets = 0;
+        int lanBuckets = 0;
+        int satelliteBuckets = 0;
+        int bothBuckets = 0;
+        // Whichever problem showed up in more buckets
+        Bottleneck overall = NoData;
+    };
+
+    LinkCorrelator() = default;
+    explicit LinkCorrelator(const Options &options) : options_(options) {}
+
+    const Options &options() const { return options_; }
+
+    // Buckets covering [fromMs, toMs), both in the stores' timestamps
+    Report correlate(const TelemetryStore &dish, const TelemetryStore &router, int64_t fromMs, int64_t toMs) const;
+
+    static const char *bottleneckName(Bottleneck bottleneck);
+
+private:
+    Options options_;
+};
+
+#endif // LINKCORRELATOR_H
@@ -0,0 +1,524 @@
+#include "livefeed.h"
+#include "fleetmanager.h"
+#include "telemetrystore.h"
+#include <QCryptographicHash>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+namespace {
+
+// Snapshots from many dishes arriving together go out as one frame
+constexpr int kPublishDelayMs = 250;
+constexpr int kMaxRequestBytes = 8 * 1024;
+constexpr int kMaxViewers = 4096;
+// A frame covers the fleet over one publish delay; more than this from one
+// dish only happens after a gap, and the rest is history the viewer can't
+// have needed live
+constexpr uint64_t kMaxFrameSamples = 3600;
+constexpr uint16_t kMaxStringBytes = 1024;
+
+constexpr char kWebSocketGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+enum Opcode : uint8_t {
+    Binary = 0x2,
+    Close = 0x8,
+    Ping = 0x9,
+    Pong = 0xA
+};
+
+template <typename T>
+void put(std::string *out, T value)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "written as raw bytes");
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out->append(bytes, sizeof(T));
+}
+
+void putString(std::string *out, const QString &value)
+{
+    const QByteArray utf8 = value.toUtf8().left(kMaxStringBytes);
+    put<uint16_t>(out, static_cast<uint16_t>(utf8.size()));
+    out->append(utf8.constData(), static_cast<size_t>(utf8.size()));
+}
+
+QByteArray webSocketFrame(uint8_t opcode, const char *payload, size_t size)
+{
+    // Server frames are never masked; FIN is always set
+    QByteArray frame;
+    frame.reserve(static_cast<qsizetype>(size + 10));
+    frame.append(static_cast<char>(0x80 | opcode));
+    if (size < 126) {
+        frame.append(static_cast<char>(size));
+    } else if (size <= 0xFFFF) {
+        frame.append(static_cast<char>(126));
+        frame.append(static_cast<char>(size >> 8));
+        frame.append(static_cast<char>(size & 0xFF));
+    } else {
+        frame.append(static_cast<char>(127));
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            frame.append(static_cast<char>((static_cast<uint64_t>(size) >> shift) & 0xFF));
+        }
+    }
+    frame.append(payload, static_cast<qsizetype>(size));
+    return frame;
+}
+
+QByteArray eventFrame(const char *event, uint32_t revision, const std::string &payload)
+{
+    QByteArray frame("event: ");
+    frame.append(event);
+    frame.append("\nid: ");
+    frame.append(QByteArray::number(static_cast<qint64>(revision)));
+    frame.append("\ndata: ");
+    frame.append(QByteArray::fromRawData(payload.data(), static_cast<qsizetype>(payload.size())).toBase64());
+    frame.append("\n\n");
+    return frame;
+}
+
+// Value of one header, found in the lowercased head but taken from the
+// original, which is the same length
+QByteArray headerValue(const QByteArray &head, const QByteArray &lowered, const char *name)
+{
+    const QByteArray key = QByteArray("\r\n") + name + ':';
+    const qsizetype start = lowered.indexOf(key.constData());
+    if (start < 0) {
+        return QByteArray();
+    }
+    const qsizetype valueStart = start + key.size();
+    qsizetype end = head.indexOf("\r\n", valueStart);
+    if (end < 0) {
+        end = head.size();
+    }
+    return head.mid(valueStart, end - valueStart).trimmed();
+}
+
+}
+
+LiveFeed::LiveFeed(FleetManager *fleet, QObject *parent)
+    : QObject(parent), fleet_(fleet)
+{
+    server_ = new QTcpServer(this);
+    server_->setMaxPendingConnections(64);
+    connect(server_, &QTcpServer::newConnection, this, &LiveFeed::acceptConnections);
+
+    publishTimer_ = new QTimer(this);
+    publishTimer_->setSingleShot(true);
+    publishTimer_->setInterval(kPublishDelayMs);
+    connect(publishTimer_, &QTimer::timeout, this, &LiveFeed::publish);
+
+    connect(fleet_, &FleetManager::targetsChanged, this, &LiveFeed::resetDishes);
+    connect(fleet_, &FleetManager::dishUpdated, this, &LiveFeed::updateDish);
+    resetDishes();
+}
+
+LiveFeed::~LiveFeed()
+{
+}
+
+bool LiveFeed::listen(const QHostAddress &address, quint16 port, QString *error)
+{
+    if (!server_->listen(address, port)) {
+        if (error) {
+            *error = server_->errorString();
+        }
+        return false;
+    }
+    return true;
+}
+
+quint16 LiveFeed::serverPort() const
+{
+    return server_->serverPort();
+}
+
+int LiveFeed::viewerCount() const
+{
+    int viewers = 0;
+    for (const auto &entry : viewers_) {
+        viewers += entry.second.transport != Transport::Http ? 1 : 0;
+    }
+    return viewers;
+}
+
+uint32_t LiveFeed::changedFields(const DishSnapshot &before, const DishSnapshot &after)
+{
+    uint32_t fields = 0;
+    auto compare = [&fields](bool differs, Field field) {
+        if (differs) {
+            fields |= field;
+        }
+    };
+    compare(before.timestampMs != after.timestampMs, TimestampMs);
+    compare(before.connected != after.connected, Connected);
+    compare(before.deviceId != after.deviceId, DeviceId);
+    compare(before.hardwareVersion != after.hardwareVersion, HardwareVersion);
+    compare(before.hasStatus != after.hasStatus, HasStatus);
+    compare(before.dishState != after.dishState, DishState);
+    compare(before.alerts != after.alerts, Alerts);
+    compare(before.currentlyObstructed != after.currentlyObstructed, CurrentlyObstructed);
+    compare(before.fractionObstructed != after.fractionObstructed, FractionObstructed);
+    compare(before.snr != after.snr, Snr);
+    compare(before.hasLocation != after.hasLocation, HasLocation);
+    compare(before.lat != after.lat, Lat);
+    compare(before.lon != after.lon, Lon);
+    compare(before.alt != after.alt, Alt);
+    compare(before.hasSpeed != after.hasSpeed, HasSpeed);
+    compare(before.downloadMbps != after.downloadMbps, DownloadMbps);
+    compare(before.uploadMbps != after.uploadMbps, UploadMbps);
+    compare(before.latencyMs != after.latencyMs, LatencyMs);
+    return fields;
+}
+
+void LiveFeed::resetDishes()
+{
+    publishTimer_->stop();
+    dishes_.assign(fleet_->dishCount(), Dish());
+    for (int i = 0; i < fleet_->dishCount(); ++i) {
+        dishes_[i].published = fleet_->snapshot(i);
+        dishes_[i].sequence = fleet_->client(i)->telemetry().sequence();
+    }
+    ++revision_;
+    snapshotValid_ = false;
+
+    // Indices from before mean nothing, so everyone starts over
+    for (auto &entry : viewers_) {
+        if (entry.second.transport != Transport::Http && !entry.second.behind) {
+            sendSnapshot(entry.first, entry.second);
+        }
+    }
+}
+
+void LiveFeed::updateDish(int index, const DishSnapshot &)
+{
+    // Compared against what was published when the frame goes out, so
+    // several snapshots in one delay cost one record
+    dishes_[index].dirty = true;
+    if (!publishTimer_->isActive()) {
+        publishTimer_->start();
+    }
+}
+
+void LiveFeed::appendHeader(std::string *out, FrameType type, size_t records) const
+{
+    put<uint8_t>(out, type);
+    put<uint8_t>(out, kVersion);
+    put<uint16_t>(out, static_cast<uint16_t>(dishes_.size()));
+    put<uint32_t>(out, revision_);
+    put<uint16_t>(out, static_cast<uint16_t>(records));
+}
+
+void LiveFeed::appendDish(std::string *out, int index, const DishSnapshot &snapshot, uint32_t fields,
+                          uint64_t fromSequence, uint64_t toSequence, bool withTarget) const
+{
+    put<uint16_t>(out, static_cast<uint16_t>(index));
+    if (withTarget) {
+        putString(out, fleet_->client(index)->target());
+    }
+
+    put<uint32_t>(out, fields);
+    for (uint32_t field = 1; field & AllFields; field <<= 1) {
+        if (!(fields & field)) {
+            continue;
+        }
+        switch (field) {
+        case TimestampMs: put<int64_t>(out, snapshot.timestampMs); break;
+        case Connected: put<uint8_t>(out, snapshot.connected); break;
+        case DeviceId: putString(out, snapshot.deviceId); break;
+        case HardwareVersion: putString(out, snapshot.hardwareVersion); break;
+        case HasStatus: put<uint8_t>(out, snapshot.hasStatus); break;
+        case DishState: put<int32_t>(out, snapshot.dishState); break;
+        case Alerts: put<uint32_t>(out, snapshot.alerts); break;
+        case CurrentlyObstructed: put<uint8_t>(out, snapshot.currentlyObstructed); break;
+        case FractionObstructed: put<float>(out, snapshot.fractionObstructed); break;
+        case Snr: put<float>(out, snapshot.snr); break;
+        case HasLocation: put<uint8_t>(out, snapshot.hasLocation); break;
+        case Lat: put<double>(out, snapshot.lat); break;
+        case Lon: put<double>(out, snapshot.lon); break;
+        case Alt: put<double>(out, snapshot.alt); break;
+        case HasSpeed: put<uint8_t>(out, snapshot.hasSpeed); break;
+        case DownloadMbps: put<float>(out, snapshot.downloadMbps); break;
+        case UploadMbps: put<float>(out, snapshot.uploadMbps); break;
+        case LatencyMs: put<float>(out, snapshot.latencyMs); break;
+        }
+    }
+
+    // Only what the store still has, and no more than a frame's worth
+    const TelemetryStore &store = fleet_->client(index)->telemetry();
+    const uint64_t oldest = store.sequence() - store.size();
+    const uint64_t first = std::max({ fromSequence, oldest, toSequence - std::min(toSequence, kMaxFrameSamples) });
+    const uint64_t end = std::max(first, std::min(toSequence, store.sequence()));
+    const size_t count = static_cast<size_t>(end - first);
+    const size_t base = static_cast<size_t>(first - oldest);
+
+    put<uint64_t>(out, first);
+    put<uint16_t>(out, static_cast<uint16_t>(count));
+    for (size_t i = 0; i < count; ++i) {
+        put<int64_t>(out, store.timestampAt(base + i));
+    }
+    for (int m = 0; m < TelemetryStore::MetricCount; ++m) {
+        for (size_t i = 0; i < count; ++i) {
+            put<float>(out, store.valueAt(static_cast<TelemetryStore::Metric>(m), base + i));
+        }
+    }
+    uint8_t bits = 0;
+    for (size_t i = 0; i < count; ++i) {
+        bits |= store.obstructedAt(base + i) ? 1 << (i % 8) : 0;
+        if (i % 8 == 7 || i + 1 == count) {
+            put<uint8_t>(out, bits);
+            bits = 0;
+        }
+    }
+}
+
+void LiveFeed::publish()
+{
+    const bool watched = viewerCount() > 0;
+
+    records_.clear();
+    size_t records = 0;
+    for (size_t i = 0; i < dishes_.size(); ++i) {
+        Dish &dish = dishes_[i];
+        if (!dish.dirty) {
+            continue;
+        }
+        dish.dirty = false;
+
+        const DishSnapshot &current = fleet_->snapshot(static_cast<int>(i));
+        const uint32_t fields = changedFields(dish.published, current);
+        const uint64_t sequence = fleet_->client(static_cast<int>(i))->telemetry().sequence();
+        if (fields == 0 && sequence == dish.sequence) {
+            continue;
+        }
+        // Nobody to tell, but the next subscriber's snapshot must be current
+        if (watched) {
+            appendDish(&records_, static_cast<int>(i), current, fields, dish.sequence, sequence, false);
+        }
+        dish.published = current;
+        dish.sequence = sequence;
+        ++records;
+    }
+    if (records == 0) {
+        return;
+    }
+    ++revision_;
+    snapshotValid_ = false;
+    if (!watched) {
+        return;
+    }
+
+    frame_.clear();
+    appendHeader(&frame_, Delta, records);
+    frame_.append(records_);
+
+    // Encoded at most once per transport, then shared by every socket
+    QByteArray webSocket;
+    QByteArray events;
+    for (auto &entry : viewers_) {
+        Viewer &viewer = entry.second;
+        if (viewer.transport == Transport::Http || viewer.behind) {
+            continue;
+        }
+        QTcpSocket *socket = entry.first;
+        if (socket->bytesToWrite() > kHighWaterBytes) {
+            // Caught up with a snapshot once its queue drains
+            viewer.behind = true;
+            continue;
+        }
+        if (viewer.transport == Transport::WebSocket) {
+            if (webSocket.isEmpty()) {
+                webSocket = webSocketFrame(Binary, frame_.data(), frame_.size());
+            }
+            socket->write(webSocket);
+        } else {
+            if (events.isEmpty()) {
+                events = eventFrame("delta", revision_, frame_);
+            }
+            socket->write(events);
+        }
+    }
+}
+
+void LiveFeed::sendSnapshot(QTcpSocket *socket, const Viewer &viewer)
+{
+    if (!snapshotValid_) {
+        frame_.clear();
+        appendHeader(&frame_, Snapshot, dishes_.size());
+        for (size_t i = 0; i < dishes_.size(); ++i) {
+            const Dish &dish = dishes_[i];
+            const uint64_t from = dish.sequence - std::min<uint64_t>(dish.sequence, kSnapshotSamples);
+            appendDish(&frame_, static_cast<int>(i), dish.published, AllFields, from, dish.sequence, true);
+        }
+        snapshotWebSocket_ = webSocketFrame(Binary, frame_.data(), frame_.size());
+        snapshotEvents_ = eventFrame("snapshot", revision_, frame_);
+        snapshotValid_ = true;
+    }
+    socket->write(viewer.transport == Transport::WebSocket ? snapshotWebSocket_ : snapshotEvents_);
+}
+
+void LiveFeed::acceptConnections()
+{
+    while (QTcpSocket *socket = server_->nextPendingConnection()) {
+        if (viewers_.size() >= static_cast<size_t>(kMaxViewers)) {
+            socket->abort();
+            socket->deleteLater();
+            continue;
+        }
+
+        viewers_.emplace(socket, Viewer());
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+            auto it = viewers_.find(socket);
+            if (it == viewers_.end()) {
+                return;
+            }
+            if (it->second.transport == Transport::Http) {
+                readRequest(socket, &it->second);
+            } else if (it->second.transport == Transport::WebSocket) {
+                readWebSocket(socket, &it->second);
+            } else {
+                socket->readAll();  // an event stream has nothing to say
+            }
+        });
+        connect(socket, &QTcpSocket::bytesWritten, this, [this, socket]() {
+            drained(socket);
+        });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            viewers_.erase(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void LiveFeed::readRequest(QTcpSocket *socket, Viewer *viewer)
+{
+    viewer->buffer.append(socket->readAll());
+    const qsizetype end = viewer->buffer.indexOf("\r\n\r\n");
+    if (end < 0) {
+        if (viewer->buffer.size() > kMaxRequestBytes) {
+            socket->abort();
+        }
+        return;
+    }
+
+    // One request per connection: it either becomes a feed or is refused
+    const QByteArray head = viewer->buffer.left(end + 2);
+    viewer->buffer.clear();
+    const qsizetype lineEnd = head.indexOf("\r\n");
+    const QList<QByteArray> requestLine = head.left(lineEnd).split(' ');
+    if (requestLine.size() != 3 || requestLine[0] != "GET") {
+        socket->write("HTTP/1.1 405 Method Not Allowed\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        socket->disconnectFromHost();
+        return;
+    }
+
+    const QByteArray &path = requestLine[1];
+    const qsizetype query = path.indexOf('?');
+    const QByteArray route = query < 0 ? path : path.left(query);
+    const QByteArray headers = head.mid(lineEnd);
+    const QByteArray lowered = headers.toLower();
+
+    if (route == "/feed" && headerValue(lowered, lowered, "upgrade") == "websocket") {
+        const QByteArray key = headerValue(headers, lowered, "sec-websocket-key");
+        if (key.isEmpty()) {
+            socket->write("HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            socket->disconnectFromHost();
+            return;
+        }
+        const QByteArray accept = QCryptographicHash::hash(key + kWebSocketGuid, QCryptographicHash::Sha1).toBase64();
+        socket->write("HTTP/1.1 101 Switching Protocols\r\n"
+                      "Upgrade: websocket\r\n"
+                      "Connection: Upgrade\r\n"
+                      "Sec-WebSocket-Accept: " + accept + "\r\n\r\n");
+        viewer->transport = Transport::WebSocket;
+        sendSnapshot(socket, *viewer);
+        return;
+    }
+
+    if (route == "/events") {
+        socket->write("HTTP/1.1 200 OK\r\n"
+                      "Content-Type: text/event-stream\r\n"
+                      "Cache-Control: no-cache\r\n\r\n");
+        viewer->transport = Transport::EventStream;
+        sendSnapshot(socket, *viewer);
+        return;
+    }
+
+    socket->write("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    socket->disconnectFromHost();
+}
+
+void LiveFeed::readWebSocket(QTcpSocket *socket, Viewer *viewer)
+{
+    QByteArray &buffer = viewer->buffer;
+    buffer.append(socket->readAll());
+
+    // Browsers only ever send pings and a close here
+    for (;;) {
+        if (buffer.size() < 2) {
+            return;
+        }
+        const auto *bytes = reinterpret_cast<const uint8_t *>(buffer.constData());
+        const uint8_t opcode = bytes[0] & 0x0F;
+        const bool masked = bytes[1] & 0x80;
+        uint64_t length = bytes[1] & 0x7F;
+        qsizetype offset = 2;
+        if (length == 126) {
+            if (buffer.size() < 4) {
+                return;
+            }
+            length = (uint64_t(bytes[2]) << 8) | bytes[3];
+            offset = 4;
+        } else if (length == 127) {
+            if (buffer.size() < 10) {
+                return;
+            }
+            length = 0;
+            for (int i = 0; i < 8; ++i) {
+                length = (length << 8) | bytes[2 + i];
+            }
+            offset = 10;
+        }
+        // Client frames must be masked, and nothing a viewer sends is large
+        if (!masked || length > static_cast<uint64_t>(kMaxRequestBytes)) {
+            socket->abort();
+            return;
+        }
+        if (buffer.size() < offset + 4 + static_cast<qsizetype>(length)) {
+            return;
+        }
+
+        const uint8_t *mask = bytes + offset;
+        QByteArray payload(reinterpret_cast<const char *>(bytes + offset + 4), static_cast<qsizetype>(length));
+        for (qsizetype i = 0; i < payload.size(); ++i) {
+            payload.data()[i] = static_cast<char>(payload.data()[i] ^ mask[i % 4]);
+        }
+        buffer.remove(0, offset + 4 + static_cast<qsizetype>(length));
+
+        if (opcode == Close) {
+            socket->write(webSocketFrame(Close, payload.constData(), std::min<size_t>(payload.size(), 2)));
+            socket->disconnectFromHost();
+            return;
+        }
+        if (opcode == Ping) {
+            socket->write(webSocketFrame(Pong, payload.constData(), static_cast<size_t>(payload.size())));
+        }
+    }
+}
+
+void LiveFeed::drained(QTcpSocket *socket)
+{
+    auto it = viewers_.find(socket);
+    if (it == viewers_.end() || !it->second.behind) {
+        return;
+    }
+    // Well below the high water mark, so one snapshot doesn't put it
+    // straight back
+    if (socket->bytesToWrite() > kHighWaterBytes / 4) {
+        return;
+    }
+    it->second.behind = false;
+    sendSnapshot(socket, it->second);
+}
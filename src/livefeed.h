@@ -0,0 +1,139 @@
+#ifndef LIVEFEED_H
+#define LIVEFEED_H
+
+#include <QByteArray>
+#include <QHostAddress>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "dishsnapshot.h"
+
+class FleetManager;
+class QTcpServer;
+class QTcpSocket;
+
+// Pushes the fleet's state to browsers, over a WebSocket at /feed or as
+// server-sent events at /events.
+//
+// A viewer gets one snapshot frame when it subscribes and delta frames
+// after that. A delta carries, per dish that changed, only the snapshot
+// fields that differ and the history samples stored since the previous
+// frame. Changes are gathered for a moment and each frame is encoded once,
+// then the same buffer goes to every viewer that is keeping up, so viewers
+// never cause any polling and cost little beyond their socket.
+//
+// A viewer with more than kHighWaterBytes still queued gets no deltas. Once
+// its queue has drained it is sent a fresh snapshot instead of everything
+// it missed.
+//
+// Frames are binary and little-endian; SSE sends them base64-encoded. Each
+// starts with the type (1 snapshot, 2 delta), the version, the number of
+// dishes in the fleet as u16 and the frame's revision as u32. Then comes
+// a u16 count of dish records, each of them:
+//
+//   u16 index (snapshot frames follow it with the target: u16 length, UTF-8)
+//   u32 field mask, then each field whose bit is set, in bit order
+//   u64 sequence of the first sample, u16 sample count, then per sample
+//   the i64 timestamp; one f32 column per TelemetryStore metric; and the
+//   obstruction flags as a bitmask of (count + 7) / 8 bytes
+//
+// Strings are a u16 length then UTF-8, flags are u8.
+class LiveFeed : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int kVersion = 1;
+    // History a snapshot includes for each dish, enough to start a sparkline
+    static constexpr int kSnapshotSamples = 60;
+    static constexpr qint64 kHighWaterBytes = 256 * 1024;
+
+    enum FrameType : uint8_t {
+        Snapshot = 1,
+        Delta = 2
+    };
+
+    // Bits of the field mask, which is also the order fields are encoded in
+    enum Field : uint32_t {
+        TimestampMs = 1 << 0,         // i64
+        Connected = 1 << 1,           // flag
+        DeviceId = 1 << 2,            // string
+        HardwareVersion = 1 << 3,     // string
+        HasStatus = 1 << 4,           // flag
+        DishState = 1 << 5,           // i32
+        Alerts = 1 << 6,              // u32
+        CurrentlyObstructed = 1 << 7, // flag
+        FractionObstructed = 1 << 8,  // f32
+        Snr = 1 << 9,                 // f32
+        HasLocation = 1 << 10,        // flag
+        Lat = 1 << 11,                // f64
+        Lon = 1 << 12,                // f64
+        Alt = 1 << 13,                // f64
+        HasSpeed = 1 << 14,           // flag
+        DownloadMbps = 1 << 15,       // f32
+        UploadMbps = 1 << 16,         // f32
+        LatencyMs = 1 << 17,          // f32
+        AllFields = (1 << 18) - 1
+    };
+
+    explicit LiveFeed(FleetManager *fleet, QObject *parent = nullptr);
+    ~LiveFeed();
+
+    bool listen(const QHostAddress &address, quint16 port, QString *error = nullptr);
+    quint16 serverPort() const;
+
+    int viewerCount() const;
+
+    static uint32_t changedFields(const DishSnapshot &before, const DishSnapshot &after);
+
+private slots:
+    void resetDishes();
+    void updateDish(int index, const DishSnapshot &snapshot);
+    void publish();
+    void acceptConnections();
+
+private:
+    enum class Transport { Http, WebSocket, EventStream };
+
+    struct Viewer {
+        Transport transport = Transport::Http;
+        QByteArray buffer;  // request, then incoming WebSocket frames
+        bool behind = false;
+    };
+
+    struct Dish {
+        DishSnapshot published;  // as of the last frame
+        uint64_t sequence = 0;   // first sample the next frame sends
+        bool dirty = false;
+    };
+
+    void readRequest(QTcpSocket *socket, Viewer *viewer);
+    void readWebSocket(QTcpSocket *socket, Viewer *viewer);
+    void drained(QTcpSocket *socket);
+    void sendSnapshot(QTcpSocket *socket, const Viewer &viewer);
+    void appendHeader(std::string *out, FrameType type, size_t records) const;
+    void appendDish(std::string *out, int index, const DishSnapshot &snapshot, uint32_t fields,
+                    uint64_t fromSequence, uint64_t toSequence, bool withTarget) const;
+
+    FleetManager *fleet_;
+    QTcpServer *server_;
+    QTimer *publishTimer_;
+
+    std::vector<Dish> dishes_;
+    uint32_t revision_ = 0;
+    std::string records_;
+    std::string frame_;
+
+    // The current revision's snapshot, in each transport's framing
+    bool snapshotValid_ = false;
+    QByteArray snapshotWebSocket_;
+    QByteArray snapshotEvents_;
+
+    std::unordered_map<QTcpSocket *, Viewer> viewers_;
+};
+
+#endif // LIVEFEED_H
@@ -0,0 +1,257 @@
+#include "logexporter.h"
+#include "historycodec.h"
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+// Column names for CSV, field keys for line protocol
+const char *const kMetricNames[TelemetryStore::MetricCount] = {
+    "downlink_bps",
+    "uplink_bps",
+    "latency_ms",
+    "drop_rate",
+    "snr",
+};
+
+constexpr char kMeasurement[] = "starlink_history";
+
+struct Job {
+    int source;
+    int segment;
+};
+
+struct Chunk {
+    std::string text;
+    size_t records = 0;
+    bool ready = false;
+};
+
+// Tag values escape commas, spaces and equals signs
+std::string lineProtocolTag(const QString &value)
+{
+    std::string escaped;
+    for (char c : value.toStdString()) {
+        if (c == ',' || c == ' ' || c == '=') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+std::string csvField(const QString &value)
+{
+    const std::string raw = value.toStdString();
+    if (raw.find_first_of(",\"\n") == std::string::npos) {
+        return raw;
+    }
+    std::string quoted = "\"";
+    for (char c : raw) {
+        if (c == '"') {
+            quoted += '"';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+void appendFormatted(std::string *text, const char *format, double value)
+{
+    char field[32];
+    const int length = std::snprintf(field, sizeof(field), format, value);
+    text->append(field, static_cast<size_t>(std::max(length, 0)));
+}
+
+}
+
+bool LogExporter::parseFormat(const QString &name, Format *format)
+{
+    if (name == "csv") {
+        *format = Csv;
+        return true;
+    }
+    if (name == "line" || name == "influx") {
+        *format = LineProtocol;
+        return true;
+    }
+    return false;
+}
+
+int LogExporter::threadCount() const
+{
+    if (options_.threads > 0) {
+        return options_.threads;
+    }
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+bool LogExporter::run(const std::vector<Source> &sources, QIODevice *out, QString *error)
+{
+    records_ = 0;
+    bytes_ = 0;
+
+    // Only segments that overlap the range are worth a thread's time
+    std::vector<Job> jobs;
+    for (int source = 0; source < static_cast<int>(sources.size()); ++source) {
+        const QVector<SegmentLog::SegmentInfo> &segments = sources[source].log->segments();
+        for (int segment = 0; segment < segments.size(); ++segment) {
+            const SegmentLog::SegmentInfo &info = segments.at(segment);
+            if (info.count > 0 && info.lastTimestampMs >= options_.fromMs && info.firstTimestampMs <= options_.toMs) {
+                jobs.push_back({ source, segment });
+            }
+        }
+    }
+
+    const auto write = [this, out, error](const std::string &text) {
+        if (text.empty()) {
+            return true;
+        }
+        if (out->write(text.data(), static_cast<qint64>(text.size())) != static_cast<qint64>(text.size())) {
+            if (error) {
+                *error = out->errorString();
+            }
+            return false;
+        }
+        bytes_ += text.size();
+        return true;
+    };
+
+    if (options_.format == Csv) {
+        std::string header = "dish,timestamp_ms";
+        for (const char *name : kMetricNames) {
+            header += ',';
+            header += name;
+        }
+        header += ",obstructed\n";
+        if (!write(header)) {
+            return false;
+        }
+    }
+    if (jobs.empty()) {
+        return true;
+    }
+
+    const size_t depth = static_cast<size_t>(window());
+    std::vector<Chunk> chunks(depth);
+    std::mutex mutex;
+    std::condition_variable changed;
+    size_t nextJob = 0;
+    size_t written = 0;
+    bool cancelled = false;
+
+    // Job j goes into chunk j % depth, which job j - depth has left by the
+    // time j may start
+    const auto work = [&]() {
+        HistoryCodec::DecodedBlock scratch;
+        std::string text;
+        for (;;) {
+            size_t job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&]() { return cancelled || nextJob >= jobs.size() || nextJob < written + depth; });
+                if (cancelled || nextJob >= jobs.size()) {
+                    return;
+                }
+                job = nextJob++;
+            }
+
+            text.clear();
+            const size_t records = format(sources[jobs[job].source], jobs[job].segment, &scratch, &text);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                Chunk &chunk = chunks[job % depth];
+                chunk.text.swap(text);
+                chunk.records = records;
+                chunk.ready = true;
+            }
+            changed.notify_all();
+        }
+    };
+
+    const int threads = std::min(threadCount(), static_cast<int>(jobs.size()));
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back(work);
+    }
+
+    // Swapped with the chunk's buffer, so buffers go round rather than
+    // being freed and allocated once per segment
+    std::string text;
+    bool ok = true;
+    for (size_t job = 0; job < jobs.size() && ok; ++job) {
+        size_t records;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            Chunk &chunk = chunks[job % depth];
+            changed.wait(lock, [&chunk]() { return chunk.ready; });
+            text.swap(chunk.text);
+            records = chunk.records;
+            chunk.ready = false;
+        }
+
+        ok = write(text);
+        records_ += records;
+        text.clear();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++written;
+            cancelled = !ok;
+        }
+        changed.notify_all();
+    }
+
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    return ok;
+}
+
+size_t LogExporter::format(const Source &source, int segment, HistoryCodec::DecodedBlock *scratch,
+                           std::string *text) const
+{
+    const std::string prefix = options_.format == Csv
+        ? csvField(source.name) + ","
+        : std::string(kMeasurement) + ",dish=" + lineProtocolTag(source.name) + " ";
+
+    return source.log->querySegment(segment, options_.fromMs, options_.toMs, [this, &prefix, text](const SegmentLog::Span &span) {
+        text->reserve(text->size() + span.count * (prefix.size() + 128));
+        for (size_t i = span.first; i < span.first + span.count; ++i) {
+            const long long timestampMs = static_cast<long long>(span.timestampAt(i));
+            const bool obstructed = span.obstructedAt(i);
+            text->append(prefix);
+
+            if (options_.format == Csv) {
+                text->append(std::to_string(timestampMs));
+                for (int m = 0; m < TelemetryStore::MetricCount; ++m) {
+                    text->push_back(',');
+                    const float value = span.columns[m][i];
+                    if (!std::isnan(value)) {
+                        appendFormatted(text, "%.7g", value);
+                    }
+                }
+                text->append(obstructed ? ",1\n" : ",0\n");
+                continue;
+            }
+
+            for (int m = 0; m < TelemetryStore::MetricCount; ++m) {
+                const float value = span.columns[m][i];
+                if (std::isnan(value)) {
+                    continue;
+                }
+                text->append(kMetricNames[m]);
+                text->push_back('=');
+                appendFormatted(text, "%.7g", value);
+                text->push_back(',');
+            }
+            text->append(obstructed ? "obstructed=true " : "obstructed=false ");
+            text->append(std::to_string(timestampMs));
+            text->append("000000\n");
+        }
+    }, scratch);
+}
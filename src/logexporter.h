@@ -0,0 +1,73 @@
+#ifndef LOGEXPORTER_H
+#define LOGEXPORTER_H
+
+#include <QIODevice>
+#include <QString>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "segmentlog.h"
+
+// Streams ranges of one or more dishes' SegmentLogs out as text, for
+// reports and offline analysis.
+//
+// Every segment overlapping the range is one job. Worker threads decode
+// and format jobs in parallel, each into a chunk of its own, while the
+// calling thread writes finished chunks out in job order: dish by dish,
+// oldest first. A worker doesn't start a job more than window() jobs ahead
+// of the writer, so however long the range, memory stays at about that
+// many segments' worth of text.
+//
+// CSV has one header line and a dish column; line protocol is InfluxDB's,
+// one starlink_history point per record tagged with the dish, nanosecond
+// timestamps. Metrics missing from a record are left empty in CSV and
+// left out in line protocol.
+class LogExporter
+{
+public:
+    enum Format {
+        Csv,
+        LineProtocol
+    };
+
+    struct Options {
+        Format format = Csv;
+        // Inclusive, in the logs' millisecond timestamps
+        int64_t fromMs = 0;
+        int64_t toMs = 0;
+        // 0 picks one per core
+        int threads = 0;
+    };
+
+    // One dish: its name in the output and its log, opened. Nothing may
+    // append to the logs while an export runs; open them read-only.
+    struct Source {
+        QString name;
+        const SegmentLog *log = nullptr;
+    };
+
+    explicit LogExporter(const Options &options) : options_(options) {}
+
+    static bool parseFormat(const QString &name, Format *format);
+
+    int threadCount() const;
+    // At most this many formatted chunks exist at once
+    int window() const { return 2 * threadCount(); }
+
+    // Stops at the first failed write
+    bool run(const std::vector<Source> &sources, QIODevice *out, QString *error = nullptr);
+
+    // Of the last run
+    size_t records() const { return records_; }
+    size_t bytes() const { return bytes_; }
+
+private:
+    size_t format(const Source &source, int segment, HistoryCodec::DecodedBlock *scratch, std::string *text) const;
+
+    Options options_;
+    size_t records_ = 0;
+    size_t bytes_ = 0;
+};
+
+#endif // LOGEXPORTER_H
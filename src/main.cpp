@@ -1,5 +1,10 @@
+#include "alertengine.h"
+#include "instrumentation.h"
 #include "mainwindow.h"
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QUrl>
 
 int main(int argc, char *argv[])
 {
@@ -13,7 +18,91 @@ int main(int argc, char *argv[])
     // Set application metadata
     a.setQuitOnLastWindowClosed(false);
 
-    MainWindow w;
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption targetsOption("targets", "Monitor every dish listed in <file>, one host:port per line.", "file");
+    QCommandLineOption transportOption("transport", "Talk to dishes with one call per request (unary) or over one stream each (stream; default unary).", "mode", "unary");
+    QCommandLineOption traceOption("trace", "Record internal trace events and write them to <file> as a Chrome trace on exit.", "file");
+    QCommandLineOption alertRulesOption("alert-rules", "Read alert rules from <file> instead of using the built-in ones.", "file");
+    QCommandLineOption webhookOption("webhook", "Also POST every alert as JSON to <url>.", "url");
+    QCommandLineOption speedTestIntervalOption("speedtest-interval", "Have each dish run a speed test about every <hours>, jittered (default never).", "hours");
+    QCommandLineOption speedTestPerSiteOption("speedtest-per-site", "Run at most <count> speed tests at once per site of the targets file (default 1).", "count", "1");
+    parser.addOption(targetsOption);
+    parser.addOption(transportOption);
+    parser.addOption(traceOption);
+    parser.addOption(alertRulesOption);
+    parser.addOption(webhookOption);
+    parser.addOption(speedTestIntervalOption);
+    parser.addOption(speedTestPerSiteOption);
+    parser.process(a);
+
+    if (parser.isSet(traceOption)) {
+        Instrumentation::global().setTracing(true);
+        const QString path = parser.value(traceOption);
+        QObject::connect(&a, &QCoreApplication::aboutToQuit, [path]() {
+            std::string trace;
+            Instrumentation::global().appendChromeTrace(&trace);
+            QFile file(path);
+            if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+                || file.write(trace.data(), static_cast<qint64>(trace.size())) != static_cast<qint64>(trace.size())) {
+                qWarning("Can't write trace to %s: %s", qPrintable(path), qPrintable(file.errorString()));
+            }
+        });
+    }
+
+    StarlinkClient::Transport transport;
+    if (!StarlinkClient::parseTransport(parser.value(transportOption), &transport)) {
+        qCritical("Unknown transport: %s", qPrintable(parser.value(transportOption)));
+        return 1;
+    }
+
+    QStringList targets;
+    QHash<QString, QString> sites;
+    if (parser.isSet(targetsOption)) {
+        QString error;
+        targets = FleetManager::readTargets(parser.value(targetsOption), &error, &sites);
+        if (targets.isEmpty()) {
+            qCritical("No targets in %s: %s", qPrintable(parser.value(targetsOption)),
+                      qPrintable(error.isEmpty() ? QString("file is empty") : error));
+            return 1;
+        }
+    }
+
+    std::vector<AlertRule> alertRules = AlertRule::defaults();
+    if (parser.isSet(alertRulesOption)) {
+        QString error;
+        if (!AlertRule::readFile(parser.value(alertRulesOption), &alertRules, &error)) {
+            qCritical("Bad alert rules in %s: %s", qPrintable(parser.value(alertRulesOption)), qPrintable(error));
+            return 1;
+        }
+    }
+    const QUrl webhook(parser.value(webhookOption));
+    if (parser.isSet(webhookOption) && !webhook.isValid()) {
+        qCritical("Invalid webhook URL: %s", qPrintable(parser.value(webhookOption)));
+        return 1;
+    }
+
+    SpeedTestRunner::Options speedTestOptions;
+    bool speedTestOk = true;
+    if (parser.isSet(speedTestIntervalOption)) {
+        const double hours = parser.value(speedTestIntervalOption).toDouble(&speedTestOk);
+        speedTestOk = speedTestOk && hours > 0.0;
+        speedTestOptions.intervalMs = static_cast<qint64>(hours * 3600.0 * 1000.0);
+    }
+    if (!speedTestOk) {
+        qCritical("Invalid speed test interval: %s", qPrintable(parser.value(speedTestIntervalOption)));
+        return 1;
+    }
+    speedTestOptions.maxPerSite = parser.value(speedTestPerSiteOption).toInt(&speedTestOk);
+    if (!speedTestOk || speedTestOptions.maxPerSite < 1) {
+        qCritical("Invalid speed tests per site: %s", qPrintable(parser.value(speedTestPerSiteOption)));
+        return 1;
+    }
+
+    MainWindow w(targets, alertRules, transport);
+    w.alerts()->setWebhook(webhook);
+    w.speedTests()->setSites(sites);
+    w.speedTests()->setOptions(speedTestOptions);
     // w.show(); // Start hidden in tray
 
     return a.exec();
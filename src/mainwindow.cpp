@@ -1,28 +1,103 @@
 #include "mainwindow.h"
+#include "instrumentation.h"
 #include <QVBoxLayout>
 #include <QCloseEvent>
 #include <QApplication>
 #include <QAction>
 #include <QMessageBox>
+#include <QStandardPaths>
+#include <cmath>
 
-MainWindow::MainWindow(QWidget *parent)
-    : QMainWindow(parent), client_(new StarlinkClient(this))
+MainWindow::MainWindow(const QStringList &targets, const std::vector<AlertRule> &alertRules,
+                       StarlinkClient::Transport transport, QWidget *parent)
+    : QMainWindow(parent)
 {
+    // Clients report through the view model, which decides when the window
+    // and tray actually need touching
+    view_ = new StatusViewModel(this);
+
     createUi();
     createTrayIcon();
 
-    connect(client_, &StarlinkClient::statusChanged, this, &MainWindow::updateStatus);
-    connect(client_, &StarlinkClient::speedUpdated, this, &MainWindow::updateSpeed);
-    connect(client_, &StarlinkClient::locationUpdated, this, &MainWindow::updateLocation);
-    connect(client_, &StarlinkClient::satelliteInfoUpdated, this, &MainWindow::updateSatelliteInfo);
+    connect(view_, &StatusViewModel::linesChanged, this, &MainWindow::updateLines);
+    connect(view_, &StatusViewModel::connectionChanged, this, &MainWindow::updateTrayIcon);
+    connect(view_, &StatusViewModel::toolTipChanged, trayIcon_, &QSystemTrayIcon::setToolTip);
 
-    client_->startMonitoring();
-    
     // Load icons (placeholders for now, will be replaced by generated images)
     connectedIcon_ = QIcon(":/icons/connected.png");
     disconnectedIcon_ = QIcon(":/icons/disconnected.png");
-    
-    updateStatus(false); // Initial state
+
+    alerts_ = new AlertMonitor(alertRules, this);
+    connect(alerts_, &AlertMonitor::alertChanged, this, &MainWindow::showAlert);
+    speedTests_ = new SpeedTestRunner(this);
+    connect(speedTests_, &SpeedTestRunner::testFinished, this, &MainWindow::showSpeedTest);
+
+    if (!targets.isEmpty()) {
+        fleet_ = new FleetManager(this);
+        connect(fleet_, &FleetManager::summaryChanged, view_, &StatusViewModel::setFleetSummary);
+        alerts_->watch(fleet_);
+        speedTests_->watch(fleet_);
+
+        // Per-dish details don't fit a single window
+        locationLabel_->hide();
+        satelliteLabel_->hide();
+        speedLabel_->hide();
+        sparklines_->hide();
+        obstructionMap_->hide();
+        setWindowTitle("Starlink Fleet Monitor");
+
+        // The window starts hidden in the tray
+        fleet_->setStorageDirectory(QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation));
+        fleet_->setTransport(transport);
+        fleet_->setTargets(targets);
+        fleet_->setBackground(true);
+        fleet_->start();
+        return;
+    }
+
+    client_ = new StarlinkClient("192.168.100.1:9200", this);
+    client_->setTransport(transport);
+
+    QString error;
+    const QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+    if (!client_->setLogDirectory(FleetManager::dishDirectory(dataDir, client_->target()), &error)) {
+        qWarning("Not keeping history: %s", qPrintable(error));
+    }
+    sparklines_->setStore(&client_->telemetry());
+
+    connect(client_, &StarlinkClient::statusChanged, view_, &StatusViewModel::setConnected);
+    connect(client_, &StarlinkClient::speedUpdated, view_, &StatusViewModel::setSpeed);
+    connect(client_, &StarlinkClient::locationUpdated, view_, &StatusViewModel::setLocation);
+    connect(client_, &StarlinkClient::satelliteInfoUpdated, view_, &StatusViewModel::setSatelliteInfo);
+    connect(client_, &StarlinkClient::wifiClientConnected, this, &MainWindow::showWifiClientConnected);
+    connect(client_, &StarlinkClient::telemetryAppended, sparklines_, &SparklineWidget::samplesAppended);
+    connect(client_, &StarlinkClient::telemetryReloaded, this, [this]() {
+        sparklines_->setStore(&client_->telemetry());
+    });
+    connect(client_, &StarlinkClient::obstructionMapUpdated, this, &MainWindow::updateObstructionMap);
+    alerts_->watch(client_);
+    speedTests_->watch(client_);
+    burst_ = new TransceiverBurst(client_, this);
+    connect(burst_, &TransceiverBurst::previewUpdated, this, &MainWindow::showBurstPreview);
+    connect(burst_, &TransceiverBurst::finished, this, &MainWindow::showBurstFinished);
+
+    client_->scheduler().setEnabled(PollScheduler::ObstructionMap, true);
+    client_->setBackground(true); // The window starts hidden in the tray
+    client_->startMonitoring();
+
+    view_->setConnected(false); // Initial state
+
+    // Last known values from the state cache, until the dish answers
+    const DishSnapshot &cached = client_->snapshot();
+    if (!cached.deviceId.isEmpty()) {
+        view_->setSatelliteInfo(cached.deviceId, cached.hardwareVersion);
+    }
+    if (cached.hasLocation) {
+        view_->setLocation(cached.lat, cached.lon, cached.alt);
+    }
+    if (cached.hasSpeed) {
+        view_->setSpeed(cached.downloadMbps, cached.uploadMbps, cached.latencyMs);
+    }
 }
 
 MainWindow::~MainWindow()
@@ -34,19 +109,32 @@ void MainWindow::createUi()
     QWidget *centralWidget = new QWidget(this);
     QVBoxLayout *layout = new QVBoxLayout(centralWidget);
 
-    statusLabel_ = new QLabel("Status: Connecting...", this);
-    speedLabel_ = new QLabel("Speed: --", this);
-    locationLabel_ = new QLabel("Location: --", this);
-    satelliteLabel_ = new QLabel("Satellite: --", this);
+    statusLabel_ = new QLabel(view_->text(StatusViewModel::Status), this);
+    speedLabel_ = new QLabel(view_->text(StatusViewModel::Speed), this);
+    sparklines_ = new SparklineWidget(this);
+    locationLabel_ = new QLabel(view_->text(StatusViewModel::Location), this);
+    satelliteLabel_ = new QLabel(view_->text(StatusViewModel::Satellite), this);
+    burstLabel_ = new QLabel(this);
+    burstLabel_->hide();
+    obstructionMap_ = new ObstructionMapWidget(this);
 
     layout->addWidget(statusLabel_);
     layout->addWidget(speedLabel_);
+    layout->addWidget(sparklines_, 1);
     layout->addWidget(locationLabel_);
     layout->addWidget(satelliteLabel_);
+    layout->addWidget(burstLabel_);
+    layout->addWidget(obstructionMap_, 1);
+
+    // Whichever of them paints first shows the latest snapshot
+    QWidget *const snapshotWidgets[] = { statusLabel_, speedLabel_, sparklines_, locationLabel_, satelliteLabel_, obstructionMap_ };
+    for (QWidget *widget : snapshotWidgets) {
+        widget->installEventFilter(this);
+    }
 
     setCentralWidget(centralWidget);
     setWindowTitle("Starlink Monitor");
-    resize(300, 200);
+    resize(320, 560);
 }
 
 void MainWindow::createTrayIcon()
@@ -57,6 +145,28 @@ void MainWindow::createTrayIcon()
     connect(restoreAction, &QAction::triggered, this, &MainWindow::showNormal);
     trayIconMenu_->addAction(restoreAction);
 
+    // Every dish of a fleet, a site's worth at a time
+    QAction *speedTestAction = new QAction("Run speed test", this);
+    connect(speedTestAction, &QAction::triggered, this, [this]() {
+        speedTests_->runAll();
+    });
+    trayIconMenu_->addAction(speedTestAction);
+
+    // A minute of transceiver telemetry at 20 Hz, for one dish only
+    QAction *burstAction = new QAction("Record RF burst", this);
+    connect(burstAction, &QAction::triggered, this, [this]() {
+        if (!burst_) {
+            return;
+        }
+        TransceiverBurst::Options options;
+        options.rateHz = TransceiverBurst::kMaxRateHz;
+        if (burst_->start(options)) {
+            burstLabel_->setText("RF burst: starting");
+            burstLabel_->show();
+        }
+    });
+    trayIconMenu_->addAction(burstAction);
+
     QAction *quitAction = new QAction("Quit", this);
     connect(quitAction, &QAction::triggered, qApp, &QCoreApplication::quit);
     trayIconMenu_->addAction(quitAction);
@@ -69,6 +179,14 @@ void MainWindow::createTrayIcon()
     trayIcon_->show();
 }
 
+bool MainWindow::eventFilter(QObject *watched, QEvent *event)
+{
+    if (event->type() == QEvent::Paint) {
+        Instrumentation::global().painted();
+    }
+    return QMainWindow::eventFilter(watched, event);
+}
+
 void MainWindow::closeEvent(QCloseEvent *event)
 {
     if (trayIcon_->isVisible()) {
@@ -77,6 +195,31 @@ void MainWindow::closeEvent(QCloseEvent *event)
     }
 }
 
+// Polling drops to its background rate while the window sits in the tray
+void MainWindow::showEvent(QShowEvent *event)
+{
+    QMainWindow::showEvent(event);
+    view_->setVisible(true);
+    if (client_) {
+        client_->setBackground(false);
+    }
+    if (fleet_) {
+        fleet_->setBackground(false);
+    }
+}
+
+void MainWindow::hideEvent(QHideEvent *event)
+{
+    QMainWindow::hideEvent(event);
+    view_->setVisible(false);
+    if (client_) {
+        client_->setBackground(true);
+    }
+    if (fleet_) {
+        fleet_->setBackground(true);
+    }
+}
+
 void MainWindow::onTrayIconActivated(QSystemTrayIcon::ActivationReason reason)
 {
     if (reason == QSystemTrayIcon::Trigger || reason == QSystemTrayIcon::DoubleClick) {
@@ -89,36 +232,91 @@ void MainWindow::onTrayIconActivated(QSystemTrayIcon::ActivationReason reason)
     }
 }
 
-void MainWindow::updateStatus(bool connected)
+void MainWindow::updateLines(StatusViewModel::LineMask lines)
 {
-    if (connected) {
-        statusLabel_->setText("Status: Connected");
-        trayIcon_->setIcon(connectedIcon_);
-        trayIcon_->setToolTip("Starlink: Connected");
-    } else {
-        statusLabel_->setText("Status: Disconnected");
-        trayIcon_->setIcon(disconnectedIcon_);
-        trayIcon_->setToolTip("Starlink: Disconnected");
+    QLabel *const labels[StatusViewModel::LineCount] = { statusLabel_, speedLabel_, locationLabel_, satelliteLabel_ };
+    for (int i = 0; i < StatusViewModel::LineCount; ++i) {
+        if (lines & StatusViewModel::bit(static_cast<StatusViewModel::Line>(i))) {
+            labels[i]->setText(view_->text(static_cast<StatusViewModel::Line>(i)));
+        }
     }
 }
 
-void MainWindow::updateSpeed(float downloadMbps, float uploadMbps, float latencyMs)
+void MainWindow::updateTrayIcon(bool connected)
+{
+    trayIcon_->setIcon(connected ? connectedIcon_ : disconnectedIcon_);
+}
+
+void MainWindow::updateObstructionMap(int firstRow, int rowCount)
 {
-    speedLabel_->setText(QString("Down: %1 Mbps | Up: %2 Mbps | Ping: %3 ms")
-                         .arg(downloadMbps, 0, 'f', 1)
-                         .arg(uploadMbps, 0, 'f', 1)
-                         .arg(latencyMs, 0, 'f', 0));
+    obstructionMap_->updateMap(client_->obstructionMap(), firstRow, rowCount);
 }
 
-void MainWindow::updateLocation(double lat, double lon, double alt)
+void MainWindow::showWifiClientConnected(const QString &name, const QString &macAddress, const QString &ipAddress)
 {
-    locationLabel_->setText(QString("Lat: %1 | Lon: %2 | Alt: %3 m")
-                            .arg(lat, 0, 'f', 4)
-                            .arg(lon, 0, 'f', 4)
-                            .arg(alt, 0, 'f', 1));
+    trayIcon_->showMessage("Starlink: New Wi-Fi client",
+                           QString("%1 (%2, %3)").arg(name.isEmpty() ? macAddress : name).arg(ipAddress).arg(macAddress));
+}
+
+void MainWindow::showAlert(const AlertMonitor::Alert &alert)
+{
+    // Which dish only matters when there is more than one
+    QString title = QString("Starlink: %1 %2").arg(alert.rule).arg(alert.firing ? "firing" : "cleared");
+    if (fleet_) {
+        title += QString(" on %1").arg(alert.target);
+    }
+    trayIcon_->showMessage(title, QString("%1 (now %2)").arg(alert.condition).arg(alert.value, 0, 'g', 3));
 }
 
-void MainWindow::updateSatelliteInfo(const QString &id, const QString &hardwareVersion)
+void MainWindow::showSpeedTest(const QString &target, bool ok, const SpeedTestResult &result,
+                               float passiveDownlinkMbps, const QString &error)
 {
-    satelliteLabel_->setText(QString("ID: %1 | HW: %2").arg(id).arg(hardwareVersion));
+    QString title = QString("Starlink: Speed test %1").arg(ok ? "finished" : "failed");
+    if (fleet_) {
+        title += QString(" on %1").arg(target);
+    }
+    if (!ok) {
+        trayIcon_->showMessage(title, error);
+        return;
+    }
+
+    QString message = QString("%1 Mbps down, %2 Mbps up, %3 ms")
+        .arg(result.downloadMbps, 0, 'f', 1).arg(result.uploadMbps, 0, 'f', 1).arg(result.latencyMs, 0, 'f', 0);
+    // What the dish reported moving meanwhile, test traffic included
+    if (!std::isnan(passiveDownlinkMbps)) {
+        message += QString("\nHistory meanwhile: %1 Mbps down").arg(passiveDownlinkMbps, 0, 'f', 1);
+    }
+    trayIcon_->showMessage(title, message);
+}
+
+void MainWindow::showBurstPreview(const TransceiverBurst::Preview &preview)
+{
+    QString text = QString("RF burst: %1/%2 samples").arg(static_cast<qint64>(preview.samples))
+                       .arg(static_cast<qint64>(preview.capacity));
+    if (!std::isnan(preview.snrMeanDb)) {
+        text += QString(", SNR %1 dB (%2 to %3)").arg(preview.snrMeanDb, 0, 'f', 1)
+                    .arg(preview.snrMinDb, 0, 'f', 1).arg(preview.snrMaxDb, 0, 'f', 1);
+    }
+    if (!std::isnan(preview.rssiDb)) {
+        text += QString(", RSSI %1 dB").arg(preview.rssiDb, 0, 'f', 1);
+    }
+    if (preview.satelliteId != 0) {
+        text += QString(", satellite %1").arg(static_cast<qint64>(preview.satelliteId));
+    }
+    burstLabel_->setText(text);
+}
+
+void MainWindow::showBurstFinished(int samples, const QString &path, const QString &error)
+{
+    burstLabel_->hide();
+    QString message = QString("%1 samples").arg(samples);
+    if (!path.isEmpty()) {
+        message += QString(" written to %1").arg(path);
+    } else if (!error.isEmpty()) {
+        message += QString(", not written: %1").arg(error);
+    }
+    if (burst_->missed() > 0 || burst_->failed() > 0) {
+        message += QString("\n%1 ticks missed, %2 requests failed").arg(burst_->missed()).arg(burst_->failed());
+    }
+    trayIcon_->showMessage("Starlink: RF burst finished", message);
 }
@@ -5,38 +5,72 @@
 #include <QSystemTrayIcon>
 #include <QLabel>
 #include <QMenu>
+#include <QStringList>
+#include <vector>
+#include "alertmonitor.h"
+#include "fleetmanager.h"
+#include "obstructionmapwidget.h"
+#include "sparklinewidget.h"
+#include "speedtestrunner.h"
 #include "starlinkclient.h"
+#include "statusviewmodel.h"
+#include "transceiverburst.h"
 
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
 
 public:
-    MainWindow(QWidget *parent = nullptr);
+    // With no targets the window monitors the default dish; otherwise it
+    // shows a summary for the whole fleet. Alerts show up as tray messages.
+    explicit MainWindow(const QStringList &targets = QStringList(),
+                        const std::vector<AlertRule> &alertRules = AlertRule::defaults(),
+                        StarlinkClient::Transport transport = StarlinkClient::Transport::Unary,
+                        QWidget *parent = nullptr);
     ~MainWindow();
 
+    AlertMonitor *alerts() const { return alerts_; }
+    // Runs on demand from the tray; scheduling is up to the caller
+    SpeedTestRunner *speedTests() const { return speedTests_; }
+
 protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
     void closeEvent(QCloseEvent *event) override;
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
 
 private slots:
-    void updateStatus(bool connected);
-    void updateSpeed(float downloadMbps, float uploadMbps, float latencyMs);
-    void updateLocation(double lat, double lon, double alt);
-    void updateSatelliteInfo(const QString &id, const QString &hardwareVersion);
+    void updateLines(StatusViewModel::LineMask lines);
+    void updateTrayIcon(bool connected);
+    void updateObstructionMap(int firstRow, int rowCount);
+    void showWifiClientConnected(const QString &name, const QString &macAddress, const QString &ipAddress);
+    void showAlert(const AlertMonitor::Alert &alert);
+    void showSpeedTest(const QString &target, bool ok, const SpeedTestResult &result,
+                       float passiveDownlinkMbps, const QString &error);
+    void showBurstPreview(const TransceiverBurst::Preview &preview);
+    void showBurstFinished(int samples, const QString &path, const QString &error);
     void onTrayIconActivated(QSystemTrayIcon::ActivationReason reason);
 
 private:
     void createTrayIcon();
     void createUi();
 
-    StarlinkClient *client_;
+    StarlinkClient *client_ = nullptr;
+    FleetManager *fleet_ = nullptr;
+    AlertMonitor *alerts_;
+    SpeedTestRunner *speedTests_;
+    TransceiverBurst *burst_ = nullptr;
+    StatusViewModel *view_;
     QSystemTrayIcon *trayIcon_;
     QMenu *trayIconMenu_;
 
     QLabel *statusLabel_;
     QLabel *speedLabel_;
+    SparklineWidget *sparklines_;
     QLabel *locationLabel_;
     QLabel *satelliteLabel_;
+    QLabel *burstLabel_;
+    ObstructionMapWidget *obstructionMap_;
     
     QIcon connectedIcon_;
     QIcon disconnectedIcon_;
@@ -0,0 +1,449 @@
+#include "metricsexporter.h"
+#include "dishsnapshot.h"
+#include "fleetmanager.h"
+#include "instrumentation.h"
+#include "telemetrystore.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+// Changes from many dishes arriving together become one rebuild
+constexpr int kRebuildDelayMs = 200;
+constexpr int kMaxRequestBytes = 8 * 1024;
+constexpr int kMaxConnections = 64;
+
+constexpr char kConnection[] = "connection:";
+constexpr qsizetype kConnectionLength = sizeof(kConnection) - 1;
+
+struct FamilyInfo {
+    const char *name;
+    const char *type;
+    const char *help;
+};
+
+const FamilyInfo kFamilies[MetricsExporter::FamilyCount] = {
+    { "starlink_up", "gauge", "Whether the dish answered its last poll." },
+    { "starlink_dish_info", "gauge", "Dish identity; always 1." },
+    { "starlink_downlink_throughput_bps", "gauge", "Mean downlink throughput over the last poll interval." },
+    { "starlink_uplink_throughput_bps", "gauge", "Mean uplink throughput over the last poll interval." },
+    { "starlink_pop_ping_latency_ms", "summary", "PoP ping latency over the last 15 minutes." },
+    { "starlink_pop_ping_drop_rate", "summary", "PoP ping drop rate over the last 15 minutes." },
+    { "starlink_snr", "gauge", "Signal to noise ratio reported by get_status." },
+    { "starlink_obstruction_fraction", "gauge", "Fraction of the sky view that is obstructed." },
+    { "starlink_currently_obstructed", "gauge", "Whether the dish is obstructed right now." },
+    { "starlink_alert", "gauge", "Active dish alerts, one series per alert." },
+    { "starlink_history_samples_total", "counter", "History samples collected since the monitor started." },
+    { "starlink_speedtest_download_bps", "gauge", "Download throughput measured by the dish's last speed test." },
+    { "starlink_speedtest_upload_bps", "gauge", "Upload throughput measured by the dish's last speed test." },
+    { "starlink_speedtest_latency_ms", "gauge", "Latency measured by the dish's last speed test." },
+};
+
+const std::pair<unsigned, const char *> kAlerts[] = {
+    { DishSnapshot::MotorsStuck, "motors_stuck" },
+    { DishSnapshot::ThermalThrottle, "thermal_throttle" },
+    { DishSnapshot::ThermalShutdown, "thermal_shutdown" },
+    { DishSnapshot::MastNotNearVertical, "mast_not_near_vertical" },
+    { DishSnapshot::UnexpectedLocation, "unexpected_location" },
+    { DishSnapshot::SlowEthernetSpeeds, "slow_ethernet_speeds" },
+};
+
+// Whether [begin, end) is exactly text
+bool spanIs(const char *begin, const char *end, const char *text, bool caseSensitive)
+{
+    const size_t length = std::strlen(text);
+    if (static_cast<size_t>(end - begin) != length) {
+        return false;
+    }
+    return caseSensitive ? std::memcmp(begin, text, length) == 0 : qstrnicmp(begin, text, length) == 0;
+}
+
+void appendLabelValue(std::string *out, const QString &value)
+{
+    const QByteArray utf8 = value.toUtf8();
+    for (char c : utf8) {
+        switch (c) {
+        case '\\': out->append("\\\\"); break;
+        case '"': out->append("\\\""); break;
+        case '\n': out->append("\\n"); break;
+        default: out->push_back(c); break;
+        }
+    }
+}
+
+// name{labels,extra} value
+void appendSample(std::string *out, const char *name, const char *suffix,
+                  const std::string &labels, const char *extra, double value)
+{
+    char number[32];
+    std::snprintf(number, sizeof(number), "%.6g", value);
+
+    out->append(name);
+    out->append(suffix);
+    out->push_back('{');
+    out->append(labels);
+    if (extra) {
+        if (!labels.empty()) {
+            out->push_back(',');
+        }
+        out->append(extra);
+    }
+    out->append("} ");
+    out->append(number);
+    out->push_back('\n');
+}
+
+void appendLatencySummary(std::string *out, const char *name, const std::string &labels,
+                          const LatencyHistogram &histogram)
+{
+    LatencyHistogram::Snapshot snapshot;
+    histogram.snapshot(&snapshot);
+    if (snapshot.count == 0) {
+        return;
+    }
+
+    static const std::pair<double, const char *> kQuantiles[] = {
+        { 0.5, "quantile=\"0.5\"" },
+        { 0.9, "quantile=\"0.9\"" },
+        { 0.99, "quantile=\"0.99\"" },
+        { 0.999, "quantile=\"0.999\"" },
+    };
+    for (const auto &quantile : kQuantiles) {
+        appendSample(out, name, "", labels, quantile.second, snapshot.quantile(quantile.first) * 1e-9);
+    }
+    appendSample(out, name, "_sum", labels, nullptr, static_cast<double>(snapshot.sumNs) * 1e-9);
+    appendSample(out, name, "_count", labels, nullptr, static_cast<double>(snapshot.count));
+}
+
+// The monitor's own timings, from Instrumentation
+void appendInstrumentation(std::string *out)
+{
+    const Instrumentation &instrumentation = Instrumentation::global();
+
+    out->append("# HELP starlink_client_stage_seconds Time spent per request kind and stage of a poll.\n"
+                "# TYPE starlink_client_stage_seconds summary\n");
+    std::string labels;
+    for (int r = 0; r < PollScheduler::RequestCount; ++r) {
+        const auto request = static_cast<PollScheduler::Request>(r);
+        for (int s = 0; s < Instrumentation::StageCount; ++s) {
+            const auto stage = static_cast<Instrumentation::Stage>(s);
+            labels = "request=\"";
+            labels.append(Instrumentation::requestName(request));
+            labels.append("\",stage=\"");
+            labels.append(Instrumentation::stageName(stage));
+            labels.push_back('"');
+            appendLatencySummary(out, "starlink_client_stage_seconds", labels,
+                                 instrumentation.histogram(request, stage));
+        }
+    }
+
+    out->append("# HELP starlink_snapshot_paint_seconds Time from a snapshot going out to the window painting it.\n"
+                "# TYPE starlink_snapshot_paint_seconds summary\n");
+    appendLatencySummary(out, "starlink_snapshot_paint_seconds", std::string(), instrumentation.paintHistogram());
+}
+
+void appendSummary(std::string *out, const char *name, const std::string &labels,
+                   const TelemetryStore::Aggregate &aggregate)
+{
+    if (aggregate.count == 0) {
+        return;
+    }
+    appendSample(out, name, "", labels, "quantile=\"0.5\"", aggregate.p50);
+    appendSample(out, name, "", labels, "quantile=\"0.95\"", aggregate.p95);
+    appendSample(out, name, "", labels, "quantile=\"0.99\"", aggregate.p99);
+    appendSample(out, name, "_sum", labels, nullptr, static_cast<double>(aggregate.mean) * aggregate.count);
+    appendSample(out, name, "_count", labels, nullptr, aggregate.count);
+}
+
+}
+
+MetricsExporter::MetricsExporter(FleetManager *fleet, QObject *parent)
+    : QObject(parent), fleet_(fleet)
+{
+    server_ = new QTcpServer(this);
+    server_->setMaxPendingConnections(kMaxConnections);
+    connect(server_, &QTcpServer::newConnection, this, &MetricsExporter::acceptConnections);
+
+    rebuildTimer_ = new QTimer(this);
+    rebuildTimer_->setSingleShot(true);
+    rebuildTimer_->setInterval(kRebuildDelayMs);
+    connect(rebuildTimer_, &QTimer::timeout, this, &MetricsExporter::rebuildBody);
+
+    connect(fleet_, &FleetManager::targetsChanged, this, &MetricsExporter::resetDishes);
+    connect(fleet_, &FleetManager::dishUpdated, this, &MetricsExporter::updateDish);
+    resetDishes();
+}
+
+MetricsExporter::~MetricsExporter()
+{
+}
+
+bool MetricsExporter::listen(const QHostAddress &address, quint16 port, QString *error)
+{
+    if (!server_->listen(address, port)) {
+        if (error) {
+            *error = server_->errorString();
+        }
+        return false;
+    }
+    return true;
+}
+
+quint16 MetricsExporter::serverPort() const
+{
+    return server_->serverPort();
+}
+
+void MetricsExporter::resetDishes()
+{
+    dishes_.assign(fleet_->dishCount(), DishLines());
+    for (int i = 0; i < fleet_->dishCount(); ++i) {
+        DishLines &dish = dishes_[i];
+        dish.labels = "dish=\"";
+        appendLabelValue(&dish.labels, fleet_->client(i)->target());
+        dish.labels.push_back('"');
+        renderDish(i, fleet_->snapshot(i));
+    }
+    rebuildBody();
+}
+
+void MetricsExporter::updateDish(int index, const DishSnapshot &snapshot)
+{
+    renderDish(index, snapshot);
+    if (!rebuildTimer_->isActive()) {
+        rebuildTimer_->start();
+    }
+}
+
+void MetricsExporter::renderDish(int index, const DishSnapshot &snapshot)
+{
+    DishLines &dish = dishes_[index];
+    const std::string &labels = dish.labels;
+    for (std::string &lines : dish.families) {
+        lines.clear();  // keeps its capacity for the next render
+    }
+
+    appendSample(&dish.families[Up], kFamilies[Up].name, "", labels, nullptr, snapshot.connected ? 1 : 0);
+    if (!snapshot.deviceId.isEmpty()) {
+        std::string info = labels;
+        info.append(",id=\"");
+        appendLabelValue(&info, snapshot.deviceId);
+        info.append("\",hardware_version=\"");
+        appendLabelValue(&info, snapshot.hardwareVersion);
+        info.push_back('"');
+        appendSample(&dish.families[Info], kFamilies[Info].name, "", info, nullptr, 1);
+    }
+
+    // A dish that isn't answering has no current values to report
+    if (!snapshot.connected) {
+        return;
+    }
+
+    if (snapshot.hasSpeed) {
+        appendSample(&dish.families[DownlinkThroughput], kFamilies[DownlinkThroughput].name, "", labels,
+                     nullptr, static_cast<double>(snapshot.downloadMbps) * 1e6);
+        appendSample(&dish.families[UplinkThroughput], kFamilies[UplinkThroughput].name, "", labels,
+                     nullptr, static_cast<double>(snapshot.uploadMbps) * 1e6);
+    }
+
+    const TelemetryStore &telemetry = fleet_->client(index)->telemetry();
+    appendSummary(&dish.families[PopPingLatency], kFamilies[PopPingLatency].name, labels,
+                  telemetry.aggregate(TelemetryStore::Latency, TelemetryStore::FifteenMinutes));
+    appendSummary(&dish.families[PopPingDropRate], kFamilies[PopPingDropRate].name, labels,
+                  telemetry.aggregate(TelemetryStore::DropRate, TelemetryStore::FifteenMinutes));
+    appendSample(&dish.families[HistorySamples], kFamilies[HistorySamples].name, "", labels,
+                 nullptr, static_cast<double>(telemetry.sequence()));
+
+    if (telemetry.speedTestCount() > 0) {
+        const SpeedTestResult &test = telemetry.speedTestAt(telemetry.speedTestCount() - 1);
+        appendSample(&dish.families[SpeedTestDownload], kFamilies[SpeedTestDownload].name, "", labels,
+                     nullptr, static_cast<double>(test.downloadMbps) * 1e6);
+        appendSample(&dish.families[SpeedTestUpload], kFamilies[SpeedTestUpload].name, "", labels,
+                     nullptr, static_cast<double>(test.uploadMbps) * 1e6);
+        appendSample(&dish.families[SpeedTestLatency], kFamilies[SpeedTestLatency].name, "", labels,
+                     nullptr, test.latencyMs);
+    }
+
+    if (snapshot.hasStatus) {
+        appendSample(&dish.families[Snr], kFamilies[Snr].name, "", labels, nullptr, snapshot.snr);
+        appendSample(&dish.families[FractionObstructed], kFamilies[FractionObstructed].name, "", labels,
+                     nullptr, snapshot.fractionObstructed);
+        appendSample(&dish.families[CurrentlyObstructed], kFamilies[CurrentlyObstructed].name, "", labels,
+                     nullptr, snapshot.currentlyObstructed ? 1 : 0);
+
+        char alertLabel[64];
+        for (const auto &alert : kAlerts) {
+            std::snprintf(alertLabel, sizeof(alertLabel), "alert=\"%s\"", alert.second);
+            appendSample(&dish.families[Alert], kFamilies[Alert].name, "", labels, alertLabel,
+                         (snapshot.alerts & alert.first) ? 1 : 0);
+        }
+    }
+}
+
+void MetricsExporter::rebuildBody()
+{
+    // The text format wants each family's samples together, so the body is
+    // family-major even though the lines are kept per dish
+    size_t size = 0;
+    for (const DishLines &dish : dishes_) {
+        for (const std::string &lines : dish.families) {
+            size += lines.size();
+        }
+    }
+
+    // Timings move on every poll, so they are rendered on every rebuild
+    std::string timings;
+    appendInstrumentation(&timings);
+
+    // A fresh buffer each time: responses still being written keep the old one
+    QByteArray body;
+    body.reserve(static_cast<qsizetype>(size + timings.size()) + FamilyCount * 128);
+    for (int f = 0; f < FamilyCount; ++f) {
+        body.append("# HELP ").append(kFamilies[f].name).append(' ').append(kFamilies[f].help).append('\n');
+        body.append("# TYPE ").append(kFamilies[f].name).append(' ').append(kFamilies[f].type).append('\n');
+        for (const DishLines &dish : dishes_) {
+            body.append(dish.families[f].data(), static_cast<qsizetype>(dish.families[f].size()));
+        }
+    }
+    body.append(timings.data(), static_cast<qsizetype>(timings.size()));
+    body_ = body;
+
+    char header[160];
+    const int length = std::snprintf(header, sizeof(header),
+                                     "HTTP/1.1 200 OK\r\n"
+                                     "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                                     "Content-Length: %lld\r\n\r\n",
+                                     static_cast<long long>(body_.size()));
+    header_ = QByteArray(header, length);
+}
+
+void MetricsExporter::acceptConnections()
+{
+    while (QTcpSocket *socket = server_->nextPendingConnection()) {
+        if (requests_.size() >= kMaxConnections) {
+            socket->abort();
+            socket->deleteLater();
+            continue;
+        }
+
+        requests_.insert(socket, QByteArray());
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+            readRequests(socket);
+        });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            requests_.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void MetricsExporter::readRequests(QTcpSocket *socket)
+{
+    // Read straight into the connection's buffer, whose capacity survives
+    // from one request to the next
+    QByteArray &buffer = requests_[socket];
+    const qsizetype previous = buffer.size();
+    const qint64 available = socket->bytesAvailable();
+    buffer.resize(previous + available);
+    buffer.resize(previous + std::max<qint64>(socket->read(buffer.data() + previous, available), 0));
+
+    // Handles keep-alive and pipelined requests; bodies are never expected.
+    // Everything is parsed where it lies in the buffer.
+    for (;;) {
+        const qsizetype end = buffer.indexOf("\r\n\r\n");
+        if (end < 0) {
+            if (buffer.size() > kMaxRequestBytes) {
+                socket->abort();
+            }
+            return;
+        }
+
+        const char *head = buffer.constData();
+        const qsizetype lineEnd = buffer.indexOf("\r\n");
+        const char *methodEnd = static_cast<const char *>(std::memchr(head, ' ', lineEnd));
+        const char *target = methodEnd ? methodEnd + 1 : nullptr;
+        const char *targetEnd = target
+            ? static_cast<const char *>(std::memchr(target, ' ', head + lineEnd - target))
+            : nullptr;
+        const char *version = targetEnd ? targetEnd + 1 : nullptr;
+        if (!version || std::memchr(version, ' ', head + lineEnd - version)) {
+            socket->abort();
+            return;
+        }
+
+        bool closeRequested = false;
+        bool keepAliveRequested = false;
+        for (qsizetype at = lineEnd + 2; at < end;) {
+            qsizetype next = buffer.indexOf("\r\n", at);
+            if (next < 0 || next > end) {
+                next = end;
+            }
+            if (next - at >= kConnectionLength && qstrnicmp(head + at, kConnection, kConnectionLength) == 0) {
+                const char *value = head + at + kConnectionLength;
+                const char *valueEnd = head + next;
+                while (value < valueEnd && (*value == ' ' || *value == '\t')) {
+                    ++value;
+                }
+                while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t')) {
+                    --valueEnd;
+                }
+                closeRequested = spanIs(value, valueEnd, "close", false);
+                keepAliveRequested = spanIs(value, valueEnd, "keep-alive", false);
+            }
+            at = next + 2;
+        }
+        const bool keepAlive = spanIs(version, head + lineEnd, "HTTP/1.1", true)
+            ? !closeRequested
+            : keepAliveRequested;
+
+        const bool get = spanIs(head, methodEnd, "GET", true);
+        if (!get && !spanIs(head, methodEnd, "HEAD", true)) {
+            socket->write("HTTP/1.1 405 Method Not Allowed\r\nContent-Length: 0\r\n\r\n");
+            socket->disconnectFromHost();
+            return;
+        }
+        respond(socket, !get, target, targetEnd);
+        if (!keepAlive) {
+            socket->disconnectFromHost();
+            return;
+        }
+        buffer.remove(0, end + 4);
+    }
+}
+
+void MetricsExporter::respond(QTcpSocket *socket, bool headOnly, const char *path, const char *pathEnd)
+{
+    const char *query = static_cast<const char *>(std::memchr(path, '?', pathEnd - path));
+    const char *routeEnd = query ? query : pathEnd;
+
+    // Rare and potentially megabytes, so rendered on demand
+    if (spanIs(path, routeEnd, "/trace", true) && Instrumentation::global().isTracing()) {
+        std::string trace;
+        Instrumentation::global().appendChromeTrace(&trace);
+        char header[128];
+        const int length = std::snprintf(header, sizeof(header),
+                                         "HTTP/1.1 200 OK\r\n"
+                                         "Content-Type: application/json\r\n"
+                                         "Content-Length: %zu\r\n\r\n",
+                                         trace.size());
+        socket->write(header, length);
+        if (!headOnly) {
+            socket->write(trace.data(), static_cast<qint64>(trace.size()));
+        }
+        return;
+    }
+
+    if (!spanIs(path, routeEnd, "/metrics", true)) {
+        socket->write("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+        return;
+    }
+
+    // Both buffers are shared with the socket rather than copied
+    socket->write(header_);
+    if (!headOnly) {
+        socket->write(body_);
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef METRICSEXPORTER_H
+#define METRICSEXPORTER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QHostAddress>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <array>
+#include <string>
+#include <vector>
+
+class FleetManager;
+class QTcpServer;
+class QTcpSocket;
+struct DishSnapshot;
+
+// Serves the fleet's state in Prometheus text format at /metrics.
+//
+// Scrapes never format anything. Each dish keeps its sample lines
+// preformatted, one buffer per metric family, re-rendered only when that
+// dish reports a new snapshot. Shortly after a change the lines are stitched
+// into one response body together with its HTTP header. A scrape then just
+// hands those two implicitly shared buffers to the socket, so it costs no
+// allocation or copying however many dishes there are.
+//
+// The body also carries the monitor's own per-request timings. With
+// tracing turned on, /trace returns the latest Instrumentation events as a
+// Chrome trace that chrome://tracing and Perfetto open directly.
+class MetricsExporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MetricsExporter(FleetManager *fleet, QObject *parent = nullptr);
+    ~MetricsExporter();
+
+    bool listen(const QHostAddress &address, quint16 port, QString *error = nullptr);
+    quint16 serverPort() const;
+
+    enum Family {
+        Up,
+        Info,
+        DownlinkThroughput,
+        UplinkThroughput,
+        PopPingLatency,
+        PopPingDropRate,
+        Snr,
+        FractionObstructed,
+        CurrentlyObstructed,
+        Alert,
+        HistorySamples,
+        SpeedTestDownload,
+        SpeedTestUpload,
+        SpeedTestLatency,
+        FamilyCount
+    };
+
+private slots:
+    void resetDishes();
+    void updateDish(int index, const DishSnapshot &snapshot);
+    void rebuildBody();
+    void acceptConnections();
+
+private:
+    struct DishLines {
+        std::string labels;  // dish="host:port"
+        std::array<std::string, FamilyCount> families;
+    };
+
+    void renderDish(int index, const DishSnapshot &snapshot);
+    void readRequests(QTcpSocket *socket);
+    void respond(QTcpSocket *socket, bool headOnly, const char *path, const char *pathEnd);
+
+    FleetManager *fleet_;
+    QTcpServer *server_;
+    QTimer *rebuildTimer_;
+
+    std::vector<DishLines> dishes_;
+    QByteArray header_;
+    QByteArray body_;
+    QHash<QTcpSocket *, QByteArray> requests_;
+};
+
+#endif // METRICSEXPORTER_H
@@ -0,0 +1,305 @@
+#include "alertmonitor.h"
+#include "fleetmanager.h"
+#include "instrumentation.h"
+#include "linkcorrelator.h"
+#include "livefeed.h"
+#include "metricsexporter.h"
+#include "outagemonitor.h"
+#include "routerclient.h"
+#include "speedtestrunner.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QTimer>
+#include <QUrl>
+#include <memory>
+
+namespace {
+
+// How often, and over how much history, router loss is held against the
+// dish's
+constexpr qint64 kCorrelationWindowMs = 15 * 60 * 1000;
+
+}
+
+#ifdef Q_OS_UNIX
+#include <QSocketNotifier>
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+int signalFds[2] = { -1, -1 };
+
+void handleSignal(int)
+{
+    // Only async-signal-safe calls here; the event loop does the rest
+    const char byte = 0;
+    (void)!::write(signalFds[0], &byte, 1);
+}
+
+// SIGINT/SIGTERM quit through the event loop, so clients shut down cleanly
+void quitOnSignals(QCoreApplication *app)
+{
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, signalFds) != 0) {
+        qWarning("socketpair failed; signals will not shut down cleanly");
+        return;
+    }
+
+    auto *notifier = new QSocketNotifier(signalFds[1], QSocketNotifier::Read, app);
+    QObject::connect(notifier, &QSocketNotifier::activated, app, [app]() {
+        char byte;
+        (void)!::read(signalFds[1], &byte, 1);
+        app->quit();
+    });
+
+    struct sigaction action = {};
+    action.sa_handler = handleSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+}
+
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    a.setApplicationName("starlink-monitord");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Polls Starlink dishes without a GUI.");
+    parser.addHelpOption();
+    QCommandLineOption targetsOption("targets", "Monitor every dish listed in <file>, one host:port per line.", "file");
+    QCommandLineOption targetOption("target", "Monitor the dish at <host:port>; may be repeated.", "host:port");
+    QCommandLineOption transportOption("transport", "Talk to dishes with one call per request (unary) or over one stream each (stream; default unary).", "mode", "unary");
+    QCommandLineOption metricsPortOption("metrics-port", "Serve Prometheus metrics on <port>; 0 turns the exporter off (default 9817).", "port", "9817");
+    QCommandLineOption dataDirOption("data-dir", "Keep each dish's history on disk under <dir>.", "dir");
+    QCommandLineOption feedPortOption("feed-port", "Push live dish state to browsers on <port>, as a WebSocket at /feed and server-sent events at /events (default off).", "port", "0");
+    QCommandLineOption metricsAddressOption("metrics-address", "Address the metrics endpoint and live feed listen on (default any).", "address");
+    QCommandLineOption traceOption("trace", "Record internal trace events, served as a Chrome trace at /trace.");
+    QCommandLineOption alertRulesOption("alert-rules", "Read alert rules from <file> instead of using the built-in ones.", "file");
+    QCommandLineOption webhookOption("webhook", "POST every alert as JSON to <url>.", "url");
+    QCommandLineOption routerOption("router", "Also poll the Wi-Fi router at <host:port>, behind the --router-dish, and report whether loss is on the LAN or the satellite link.", "host:port");
+    QCommandLineOption routerDishOption("router-dish", "The dish at <host:port> is the one the --router sits behind; needed when there are several.", "host:port");
+    QCommandLineOption speedTestIntervalOption("speedtest-interval", "Have each dish run a speed test about every <hours>, jittered (default never).", "hours");
+    QCommandLineOption speedTestPerSiteOption("speedtest-per-site", "Run at most <count> speed tests at once per site of the targets file (default 1).", "count", "1");
+    parser.addOption(targetsOption);
+    parser.addOption(targetOption);
+    parser.addOption(transportOption);
+    parser.addOption(metricsPortOption);
+    parser.addOption(metricsAddressOption);
+    parser.addOption(feedPortOption);
+    parser.addOption(dataDirOption);
+    parser.addOption(traceOption);
+    parser.addOption(alertRulesOption);
+    parser.addOption(webhookOption);
+    parser.addOption(routerOption);
+    parser.addOption(routerDishOption);
+    parser.addOption(speedTestIntervalOption);
+    parser.addOption(speedTestPerSiteOption);
+    parser.process(a);
+
+    if (parser.isSet(traceOption)) {
+        Instrumentation::global().setTracing(true);
+    }
+
+    StarlinkClient::Transport transport;
+    if (!StarlinkClient::parseTransport(parser.value(transportOption), &transport)) {
+        qCritical("Unknown transport: %s", qPrintable(parser.value(transportOption)));
+        return 1;
+    }
+
+    bool portOk = false;
+    const uint metricsPort = parser.value(metricsPortOption).toUInt(&portOk);
+    if (!portOk || metricsPort > 65535) {
+        qCritical("Invalid metrics port: %s", qPrintable(parser.value(metricsPortOption)));
+        return 1;
+    }
+    const uint feedPort = parser.value(feedPortOption).toUInt(&portOk);
+    if (!portOk || feedPort > 65535) {
+        qCritical("Invalid feed port: %s", qPrintable(parser.value(feedPortOption)));
+        return 1;
+    }
+    QHostAddress metricsAddress(QHostAddress::Any);
+    if (parser.isSet(metricsAddressOption) && !metricsAddress.setAddress(parser.value(metricsAddressOption))) {
+        qCritical("Invalid metrics address: %s", qPrintable(parser.value(metricsAddressOption)));
+        return 1;
+    }
+
+    QStringList targets = parser.values(targetOption);
+    QHash<QString, QString> sites;
+    if (parser.isSet(targetsOption)) {
+        QString error;
+        const QStringList listed = FleetManager::readTargets(parser.value(targetsOption), &error, &sites);
+        if (listed.isEmpty()) {
+            qCritical("No targets in %s: %s", qPrintable(parser.value(targetsOption)),
+                      qPrintable(error.isEmpty() ? QString("file is empty") : error));
+            return 1;
+        }
+        targets += listed;
+    }
+    if (targets.isEmpty()) {
+        targets.append("192.168.100.1:9200");
+    }
+
+    // The router's loss is only comparable with the dish it sits behind
+    int routerDish = 0;
+    if (parser.isSet(routerDishOption)) {
+        routerDish = static_cast<int>(targets.indexOf(parser.value(routerDishOption)));
+        if (routerDish < 0) {
+            qCritical("--router-dish %s is not one of the targets", qPrintable(parser.value(routerDishOption)));
+            return 1;
+        }
+    } else if (parser.isSet(routerOption) && targets.size() > 1) {
+        qCritical("--router needs --router-dish to say which of the %lld dishes is behind it",
+                  static_cast<long long>(targets.size()));
+        return 1;
+    }
+
+    std::vector<AlertRule> alertRules = AlertRule::defaults();
+    if (parser.isSet(alertRulesOption)) {
+        QString error;
+        if (!AlertRule::readFile(parser.value(alertRulesOption), &alertRules, &error)) {
+            qCritical("Bad alert rules in %s: %s", qPrintable(parser.value(alertRulesOption)), qPrintable(error));
+            return 1;
+        }
+    }
+    const QUrl webhook(parser.value(webhookOption));
+    if (parser.isSet(webhookOption) && !webhook.isValid()) {
+        qCritical("Invalid webhook URL: %s", qPrintable(parser.value(webhookOption)));
+        return 1;
+    }
+
+    SpeedTestRunner::Options speedTestOptions;
+    bool speedTestOk = true;
+    if (parser.isSet(speedTestIntervalOption)) {
+        const double hours = parser.value(speedTestIntervalOption).toDouble(&speedTestOk);
+        speedTestOk = speedTestOk && hours > 0.0;
+        speedTestOptions.intervalMs = static_cast<qint64>(hours * 3600.0 * 1000.0);
+    }
+    if (!speedTestOk) {
+        qCritical("Invalid speed test interval: %s", qPrintable(parser.value(speedTestIntervalOption)));
+        return 1;
+    }
+    speedTestOptions.maxPerSite = parser.value(speedTestPerSiteOption).toInt(&speedTestOk);
+    if (!speedTestOk || speedTestOptions.maxPerSite < 1) {
+        qCritical("Invalid speed tests per site: %s", qPrintable(parser.value(speedTestPerSiteOption)));
+        return 1;
+    }
+
+#ifdef Q_OS_UNIX
+    quitOnSignals(&a);
+#endif
+
+    FleetManager fleet;
+    QObject::connect(&fleet, &FleetManager::summaryChanged, [](int connected, int total) {
+        qInfo("%d/%d dishes connected", connected, total);
+    });
+
+    AlertMonitor alerts(alertRules);
+    alerts.setWebhook(webhook);
+    alerts.watch(&fleet);
+    QObject::connect(&alerts, &AlertMonitor::alertChanged, [](const AlertMonitor::Alert &alert) {
+        if (alert.firing) {
+            qWarning("%s: %s firing, %s (now %g)", qPrintable(alert.target), qPrintable(alert.rule),
+                     qPrintable(alert.condition), static_cast<double>(alert.value));
+        } else {
+            qInfo("%s: %s cleared (now %g)", qPrintable(alert.target), qPrintable(alert.rule),
+                  static_cast<double>(alert.value));
+        }
+    });
+
+    // Shared outages are worth a warning; a single dish's trouble is
+    // logged as information, as its own alerts already cover it
+    OutageMonitor outages;
+    outages.watch(&fleet);
+    QObject::connect(&outages, &OutageMonitor::outageChanged, [](const OutageMonitor::Outage &outage) {
+        const QString where = outage.scope == OutageCorrelator::Local
+            ? outage.targets.value(0)
+            : QString("%1 %2").arg(OutageCorrelator::scopeName(outage.scope)).arg(outage.groupId);
+        const char *scope = outage.scope == OutageCorrelator::Local ? "local" : "shared";
+        if (!outage.active) {
+            qInfo("%s outage on %s cleared", scope, qPrintable(where));
+        } else if (outage.scope == OutageCorrelator::Local) {
+            qInfo("local outage on %s: drop %.0f%%, latency %.0f ms, r = %.2f with the fleet", qPrintable(where),
+                  static_cast<double>(outage.dropRate * 100.0f), static_cast<double>(outage.latencyMs),
+                  static_cast<double>(outage.coherence));
+        } else {
+            qWarning("shared outage on %s: %lld of %d dishes, drop %.0f%%, latency %.0f ms, r = %.2f (%s)",
+                     qPrintable(where), static_cast<long long>(outage.targets.size()), outage.reporting,
+                     static_cast<double>(outage.dropRate * 100.0f), static_cast<double>(outage.latencyMs),
+                     static_cast<double>(outage.coherence), qPrintable(outage.targets.join(", ")));
+        }
+    });
+
+    SpeedTestRunner speedTests;
+    speedTests.setSites(sites);
+    speedTests.setOptions(speedTestOptions);
+    speedTests.watch(&fleet);
+    QObject::connect(&speedTests, &SpeedTestRunner::testFinished,
+                     [](const QString &target, bool ok, const SpeedTestResult &result, float passiveDownlinkMbps,
+                        const QString &error) {
+        if (!ok) {
+            qWarning("%s: speed test failed: %s", qPrintable(target), qPrintable(error));
+            return;
+        }
+        qInfo("%s: speed test %.1f Mbps down, %.1f Mbps up, %.0f ms; history meanwhile %.1f Mbps down",
+              qPrintable(target), static_cast<double>(result.downloadMbps), static_cast<double>(result.uploadMbps),
+              static_cast<double>(result.latencyMs), static_cast<double>(passiveDownlinkMbps));
+    });
+
+    MetricsExporter exporter(&fleet);
+    if (metricsPort != 0) {
+        QString error;
+        if (!exporter.listen(metricsAddress, static_cast<quint16>(metricsPort), &error)) {
+            qCritical("Can't serve metrics on port %u: %s", metricsPort, qPrintable(error));
+            return 1;
+        }
+        qInfo("Serving metrics on port %u", exporter.serverPort());
+    }
+
+    // Shares the metrics endpoint's address
+    LiveFeed feed(&fleet);
+    if (feedPort != 0) {
+        QString error;
+        if (!feed.listen(metricsAddress, static_cast<quint16>(feedPort), &error)) {
+            qCritical("Can't serve the live feed on port %u: %s", feedPort, qPrintable(error));
+            return 1;
+        }
+        qInfo("Serving the live feed on port %u", feed.serverPort());
+    }
+
+    fleet.setStorageDirectory(parser.value(dataDirOption));
+    fleet.setTransport(transport);
+    fleet.setTargets(targets);
+    fleet.start();
+
+    std::unique_ptr<RouterClient> router;
+    QTimer correlationTimer;
+    if (parser.isSet(routerOption)) {
+        router = std::make_unique<RouterClient>(parser.value(routerOption), fleet.pool());
+        QObject::connect(router.get(), &RouterClient::statusChanged, [&router](bool connected) {
+            qInfo("Router %s %s", qPrintable(router->target()), connected ? "connected" : "unreachable");
+        });
+        router->startMonitoring();
+
+        QObject::connect(&correlationTimer, &QTimer::timeout, [&fleet, &router, routerDish]() {
+            const int64_t now = QDateTime::currentMSecsSinceEpoch();
+            const LinkCorrelator::Report report = LinkCorrelator().correlate(
+                fleet.client(routerDish)->telemetry(), router->telemetry(), now - kCorrelationWindowMs, now);
+            qInfo("%s: loss over the last %lld min is %s (lan %d, satellite %d, both %d of %zu buckets, r = %.2f)",
+                  qPrintable(fleet.client(routerDish)->target()), static_cast<long long>(kCorrelationWindowMs / 60000),
+                  LinkCorrelator::bottleneckName(report.overall), report.lanBuckets + report.bothBuckets,
+                  report.satelliteBuckets + report.bothBuckets, report.bothBuckets, report.buckets.size(),
+                  static_cast<double>(report.correlation));
+        });
+        correlationTimer.start(static_cast<int>(kCorrelationWindowMs));
+    }
+
+    return a.exec();
+}
@@ -0,0 +1,57 @@
+#include "obstructionmap.h"
+#include <algorithm>
+#include <cstring>
+
+bool ObstructionMap::update(int rows, int cols, const float *snr)
+{
+    changedFirstRow_ = 0;
+    changedRowCount_ = 0;
+    changedCells_ = 0;
+
+    if (rows <= 0 || cols <= 0) {
+        const bool changed = !isEmpty();
+        clear();
+        return changed;
+    }
+
+    const size_t cells = static_cast<size_t>(rows) * cols;
+    if (rows != rows_ || cols != cols_) {
+        rows_ = rows;
+        cols_ = cols;
+        snr_.assign(snr, snr + cells);
+        changedRowCount_ = rows;
+        changedCells_ = cells;
+        return true;
+    }
+
+    // Compared bitwise, so a cell stuck at NaN doesn't count as changing
+    int firstRow = rows;
+    int lastRow = -1;
+    for (int r = 0; r < rows; ++r) {
+        float *current = snr_.data() + static_cast<size_t>(r) * cols;
+        const float *next = snr + static_cast<size_t>(r) * cols;
+        if (std::memcmp(current, next, cols * sizeof(float)) == 0) {
+            continue;
+        }
+        for (int c = 0; c < cols; ++c) {
+            changedCells_ += std::memcmp(current + c, next + c, sizeof(float)) != 0;
+        }
+        std::memcpy(current, next, cols * sizeof(float));
+        firstRow = std::min(firstRow, r);
+        lastRow = r;
+    }
+
+    if (lastRow < 0) {
+        return false;
+    }
+    changedFirstRow_ = firstRow;
+    changedRowCount_ = lastRow - firstRow + 1;
+    return true;
+}
+
+void ObstructionMap::clear()
+{
+    rows_ = 0;
+    cols_ = 0;
+    snr_.clear();
+}
@@ -0,0 +1,42 @@
+#ifndef OBSTRUCTIONMAP_H
+#define OBSTRUCTIONMAP_H
+
+#include <cstddef>
+#include <vector>
+
+// The dish's obstruction map: a num_rows x num_cols grid of SNR values in
+// [0, 1], row-major, with -1 where it has no data yet.
+//
+// Each update is diffed against the previous map a row at a time, and the
+// band of rows that changed is kept so a view can redraw just that band.
+// The map fills in slowly, so most updates touch a few rows or none.
+class ObstructionMap
+{
+public:
+    // Returns whether anything changed. A grid of a different shape
+    // replaces the old one outright.
+    bool update(int rows, int cols, const float *snr);
+    void clear();
+
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+    bool isEmpty() const { return snr_.empty(); }
+    const float *row(int r) const { return snr_.data() + static_cast<size_t>(r) * cols_; }
+
+    // Rows [changedFirstRow(), changedFirstRow() + changedRowCount()) hold
+    // every cell the last update() changed
+    int changedFirstRow() const { return changedFirstRow_; }
+    int changedRowCount() const { return changedRowCount_; }
+    size_t changedCells() const { return changedCells_; }
+
+private:
+    int rows_ = 0;
+    int cols_ = 0;
+    std::vector<float> snr_;
+
+    int changedFirstRow_ = 0;
+    int changedRowCount_ = 0;
+    size_t changedCells_ = 0;
+};
+
+#endif // OBSTRUCTIONMAP_H
@@ -0,0 +1,66 @@
+#include "obstructionmapwidget.h"
+#include "kernels.h"
+#include <QPaintEvent>
+#include <QPainter>
+#include <algorithm>
+
+ObstructionMapWidget::ObstructionMapWidget(QWidget *parent)
+    : QWidget(parent)
+{
+    // paintEvent() covers every pixel, so Qt needn't clear first
+    setAttribute(Qt::WA_OpaquePaintEvent);
+}
+
+QSize ObstructionMapWidget::sizeHint() const
+{
+    return QSize(200, 200);
+}
+
+void ObstructionMapWidget::updateMap(const ObstructionMap &map, int firstRow, int rowCount)
+{
+    if (map.isEmpty()) {
+        image_ = QImage();
+        update();
+        return;
+    }
+
+    if (image_.width() != map.cols() || image_.height() != map.rows()) {
+        image_ = QImage(map.cols(), map.rows(), QImage::Format_ARGB32);
+        firstRow = 0;
+        rowCount = map.rows();
+    }
+
+    firstRow = std::clamp(firstRow, 0, map.rows());
+    rowCount = std::clamp(rowCount, 0, map.rows() - firstRow);
+    for (int r = firstRow; r < firstRow + rowCount; ++r) {
+        Kernels::snrToArgb(map.row(r), static_cast<size_t>(map.cols()),
+                           reinterpret_cast<uint32_t *>(image_.scanLine(r)));
+    }
+
+    // Repaint only the band of the widget those rows land on
+    const QRect target = targetRect();
+    const int top = target.top() + firstRow * target.height() / map.rows();
+    const int bottom = target.top() + ((firstRow + rowCount) * target.height() + map.rows() - 1) / map.rows();
+    update(QRect(target.left(), top, target.width(), bottom - top + 1));
+}
+
+QRect ObstructionMapWidget::targetRect() const
+{
+    const int side = std::min(width(), height());
+    return QRect((width() - side) / 2, (height() - side) / 2, side, side);
+}
+
+void ObstructionMapWidget::paintEvent(QPaintEvent *event)
+{
+    QPainter painter(this);
+    painter.fillRect(event->rect(), palette().window());
+
+    if (image_.isNull()) {
+        painter.drawText(rect(), Qt::AlignCenter, "No obstruction data yet");
+        return;
+    }
+
+    // Cells stay crisp squares rather than being smoothed into each other
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+    painter.drawImage(targetRect(), image_);
+}
@@ -0,0 +1,36 @@
+#ifndef OBSTRUCTIONMAPWIDGET_H
+#define OBSTRUCTIONMAPWIDGET_H
+
+#include <QImage>
+#include <QWidget>
+#include "obstructionmap.h"
+
+// Heatmap of the dish's obstruction map.
+//
+// Cells are converted to pixels by Kernels::snrToArgb straight into a cached
+// QImage, one map cell per pixel, and only the rows that changed since the
+// last map are converted again. Painting just scales the cached image into
+// the widget, clipped to the region that changed.
+class ObstructionMapWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit ObstructionMapWidget(QWidget *parent = nullptr);
+
+    // Rows [firstRow, firstRow + rowCount) of map are new
+    void updateMap(const ObstructionMap &map, int firstRow, int rowCount);
+
+    QSize sizeHint() const override;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    // Largest square that fits, centred; the map covers the whole sky
+    QRect targetRect() const;
+
+    QImage image_;
+};
+
+#endif // OBSTRUCTIONMAPWIDGET_H
@@ -0,0 +1,405 @@
+#include "outagecorrelator.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+namespace {
+
+// Below this many dishes or groups per thread, a bucket is judged sooner
+// than the threads start
+constexpr int kMinItemsPerThread = 64;
+
+// After a long gap only the latest buckets are worth judging
+constexpr int kMaxCatchUpBuckets = 20;
+
+// Buckets' worth of weight before a correlation means anything
+constexpr double kMinCorrelationWeight = 5.0;
+
+const char *const kScopeNames[OutageCorrelator::ScopeCount] = {
+    "local",
+    "cell",
+    "gateway",
+    "pop",
+    "fleet",
+};
+
+// fn(0) to fn(count - 1) in any order, on the calling thread and up to
+// threads - 1 more
+template <typename Fn>
+void parallelFor(int count, int threads, const Fn &fn)
+{
+    threads = std::min(threads, count / kMinItemsPerThread);
+    if (threads <= 1) {
+        for (int i = 0; i < count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+
+    std::atomic<int> next(0);
+    const auto work = [&]() {
+        for (int i = next++; i < count; i = next++) {
+            fn(i);
+        }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (int t = 1; t < threads; ++t) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+}
+
+void OutageCorrelator::Moments::add(double valueX, double valueY, double decay)
+{
+    weight = weight * decay + 1.0;
+    x = x * decay + valueX;
+    y = y * decay + valueY;
+    xx = xx * decay + valueX * valueX;
+    yy = yy * decay + valueY * valueY;
+    xy = xy * decay + valueX * valueY;
+}
+
+float OutageCorrelator::Moments::correlation() const
+{
+    if (weight < kMinCorrelationWeight) {
+        return std::numeric_limits<float>::quiet_NaN();
+    }
+    const double meanX = x / weight;
+    const double meanY = y / weight;
+    const double covariance = xy / weight - meanX * meanY;
+    const double varianceX = xx / weight - meanX * meanX;
+    const double varianceY = yy / weight - meanY * meanY;
+    // A dish that never drops a ping correlates with nothing
+    if (varianceX <= 1e-12 || varianceY <= 1e-12) {
+        return std::numeric_limits<float>::quiet_NaN();
+    }
+    return static_cast<float>(std::clamp(covariance / std::sqrt(varianceX * varianceY), -1.0, 1.0));
+}
+
+int OutageCorrelator::threadCount() const
+{
+    if (options_.threads > 0) {
+        return options_.threads;
+    }
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+void OutageCorrelator::reset(int dishCount)
+{
+    dishes_.assign(static_cast<size_t>(std::max(dishCount, 0)), Dish());
+    groups_.clear();
+    groupIndex_.clear();
+    tracked_.clear();
+    groupsDirty_ = true;
+    nextBucketMs_ = -1;
+}
+
+uint32_t OutageCorrelator::contextId(const Context &context, Scope scope)
+{
+    switch (scope) {
+    case Cell:
+        return context.cellId;
+    case Gateway:
+        return context.gatewayId;
+    case PopRack:
+        return context.popRackId;
+    case Local:
+    case Fleet:
+    case ScopeCount:
+        break;
+    }
+    return 0;
+}
+
+void OutageCorrelator::setContext(int dish, const Context &context)
+{
+    Dish &entry = dishes_[dish];
+    bool changed = false;
+    for (int s = Cell; s < Fleet; ++s) {
+        const Scope scope = static_cast<Scope>(s);
+        if (contextId(entry.context, scope) != contextId(context, scope)) {
+            // Correlation with the old neighbours says nothing about the new
+            entry.moments[s] = Moments();
+            changed = true;
+        }
+    }
+    if (changed) {
+        entry.context = context;
+        groupsDirty_ = true;
+    }
+}
+
+void OutageCorrelator::rebuildGroups()
+{
+    groups_.clear();
+    groupIndex_.clear();
+    for (int i = 0; i < dishCount(); ++i) {
+        Dish &dish = dishes_[i];
+        for (int s = Cell; s < ScopeCount; ++s) {
+            const Scope scope = static_cast<Scope>(s);
+            const uint32_t id = contextId(dish.context, scope);
+            dish.group[s] = -1;
+            if (scope != Fleet && id == 0) {
+                continue;
+            }
+            auto it = groupIndex_.find(key(scope, id));
+            if (it == groupIndex_.end()) {
+                it = groupIndex_.emplace(key(scope, id), static_cast<int>(groups_.size())).first;
+                Group group;
+                group.scope = scope;
+                group.id = id;
+                groups_.push_back(group);
+            }
+            groups_[it->second].members.push_back(i);
+            dish.group[s] = it->second;
+        }
+    }
+    for (Group &group : groups_) {
+        group.outage = tracked_.count(key(group.scope, group.id)) > 0;
+    }
+    groupsDirty_ = false;
+}
+
+int OutageCorrelator::advance(const std::vector<const TelemetryStore *> &stores, int64_t nowMs,
+                              std::vector<Outage> *changes)
+{
+    if (dishes_.empty()) {
+        return 0;
+    }
+
+    // Buckets starting before settledEnd have closed and settled
+    const int64_t bucketMs = std::max<int64_t>(options_.bucketMs, 1000);
+    const int64_t settledEnd = TelemetryStore::alignDown(nowMs - std::max<int64_t>(options_.settleMs, 0), bucketMs);
+    if (nextBucketMs_ < 0) {
+        nextBucketMs_ = settledEnd - bucketMs;
+    }
+    nextBucketMs_ = std::max(nextBucketMs_, settledEnd - kMaxCatchUpBuckets * bucketMs);
+    if (nextBucketMs_ >= settledEnd) {
+        return 0;
+    }
+
+    if (groupsDirty_) {
+        rebuildGroups();
+    }
+    int judged = 0;
+    for (; nextBucketMs_ < settledEnd; nextBucketMs_ += bucketMs) {
+        judgeBucket(stores, nextBucketMs_, changes);
+        ++judged;
+    }
+    return judged;
+}
+
+void OutageCorrelator::judgeBucket(const std::vector<const TelemetryStore *> &stores, int64_t startMs,
+                                   std::vector<Outage> *changes)
+{
+    // Each pass only writes what belongs to its own dish or group: a dish
+    // is in one group per scope and keeps its moments per scope
+    const int threads = threadCount();
+    parallelFor(dishCount(), threads, [&](int i) {
+        judgeDish(&dishes_[i], i < static_cast<int>(stores.size()) ? stores[i] : nullptr, startMs);
+    });
+    parallelFor(static_cast<int>(groups_.size()), threads, [this](int g) {
+        judgeGroup(&groups_[g]);
+    });
+    attribute(startMs, changes);
+}
+
+void OutageCorrelator::judgeDish(Dish *dish, const TelemetryStore *store, int64_t startMs)
+{
+    dish->reporting = false;
+    dish->anomalous = false;
+    if (!store) {
+        return;
+    }
+
+    // Inclusive at both ends, so the next bucket starts a millisecond on
+    const int64_t endMs = startMs + std::max<int64_t>(options_.bucketMs, 1000) - 1;
+    const Kernels::Summary drops = store->summarizeBetween(TelemetryStore::DropRate, startMs, endMs);
+    if (drops.count < static_cast<size_t>(std::max(options_.minSamples, 1))) {
+        return;
+    }
+    const Kernels::Summary latency = store->summarizeBetween(TelemetryStore::Latency, startMs, endMs);
+
+    dish->reporting = true;
+    dish->dropRate = drops.mean();
+    dish->latencyMs = latency.count > 0 ? latency.mean() : std::numeric_limits<float>::quiet_NaN();
+    const bool slow = latency.count > 0 && dish->baselineBuckets > 0
+                   && dish->latencyMs - dish->baselineMs >= options_.latencyJumpMs;
+    dish->anomalous = dish->dropRate >= options_.dropThreshold || slow;
+
+    // Lost buckets leave the baseline alone. A lasting step in latency, as
+    // after a POP change, is taken in at a quarter of the usual rate.
+    if (latency.count > 0 && dish->dropRate < options_.dropThreshold) {
+        dish->baselineBuckets = std::min(dish->baselineBuckets + 1, std::max(options_.baselineBuckets, 1));
+        const float rate = (slow ? 0.25f : 1.0f) / dish->baselineBuckets;
+        dish->baselineMs += (dish->latencyMs - dish->baselineMs) * rate;
+    }
+}
+
+void OutageCorrelator::judgeGroup(Group *group)
+{
+    group->reporting = 0;
+    group->anomalous = 0;
+    double sum = 0.0;
+    for (int member : group->members) {
+        const Dish &dish = dishes_[member];
+        if (dish.reporting) {
+            ++group->reporting;
+            group->anomalous += dish.anomalous;
+            sum += dish.dropRate;
+        }
+    }
+
+    // Each member against the mean of the others, so the group's mean
+    // doesn't simply follow whichever dish is worst
+    double total = 0.0;
+    int correlated = 0;
+    const double decay = 1.0 - 1.0 / std::max(options_.correlationBuckets, 2);
+    for (int member : group->members) {
+        Dish &dish = dishes_[member];
+        if (group->reporting >= 2 && dish.reporting) {
+            const double others = (sum - dish.dropRate) / (group->reporting - 1);
+            dish.moments[group->scope].add(dish.dropRate, others, decay);
+        }
+        const float r = dish.moments[group->scope].correlation();
+        if (!std::isnan(r)) {
+            total += r;
+            ++correlated;
+        }
+    }
+    group->coherence = correlated > 0 ? static_cast<float>(total / correlated) : std::numeric_limits<float>::quiet_NaN();
+
+    // Easier to stay impaired than to become so, so an outage that is
+    // winding down doesn't break up into local ones
+    const int minShared = std::max(options_.minShared, 2);
+    const int needed = group->outage
+        ? minShared
+        : std::max(minShared, static_cast<int>(std::ceil(options_.sharedFraction * group->reporting)));
+    group->impaired = group->reporting > 0 && group->anomalous >= needed;
+}
+
+void OutageCorrelator::attribute(int64_t startMs, std::vector<Outage> *changes)
+{
+    struct Seen {
+        Outage outage;
+        int latencies = 0;
+    };
+    std::map<uint64_t, Seen> seen;
+
+    for (int i = 0; i < dishCount(); ++i) {
+        const Dish &dish = dishes_[i];
+        if (!dish.anomalous) {
+            continue;
+        }
+
+        // The widest impaired group takes it
+        const Group *owner = nullptr;
+        for (int s = Fleet; s > Local && !owner; --s) {
+            if (dish.group[s] >= 0 && groups_[dish.group[s]].impaired) {
+                owner = &groups_[dish.group[s]];
+            }
+        }
+        const Scope scope = owner ? owner->scope : Local;
+        const uint32_t id = owner ? owner->id : static_cast<uint32_t>(i);
+
+        Seen &entry = seen[key(scope, id)];
+        Outage &outage = entry.outage;
+        if (outage.dishes.empty()) {
+            outage.scope = scope;
+            outage.groupId = id;
+            outage.reporting = owner ? owner->reporting : 1;
+            outage.coherence = owner ? owner->coherence : dish.moments[Fleet].correlation();
+        }
+        outage.dishes.push_back(i);
+        outage.dropRate += dish.dropRate;
+        if (!std::isnan(dish.latencyMs)) {
+            outage.latencyMs += dish.latencyMs;
+            ++entry.latencies;
+        }
+    }
+
+    const int64_t endMs = startMs + std::max<int64_t>(options_.bucketMs, 1000);
+    for (auto &entry : seen) {
+        Outage &outage = entry.second.outage;
+        outage.active = true;
+        outage.dropRate /= static_cast<float>(outage.dishes.size());
+        outage.latencyMs = entry.second.latencies > 0 ? outage.latencyMs / entry.second.latencies
+                                                      : std::numeric_limits<float>::quiet_NaN();
+        outage.lastSeenMs = endMs;
+
+        auto it = tracked_.find(entry.first);
+        if (it == tracked_.end()) {
+            outage.startedMs = startMs;
+            tracked_[entry.first].outage = outage;
+            changes->push_back(outage);
+            continue;
+        }
+        outage.startedMs = it->second.outage.startedMs;
+        it->second.outage = std::move(outage);
+        it->second.quietBuckets = 0;
+    }
+
+    for (auto it = tracked_.begin(); it != tracked_.end();) {
+        if (seen.count(it->first)) {
+            ++it;
+            continue;
+        }
+
+        // Without data an outage can't be said to be over, only for a
+        // group that no longer exists
+        const Outage &outage = it->second.outage;
+        bool hadData = true;
+        if (outage.scope == Local) {
+            hadData = outage.groupId < dishes_.size() && dishes_[outage.groupId].reporting;
+        } else {
+            const auto group = groupIndex_.find(it->first);
+            hadData = group == groupIndex_.end() || groups_[group->second].reporting > 0;
+        }
+        if (hadData && ++it->second.quietBuckets >= std::max(options_.clearBuckets, 1)) {
+            Outage cleared = std::move(it->second.outage);
+            cleared.active = false;
+            changes->push_back(std::move(cleared));
+            it = tracked_.erase(it);
+            continue;
+        }
+        ++it;
+    }
+
+    for (Group &group : groups_) {
+        group.outage = tracked_.count(key(group.scope, group.id)) > 0;
+    }
+}
+
+std::vector<OutageCorrelator::Outage> OutageCorrelator::outages() const
+{
+    std::vector<Outage> active;
+    active.reserve(tracked_.size());
+    for (const auto &entry : tracked_) {
+        active.push_back(entry.second.outage);
+    }
+    std::stable_sort(active.begin(), active.end(), [](const Outage &a, const Outage &b) {
+        return a.scope > b.scope;
+    });
+    return active;
+}
+
+float OutageCorrelator::coherence(int dish, Scope scope) const
+{
+    if (scope == Local || scope == ScopeCount || dishes_[dish].group[scope] < 0) {
+        return std::numeric_limits<float>::quiet_NaN();
+    }
+    return dishes_[dish].moments[scope].correlation();
+}
+
+const char *OutageCorrelator::scopeName(Scope scope)
+{
+    return scope >= Local && scope < ScopeCount ? kScopeNames[scope] : "unknown";
+}
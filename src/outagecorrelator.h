@@ -0,0 +1,187 @@
+#ifndef OUTAGECORRELATOR_H
+#define OUTAGECORRELATOR_H
+
+#include <cstdint>
+#include <map>
+#include <vector>
+#include "telemetrystore.h"
+
+// Tells an outage a dish has on its own from one it shares with the other
+// dishes on its cell, gateway or POP, or with the whole fleet.
+//
+// Every dish's history is cut into the same wall-clock buckets, aligned
+// with TelemetryStore::alignDown() as LinkCorrelator's are. A bucket is
+// judged once it has closed and settleMs more have passed for late history
+// polls to land, so an outage is reported at most bucketMs + settleMs
+// after it shows. Judging runs in two passes, each spread over threads once there
+// are enough dishes or groups: first every dish against its own history,
+// then every group of dishes sharing a network ID.
+//
+// A dish is anomalous in a bucket when it drops at least dropThreshold of
+// its pings, or its latency is latencyJumpMs or more above its own
+// baseline. A group is impaired when at least minShared of its reporting
+// dishes, and sharedFraction of them, are anomalous at once; an impaired
+// group stays so while minShared members are. Each anomalous dish is put
+// down to the widest impaired group it belongs to, or to itself, so a
+// fleet-wide outage is reported once rather than once per cell.
+//
+// Each group also keeps a decaying correlation of every member's drop rate
+// with the mean of the others', over about correlationBuckets buckets. It
+// stays near zero for dishes whose trouble is their own and rises towards
+// one as a group's members keep failing together.
+class OutageCorrelator
+{
+public:
+    // Narrowest to widest
+    enum Scope {
+        Local,
+        Cell,
+        Gateway,
+        PopRack,
+        Fleet,
+        ScopeCount
+    };
+
+    struct Options {
+        int64_t bucketMs = 30 * 1000;
+        int64_t settleMs = 15 * 1000;
+        // A dish needs this many samples in a bucket to be judged
+        int minSamples = 10;
+        float dropThreshold = 0.1f;
+        float latencyJumpMs = 50.0f;
+        // Latency baselines average about this many healthy buckets
+        int baselineBuckets = 20;
+        int minShared = 2;
+        float sharedFraction = 0.5f;
+        // Buckets without an anomaly, with data, before an outage clears
+        int clearBuckets = 2;
+        int correlationBuckets = 60;
+        // 0 picks one per core
+        int threads = 0;
+    };
+
+    // Network IDs from dish_get_context; 0 where unknown
+    struct Context {
+        uint32_t cellId = 0;
+        uint32_t popRackId = 0;
+        uint32_t gatewayId = 0;
+    };
+
+    struct Outage {
+        Scope scope = Local;
+        // The dish index for Local, 0 for Fleet
+        uint32_t groupId = 0;
+        bool active = false;
+        // Start of the first anomalous bucket, end of the latest
+        int64_t startedMs = 0;
+        int64_t lastSeenMs = 0;
+        // Anomalous in the latest anomalous bucket, and how many of the
+        // group's dishes reported then
+        std::vector<int> dishes;
+        int reporting = 0;
+        // Means over the anomalous dishes
+        float dropRate = 0.0f;
+        float latencyMs = 0.0f;
+        // The group's mean correlation, or for Local the dish's with the
+        // rest of the fleet; NaN until there is enough history
+        float coherence = 0.0f;
+    };
+
+    OutageCorrelator() = default;
+    explicit OutageCorrelator(const Options &options) : options_(options) {}
+
+    const Options &options() const { return options_; }
+    int threadCount() const;
+
+    // Forgets everything; dishes are numbered 0 to dishCount - 1 from now on
+    void reset(int dishCount);
+    int dishCount() const { return static_cast<int>(dishes_.size()); }
+
+    void setContext(int dish, const Context &context);
+    const Context &context(int dish) const { return dishes_[dish].context; }
+
+    // Judges every bucket that has settled by nowMs, in the stores'
+    // timestamps. stores[i] is dish i's history, or null. Outages that
+    // started or cleared are appended to *changes, oldest first. Returns
+    // the number of buckets judged.
+    int advance(const std::vector<const TelemetryStore *> &stores, int64_t nowMs, std::vector<Outage> *changes);
+
+    // Active outages, widest first
+    std::vector<Outage> outages() const;
+
+    // One dish's correlation with the rest of its group at scope, NaN
+    // until there is enough history or for Local
+    float coherence(int dish, Scope scope) const;
+
+    static const char *scopeName(Scope scope);
+
+private:
+    // Decaying sums for a weighted Pearson correlation
+    struct Moments {
+        double weight = 0.0;
+        double x = 0.0;
+        double y = 0.0;
+        double xx = 0.0;
+        double yy = 0.0;
+        double xy = 0.0;
+
+        void add(double valueX, double valueY, double decay);
+        float correlation() const;
+    };
+
+    struct Dish {
+        Context context;
+        // Index into groups_ per scope, -1 where the ID is unknown
+        int group[ScopeCount] = { -1, -1, -1, -1, -1 };
+        Moments moments[ScopeCount];
+
+        // The latest judged bucket
+        bool reporting = false;
+        bool anomalous = false;
+        float dropRate = 0.0f;
+        float latencyMs = 0.0f;
+
+        float baselineMs = 0.0f;
+        int baselineBuckets = 0;
+    };
+
+    struct Group {
+        Scope scope = Fleet;
+        uint32_t id = 0;
+        std::vector<int> members;
+        // Has an outage that hasn't cleared
+        bool outage = false;
+
+        // The latest judged bucket
+        int reporting = 0;
+        int anomalous = 0;
+        bool impaired = false;
+        float coherence = 0.0f;
+    };
+
+    struct Tracked {
+        Outage outage;
+        int quietBuckets = 0;
+    };
+
+    static uint64_t key(Scope scope, uint32_t id) { return static_cast<uint64_t>(scope) << 32 | id; }
+    static uint32_t contextId(const Context &context, Scope scope);
+
+    void rebuildGroups();
+    void judgeBucket(const std::vector<const TelemetryStore *> &stores, int64_t startMs, std::vector<Outage> *changes);
+    void judgeDish(Dish *dish, const TelemetryStore *store, int64_t startMs);
+    void judgeGroup(Group *group);
+    void attribute(int64_t startMs, std::vector<Outage> *changes);
+
+    Options options_;
+    std::vector<Dish> dishes_;
+    std::vector<Group> groups_;
+    std::map<uint64_t, int> groupIndex_;
+    bool groupsDirty_ = true;
+    // Start of the next bucket to judge, or -1 before the first advance
+    int64_t nextBucketMs_ = -1;
+    // Ordered so changes come out the same way every time
+    std::map<uint64_t, Tracked> tracked_;
+};
+
+#endif // OUTAGECORRELATOR_H
@@ -0,0 +1,77 @@
+#include "outagemonitor.h"
+#include "fleetmanager.h"
+#include "starlinkclient.h"
+#include <QDateTime>
+
+OutageMonitor::OutageMonitor(const OutageCorrelator::Options &options, QObject *parent)
+    : QObject(parent), correlator_(options)
+{
+}
+
+void OutageMonitor::watch(FleetManager *fleet)
+{
+    fleet_ = fleet;
+    connect(fleet, &FleetManager::targetsChanged, this, &OutageMonitor::resetDishes);
+    connect(fleet, &FleetManager::dishUpdated, this, &OutageMonitor::update);
+    resetDishes();
+}
+
+void OutageMonitor::resetDishes()
+{
+    // Outages under the old indices go unreported; they name dishes that
+    // are no longer watched
+    correlator_.reset(fleet_->dishCount());
+    stores_.clear();
+    for (int i = 0; i < fleet_->dishCount(); ++i) {
+        stores_.push_back(&fleet_->client(i)->telemetry());
+    }
+}
+
+std::vector<OutageMonitor::Outage> OutageMonitor::outages() const
+{
+    std::vector<Outage> described;
+    for (const OutageCorrelator::Outage &outage : correlator_.outages()) {
+        described.push_back(describe(outage));
+    }
+    return described;
+}
+
+void OutageMonitor::update(int index, const DishSnapshot &snapshot)
+{
+    if (index >= correlator_.dishCount()) {
+        return;
+    }
+    if (snapshot.hasContext) {
+        OutageCorrelator::Context context;
+        context.cellId = snapshot.cellId;
+        context.popRackId = snapshot.popRackId;
+        context.gatewayId = snapshot.gatewayId;
+        correlator_.setContext(index, context);
+    }
+
+    // Does nothing until a bucket has settled, which any dish's update
+    // may be the first to notice
+    changes_.clear();
+    correlator_.advance(stores_, QDateTime::currentMSecsSinceEpoch(), &changes_);
+    for (const OutageCorrelator::Outage &outage : changes_) {
+        emit outageChanged(describe(outage));
+    }
+}
+
+OutageMonitor::Outage OutageMonitor::describe(const OutageCorrelator::Outage &outage) const
+{
+    Outage described;
+    described.scope = outage.scope;
+    described.groupId = outage.groupId;
+    described.active = outage.active;
+    for (int dish : outage.dishes) {
+        described.targets.append(fleet_->client(dish)->target());
+    }
+    described.reporting = outage.reporting;
+    described.dropRate = outage.dropRate;
+    described.latencyMs = outage.latencyMs;
+    described.coherence = outage.coherence;
+    described.startedMs = outage.startedMs;
+    described.lastSeenMs = outage.lastSeenMs;
+    return described;
+}
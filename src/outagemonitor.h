@@ -0,0 +1,58 @@
+#ifndef OUTAGEMONITOR_H
+#define OUTAGEMONITOR_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <vector>
+#include "dishsnapshot.h"
+#include "outagecorrelator.h"
+
+class FleetManager;
+
+// Runs an OutageCorrelator over a fleet: groups the dishes by the network
+// IDs their snapshots carry, feeds it as history arrives and reports every
+// outage that starts or clears, with the dishes it hit by target.
+class OutageMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Outage {
+        OutageCorrelator::Scope scope = OutageCorrelator::Local;
+        quint32 groupId = 0;
+        bool active = false;
+        QStringList targets;
+        int reporting = 0;
+        float dropRate = 0.0f;
+        float latencyMs = 0.0f;
+        float coherence = 0.0f;
+        qint64 startedMs = 0;
+        qint64 lastSeenMs = 0;
+    };
+
+    explicit OutageMonitor(const OutageCorrelator::Options &options = OutageCorrelator::Options(),
+                           QObject *parent = nullptr);
+
+    // Follows every dish of the fleet as its targets come and go
+    void watch(FleetManager *fleet);
+
+    const OutageCorrelator &correlator() const { return correlator_; }
+    // Active outages, widest first
+    std::vector<Outage> outages() const;
+
+signals:
+    void outageChanged(const OutageMonitor::Outage &outage);
+
+private:
+    void resetDishes();
+    void update(int index, const DishSnapshot &snapshot);
+    Outage describe(const OutageCorrelator::Outage &outage) const;
+
+    FleetManager *fleet_ = nullptr;
+    OutageCorrelator correlator_;
+    std::vector<const TelemetryStore *> stores_;
+    std::vector<OutageCorrelator::Outage> changes_;
+};
+
+#endif // OUTAGEMONITOR_H
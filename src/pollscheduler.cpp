@@ -0,0 +1,198 @@
+#include "pollscheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+namespace {
+
+constexpr qint64 kStatusFastMs = 1000;
+constexpr qint64 kStatusSteadyMs = 10 * 1000;
+constexpr qint64 kStatusBackgroundMs = 30 * 1000;
+
+constexpr qint64 kBackoffFirstMs = 2000;
+constexpr qint64 kBackoffMaxMs = 60 * 1000;
+constexpr qint64 kBackoffBackgroundMaxMs = 5 * 60 * 1000;
+
+constexpr qint64 kRarelyChangesMs = 10 * 60 * 1000;
+constexpr qint64 kRarelyChangesBackgroundMs = 30 * 60 * 1000;
+
+constexpr qint64 kContextMs = 60 * 1000;
+
+constexpr qint64 kObstructionMapMs = 2 * 60 * 1000;
+constexpr qint64 kObstructionMapBackgroundMs = 30 * 60 * 1000;
+
+// Foreground history polls pick up this many new samples each; background
+// polls wait until the rings are half way to wrapping
+constexpr double kForegroundBatch = 5.0;
+constexpr double kRingFillBeforePoll = 0.5;
+constexpr int kDefaultRingSize = 900;
+
+constexpr qint64 kHistoryMinMs = 1000;
+constexpr qint64 kHistoryMaxMs = 10 * 60 * 1000;
+
+}
+
+qint64 PollScheduler::now()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+PollScheduler::PollScheduler()
+{
+    reset(0);
+}
+
+void PollScheduler::reset(qint64 firstPollMs)
+{
+    std::fill(std::begin(due_), std::end(due_), firstPollMs);
+    statusIntervalMs_ = kStatusFastMs;
+    failures_ = 0;
+    connected_ = false;
+    stateKey_ = 0;
+    lastHistoryMs_ = -1;
+    samplesPerSecond_ = 1.0;
+    ringSize_ = 0;
+}
+
+void PollScheduler::setEnabled(Request request, bool enabled)
+{
+    if (enabled) {
+        enabled_ |= bit(request);
+    } else {
+        enabled_ &= ~bit(request);
+    }
+}
+
+void PollScheduler::expedite(qint64 nowMs)
+{
+    for (qint64 &due : due_) {
+        due = std::min(due, nowMs);
+    }
+}
+
+void PollScheduler::expedite(Request request, qint64 nowMs)
+{
+    due_[request] = std::min(due_[request], nowMs);
+}
+
+PollScheduler::RequestMask PollScheduler::takeDue(qint64 nowMs)
+{
+    RequestMask mask = 0;
+    for (int r = 0; r < RequestCount; ++r) {
+        const Request request = static_cast<Request>(r);
+        if (!isEnabled(request) || (isSuspended() && request != Status)) {
+            continue;
+        }
+        if (due_[r] <= nowMs) {
+            mask |= bit(request);
+            due_[r] = nowMs + intervalMs(request);
+        }
+    }
+    return mask;
+}
+
+qint64 PollScheduler::nextDueMs() const
+{
+    if (isSuspended()) {
+        return due_[Status];
+    }
+    qint64 next = std::numeric_limits<qint64>::max();
+    for (int r = 0; r < RequestCount; ++r) {
+        if (isEnabled(static_cast<Request>(r))) {
+            next = std::min(next, due_[r]);
+        }
+    }
+    return next;
+}
+
+void PollScheduler::statusPolled(qint64 nowMs, bool connected, quint32 stateKey)
+{
+    if (!connected) {
+        // 2 s, 4 s, 8 s, ... while the dish stays away
+        const qint64 maxMs = background_ ? kBackoffBackgroundMaxMs : kBackoffMaxMs;
+        const int shift = std::min(failures_, 16);
+        statusIntervalMs_ = std::min(kBackoffFirstMs << shift, maxMs);
+        ++failures_;
+        connected_ = false;
+        due_[Status] = nowMs + statusIntervalMs_;
+        return;
+    }
+
+    // Requests suspended during an outage kept their old due times, so they
+    // go out with the next poll without any help here
+    if (!connected_ || stateKey != stateKey_) {
+        statusIntervalMs_ = kStatusFastMs;
+    } else {
+        statusIntervalMs_ = std::min(statusIntervalMs_ * 2, kStatusSteadyMs);
+    }
+
+    failures_ = 0;
+    connected_ = true;
+    stateKey_ = stateKey;
+    due_[Status] = nowMs + intervalMs(Status);
+}
+
+void PollScheduler::historyPolled(qint64 nowMs, int newSamples, int ringSize)
+{
+    if (ringSize > 0) {
+        ringSize_ = ringSize;
+    }
+
+    // The first poll after a reset returns the whole ring, which says
+    // nothing about the rate; a later full ring means we already fell behind
+    // and the true rate is at least what we saw
+    if (lastHistoryMs_ >= 0 && nowMs > lastHistoryMs_ && newSamples > 0) {
+        const double observed = newSamples * 1000.0 / (nowMs - lastHistoryMs_);
+        samplesPerSecond_ = std::clamp(0.75 * samplesPerSecond_ + 0.25 * observed, 0.1, 10.0);
+    }
+    lastHistoryMs_ = nowMs;
+    due_[History] = nowMs + intervalMs(History);
+}
+
+void PollScheduler::requestFailed(qint64 nowMs)
+{
+    due_[Status] = std::min(due_[Status], nowMs);
+}
+
+void PollScheduler::setBackground(bool background, qint64 nowMs)
+{
+    if (background == background_) {
+        return;
+    }
+    background_ = background;
+
+    // Coming back to the foreground should show fresh numbers at once;
+    // going to the background simply stretches the next intervals
+    if (!background_ && connected_) {
+        due_[Status] = std::min(due_[Status], nowMs);
+        due_[History] = std::min(due_[History], nowMs);
+        due_[ObstructionMap] = std::min(due_[ObstructionMap], nowMs);
+    }
+}
+
+qint64 PollScheduler::intervalMs(Request request) const
+{
+    switch (request) {
+    case Status:
+        return (background_ && !isSuspended()) ? std::max(statusIntervalMs_, kStatusBackgroundMs)
+                                                : statusIntervalMs_;
+    case DeviceInfo:
+    case Location:
+        return background_ ? kRarelyChangesBackgroundMs : kRarelyChangesMs;
+    case ObstructionMap:
+        return background_ ? kObstructionMapBackgroundMs : kObstructionMapMs;
+    case Context:
+        return background_ ? kRarelyChangesMs : kContextMs;
+    case History: {
+        const double ring = ringSize_ > 0 ? ringSize_ : kDefaultRingSize;
+        const double safeSamples = ring * kRingFillBeforePoll;
+        const double samples = background_ ? safeSamples : std::min(kForegroundBatch, safeSamples);
+        const qint64 ms = static_cast<qint64>(samples * 1000.0 / samplesPerSecond_);
+        return std::clamp(ms, kHistoryMinMs, kHistoryMaxMs);
+    }
+    case RequestCount:
+        break;
+    }
+    return std::numeric_limits<qint64>::max() / 2;
+}
@@ -0,0 +1,90 @@
+#ifndef POLLSCHEDULER_H
+#define POLLSCHEDULER_H
+
+#include <QtGlobal>
+
+// Decides when each kind of request is next worth sending to a dish.
+//
+// get_status runs fast while the dish state is changing and relaxes to a
+// steady rate once it settles. get_location and get_device_info practically
+// never change and are polled rarely. get_history is timed to how quickly
+// the dish fills its ring buffers: often enough to keep the display fresh in
+// the foreground, and in the background only as often as needed to read the
+// rings before they wrap. The obstruction map builds up over hours and is
+// only fetched every few minutes, and only by callers that enable it.
+// dish_get_context names the cell, POP and gateway serving the dish, which
+// only change on handover, so it is polled about once a minute. While the
+// dish is unreachable only get_status is sent, with exponential backoff,
+// and everything else resumes once it answers again.
+//
+// All times are milliseconds from now().
+class PollScheduler
+{
+public:
+    enum Request {
+        Status,
+        DeviceInfo,
+        Location,
+        History,
+        ObstructionMap,
+        Context,
+        RequestCount
+    };
+
+    using RequestMask = unsigned;
+    static constexpr RequestMask bit(Request request) { return 1u << request; }
+
+    // Monotonic clock shared by every scheduler in the process
+    static qint64 now();
+
+    PollScheduler();
+
+    // Forget everything learned so far; all requests fall due at firstPollMs
+    void reset(qint64 firstPollMs);
+
+    // Disabled requests never fall due. Everything but ObstructionMap is
+    // enabled to begin with.
+    void setEnabled(Request request, bool enabled);
+    bool isEnabled(Request request) const { return enabled_ & bit(request); }
+
+    // Make every request due now, e.g. for a manual refresh
+    void expedite(qint64 nowMs);
+    void expedite(Request request, qint64 nowMs);
+
+    // Requests due at nowMs. Each returned request is rescheduled as if it
+    // was sent at nowMs.
+    RequestMask takeDue(qint64 nowMs);
+    qint64 nextDueMs() const;
+
+    // Feedback from a finished poll. stateKey summarises whatever counts as
+    // a state change (dish state, alerts, obstruction); counters that move
+    // every second must not be part of it.
+    void statusPolled(qint64 nowMs, bool connected, quint32 stateKey);
+    void historyPolled(qint64 nowMs, int newSamples, int ringSize);
+    // Any failed request; status is probed right away to confirm the outage
+    void requestFailed(qint64 nowMs);
+
+    // Hidden in the tray: everything runs at its slowest useful rate
+    void setBackground(bool background, qint64 nowMs);
+    bool isBackground() const { return background_; }
+
+    bool isConnected() const { return connected_; }
+    qint64 intervalMs(Request request) const;
+
+private:
+    bool isSuspended() const { return !connected_ && failures_ > 0; }
+
+    qint64 due_[RequestCount];
+    RequestMask enabled_ = ~bit(ObstructionMap);
+    qint64 statusIntervalMs_;
+    int failures_ = 0;
+    bool connected_ = false;
+    bool background_ = false;
+
+    quint32 stateKey_ = 0;
+    qint64 lastHistoryMs_ = -1;
+    double samplesPerSecond_ = 1.0;
+    int ringSize_ = 0;
+};
+
+#endif // POLLSCHEDULER_H
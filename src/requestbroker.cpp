@@ -0,0 +1,74 @@
+#include "requestbroker.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+// Status and history change every second; a consumer that has just been
+// handed one doesn't need another. Identity and location hardly ever change.
+constexpr qint64 kFastMaxAgeMs = 1000;
+constexpr qint64 kObstructionMapMaxAgeMs = 60 * 1000;
+constexpr qint64 kSlowMaxAgeMs = 10 * 60 * 1000;
+
+}
+
+qint64 RequestBroker::defaultMaxAgeMs(PollScheduler::Request request)
+{
+    switch (request) {
+    case PollScheduler::Status:
+    case PollScheduler::History:
+        return kFastMaxAgeMs;
+    case PollScheduler::ObstructionMap:
+        return kObstructionMapMaxAgeMs;
+    case PollScheduler::DeviceInfo:
+    case PollScheduler::Location:
+    case PollScheduler::Context:
+    case PollScheduler::RequestCount:
+        break;
+    }
+    return kSlowMaxAgeMs;
+}
+
+qint64 RequestBroker::ageMs(PollScheduler::Request request, qint64 nowMs) const
+{
+    if (!haveAnswer_[request]) {
+        return std::numeric_limits<qint64>::max();
+    }
+    return nowMs - answeredMs_[request];
+}
+
+void RequestBroker::answered(PollScheduler::Request request, qint64 nowMs)
+{
+    answeredMs_[request] = nowMs;
+    haveAnswer_[request] = true;
+}
+
+void RequestBroker::wait(PollScheduler::Request request, QObject *context, Callback callback)
+{
+    waiters_.push_back({ request, context, std::move(callback) });
+}
+
+void RequestBroker::deliver(PollScheduler::RequestMask requests, bool failed, const DishSnapshot &snapshot)
+{
+    if (waiters_.empty()) {
+        return;
+    }
+
+    auto answered = std::stable_partition(waiters_.begin(), waiters_.end(), [requests, failed](const Waiter &waiter) {
+        return !failed && !(requests & PollScheduler::bit(waiter.request));
+    });
+    for (auto it = answered; it != waiters_.end(); ++it) {
+        if (it->context) {
+            deliverLater(it->context, it->callback, snapshot);
+        }
+    }
+    waiters_.erase(answered, waiters_.end());
+}
+
+void RequestBroker::deliverLater(QObject *context, const Callback &callback, const DishSnapshot &snapshot)
+{
+    // Never from inside the caller's own read() or the client's publish
+    QMetaObject::invokeMethod(context, [callback, snapshot]() {
+        callback(snapshot);
+    }, Qt::QueuedConnection);
+}
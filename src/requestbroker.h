@@ -0,0 +1,60 @@
+#ifndef REQUESTBROKER_H
+#define REQUESTBROKER_H
+
+#include <QObject>
+#include <QPointer>
+#include <array>
+#include <functional>
+#include <vector>
+#include "dishsnapshot.h"
+#include "pollscheduler.h"
+
+// Keeps track of who is waiting for which reply from one dish, so that any
+// number of consumers asking for the same thing cost the dish one request.
+//
+// A read is served from the last reply of its kind while that is younger
+// than the caller's maximum age. Otherwise the caller waits: for the reply
+// already on its way if there is one, else for the one StarlinkClient sends
+// next. Whoever is waiting when a cycle is published gets that snapshot,
+// once, on their context object's thread.
+//
+// Times are PollScheduler::now() milliseconds.
+class RequestBroker
+{
+public:
+    using Callback = std::function<void(const DishSnapshot &snapshot)>;
+
+    // How stale a cached reply may be when the caller doesn't say
+    static qint64 defaultMaxAgeMs(PollScheduler::Request request);
+
+    // Age of the last good reply of this kind, or a huge number before one
+    qint64 ageMs(PollScheduler::Request request, qint64 nowMs) const;
+    bool isFresh(PollScheduler::Request request, qint64 maxAgeMs, qint64 nowMs) const
+    {
+        return ageMs(request, nowMs) <= maxAgeMs;
+    }
+
+    void answered(PollScheduler::Request request, qint64 nowMs);
+
+    void wait(PollScheduler::Request request, QObject *context, Callback callback);
+
+    // A cycle that sent requests was published. Everyone waiting for one of
+    // them is answered; after a failed cycle everyone is, rather than left
+    // waiting for a dish that isn't answering.
+    void deliver(PollScheduler::RequestMask requests, bool failed, const DishSnapshot &snapshot);
+
+    static void deliverLater(QObject *context, const Callback &callback, const DishSnapshot &snapshot);
+
+private:
+    struct Waiter {
+        PollScheduler::Request request;
+        QPointer<QObject> context;
+        Callback callback;
+    };
+
+    std::array<qint64, PollScheduler::RequestCount> answeredMs_ {};
+    std::array<bool, PollScheduler::RequestCount> haveAnswer_ {};
+    std::vector<Waiter> waiters_;
+};
+
+#endif // REQUESTBROKER_H
@@ -0,0 +1,309 @@
+#include "routerclient.h"
+#include <QDateTime>
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+// The router is on the LAN like the dish, and even its history reply is
+// small: two rings of floats
+constexpr int kRequestDeadlineMs = 2000;
+
+// The router's history is a few hours of 1 Hz pings; nothing a LAN
+// comparison needs longer than the dish's default store
+constexpr size_t kHistoryCapacity = 6 * 3600;
+
+}
+
+RouterClient::RouterClient(const QString &target, QObject *parent)
+    : RouterClient(target, std::make_shared<TransportPool>(1), parent)
+{
+}
+
+RouterClient::RouterClient(const QString &target, std::shared_ptr<TransportPool> pool, QObject *parent)
+    : QObject(parent), pool_(std::move(pool)), target_(target), telemetry_(kHistoryCapacity)
+{
+    cq_ = pool_->nextQueue();
+
+    // Nothing of the dish's besides these, and no obstruction map
+    scheduler_.setEnabled(PollScheduler::Location, false);
+    scheduler_.setEnabled(PollScheduler::ObstructionMap, false);
+    scheduler_.reset(PollScheduler::now());
+
+    pollTimer_ = new QTimer(this);
+    pollTimer_->setSingleShot(true);
+    pollTimer_->setTimerType(Qt::CoarseTimer);
+    connect(pollTimer_, &QTimer::timeout, this, [this]() {
+        pollDue(PollScheduler::now());
+        armPollTimer();
+    });
+}
+
+RouterClient::~RouterClient()
+{
+    stopMonitoring();
+    for (RouterCall *call : inFlight_) {
+        call->context.TryCancel();
+    }
+    operations_.drain(this);
+}
+
+void RouterClient::startMonitoring()
+{
+    monitoring_ = true;
+    scheduler_.expedite(PollScheduler::now());
+    armPollTimer();
+}
+
+void RouterClient::stopMonitoring()
+{
+    monitoring_ = false;
+    pollTimer_->stop();
+}
+
+void RouterClient::setBackground(bool background)
+{
+    scheduler_.setBackground(background, PollScheduler::now());
+    armPollTimer();
+}
+
+void RouterClient::armPollTimer()
+{
+    if (!monitoring_ || !inFlight_.empty()) {
+        return;
+    }
+    const qint64 wait = std::max<qint64>(0, nextPollMs() - PollScheduler::now());
+    pollTimer_->start(static_cast<int>(std::min<qint64>(wait, std::numeric_limits<int>::max())));
+}
+
+void RouterClient::ensureChannel()
+{
+    if (channel_) {
+        return;
+    }
+    channel_ = pool_->channel(target_.toStdString());
+    stub_ = SpaceX::API::Device::Device::NewStub(channel_);
+}
+
+void RouterClient::pollDue(qint64 nowMs)
+{
+    if (!inFlight_.empty()) {
+        return;
+    }
+    const PollScheduler::RequestMask due = scheduler_.takeDue(nowMs);
+    if (due == 0) {
+        return;
+    }
+    ensureChannel();
+
+    cycleRequests_ = due;
+    cycleFailed_ = false;
+    cycleAnswered_ = false;
+    historySamples_ = 0;
+    if (due & PollScheduler::bit(PollScheduler::Status)) {
+        issueRequest(RequestKind::PingMetrics);
+        issueRequest(RequestKind::Clients);
+    }
+    if (due & PollScheduler::bit(PollScheduler::History)) {
+        issueRequest(RequestKind::History);
+    }
+    if (due & PollScheduler::bit(PollScheduler::DeviceInfo)) {
+        issueRequest(RequestKind::Diagnostics);
+    }
+}
+
+void RouterClient::issueRequest(RequestKind kind)
+{
+    SpaceX::API::Device::Request request;
+    switch (kind) {
+    case RequestKind::PingMetrics:
+        request.mutable_wifi_get_ping_metrics();
+        break;
+    case RequestKind::Clients:
+        request.mutable_wifi_get_clients();
+        break;
+    case RequestKind::History:
+        request.mutable_get_history();
+        break;
+    case RequestKind::Diagnostics:
+        request.mutable_wifi_get_diagnostics();
+        break;
+    }
+
+    auto *call = new RouterCall;
+    call->client = this;
+    call->kind = kind;
+    call->context.set_deadline(TransportPool::deadlineAfter(kRequestDeadlineMs));
+
+    operations_.started();
+    call->reader = stub_->PrepareAsyncHandle(&call->context, request, cq_);
+    call->reader->StartCall();
+    call->reader->Finish(&call->response, &call->status, call);
+    inFlight_.push_back(call);
+}
+
+void RouterClient::RouterCall::complete(bool)
+{
+    std::shared_ptr<RouterCall> call(this);
+    RouterClient *owner = client;
+    QMetaObject::invokeMethod(owner, [owner, call]() {
+        owner->handleResponse(call.get());
+    }, Qt::QueuedConnection);
+    owner->operations_.finished();
+}
+
+void RouterClient::handleResponse(RouterCall *call)
+{
+    inFlight_.erase(std::remove(inFlight_.begin(), inFlight_.end(), call), inFlight_.end());
+
+    const qint64 now = PollScheduler::now();
+    const grpc::Status &status = call->status;
+    const SpaceX::API::Device::Response &response = call->response;
+    if (TransportPool::isUnreachable(status)) {
+        cycleFailed_ = true;
+    } else {
+        cycleAnswered_ = true;
+    }
+
+    if (status.ok()) {
+        switch (call->kind) {
+        case RequestKind::PingMetrics:
+            if (response.has_wifi_get_ping_metrics()) {
+                const auto &internet = response.wifi_get_ping_metrics().internet();
+                pingMetrics_.valid = true;
+                pingMetrics_.latencyMeanMs = internet.latency_mean_ms();
+                pingMetrics_.latencyStddevMs = internet.latency_stddev_ms();
+                pingMetrics_.dropRate = internet.drop_rate();
+                pingMetrics_.dropRate5m = internet.drop_rate_5m();
+                pingMetrics_.dropRate1h = internet.drop_rate_1h();
+                pingMetrics_.secondsSinceLastSuccess = internet.seconds_since_last_success();
+                emit pingMetricsUpdated(pingMetrics_);
+            }
+            break;
+        case RequestKind::Clients:
+            if (response.has_wifi_get_clients()) {
+                clients_.update(QDateTime::currentMSecsSinceEpoch(), response.wifi_get_clients());
+                emit clientsUpdated(clients_.connectedCount());
+            }
+            break;
+        case RequestKind::History:
+            if (response.has_wifi_get_history()) {
+                applyHistory(response.wifi_get_history());
+            }
+            break;
+        case RequestKind::Diagnostics:
+            if (response.has_wifi_get_diagnostics()) {
+                applyDiagnostics(response.wifi_get_diagnostics());
+            }
+            break;
+        }
+    } else if (!TransportPool::isUnreachable(status)) {
+        qWarning("Router %s: %s", qPrintable(target_), status.error_message().c_str());
+    }
+
+    if (!inFlight_.empty()) {
+        return;
+    }
+    // Like the dish: only transport failures count as the router being gone,
+    // and there is no state to speed polling up for
+    const bool connected = cycleAnswered_ && !cycleFailed_;
+    if (cycleRequests_ & PollScheduler::bit(PollScheduler::Status)) {
+        scheduler_.statusPolled(now, connected, 0);
+    } else if (cycleFailed_) {
+        scheduler_.requestFailed(now);
+    }
+    if ((cycleRequests_ & PollScheduler::bit(PollScheduler::History)) && !cycleFailed_) {
+        scheduler_.historyPolled(now, historySamples_, historyRingSize_);
+    }
+    setConnected(connected);
+    armPollTimer();
+}
+
+void RouterClient::applyHistory(const SpaceX::API::Device::WifiGetHistoryResponse &history)
+{
+    const int dropSize = history.ping_drop_rate_size();
+    const int latencySize = history.ping_latency_ms_size();
+    int ringSize = std::min(dropSize, latencySize);
+    if (ringSize == 0) {
+        ringSize = std::max(dropSize, latencySize);
+    }
+    if (ringSize == 0) {
+        return;
+    }
+
+    // The same counter scheme as the dish's rings, see HistoryDecoder
+    const uint64_t current = history.current();
+    if (historyPrimed_ && current < lastCurrent_) {
+        historyPrimed_ = false;
+    }
+    const uint64_t fresh = std::min<uint64_t>(historyPrimed_ ? current - lastCurrent_ : current,
+                                              static_cast<uint64_t>(ringSize));
+    lastCurrent_ = current;
+    historyPrimed_ = true;
+    historySamples_ = static_cast<int>(fresh);
+    historyRingSize_ = ringSize;
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const int64_t newestMs = QDateTime::currentMSecsSinceEpoch();
+    int stored = 0;
+    for (uint64_t index = current - fresh; index < current; ++index) {
+        HistorySample sample;
+        sample.index = index;
+        sample.downlinkBps = nan;
+        sample.uplinkBps = nan;
+        sample.snr = nan;
+        sample.dropRate = dropSize > 0 ? history.ping_drop_rate(static_cast<int>(index % dropSize)) : nan;
+        sample.latencyMs = latencySize > 0 ? history.ping_latency_ms(static_cast<int>(index % latencySize)) : nan;
+
+        // One sample a second, the newest taken about now; the store wants
+        // timestamps that only move forward
+        const int64_t timestampMs = newestMs - static_cast<int64_t>(current - 1 - index) * 1000;
+        if (timestampMs <= lastStoredMs_) {
+            continue;
+        }
+        telemetry_.append(timestampMs, sample);
+        lastStoredMs_ = timestampMs;
+        ++stored;
+    }
+
+    if (stored > 0) {
+        emit telemetryAppended(stored);
+    }
+}
+
+void RouterClient::applyDiagnostics(const SpaceX::API::Device::WifiGetDiagnosticsResponse &response)
+{
+    Diagnostics diagnostics;
+    diagnostics.valid = true;
+    for (const auto &network : response.wifi_networks()) {
+        if (network.band() == SpaceX::API::Device::WifiNetwork::WIFI_2_4GHZ) {
+            diagnostics.channel2Ghz = static_cast<int>(network.channel());
+        } else if (network.band() == SpaceX::API::Device::WifiNetwork::WIFI_5GHZ) {
+            diagnostics.channel5Ghz = static_cast<int>(network.channel());
+        }
+    }
+
+    using Network = SpaceX::API::Device::WifiScanResults::Network;
+    for (const auto &network : response.network_scan().networks()) {
+        ++diagnostics.networksScanned;
+        if (network.source() == Network::SCAN_2_4GHZ && diagnostics.channel2Ghz != 0
+            && network.channel() == diagnostics.channel2Ghz) {
+            ++diagnostics.sameChannel2Ghz;
+        } else if (network.source() == Network::SCAN_5GHZ && diagnostics.channel5Ghz != 0
+                   && network.channel() == diagnostics.channel5Ghz) {
+            ++diagnostics.sameChannel5Ghz;
+        }
+    }
+
+    diagnostics_ = diagnostics;
+    emit diagnosticsUpdated(diagnostics_);
+}
+
+void RouterClient::setConnected(bool connected)
+{
+    if (connected == connected_) {
+        return;
+    }
+    connected_ = connected;
+    emit statusChanged(connected);
+}
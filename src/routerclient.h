@@ -0,0 +1,140 @@
+#ifndef ROUTERCLIENT_H
+#define ROUTERCLIENT_H
+
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <grpcpp/grpcpp.h>
+#include "pollscheduler.h"
+#include "telemetrystore.h"
+#include "transportpool.h"
+#include "wificlienttable.h"
+#include "spacex/api/device/service.grpc.pb.h"
+
+// Polls the Starlink Wi-Fi router that sits behind a dish.
+//
+// It runs on a TransportPool like StarlinkClient, usually the same one, and
+// keeps its own PollScheduler; the router's requests ride on the dish's
+// kinds so they get the same pacing, backoff and background behaviour:
+//
+//   Status      wifi_get_ping_metrics and wifi_get_clients
+//   History     get_history, which the router answers with its own rings
+//   DeviceInfo  wifi_get_diagnostics
+//
+// The router's history goes into a TelemetryStore with Latency and DropRate
+// filled in from its internet pings and the other metrics NaN, so it can be
+// bucketed against the dish's store by a LinkCorrelator.
+class RouterClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct PingMetrics {
+        bool valid = false;
+        float latencyMeanMs = 0.0f;
+        float latencyStddevMs = 0.0f;
+        float dropRate = 0.0f;
+        float dropRate5m = 0.0f;
+        float dropRate1h = 0.0f;
+        float secondsSinceLastSuccess = 0.0f;
+    };
+
+    // The router's own networks and how crowded their channels are
+    struct Diagnostics {
+        bool valid = false;
+        int channel2Ghz = 0;
+        int channel5Ghz = 0;
+        int networksScanned = 0;
+        // Neighbouring networks on the same channels as ours
+        int sameChannel2Ghz = 0;
+        int sameChannel5Ghz = 0;
+    };
+
+    explicit RouterClient(const QString &target = "192.168.1.1:9000", QObject *parent = nullptr);
+    RouterClient(const QString &target, std::shared_ptr<TransportPool> pool, QObject *parent = nullptr);
+    ~RouterClient();
+
+    QString target() const { return target_; }
+
+    void startMonitoring();
+    void stopMonitoring();
+    void pollDue(qint64 nowMs);
+    qint64 nextPollMs() const { return scheduler_.nextDueMs(); }
+    PollScheduler &scheduler() { return scheduler_; }
+    void setBackground(bool background);
+
+    bool isConnected() const { return connected_; }
+    const TelemetryStore &telemetry() const { return telemetry_; }
+    const WifiClientTable &clients() const { return clients_; }
+    const PingMetrics &pingMetrics() const { return pingMetrics_; }
+    const Diagnostics &diagnostics() const { return diagnostics_; }
+
+signals:
+    void statusChanged(bool connected);
+    void pingMetricsUpdated(const RouterClient::PingMetrics &metrics);
+    void clientsUpdated(int connected);
+    void telemetryAppended(int samples);
+    void diagnosticsUpdated(const RouterClient::Diagnostics &diagnostics);
+
+private:
+    enum class RequestKind {
+        PingMetrics,
+        Clients,
+        History,
+        Diagnostics
+    };
+
+    // Owns itself once started, like StarlinkClient's calls
+    struct RouterCall : CompletionTag {
+        void complete(bool ok) override;
+
+        RouterClient *client = nullptr;
+        RequestKind kind = RequestKind::PingMetrics;
+        grpc::ClientContext context;
+        SpaceX::API::Device::Response response;
+        grpc::Status status;
+        std::unique_ptr<grpc::ClientAsyncResponseReader<SpaceX::API::Device::Response>> reader;
+    };
+
+    void ensureChannel();
+    void issueRequest(RequestKind kind);
+    void handleResponse(RouterCall *call);
+    void applyHistory(const SpaceX::API::Device::WifiGetHistoryResponse &history);
+    void applyDiagnostics(const SpaceX::API::Device::WifiGetDiagnosticsResponse &response);
+    void setConnected(bool connected);
+    void armPollTimer();
+
+    std::shared_ptr<TransportPool> pool_;
+    QString target_;
+    std::shared_ptr<grpc::Channel> channel_;
+    std::unique_ptr<SpaceX::API::Device::Device::Stub> stub_;
+    grpc::CompletionQueue *cq_;
+
+    PendingOperations operations_;
+
+    std::vector<RouterCall *> inFlight_;
+    PollScheduler::RequestMask cycleRequests_ = 0;
+    bool cycleFailed_ = false;
+    bool cycleAnswered_ = false;
+
+    PollScheduler scheduler_;
+    QTimer *pollTimer_;
+    bool monitoring_ = false;
+    bool connected_ = false;
+
+    TelemetryStore telemetry_;
+    WifiClientTable clients_;
+    PingMetrics pingMetrics_;
+    Diagnostics diagnostics_;
+
+    uint64_t lastCurrent_ = 0;
+    bool historyPrimed_ = false;
+    int historySamples_ = 0;  // fresh in the last reply
+    int historyRingSize_ = 0;
+    int64_t lastStoredMs_ = 0;
+};
+
+#endif // ROUTERCLIENT_H
@@ -0,0 +1,627 @@
+#include "segmentlog.h"
+#include "historycodec.h"
+#include <QDir>
+#include <QSaveFile>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+constexpr char kMagic[8] = { 'S', 'L', 'S', 'E', 'G', 'L', 'O', 'G' };
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderBytes = 4096;
+constexpr int64_t kSyncIntervalMs = 10 * 1000;
+constexpr int64_t kMaxOffsetMs = std::numeric_limits<uint32_t>::max();
+
+constexpr char kArchiveMagic[8] = { 'S', 'L', 'A', 'R', 'C', 'H', 'I', 'V' };
+constexpr uint32_t kArchiveVersion = 1;
+// Small enough that a narrow query decodes little it doesn't need, large
+// enough that the per-block index entry and raw first values don't matter
+constexpr size_t kBlockRecords = 1024;
+
+// Stored in host byte order; the files are not meant to move between
+// machines of different endianness
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t capacity;
+    int64_t baseTimestampMs;
+    int64_t lastTimestampMs;
+    uint32_t count;
+    uint32_t reserved;
+    float min[TelemetryStore::MetricCount];
+    float max[TelemetryStore::MetricCount];
+};
+static_assert(sizeof(Header) <= kHeaderBytes, "segment header outgrew its page");
+
+// An archive is this header, blockCount BlockEntries and then the encoded
+// blocks back to back
+struct ArchiveHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t blockCount;
+    int64_t firstTimestampMs;
+    int64_t lastTimestampMs;
+    uint32_t count;
+    uint32_t reserved;
+    float min[TelemetryStore::MetricCount];
+    float max[TelemetryStore::MetricCount];
+};
+
+struct BlockEntry {
+    int64_t firstTimestampMs;
+    int64_t lastTimestampMs;
+    uint64_t offset;
+    uint32_t bytes;
+    uint32_t count;
+};
+
+// Byte offsets of each column; every column starts 8-byte aligned
+struct Layout {
+    explicit Layout(uint32_t capacity)
+    {
+        const auto align = [](size_t n) { return (n + 7) & ~size_t(7); };
+        size_t at = kHeaderBytes;
+        timestamps = at;
+        at = align(at + capacity * sizeof(uint32_t));
+        for (size_t &column : columns) {
+            column = at;
+            at = align(at + capacity * sizeof(float));
+        }
+        obstructed = at;
+        at += (capacity + 63) / 64 * sizeof(uint64_t);
+        total = at;
+    }
+
+    size_t timestamps;
+    size_t columns[TelemetryStore::MetricCount];
+    size_t obstructed;
+    size_t total;
+};
+
+QString segmentName(int64_t baseTimestampMs)
+{
+    // Zero-padded so that name order is time order
+    return QString("%1.seg").arg(baseTimestampMs, 16, 10, QChar('0'));
+}
+
+QString archivePath(const QString &segmentPath)
+{
+    return segmentPath.chopped(4) + ".slz";
+}
+
+}
+
+struct SegmentLog::Active {
+    explicit Active(const QString &path, uint32_t capacity) : file(path), layout(capacity) {}
+
+    Header *header() const { return reinterpret_cast<Header *>(map); }
+    uint32_t *timestamps() const { return reinterpret_cast<uint32_t *>(map + layout.timestamps); }
+    float *column(int metric) const { return reinterpret_cast<float *>(map + layout.columns[metric]); }
+    uint64_t *obstructed() const { return reinterpret_cast<uint64_t *>(map + layout.obstructed); }
+
+    QFile file;
+    Layout layout;
+    uchar *map = nullptr;
+};
+
+SegmentLog::SegmentLog(const QString &directory, uint32_t segmentCapacity)
+    : directory_(directory), capacity_(std::max<uint32_t>(segmentCapacity, 1)),
+      scratch_(std::make_unique<HistoryCodec::DecodedBlock>())
+{
+}
+
+SegmentLog::~SegmentLog()
+{
+    close();
+}
+
+bool SegmentLog::open(QString *error)
+{
+    close();
+
+    if (!QDir(directory_).mkpath(".")) {
+        if (error) {
+            *error = QString("can't create %1").arg(directory_);
+        }
+        return false;
+    }
+    readHeaders(false);
+
+    // Keep filling the newest segment if it was left with room
+    const bool resume = !segments_.isEmpty() && !segments_.last().compressed && segments_.last().count < capacity_;
+    if (resume) {
+        QString reason;
+        if (!mapSegment(segments_.last().path, true, &active_, &reason)) {
+            qWarning("Can't reopen %s for appending: %s", qPrintable(segments_.last().path), qPrintable(reason));
+            active_.reset();
+        }
+    }
+
+    // Everything else is sealed; archive what an earlier run didn't get to
+    for (int i = 0; i < segments_.size() - (active_ ? 1 : 0); ++i) {
+        SegmentInfo &info = segments_[i];
+        if (info.compressed) {
+            continue;
+        }
+        std::unique_ptr<Active> segment;
+        QString reason;
+        if (mapSegment(info.path, false, &segment, &reason)) {
+            archiveSegment(*segment, &info);
+        }
+    }
+
+    opened_ = true;
+    return true;
+}
+
+bool SegmentLog::openReadOnly(QString *error)
+{
+    close();
+
+    if (!QDir(directory_).exists()) {
+        if (error) {
+            *error = QString("%1 doesn't exist").arg(directory_);
+        }
+        return false;
+    }
+    readHeaders(true);
+    readOnly_ = true;
+    opened_ = true;
+    return true;
+}
+
+void SegmentLog::readHeaders(bool readOnly)
+{
+    // Only headers are read here; columns stay on disk until queried
+    QDir dir(directory_);
+    const QStringList names = dir.entryList(QStringList() << "*.seg" << "*.slz", QDir::Files, QDir::Name);
+    for (const QString &name : names) {
+        const QString path = dir.filePath(name);
+        SegmentInfo info;
+        QString reason;
+
+        if (name.endsWith(".slz")) {
+            if (!readArchiveInfo(path, &info, &reason)) {
+                qWarning("Skipping archive %s: %s", qPrintable(name), qPrintable(reason));
+                continue;
+            }
+            // The segment it was made from sorts just before it and is only
+            // still around if removing it failed, or if the writer is
+            // removing it right now
+            if (!segments_.isEmpty() && archivePath(segments_.last().path) == path) {
+                if (!readOnly) {
+                    QFile::remove(segments_.last().path);
+                }
+                segments_.last() = info;
+            } else {
+                segments_.append(info);
+            }
+            continue;
+        }
+
+        std::unique_ptr<Active> segment;
+        if (!mapSegment(path, false, &segment, &reason)) {
+            qWarning("Skipping segment %s: %s", qPrintable(name), qPrintable(reason));
+            continue;
+        }
+
+        const Header *header = segment->header();
+        info.path = path;
+        info.firstTimestampMs = header->baseTimestampMs;
+        info.lastTimestampMs = header->lastTimestampMs;
+        info.count = header->count;
+        std::copy(std::begin(header->min), std::end(header->min), info.min);
+        std::copy(std::begin(header->max), std::end(header->max), info.max);
+        segments_.append(info);
+    }
+}
+
+void SegmentLog::close()
+{
+    if (active_) {
+#ifdef Q_OS_UNIX
+        msync(active_->map, active_->layout.total, MS_SYNC);
+#endif
+        active_.reset();
+    }
+    segments_.clear();
+    opened_ = false;
+    readOnly_ = false;
+}
+
+bool SegmentLog::mapSegment(const QString &path, bool writable, std::unique_ptr<Active> *active, QString *error) const
+{
+    auto segment = std::make_unique<Active>(path, capacity_);
+    if (!segment->file.open(writable ? QIODevice::ReadWrite : QIODevice::ReadOnly)) {
+        *error = segment->file.errorString();
+        return false;
+    }
+
+    Header header;
+    if (segment->file.read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header)
+        || std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion) {
+        *error = "not a segment file";
+        return false;
+    }
+    // Segments written with a different capacity have a different layout
+    if (header.capacity != capacity_ || header.count > capacity_
+        || segment->file.size() < static_cast<qint64>(segment->layout.total)) {
+        *error = "unexpected segment layout";
+        return false;
+    }
+
+    segment->map = segment->file.map(0, segment->layout.total);
+    if (!segment->map) {
+        *error = segment->file.errorString();
+        return false;
+    }
+
+    *active = std::move(segment);
+    return true;
+}
+
+bool SegmentLog::startSegment(int64_t baseTimestampMs)
+{
+    sync();
+    if (active_) {
+        archiveSegment(*active_, &segments_.last());
+    }
+    active_.reset();
+
+    const QString path = QDir(directory_).filePath(segmentName(baseTimestampMs));
+    if (QFile::exists(path)) {
+        // Only happens if the clock went back onto an older segment
+        qWarning("Segment %s already exists", qPrintable(path));
+        return false;
+    }
+    auto segment = std::make_unique<Active>(path, capacity_);
+
+    // Sized up front so the map never has to grow; untouched pages stay
+    // sparse on disk
+    if (!segment->file.open(QIODevice::ReadWrite | QIODevice::Truncate)
+        || !segment->file.resize(static_cast<qint64>(segment->layout.total))) {
+        qWarning("Can't create segment %s: %s", qPrintable(path), qPrintable(segment->file.errorString()));
+        return false;
+    }
+    segment->map = segment->file.map(0, segment->layout.total);
+    if (!segment->map) {
+        qWarning("Can't map segment %s: %s", qPrintable(path), qPrintable(segment->file.errorString()));
+        return false;
+    }
+
+    Header *header = segment->header();
+    std::memcpy(header->magic, kMagic, sizeof(kMagic));
+    header->version = kVersion;
+    header->capacity = capacity_;
+    header->baseTimestampMs = baseTimestampMs;
+    header->lastTimestampMs = baseTimestampMs;
+    header->count = 0;
+    std::fill(std::begin(header->min), std::end(header->min), std::numeric_limits<float>::infinity());
+    std::fill(std::begin(header->max), std::end(header->max), -std::numeric_limits<float>::infinity());
+
+    SegmentInfo info;
+    info.path = path;
+    info.firstTimestampMs = baseTimestampMs;
+    info.lastTimestampMs = baseTimestampMs;
+    segments_.append(info);
+
+    active_ = std::move(segment);
+    return true;
+}
+
+bool SegmentLog::append(int64_t timestampMs, const HistorySample &sample)
+{
+    if (!opened_ || readOnly_) {
+        return false;
+    }
+
+    const Header *current = active_ ? active_->header() : nullptr;
+    if (!current || current->count >= capacity_
+        || (current->count > 0 && timestampMs < current->lastTimestampMs)
+        || timestampMs - current->baseTimestampMs > kMaxOffsetMs
+        || timestampMs < current->baseTimestampMs) {
+        if (!startSegment(timestampMs)) {
+            return false;
+        }
+    }
+
+    Header *header = active_->header();
+    const uint32_t i = header->count;
+
+    const float values[TelemetryStore::MetricCount] = {
+        sample.downlinkBps, sample.uplinkBps, sample.latencyMs, sample.dropRate, sample.snr
+    };
+
+    active_->timestamps()[i] = static_cast<uint32_t>(timestampMs - header->baseTimestampMs);
+    for (int m = 0; m < TelemetryStore::MetricCount; ++m) {
+        active_->column(m)[i] = values[m];
+        if (!std::isnan(values[m])) {
+            header->min[m] = std::min(header->min[m], values[m]);
+            header->max[m] = std::max(header->max[m], values[m]);
+        }
+    }
+
+    uint64_t &word = active_->obstructed()[i / 64];
+    const uint64_t bit = uint64_t(1) << (i % 64);
+    word = sample.obstructed ? (word | bit) : (word & ~bit);
+
+    // The count goes last: it is what makes the record visible, and the
+    // fence keeps the record's stores from being reordered after it
+    header->lastTimestampMs = timestampMs;
+    std::atomic_thread_fence(std::memory_order_release);
+    header->count = i + 1;
+    updateInfo();
+
+    if (timestampMs - lastSyncMs_ >= kSyncIntervalMs) {
+        sync();
+        lastSyncMs_ = timestampMs;
+    }
+    return true;
+}
+
+void SegmentLog::updateInfo()
+{
+    const Header *header = active_->header();
+    SegmentInfo &info = segments_.last();
+    info.lastTimestampMs = header->lastTimestampMs;
+    info.count = header->count;
+    std::copy(std::begin(header->min), std::end(header->min), info.min);
+    std::copy(std::begin(header->max), std::end(header->max), info.max);
+}
+
+bool SegmentLog::archiveSegment(const Active &segment, SegmentInfo *info)
+{
+    const Header *header = segment.header();
+    if (header->count == 0) {
+        return false;
+    }
+
+    const uint32_t blockCount = static_cast<uint32_t>((header->count + kBlockRecords - 1) / kBlockRecords);
+    std::vector<BlockEntry> index(blockCount);
+    std::vector<uint8_t> payload;
+    payload.reserve(header->count * 4);
+
+    const uint64_t payloadStart = sizeof(ArchiveHeader) + blockCount * sizeof(BlockEntry);
+    for (uint32_t b = 0; b < blockCount; ++b) {
+        const size_t first = b * kBlockRecords;
+        const size_t count = std::min<size_t>(kBlockRecords, header->count - first);
+        const Span span = spanOf(segment, first, count);
+
+        BlockEntry &entry = index[b];
+        entry.firstTimestampMs = span.timestampAt(first);
+        entry.lastTimestampMs = span.timestampAt(first + count - 1);
+        entry.offset = payloadStart + payload.size();
+        entry.count = static_cast<uint32_t>(count);
+        HistoryCodec::encodeBlock(span, &payload);
+        entry.bytes = static_cast<uint32_t>(payloadStart + payload.size() - entry.offset);
+    }
+
+    ArchiveHeader archive = {};
+    std::memcpy(archive.magic, kArchiveMagic, sizeof(kArchiveMagic));
+    archive.version = kArchiveVersion;
+    archive.blockCount = blockCount;
+    archive.firstTimestampMs = header->baseTimestampMs;
+    archive.lastTimestampMs = header->lastTimestampMs;
+    archive.count = header->count;
+    std::copy(std::begin(header->min), std::end(header->min), archive.min);
+    std::copy(std::begin(header->max), std::end(header->max), archive.max);
+
+    // Written to a temporary and renamed into place, so an archive that
+    // exists is always complete and the segment can go
+    const QString path = archivePath(segment.file.fileName());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)
+        || file.write(reinterpret_cast<const char *>(&archive), sizeof(archive)) != sizeof(archive)
+        || file.write(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(BlockEntry))
+               != static_cast<qint64>(index.size() * sizeof(BlockEntry))
+        || file.write(reinterpret_cast<const char *>(payload.data()), payload.size())
+               != static_cast<qint64>(payload.size())
+        || !file.commit()) {
+        qWarning("Can't archive %s: %s", qPrintable(segment.file.fileName()), qPrintable(file.errorString()));
+        return false;
+    }
+
+    QFile::remove(segment.file.fileName());
+    info->path = path;
+    info->compressed = true;
+    return true;
+}
+
+bool SegmentLog::readArchiveInfo(const QString &path, SegmentInfo *info, QString *error) const
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = file.errorString();
+        return false;
+    }
+
+    ArchiveHeader header;
+    if (file.read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header)
+        || std::memcmp(header.magic, kArchiveMagic, sizeof(kArchiveMagic)) != 0
+        || header.version != kArchiveVersion) {
+        *error = "not an archive file";
+        return false;
+    }
+    if (file.size() < static_cast<qint64>(sizeof(header) + header.blockCount * sizeof(BlockEntry))) {
+        *error = "truncated block index";
+        return false;
+    }
+
+    info->path = path;
+    info->firstTimestampMs = header.firstTimestampMs;
+    info->lastTimestampMs = header.lastTimestampMs;
+    info->count = header.count;
+    info->compressed = true;
+    std::copy(std::begin(header.min), std::end(header.min), info->min);
+    std::copy(std::begin(header.max), std::end(header.max), info->max);
+    return true;
+}
+
+SegmentLog::Span SegmentLog::spanOf(const Active &segment, size_t first, size_t count)
+{
+    Span span;
+    span.baseTimestampMs = segment.header()->baseTimestampMs;
+    span.timestampOffsets = segment.timestamps();
+    for (int m = 0; m < TelemetryStore::MetricCount; ++m) {
+        span.columns[m] = segment.column(m);
+    }
+    span.obstructed = segment.obstructed();
+    span.first = first;
+    span.count = count;
+    return span;
+}
+
+void SegmentLog::sync()
+{
+#ifdef Q_OS_UNIX
+    if (active_) {
+        msync(active_->map, active_->layout.total, MS_ASYNC);
+    }
+#endif
+}
+
+int64_t SegmentLog::lastTimestampMs() const
+{
+    for (auto it = segments_.crbegin(); it != segments_.crend(); ++it) {
+        if (it->count > 0) {
+            return it->lastTimestampMs;
+        }
+    }
+    return std::numeric_limits<int64_t>::min();
+}
+
+size_t SegmentLog::query(int64_t fromMs, int64_t toMs, const std::function<void(const Span &)> &visit) const
+{
+    size_t visited = 0;
+    for (int i = 0; i < segments_.size(); ++i) {
+        visited += querySegment(i, fromMs, toMs, visit, scratch_.get());
+    }
+    return visited;
+}
+
+size_t SegmentLog::querySegment(int index, int64_t fromMs, int64_t toMs,
+                                const std::function<void(const Span &)> &visit,
+                                HistoryCodec::DecodedBlock *scratch) const
+{
+    const SegmentInfo &info = segments_.at(index);
+    if (info.count == 0 || info.lastTimestampMs < fromMs || info.firstTimestampMs > toMs) {
+        return 0;
+    }
+    if (info.compressed) {
+        return queryArchive(info, fromMs, toMs, visit, scratch);
+    }
+
+    // The segment being written is already mapped; older ones are mapped
+    // just for the duration of the visit
+    std::unique_ptr<Active> mapped;
+    const Active *segment = nullptr;
+    if (active_ && active_->file.fileName() == info.path) {
+        segment = active_.get();
+    } else {
+        QString reason;
+        if (!mapSegment(info.path, false, &mapped, &reason)) {
+            // A reader may find the writer has archived it since
+            SegmentInfo archived;
+            QString ignored;
+            if (readOnly_ && readArchiveInfo(archivePath(info.path), &archived, &ignored)) {
+                return queryArchive(archived, fromMs, toMs, visit, scratch);
+            }
+            qWarning("Can't read segment %s: %s", qPrintable(info.path), qPrintable(reason));
+            return 0;
+        }
+        segment = mapped.get();
+    }
+
+    // Pairs with the fence in append(): every record below the count is
+    // complete
+    const Header *header = segment->header();
+    const uint32_t count = header->count;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint32_t *offsets = segment->timestamps();
+    const uint32_t *end = offsets + std::min(count, capacity_);
+
+    const auto offsetOf = [header](int64_t ms) {
+        return static_cast<uint32_t>(std::clamp<int64_t>(ms - header->baseTimestampMs, 0, kMaxOffsetMs));
+    };
+    const uint32_t *first = std::lower_bound(offsets, end, offsetOf(fromMs));
+    const uint32_t *last = std::upper_bound(first, end, offsetOf(toMs));
+    if (first == last) {
+        return 0;
+    }
+
+    const Span span = spanOf(*segment, static_cast<size_t>(first - offsets), static_cast<size_t>(last - first));
+    visit(span);
+    return span.count;
+}
+
+size_t SegmentLog::queryArchive(const SegmentInfo &info, int64_t fromMs, int64_t toMs,
+                                const std::function<void(const Span &)> &visit,
+                                HistoryCodec::DecodedBlock *scratch) const
+{
+    // Mapped rather than read so that only the index and the blocks that
+    // get decoded are paged in
+    QFile file(info.path);
+    uchar *map = file.open(QIODevice::ReadOnly) ? file.map(0, file.size()) : nullptr;
+    if (!map) {
+        qWarning("Can't read archive %s: %s", qPrintable(info.path), qPrintable(file.errorString()));
+        return 0;
+    }
+
+    // The file may have been replaced or cut short since its info was read,
+    // so nothing in it is trusted before it is known to be inside the map
+    const size_t size = static_cast<size_t>(file.size());
+    if (size < sizeof(ArchiveHeader)) {
+        qWarning("Skipping truncated archive %s", qPrintable(info.path));
+        return 0;
+    }
+    const ArchiveHeader *header = reinterpret_cast<const ArchiveHeader *>(map);
+    if (std::memcmp(header->magic, kArchiveMagic, sizeof(kArchiveMagic)) != 0
+        || header->version != kArchiveVersion) {
+        qWarning("Skipping %s: not an archive file", qPrintable(info.path));
+        return 0;
+    }
+    const uint32_t blockCount = header->blockCount;
+    if (blockCount > (size - sizeof(ArchiveHeader)) / sizeof(BlockEntry)) {
+        qWarning("Skipping archive %s: truncated block index", qPrintable(info.path));
+        return 0;
+    }
+    const BlockEntry *index = reinterpret_cast<const BlockEntry *>(map + sizeof(ArchiveHeader));
+
+    size_t visited = 0;
+    for (uint32_t b = 0; b < blockCount; ++b) {
+        const BlockEntry &entry = index[b];
+        if (entry.lastTimestampMs < fromMs || entry.firstTimestampMs > toMs) {
+            continue;
+        }
+        if (entry.offset > size || entry.bytes > size - entry.offset
+            || !scratch->decode(map + entry.offset, entry.bytes, entry.count)) {
+            qWarning("Skipping corrupt block %u of %s", b, qPrintable(info.path));
+            continue;
+        }
+
+        const int64_t base = scratch->baseTimestampMs();
+        const auto offsetOf = [base](int64_t ms) {
+            return static_cast<uint32_t>(std::clamp<int64_t>(ms - base, 0, kMaxOffsetMs));
+        };
+        const uint32_t *offsets = scratch->timestampOffsets();
+        const uint32_t *end = offsets + scratch->size();
+        const uint32_t *first = std::lower_bound(offsets, end, offsetOf(fromMs));
+        const uint32_t *last = std::upper_bound(first, end, offsetOf(toMs));
+        if (first == last) {
+            continue;
+        }
+
+        const Span span = scratch->span(static_cast<size_t>(first - offsets), static_cast<size_t>(last - first));
+        visit(span);
+        visited += span.count;
+    }
+    return visited;
+}
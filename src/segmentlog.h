@@ -0,0 +1,135 @@
+#ifndef SEGMENTLOG_H
+#define SEGMENTLOG_H
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include "historydecoder.h"
+#include "telemetrystore.h"
+
+namespace HistoryCodec {
+class DecodedBlock;
+}
+
+// Append-only on-disk history for one dish, as a directory of fixed-size
+// segment files written and read through mmap.
+//
+// A segment is a header followed by one fixed-width column per field:
+// uint32 millisecond offsets from the segment's base timestamp, one float
+// column per TelemetryStore::Metric and an obstruction bitset. Records are
+// appended in place and the header's count is bumped last, so a reader
+// never sees a half-written record. The header also carries the segment's
+// time range and per-metric min/max, which is all a query needs to skip a
+// segment without touching its columns.
+//
+// At 1 Hz a record costs 24 bytes plus a bit, about 2 MB per dish per day.
+//
+// Once a segment is sealed (full, or left behind by a clock jump or a
+// restart) it is rewritten as an archive of independently decodable
+// HistoryCodec blocks with a small block index, several times smaller
+// than the raw columns. Queries against an archive decode only the blocks whose time
+// range overlaps the request.
+class SegmentLog
+{
+public:
+    static constexpr uint32_t kDefaultSegmentCapacity = 6 * 3600;
+
+    // What the header says about one segment
+    struct SegmentInfo {
+        QString path;
+        int64_t firstTimestampMs = 0;
+        int64_t lastTimestampMs = 0;
+        uint32_t count = 0;
+        bool compressed = false;
+        float min[TelemetryStore::MetricCount] = {};
+        float max[TelemetryStore::MetricCount] = {};
+    };
+
+    // Records [first, first + count) of one segment, straight from the map
+    // or from a decoded archive block. Only valid during the callback.
+    struct Span {
+        int64_t baseTimestampMs = 0;
+        const uint32_t *timestampOffsets = nullptr;
+        const float *columns[TelemetryStore::MetricCount] = {};
+        const uint64_t *obstructed = nullptr;
+        size_t first = 0;
+        size_t count = 0;
+
+        int64_t timestampAt(size_t i) const { return baseTimestampMs + timestampOffsets[i]; }
+        bool obstructedAt(size_t i) const { return (obstructed[i / 64] >> (i % 64)) & 1; }
+    };
+
+    explicit SegmentLog(const QString &directory, uint32_t segmentCapacity = kDefaultSegmentCapacity);
+    ~SegmentLog();
+
+    SegmentLog(const SegmentLog &) = delete;
+    SegmentLog &operator=(const SegmentLog &) = delete;
+
+    // Reads every segment header and reopens the newest segment for
+    // appending if it has room
+    bool open(QString *error = nullptr);
+    // Reads the headers and nothing else, for looking at a log another
+    // process may be writing: no segment is created, resumed or archived,
+    // and append() fails
+    bool openReadOnly(QString *error = nullptr);
+    void close();
+    bool isOpen() const { return opened_; }
+    bool isReadOnly() const { return readOnly_; }
+
+    QString directory() const { return directory_; }
+
+    // Timestamps must not go backwards; a sample older than the last one
+    // starts a new segment rather than breaking the ordering of this one
+    bool append(int64_t timestampMs, const HistorySample &sample);
+
+    // Schedules dirty pages for writeback; append() does this periodically
+    void sync();
+
+    const QVector<SegmentInfo> &segments() const { return segments_; }
+    int64_t lastTimestampMs() const;
+
+    // Visits the records with timestamps in [fromMs, toMs], oldest first,
+    // one span per segment or archive block. Returns the number of records
+    // visited.
+    size_t query(int64_t fromMs, int64_t toMs, const std::function<void(const Span &)> &visit) const;
+
+    // The same for segments()[index] alone, decoding archive blocks into
+    // scratch. Several threads may query segments at once, each with its
+    // own scratch, as long as nothing appends meanwhile.
+    size_t querySegment(int index, int64_t fromMs, int64_t toMs, const std::function<void(const Span &)> &visit,
+                        HistoryCodec::DecodedBlock *scratch) const;
+
+private:
+    struct Active;
+
+    bool startSegment(int64_t baseTimestampMs);
+    bool mapSegment(const QString &path, bool writable, std::unique_ptr<Active> *active, QString *error) const;
+    void updateInfo();
+
+    // Rewrites a sealed segment as an archive and removes the original
+    bool archiveSegment(const Active &segment, SegmentInfo *info);
+    bool readArchiveInfo(const QString &path, SegmentInfo *info, QString *error) const;
+    // Fills segments_ from the directory; readOnly leaves its files alone
+    void readHeaders(bool readOnly);
+    size_t queryArchive(const SegmentInfo &info, int64_t fromMs, int64_t toMs,
+                        const std::function<void(const Span &)> &visit, HistoryCodec::DecodedBlock *scratch) const;
+    static Span spanOf(const Active &segment, size_t first, size_t count);
+
+    QString directory_;
+    uint32_t capacity_;
+    bool opened_ = false;
+    bool readOnly_ = false;
+
+    QVector<SegmentInfo> segments_;
+    std::unique_ptr<Active> active_;
+    int64_t lastSyncMs_ = 0;
+
+    // Reused across queries so reading archives doesn't allocate per block
+    mutable std::unique_ptr<HistoryCodec::DecodedBlock> scratch_;
+};
+
+#endif // SEGMENTLOG_H
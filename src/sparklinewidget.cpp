@@ -0,0 +1,254 @@
+#include "sparklinewidget.h"
+#include <QPaintEvent>
+#include <QPainter>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr int kRowGap = 4;
+
+constexpr TelemetryStore::Metric kSeriesMetrics[] = {
+    TelemetryStore::Downlink,
+    TelemetryStore::Uplink,
+    TelemetryStore::Latency,
+    TelemetryStore::DropRate,
+};
+
+// Rounds a scale up to 1, 2 or 5 times a power of ten so it doesn't change
+// with every sample
+float niceCeiling(float value)
+{
+    if (!(value > 0.0f)) {
+        return 1.0f;
+    }
+    const float magnitude = std::pow(10.0f, std::floor(std::log10(value)));
+    for (const float step : { 1.0f, 2.0f, 5.0f, 10.0f }) {
+        if (value <= step * magnitude) {
+            return step * magnitude;
+        }
+    }
+    return 10.0f * magnitude;
+}
+
+}
+
+SparklineWidget::SparklineWidget(QWidget *parent)
+    : QWidget(parent)
+{
+    setAttribute(Qt::WA_OpaquePaintEvent);
+}
+
+QSize SparklineWidget::sizeHint() const
+{
+    return QSize(300, 150);
+}
+
+void SparklineWidget::setStore(const TelemetryStore *store)
+{
+    store_ = store;
+    stale_ = true;
+    samplesAppended();
+}
+
+void SparklineWidget::setWindowSamples(size_t samples)
+{
+    windowSamples_ = std::max<size_t>(samples, 1);
+    stale_ = true;
+    samplesAppended();
+}
+
+void SparklineWidget::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    stale_ = true;
+    samplesAppended();
+}
+
+void SparklineWidget::showEvent(QShowEvent *event)
+{
+    QWidget::showEvent(event);
+    samplesAppended();
+}
+
+void SparklineWidget::samplesAppended()
+{
+    // Nobody sees the chart from the tray; catch up once it is shown
+    if (!isVisible()) {
+        return;
+    }
+    if (!store_ || store_->sequence() < seenSequence_ || store_->capacity() != seenCapacity_) {
+        stale_ = true;
+    }
+    if (stale_) {
+        rebuild();
+        update();
+        return;
+    }
+
+    const uint64_t sequence = store_->sequence();
+    if (sequence == seenSequence_) {
+        return;
+    }
+    seenSequence_ = sequence;
+
+    // Only the bucket that was filling and any started since need work
+    const uint64_t lastBucket = (sequence - 1) / samplesPerBucket_;
+    const uint64_t oldLast = firstBucket_ + buckets_.size() - 1;
+    const bool scrolled = buckets_.empty() || lastBucket != oldLast;
+    uint64_t from = buckets_.empty() ? lastBucket : oldLast;
+    if (lastBucket - from >= static_cast<uint64_t>(columns_)) {
+        from = lastBucket - columns_ + 1;
+        buckets_.clear();
+    }
+    if (buckets_.empty()) {
+        firstBucket_ = from;
+    }
+    for (uint64_t b = from; b <= lastBucket; ++b) {
+        const Bucket bucket = summarize(b);
+        if (!buckets_.empty() && b == firstBucket_ + buckets_.size() - 1) {
+            buckets_.back() = bucket;
+        } else {
+            buckets_.push_back(bucket);
+        }
+    }
+    while (buckets_.size() > static_cast<size_t>(columns_)) {
+        buckets_.pop_front();
+        ++firstBucket_;
+    }
+
+    if (updateScales() || scrolled) {
+        update();
+        return;
+    }
+    // Just the newest column
+    for (int row = 0; row < RowCount; ++row) {
+        const QRect r = rowRect(static_cast<Row>(row));
+        update(QRect(r.left() + columns_ - 1, r.top(), 1, r.height()));
+    }
+}
+
+void SparklineWidget::rebuild()
+{
+    stale_ = false;
+    buckets_.clear();
+    columns_ = std::max(1, width());
+    seenSequence_ = store_ ? store_->sequence() : 0;
+    seenCapacity_ = store_ ? store_->capacity() : 0;
+    samplesPerBucket_ = std::max<uint64_t>(1, (windowSamples_ + columns_ - 1) / columns_);
+
+    if (!store_ || store_->isEmpty()) {
+        updateScales();
+        return;
+    }
+
+    const uint64_t oldest = store_->sequence() - store_->size();
+    const uint64_t lastBucket = (store_->sequence() - 1) / samplesPerBucket_;
+    firstBucket_ = std::max(oldest / samplesPerBucket_,
+                            lastBucket >= static_cast<uint64_t>(columns_) ? lastBucket - columns_ + 1 : 0);
+    for (uint64_t b = firstBucket_; b <= lastBucket; ++b) {
+        buckets_.push_back(summarize(b));
+    }
+    updateScales();
+}
+
+SparklineWidget::Bucket SparklineWidget::summarize(uint64_t bucket) const
+{
+    Bucket result = {};
+    const uint64_t oldest = store_->sequence() - store_->size();
+    const uint64_t first = std::max(bucket * samplesPerBucket_, oldest);
+    const uint64_t last = std::min((bucket + 1) * samplesPerBucket_, store_->sequence());
+    if (first >= last) {
+        return result;
+    }
+
+    for (int s = 0; s < SeriesCount; ++s) {
+        const Kernels::Summary summary = store_->summarize(kSeriesMetrics[s], static_cast<size_t>(first - oldest),
+                                                          static_cast<size_t>(last - first));
+        result.valid[s] = summary.count > 0;
+        result.min[s] = summary.min;
+        result.max[s] = summary.max;
+    }
+    return result;
+}
+
+bool SparklineWidget::updateScales()
+{
+    float peaks[RowCount] = {};
+    for (const Bucket &bucket : buckets_) {
+        for (int s = 0; s < SeriesCount; ++s) {
+            if (!bucket.valid[s]) {
+                continue;
+            }
+            const int row = s <= Uplink ? ThroughputRow : s - 1;
+            peaks[row] = std::max(peaks[row], bucket.max[s]);
+        }
+    }
+    // Drop rate is a fraction
+    peaks[DropRateRow] = 1.0f;
+
+    bool changed = false;
+    for (int row = 0; row < RowCount; ++row) {
+        const float scale = niceCeiling(peaks[row]);
+        changed |= scale != scale_[row];
+        scale_[row] = scale;
+    }
+    return changed;
+}
+
+QRect SparklineWidget::rowRect(Row row) const
+{
+    const int rowHeight = std::max(1, (height() - kRowGap * (RowCount - 1)) / RowCount);
+    return QRect(0, row * (rowHeight + kRowGap), width(), rowHeight);
+}
+
+void SparklineWidget::paintEvent(QPaintEvent *event)
+{
+    QPainter painter(this);
+    const QRect dirty = event->rect();
+    painter.fillRect(dirty, palette().base());
+
+    static const QColor kColors[SeriesCount] = {
+        QColor(30, 136, 229), QColor(67, 160, 71), QColor(251, 140, 0), QColor(229, 57, 53)
+    };
+
+    // Columns of the oldest and newest bucket; the newest is at the right edge
+    const int right = columns_ - 1;
+    const int left = right - static_cast<int>(buckets_.size()) + 1;
+    const int from = std::max(left, dirty.left());
+    const int to = std::min(right, dirty.right());
+
+    for (int s = 0; s < SeriesCount; ++s) {
+        const Row row = s <= Uplink ? ThroughputRow : static_cast<Row>(s - 1);
+        const QRect r = rowRect(row);
+        if (!r.intersects(dirty)) {
+            continue;
+        }
+        const float perPixel = (r.height() - 1) / scale_[row];
+        const auto y = [&](float value) {
+            return r.bottom() - static_cast<int>(std::clamp(value, 0.0f, scale_[row]) * perPixel);
+        };
+
+        // One vertical min..max line per column, drawn in a single batch
+        lines_.clear();
+        for (int x = from; x <= to; ++x) {
+            const Bucket &bucket = buckets_[static_cast<size_t>(x - left)];
+            if (bucket.valid[s]) {
+                lines_.append(QLine(x, y(bucket.min[s]), x, y(bucket.max[s])));
+            }
+        }
+        painter.setPen(kColors[s]);
+        painter.drawLines(lines_);
+    }
+
+    painter.setPen(palette().text().color());
+    const char *const names[RowCount] = { "Mbps", "ms", "drop" };
+    const float units[RowCount] = { 1e6f, 1.0f, 1.0f };
+    for (int row = 0; row < RowCount; ++row) {
+        const QRect r = rowRect(static_cast<Row>(row));
+        if (r.intersects(dirty)) {
+            painter.drawText(r.adjusted(2, 0, 0, 0), Qt::AlignTop | Qt::AlignLeft,
+                             QString("%1 %2").arg(scale_[row] / units[row], 0, 'g', 3).arg(names[row]));
+        }
+    }
+}
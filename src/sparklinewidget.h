@@ -0,0 +1,87 @@
+#ifndef SPARKLINEWIDGET_H
+#define SPARKLINEWIDGET_H
+
+#include <QLine>
+#include <QVector>
+#include <QWidget>
+#include <cstdint>
+#include <deque>
+#include "telemetrystore.h"
+
+// Throughput, latency and drop-rate sparklines drawn straight from a
+// TelemetryStore's rings.
+//
+// The window is cut into one bucket per pixel column, and each bucket keeps
+// the min and max of its samples, so a paint costs O(width) however many
+// samples the window spans. Buckets are aligned to sample sequence numbers
+// rather than to the window edge, which means a bucket never changes once
+// it is complete: new samples only recompute the newest bucket and repaint
+// its column, and the chart scrolls one pixel whenever a new bucket starts.
+class SparklineWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit SparklineWidget(QWidget *parent = nullptr);
+
+    // store must outlive the widget
+    void setStore(const TelemetryStore *store);
+    // How many of the newest samples the chart spans
+    void setWindowSamples(size_t samples);
+
+    QSize sizeHint() const override;
+
+public slots:
+    void samplesAppended();
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void showEvent(QShowEvent *event) override;
+
+private:
+    enum Series {
+        Downlink,
+        Uplink,
+        Latency,
+        DropRate,
+        SeriesCount
+    };
+
+    enum Row {
+        ThroughputRow,
+        LatencyRow,
+        DropRateRow,
+        RowCount
+    };
+
+    struct Bucket {
+        float min[SeriesCount];
+        float max[SeriesCount];
+        bool valid[SeriesCount];
+    };
+
+    void rebuild();
+    Bucket summarize(uint64_t bucket) const;
+    // Per-row scale; returns whether any row changed
+    bool updateScales();
+    QRect rowRect(Row row) const;
+
+    const TelemetryStore *store_ = nullptr;
+    size_t windowSamples_ = TelemetryStore::kDefaultCapacity;
+
+    // buckets_[i] summarises samples [(firstBucket_ + i) * samplesPerBucket_,
+    // (firstBucket_ + i + 1) * samplesPerBucket_)
+    std::deque<Bucket> buckets_;
+    uint64_t firstBucket_ = 0;
+    uint64_t samplesPerBucket_ = 1;
+    int columns_ = 0;
+    uint64_t seenSequence_ = 0;
+    size_t seenCapacity_ = 0;
+    bool stale_ = true;
+
+    float scale_[RowCount] = {};
+    mutable QVector<QLine> lines_;
+};
+
+#endif // SPARKLINEWIDGET_H
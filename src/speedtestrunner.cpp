@@ -0,0 +1,266 @@
+#include "speedtestrunner.h"
+#include "fleetmanager.h"
+#include "pollscheduler.h"
+#include "starlinkclient.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Rechecking this often is plenty for intervals counted in hours, and
+// notices new dishes and options without rearming precisely
+constexpr qint64 kMaxWaitMs = 60 * 1000;
+constexpr qint64 kOff = std::numeric_limits<qint64>::max();
+
+}
+
+SpeedTestRunner::SpeedTestRunner(QObject *parent)
+    : QObject(parent), rng_(std::random_device{}())
+{
+    timer_ = new QTimer(this);
+    timer_->setSingleShot(true);
+    timer_->setTimerType(Qt::VeryCoarseTimer);
+    connect(timer_, &QTimer::timeout, this, &SpeedTestRunner::runDue);
+}
+
+void SpeedTestRunner::setOptions(const Options &options)
+{
+    options_ = options;
+    options_.maxPerSite = std::max(options_.maxPerSite, 1);
+    options_.jitter = std::clamp(options_.jitter, 0.0, 0.9);
+
+    // Spread the first run over one interval, as for a new dish
+    const qint64 now = PollScheduler::now();
+    for (Dish &dish : dishes_) {
+        dish.nextDueMs = options_.intervalMs > 0
+            ? now + std::uniform_int_distribution<qint64>(0, options_.intervalMs - 1)(rng_)
+            : kOff;
+    }
+    armTimer();
+    startQueued();
+}
+
+void SpeedTestRunner::setSites(const QHash<QString, QString> &sites)
+{
+    sites_ = sites;
+    for (Dish &dish : dishes_) {
+        const QString site = siteOf(dish.client);
+        if (dish.running) {
+            if (--running_[dish.site] <= 0) {
+                running_.remove(dish.site);
+            }
+            ++running_[site];
+        }
+        dish.site = site;
+    }
+    startQueued();
+}
+
+void SpeedTestRunner::watch(StarlinkClient *client)
+{
+    add(client);
+    armTimer();
+}
+
+void SpeedTestRunner::watch(FleetManager *fleet)
+{
+    auto rebuild = [this, fleet]() {
+        // setTargets() destroys the old clients, which removes them
+        for (int i = 0; i < fleet->dishCount(); ++i) {
+            add(fleet->client(i));
+        }
+        armTimer();
+        startQueued();
+    };
+    connect(fleet, &FleetManager::targetsChanged, this, rebuild);
+    rebuild();
+}
+
+void SpeedTestRunner::runNow(StarlinkClient *client)
+{
+    if (Dish *dish = find(client)) {
+        enqueue(dish);
+        startQueued();
+    }
+}
+
+void SpeedTestRunner::runAll()
+{
+    for (Dish &dish : dishes_) {
+        enqueue(&dish);
+    }
+    startQueued();
+}
+
+int SpeedTestRunner::runningCount() const
+{
+    int running = 0;
+    for (const Dish &dish : dishes_) {
+        running += dish.running ? 1 : 0;
+    }
+    return running;
+}
+
+QString SpeedTestRunner::siteOf(StarlinkClient *client) const
+{
+    // A dish without a site shares its backhaul with nobody
+    return sites_.value(client->target(), QString("dish:") + client->target());
+}
+
+SpeedTestRunner::Dish *SpeedTestRunner::find(StarlinkClient *client)
+{
+    for (Dish &dish : dishes_) {
+        if (dish.client == client) {
+            return &dish;
+        }
+    }
+    return nullptr;
+}
+
+void SpeedTestRunner::add(StarlinkClient *client)
+{
+    if (find(client)) {
+        return;
+    }
+
+    Dish dish;
+    dish.client = client;
+    dish.site = siteOf(client);
+    dish.nextDueMs = options_.intervalMs > 0
+        ? PollScheduler::now() + std::uniform_int_distribution<qint64>(0, options_.intervalMs - 1)(rng_)
+        : kOff;
+    dishes_.push_back(dish);
+
+    connect(client, &StarlinkClient::speedTestFinished, this,
+            [this, client](bool ok, const SpeedTestResult &result, const QString &error) {
+        finished(client, ok, result, error);
+    });
+    connect(client, &QObject::destroyed, this, [this, client]() {
+        remove(client);
+    });
+}
+
+void SpeedTestRunner::remove(StarlinkClient *client)
+{
+    queue_.erase(std::remove(queue_.begin(), queue_.end(), client), queue_.end());
+    auto it = std::find_if(dishes_.begin(), dishes_.end(), [client](const Dish &dish) {
+        return dish.client == client;
+    });
+    if (it == dishes_.end()) {
+        return;
+    }
+    // The test itself is cancelled with the client
+    if (it->running && --running_[it->site] <= 0) {
+        running_.remove(it->site);
+    }
+    dishes_.erase(it);
+    startQueued();
+}
+
+void SpeedTestRunner::enqueue(Dish *dish)
+{
+    if (dish->queued || dish->running) {
+        return;
+    }
+    dish->queued = true;
+    queue_.push_back(dish->client);
+}
+
+void SpeedTestRunner::startQueued()
+{
+    // First come first served, but a dish whose site is busy doesn't hold
+    // up one at another site
+    for (auto it = queue_.begin(); it != queue_.end();) {
+        Dish *dish = find(*it);
+        if (!dish) {
+            it = queue_.erase(it);
+            continue;
+        }
+        if (running_.value(dish->site) >= options_.maxPerSite) {
+            ++it;
+            continue;
+        }
+
+        it = queue_.erase(it);
+        dish->queued = false;
+        if (!dish->client->runSpeedTest()) {
+            // Someone else started one; its result is reported all the same
+            continue;
+        }
+        dish->running = true;
+        ++running_[dish->site];
+        emit testStarted(dish->client->target());
+    }
+}
+
+void SpeedTestRunner::finished(StarlinkClient *client, bool ok, const SpeedTestResult &result, const QString &error)
+{
+    Dish *dish = find(client);
+    if (!dish) {
+        return;
+    }
+    if (dish->running) {
+        dish->running = false;
+        if (--running_[dish->site] <= 0) {
+            running_.remove(dish->site);
+        }
+    }
+    if (options_.intervalMs > 0) {
+        dish->nextDueMs = PollScheduler::now() + nextIntervalMs();
+    }
+
+    float passive = std::numeric_limits<float>::quiet_NaN();
+    if (ok) {
+        const Kernels::Summary summary = client->telemetry().summarizeBetween(
+            TelemetryStore::Downlink, result.startedMs, result.finishedMs);
+        if (summary.count > 0) {
+            passive = summary.mean() / 1e6f;
+        }
+    }
+    emit testFinished(client->target(), ok, result, passive, error);
+
+    startQueued();
+    armTimer();
+}
+
+qint64 SpeedTestRunner::nextIntervalMs()
+{
+    std::uniform_real_distribution<double> spread(1.0 - options_.jitter, 1.0 + options_.jitter);
+    return static_cast<qint64>(std::llround(options_.intervalMs * spread(rng_)));
+}
+
+void SpeedTestRunner::armTimer()
+{
+    if (options_.intervalMs <= 0 || dishes_.empty()) {
+        timer_->stop();
+        return;
+    }
+    qint64 next = kOff;
+    for (const Dish &dish : dishes_) {
+        if (!dish.queued && !dish.running) {
+            next = std::min(next, dish.nextDueMs);
+        }
+    }
+    if (next == kOff) {
+        timer_->stop();
+        return;
+    }
+    const qint64 wait = std::clamp<qint64>(next - PollScheduler::now(), 0, kMaxWaitMs);
+    timer_->start(static_cast<int>(wait));
+}
+
+void SpeedTestRunner::runDue()
+{
+    const qint64 now = PollScheduler::now();
+    for (Dish &dish : dishes_) {
+        if (dish.nextDueMs <= now) {
+            // Rescheduled when it finishes; this keeps a dish that can't
+            // start from being queued again every pass
+            dish.nextDueMs = now + nextIntervalMs();
+            enqueue(&dish);
+        }
+    }
+    startQueued();
+    armTimer();
+}
@@ -0,0 +1,91 @@
+#ifndef SPEEDTESTRUNNER_H
+#define SPEEDTESTRUNNER_H
+
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <deque>
+#include <random>
+#include <vector>
+#include "telemetrystore.h"
+
+class FleetManager;
+class StarlinkClient;
+
+// Runs the dishes' own speed tests, on demand and on a schedule.
+//
+// A speed test saturates the dish's link, and dishes at one site usually
+// share the backhaul behind them, so no more than maxPerSite tests ever
+// run at once per site; the rest wait their turn. Scheduled tests are
+// spread over the interval and each one's next run is jittered, so a fleet
+// never tests in lockstep. Dishes nobody assigned a site are each a site
+// of their own.
+//
+// Results land in each client's TelemetryStore next to the passive history.
+class SpeedTestRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options {
+        int maxPerSite = 1;
+        qint64 intervalMs = 0;  // 0 runs tests on demand only
+        double jitter = 0.25;   // each interval is this fraction longer or shorter
+    };
+
+    explicit SpeedTestRunner(QObject *parent = nullptr);
+
+    void setOptions(const Options &options);
+    const Options &options() const { return options_; }
+
+    // target to site, for the dishes watched already and any to come
+    void setSites(const QHash<QString, QString> &sites);
+
+    void watch(StarlinkClient *client);
+    void watch(FleetManager *fleet);
+
+    // Queued, and started as soon as the dish's site has a free slot
+    void runNow(StarlinkClient *client);
+    void runAll();
+
+    int runningCount() const;
+    int queuedCount() const { return static_cast<int>(queue_.size()); }
+
+signals:
+    void testStarted(const QString &target);
+    // passiveDownlinkMbps is the mean of the history samples taken while
+    // the test ran, or NaN if there were none yet
+    void testFinished(const QString &target, bool ok, const SpeedTestResult &result,
+                      float passiveDownlinkMbps, const QString &error);
+
+private:
+    struct Dish {
+        StarlinkClient *client;
+        QString site;
+        qint64 nextDueMs;
+        bool queued = false;
+        bool running = false;
+    };
+
+    QString siteOf(StarlinkClient *client) const;
+    Dish *find(StarlinkClient *client);
+    void add(StarlinkClient *client);
+    void remove(StarlinkClient *client);
+    void enqueue(Dish *dish);
+    void startQueued();
+    void finished(StarlinkClient *client, bool ok, const SpeedTestResult &result, const QString &error);
+    qint64 nextIntervalMs();
+    void armTimer();
+    void runDue();
+
+    Options options_;
+    QHash<QString, QString> sites_;
+    std::vector<Dish> dishes_;
+    std::deque<StarlinkClient *> queue_;
+    QHash<QString, int> running_;
+    std::mt19937_64 rng_;
+    QTimer *timer_;
+};
+
+#endif // SPEEDTESTRUNNER_H
@@ -1,108 +1,1186 @@
 #include "starlinkclient.h"
-#include "spacex/api/device/device.grpc.pb.h"
+#include "wirescanner.h"
 #include "spacex/api/device/device.pb.h"
-#include <grpcpp/create_channel.h>
+#include <QDateTime>
 #include <QDebug>
+#include <QDir>
+#include <QThreadPool>
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
 
-using grpc::Channel;
 using grpc::ClientContext;
 using grpc::Status;
 
+namespace {
+
+// The dish sits on the local network and answers in milliseconds; anything
+// slower than this is as good as gone. History replies are a few hundred KB
+// and obstruction maps tens of KB.
+constexpr int kRequestDeadlineMs = 2000;
+constexpr int kLargeReplyDeadlineMs = 4000;
+// The dish measures each direction for several seconds per connection count
+constexpr int kSpeedTestDeadlineMs = 120 * 1000;
+
+// Samples reloaded from the log and the same samples decoded again after a
+// restart get timestamps this close together
+constexpr int64_t kDuplicateSlackMs = 500;
+// Beyond this the dish's 1 Hz sample clock and ours have drifted apart
+constexpr int64_t kSampleClockSlackMs = 2000;
+
+// A cycle's replies are a few tens of KB; past this the arena's first block
+// stops growing and a freak reply can't pin memory for good
+constexpr size_t kMaxArenaBlockBytes = 1024 * 1024;
+
+// Device.Handle as the generated stub calls it
+constexpr char kHandleMethod[] = "/SpaceX.API.Device.Device/Handle";
+
+// A crash loses at most this much of the state cache
+constexpr qint64 kStateSaveIntervalMs = 60 * 1000;
+
+// How long one channel watch waits before it is renewed. This also bounds
+// how long a TransportPool takes to shut down while a dish is unreachable.
+constexpr int kChannelWatchMs = 2000;
+
+}
+
 StarlinkClient::StarlinkClient(const QString &target, QObject *parent)
-    : QObject(parent), target_(target)
+    : StarlinkClient(target, std::make_shared<TransportPool>(1), parent)
+{
+}
+
+StarlinkClient::StarlinkClient(const QString &target, std::shared_ptr<TransportPool> pool, QObject *parent)
+    : QObject(parent), pool_(std::move(pool)), target_(target)
 {
-    // Create gRPC channel
-    auto channel = grpc::CreateChannel(target.toStdString(), grpc::InsecureChannelCredentials());
-    stub_ = SpaceX::API::Device::Device::NewStub(channel);
+    // All RPCs complete on the pool's threads; this thread only starts
+    // them. The channel waits for the first poll, see ensureChannel().
+    cq_ = pool_->nextQueue();
+    arena_ = std::make_unique<google::protobuf::Arena>();
+
+    // The generic stub takes the request already serialized; the buffer
+    // is reference counted, so sharing it between calls copies nothing
+    const std::string historyRequest = prebuiltRequest(RequestKind::History).SerializeAsString();
+    grpc::Slice slice(historyRequest);
+    historyRequest_ = grpc::ByteBuffer(&slice, 1);
+
+    scheduler_.reset(PollScheduler::now());
 
     pollTimer_ = new QTimer(this);
-    connect(pollTimer_, &QTimer::timeout, this, &StarlinkClient::fetchStatus);
+    pollTimer_->setSingleShot(true);
+    pollTimer_->setTimerType(Qt::CoarseTimer);
+    connect(pollTimer_, &QTimer::timeout, this, [this]() {
+        pollDue(PollScheduler::now());
+        armPollTimer();
+    });
+
+    streamDeadline_ = new QTimer(this);
+    streamDeadline_->setSingleShot(true);
+    connect(streamDeadline_, &QTimer::timeout, this, [this]() {
+        // closeStream() then abandons the cycle as unreachable
+        if (!streamPending_.empty() && streamContext_) {
+            streamContext_->TryCancel();
+        }
+    });
 }
 
 StarlinkClient::~StarlinkClient()
 {
     stopMonitoring();
+    saveState();
+
+    for (AsyncCall *call : inFlight_) {
+        call->context.TryCancel();
+    }
+    if (speedTest_) {
+        speedTest_->context.TryCancel();
+    }
+    if (streamContext_) {
+        streamContext_->TryCancel();
+    }
+    if (channelWatch_) {
+        std::lock_guard<std::mutex> lock(channelWatch_->mutex);
+        channelWatch_->client = nullptr;
+    }
+
+    // Completions that were queued to us but never delivered own their calls
+    operations_.drain(this);
 }
 
 void StarlinkClient::startMonitoring()
 {
-    pollTimer_->start(5000); // Poll every 5 seconds
-    fetchStatus(); // Initial fetch
+    // The first cycle goes out from the event loop, so whoever starts us
+    // while setting up a window isn't kept waiting by it
+    monitoring_ = true;
+    scheduler_.expedite(PollScheduler::now());
+    armPollTimer();
 }
 
 void StarlinkClient::stopMonitoring()
 {
+    monitoring_ = false;
     pollTimer_->stop();
 }
 
+void StarlinkClient::armPollTimer()
+{
+    // While a cycle is running the timer is re-armed when it publishes
+    if (!monitoring_ || !inFlight_.empty() || !streamPending_.empty()) {
+        return;
+    }
+    const qint64 wait = std::max<qint64>(0, nextPollMs() - PollScheduler::now());
+    pollTimer_->start(static_cast<int>(std::min<qint64>(wait, std::numeric_limits<int>::max())));
+}
+
+qint64 StarlinkClient::nextPollMs() const
+{
+    switch (breaker_.state()) {
+    case CircuitBreaker::State::Open:
+        return breaker_.retryAtMs();
+    case CircuitBreaker::State::HalfOpen:
+        return 0;
+    case CircuitBreaker::State::Closed:
+        break;
+    }
+    return scheduler_.nextDueMs();
+}
+
+void StarlinkClient::setBackground(bool background)
+{
+    scheduler_.setBackground(background, PollScheduler::now());
+    armPollTimer();
+}
+
+void StarlinkClient::setHistoryCapacity(size_t samples)
+{
+    telemetry_ = TelemetryStore(samples);
+}
+
+bool StarlinkClient::setLogDirectory(const QString &directory, QString *error)
+{
+    log_.reset();
+    logDirectory_.clear();
+    ++reloadGeneration_;
+    reloading_ = false;
+    unlogged_.clear();
+    if (!QDir(directory).mkpath(".")) {
+        if (error) {
+            *error = QString("can't create %1").arg(directory);
+        }
+        return false;
+    }
+
+    telemetry_.clear();
+    stateCache_ = std::make_unique<StateCache>(QDir(directory).filePath("state.cache"));
+    DishSnapshot cached;
+    if (stateCache_->load(&cached, &telemetry_)) {
+        cached.connected = false;
+        pending_ = cached;
+        published_ = cached;
+    }
+    lastStoredMs_ = telemetry_.isEmpty() ? std::numeric_limits<int64_t>::min()
+                                         : telemetry_.timestampAt(telemetry_.size() - 1);
+    haveStoredIndex_ = false;
+
+    logDirectory_ = directory;
+    startReload();
+    return true;
+}
+
+// What a worker hands back: the open log and the newest samples in it
+struct StarlinkClient::Reload {
+    std::unique_ptr<SegmentLog> log;
+    TelemetryStore telemetry;
+    int64_t lastMs = std::numeric_limits<int64_t>::min();
+};
+
+void StarlinkClient::startReload()
+{
+    auto reload = std::make_shared<Reload>();
+    reload->telemetry = TelemetryStore(telemetry_.capacity());
+    const QString directory = logDirectory_;
+    const QString target = target_;
+    const int generation = reloadGeneration_;
+    reloading_ = true;
+
+    // The destructor waits for this like any other pending operation
+    operations_.started();
+    QThreadPool::globalInstance()->start([this, reload, directory, target, generation]() {
+        auto log = std::make_unique<SegmentLog>(directory);
+        QString error;
+        if (log->open(&error)) {
+            // The newest samples that fit; the cached ones are among them
+            reload->lastMs = log->lastTimestampMs();
+            if (reload->lastMs != std::numeric_limits<int64_t>::min()) {
+                TelemetryStore &telemetry = reload->telemetry;
+                const int64_t first = reload->lastMs - static_cast<int64_t>(telemetry.capacity()) * 1000;
+                log->query(first, reload->lastMs, [&telemetry](const SegmentLog::Span &span) {
+                    for (size_t i = span.first; i < span.first + span.count; ++i) {
+                        HistorySample sample;
+                        sample.downlinkBps = span.columns[TelemetryStore::Downlink][i];
+                        sample.uplinkBps = span.columns[TelemetryStore::Uplink][i];
+                        sample.latencyMs = span.columns[TelemetryStore::Latency][i];
+                        sample.dropRate = span.columns[TelemetryStore::DropRate][i];
+                        sample.snr = span.columns[TelemetryStore::Snr][i];
+                        sample.obstructed = span.obstructedAt(i);
+                        telemetry.append(span.timestampAt(i), sample);
+                    }
+                });
+            }
+            reload->log = std::move(log);
+        } else {
+            qWarning("Not keeping history for %s: %s", qPrintable(target), qPrintable(error));
+        }
+
+        QMetaObject::invokeMethod(this, [this, reload, generation]() {
+            finishReload(generation, reload.get());
+        }, Qt::QueuedConnection);
+        operations_.finished();
+    });
+}
+
+void StarlinkClient::finishReload(int generation, Reload *reload)
+{
+    if (generation != reloadGeneration_) {
+        return;
+    }
+    reloading_ = false;
+    if (!reload->log) {
+        unlogged_.clear();
+        return;
+    }
+    log_ = std::move(reload->log);
+
+    if (reload->lastMs != std::numeric_limits<int64_t>::min()) {
+        telemetry_ = std::move(reload->telemetry);
+    }
+    // What was polled meanwhile, less what the log turned out to have
+    for (const auto &[timestampMs, sample] : unlogged_) {
+        if (reload->lastMs != std::numeric_limits<int64_t>::min()
+            && timestampMs <= reload->lastMs + kDuplicateSlackMs) {
+            continue;
+        }
+        log_->append(timestampMs, sample);
+        if (reload->lastMs != std::numeric_limits<int64_t>::min()) {
+            telemetry_.append(timestampMs, sample);
+        }
+    }
+    unlogged_.clear();
+    lastStoredMs_ = std::max(lastStoredMs_, reload->lastMs);
+    emit telemetryReloaded();
+}
+
+void StarlinkClient::saveState()
+{
+    if (!stateCache_ || !stateChanged_) {
+        return;
+    }
+    stateChanged_ = false;
+    stateSavedMs_ = PollScheduler::now();
+
+    QString error;
+    if (!stateCache_->save(published_, telemetry_, &error)) {
+        qWarning("Can't save state to %s: %s", qPrintable(stateCache_->path()), qPrintable(error));
+    }
+}
+
+void StarlinkClient::ensureChannel()
+{
+    if (channel_) {
+        return;
+    }
+    channel_ = pool_->channel(target_.toStdString());
+    stub_ = SpaceX::API::Device::Device::NewStub(channel_);
+    genericStub_ = std::make_unique<grpc::GenericStub>(channel_);
+}
+
+bool StarlinkClient::storeSample(int64_t estimatedMs, const HistorySample &sample)
+{
+    // The first batch after a restart replays the dish's whole ring, much
+    // of which the log already has
+    if (!haveStoredIndex_ && estimatedMs <= lastStoredMs_ + kDuplicateSlackMs) {
+        return false;
+    }
+
+    // Consecutive samples are exactly a second apart; only fall back to our
+    // own clock when the dish skipped samples or the clocks drifted
+    int64_t timestampMs = estimatedMs;
+    if (haveStoredIndex_ && sample.index == lastStoredIndex_ + 1
+        && std::abs(estimatedMs - (lastStoredMs_ + 1000)) < kSampleClockSlackMs) {
+        timestampMs = lastStoredMs_ + 1000;
+    }
+    timestampMs = std::max(timestampMs, lastStoredMs_ + 1);
+
+    telemetry_.append(timestampMs, sample);
+    if (log_) {
+        log_->append(timestampMs, sample);
+    } else if (reloading_) {
+        unlogged_.emplace_back(timestampMs, sample);
+    }
+    lastStoredMs_ = timestampMs;
+    lastStoredIndex_ = sample.index;
+    haveStoredIndex_ = true;
+    return true;
+}
+
+void StarlinkClient::setTransport(Transport transport)
+{
+    if (transport == transport_) {
+        return;
+    }
+    transport_ = transport;
+
+    // Let an open stream wind down through the normal read/finish path
+    if (transport_ == Transport::Unary && streamContext_) {
+        streamContext_->TryCancel();
+    }
+}
+
+bool StarlinkClient::parseTransport(const QString &name, Transport *transport)
+{
+    if (name == "unary") {
+        *transport = Transport::Unary;
+        return true;
+    }
+    if (name == "stream") {
+        *transport = Transport::Stream;
+        return true;
+    }
+    return false;
+}
+
+void StarlinkClient::read(PollScheduler::Request request, qint64 maxAgeMs, QObject *context,
+                          RequestBroker::Callback callback)
+{
+    const qint64 now = PollScheduler::now();
+    if (maxAgeMs < 0) {
+        maxAgeMs = RequestBroker::defaultMaxAgeMs(request);
+    }
+    if (broker_.isFresh(request, maxAgeMs, now) || !scheduler_.isEnabled(request)
+        || breaker_.state() == CircuitBreaker::State::Open) {
+        RequestBroker::deliverLater(context, callback, published_);
+        return;
+    }
+
+    broker_.wait(request, context, std::move(callback));
+    const bool cycleRunning = !inFlight_.empty() || !streamPending_.empty();
+    if (cycleRunning && (cycleRequests_ & PollScheduler::bit(request))) {
+        return;
+    }
+
+    // Goes out with the next cycle, which starts right away unless one is
+    // still running; either way it's rescheduled as if polled on time, so
+    // the dish doesn't see it twice
+    scheduler_.expedite(request, now);
+    if (!cycleRunning) {
+        pollDue(now);
+    }
+    armPollTimer();
+}
+
 void StarlinkClient::fetchStatus()
 {
-    // 1. Get Status
-    {
-        ClientContext context;
-        SpaceX::API::Device::Request request;
-        SpaceX::API::Device::Response response;
-        
-        request.mutable_get_status();
-
-        Status status = stub_->Handle(&context, request, &response);
-
-        if (status.ok()) {
-            emit statusChanged(true);
-            
-            // Parse device info if available
-            if (response.has_get_device_info()) {
-                const auto& info = response.get_device_info().device_info();
-                emit satelliteInfoUpdated(QString::fromStdString(info.id()), QString::fromStdString(info.hardware_version()));
+    const qint64 now = PollScheduler::now();
+    scheduler_.expedite(now);
+    pollDue(now);
+}
+
+void StarlinkClient::pollDue(qint64 nowMs)
+{
+    // A slow or unreachable dish must not pile up requests behind it
+    if (!inFlight_.empty() || !streamPending_.empty()) {
+        return;
+    }
+
+    if (transport_ == Transport::Stream) {
+        if (streamState_ == StreamState::Closing) {
+            return;
+        }
+        if (streamState_ == StreamState::Closed) {
+            // The previous stream still has a write outstanding
+            if (stream_) {
+                return;
             }
-            
-            // Note: Real status might be in a different message depending on the exact proto version
-            // For now, we assume successful RPC means connected.
+        }
+    }
+
+    if (!breaker_.allowRequest(nowMs)) {
+        return;
+    }
+
+    PollScheduler::RequestMask due = 0;
+    if (breaker_.state() == CircuitBreaker::State::HalfOpen) {
+        // One cheap probe; the rest of the schedule resumes once it answers
+        due = PollScheduler::bit(PollScheduler::Status);
+    } else {
+        due = scheduler_.takeDue(nowMs);
+    }
+    if (!due) {
+        return;
+    }
+
+    ensureChannel();
+
+    // Every RPC on a channel in TRANSIENT_FAILURE fails at once, so don't
+    // send any. Asking for the state also starts reconnecting an idle channel.
+    if (channel_->GetState(true) == GRPC_CHANNEL_TRANSIENT_FAILURE) {
+        failCycle(due);
+        return;
+    }
+
+    if (transport_ == Transport::Stream && streamState_ == StreamState::Closed) {
+        openStream();
+    }
+
+    // Nothing refers to the previous cycle's replies any more
+    resetArena();
+
+    // Fan out everything that is due at once; the cycle only takes as long
+    // as the slowest request. Results are joined in pending_ and published
+    // together once the last one lands. Fields nothing in this cycle asked
+    // about keep their values from earlier cycles.
+    pending_.timestampMs = QDateTime::currentMSecsSinceEpoch();
+    pending_.newHistorySamples = 0;
+    obstructionMapChanged_ = false;
+    cycleRequests_ = due;
+    cycleFailed_ = false;
+
+    static const std::pair<PollScheduler::Request, RequestKind> kRequests[] = {
+        { PollScheduler::Status, RequestKind::Status },
+        { PollScheduler::DeviceInfo, RequestKind::DeviceInfo },
+        { PollScheduler::Location, RequestKind::Location },
+        { PollScheduler::History, RequestKind::History },
+        { PollScheduler::ObstructionMap, RequestKind::ObstructionMap },
+        { PollScheduler::Context, RequestKind::Context },
+    };
+    int streamDeadlineMs = 0;
+    for (const auto &entry : kRequests) {
+        if (!(due & PollScheduler::bit(entry.first))) {
+            continue;
+        }
+        if (transport_ == Transport::Stream) {
+            queueStreamRequest(entry.second);
+            streamDeadlineMs = std::max(streamDeadlineMs, deadlineMs(entry.second));
         } else {
-            emit statusChanged(false);
-            qWarning() << "gRPC Status Failed:" << status.error_message().c_str();
+            issueRequest(entry.second);
         }
     }
+    if (streamDeadlineMs > 0) {
+        streamDeadline_->start(streamDeadlineMs);
+    }
+}
 
-    // 2. Get Location
-    {
-        ClientContext context;
-        SpaceX::API::Device::Request request;
-        SpaceX::API::Device::Response response;
+void StarlinkClient::failCycle(PollScheduler::RequestMask requests)
+{
+    pending_.timestampMs = QDateTime::currentMSecsSinceEpoch();
+    pending_.newHistorySamples = 0;
+    pending_.connected = false;
+    pending_.statusError.clear();
+    obstructionMapChanged_ = false;
+    cycleRequests_ = requests;
+    cycleFailed_ = true;
+    publishSnapshot();
+}
 
-        request.mutable_get_location();
+void StarlinkClient::resetArena()
+{
+    const size_t used = static_cast<size_t>(arena_->SpaceAllocated());
+    if (used <= arenaBlock_.size() || arenaBlock_.size() >= kMaxArenaBlockBytes) {
+        arena_->Reset();
+        return;
+    }
+
+    // The last cycle spilled out of the first block; start from one that
+    // would have held it, with some room to spare
+    arena_.reset();
+    arenaBlock_.assign(std::min(used + used / 4, kMaxArenaBlockBytes), 0);
+    google::protobuf::ArenaOptions options;
+    options.initial_block = arenaBlock_.data();
+    options.initial_block_size = arenaBlock_.size();
+    arena_ = std::make_unique<google::protobuf::Arena>(options);
+}
+
+void StarlinkClient::fillRequest(RequestKind kind, SpaceX::API::Device::Request *request)
+{
+    switch (kind) {
+    case RequestKind::Status:
+        request->mutable_get_status();
+        break;
+    case RequestKind::DeviceInfo:
+        request->mutable_get_device_info();
+        break;
+    case RequestKind::Location:
+        request->mutable_get_location();
+        break;
+    case RequestKind::History:
+        request->mutable_get_history();
+        break;
+    case RequestKind::ObstructionMap:
+        request->mutable_dish_get_obstruction_map();
+        break;
+    case RequestKind::Context:
+        request->mutable_dish_get_context();
+        break;
+    }
+}
 
-        Status status = stub_->Handle(&context, request, &response);
+const SpaceX::API::Device::Request &StarlinkClient::prebuiltRequest(RequestKind kind)
+{
+    // A request says nothing but what it asks for, so one of each kind
+    // serves every call of every client
+    static const auto requests = []() {
+        std::array<SpaceX::API::Device::Request, PollScheduler::RequestCount> built;
+        for (RequestKind each : { RequestKind::Status, RequestKind::DeviceInfo, RequestKind::Location,
+                                  RequestKind::History, RequestKind::ObstructionMap, RequestKind::Context }) {
+            fillRequest(each, &built[scheduledAs(each)]);
+        }
+        return built;
+    }();
+    return requests[scheduledAs(kind)];
+}
+
+PollScheduler::Request StarlinkClient::scheduledAs(RequestKind kind)
+{
+    switch (kind) {
+    case RequestKind::Status:
+        return PollScheduler::Status;
+    case RequestKind::DeviceInfo:
+        return PollScheduler::DeviceInfo;
+    case RequestKind::Location:
+        return PollScheduler::Location;
+    case RequestKind::History:
+        return PollScheduler::History;
+    case RequestKind::ObstructionMap:
+        return PollScheduler::ObstructionMap;
+    case RequestKind::Context:
+        return PollScheduler::Context;
+    }
+    return PollScheduler::Status;
+}
+
+int StarlinkClient::deadlineMs(RequestKind kind)
+{
+    return kind == RequestKind::History || kind == RequestKind::ObstructionMap ? kLargeReplyDeadlineMs
+                                                                               : kRequestDeadlineMs;
+}
+
+// History replies are hundreds of KB of packed floats of which a poll
+// needs the last few seconds; they are scanned in place, not parsed
+bool StarlinkClient::arrivesRaw(RequestKind kind)
+{
+    return kind == RequestKind::History;
+}
+
+void StarlinkClient::issueRequest(RequestKind kind)
+{
+    const int64_t startNs = Instrumentation::nowNs();
+    auto *call = new AsyncCall;
+    call->client = this;
+    call->kind = kind;
+    call->context.set_deadline(TransportPool::deadlineAfter(deadlineMs(kind)));
+
+    operations_.started();
+    if (arrivesRaw(kind)) {
+        call->rawReader = genericStub_->PrepareUnaryCall(&call->context, kHandleMethod, historyRequest_, cq_);
+        call->rawReader->StartCall();
+        call->sentNs = Instrumentation::nowNs();
+        call->rawReader->Finish(&call->raw, &call->status, call);
+    } else {
+        // The request is serialized as the call is prepared
+        call->response = google::protobuf::Arena::CreateMessage<SpaceX::API::Device::Response>(arena_.get());
+        call->reader = stub_->PrepareAsyncHandle(&call->context, prebuiltRequest(kind), cq_);
+        call->reader->StartCall();
+        call->sentNs = Instrumentation::nowNs();
+        call->reader->Finish(call->response, &call->status, call);
+    }
+    inFlight_.push_back(call);
+
+    Instrumentation::global().record(scheduledAs(kind), Instrumentation::Serialize, startNs, call->sentNs);
+}
+
+void StarlinkClient::AsyncCall::complete(bool)
+{
+    completedNs = Instrumentation::nowNs();
+    Instrumentation::global().record(scheduledAs(kind), Instrumentation::RoundTrip, sentNs, completedNs);
 
-        if (status.ok() && response.has_get_location()) {
+    // Finish() always completes; the RPC outcome lives in status
+    std::shared_ptr<AsyncCall> call(this);
+    StarlinkClient *owner = client;
+    QMetaObject::invokeMethod(owner, [owner, call]() {
+        owner->handleResponse(call.get());
+    }, Qt::QueuedConnection);
+    owner->operations_.finished();
+}
+
+bool StarlinkClient::runSpeedTest()
+{
+    if (speedTest_) {
+        return false;
+    }
+    ensureChannel();
+
+    auto *call = new SpeedTestCall;
+    call->client = this;
+    call->startedMs = QDateTime::currentMSecsSinceEpoch();
+    call->context.set_deadline(TransportPool::deadlineAfter(kSpeedTestDeadlineMs));
+
+    SpaceX::API::Device::Request request;
+    request.mutable_speed_test();
+    operations_.started();
+    call->reader = stub_->PrepareAsyncHandle(&call->context, request, cq_);
+    call->reader->StartCall();
+    call->reader->Finish(&call->response, &call->status, call);
+    speedTest_ = call;
+    return true;
+}
+
+void StarlinkClient::SpeedTestCall::complete(bool)
+{
+    std::shared_ptr<SpeedTestCall> call(this);
+    StarlinkClient *owner = client;
+    QMetaObject::invokeMethod(owner, [owner, call]() {
+        owner->handleSpeedTest(call.get());
+    }, Qt::QueuedConnection);
+    owner->operations_.finished();
+}
+
+void StarlinkClient::handleSpeedTest(SpeedTestCall *call)
+{
+    speedTest_ = nullptr;
+
+    SpeedTestResult result;
+    result.startedMs = call->startedMs;
+    result.finishedMs = QDateTime::currentMSecsSinceEpoch();
+    if (!call->status.ok() || !call->response.has_speed_test()) {
+        const QString error = call->status.ok() ? QString("no speed test in the reply")
+                                                : QString::fromStdString(call->status.error_message());
+        emit speedTestFinished(false, result, error);
+        return;
+    }
+
+    // Older firmware only fills in the bps fields
+    const auto &test = call->response.speed_test();
+    result.downloadMbps = test.has_download_mbps() ? test.download_mbps() : test.download_bps() / 1e6f;
+    result.uploadMbps = test.has_upload_mbps() ? test.upload_mbps() : test.upload_bps() / 1e6f;
+    result.latencyMs = test.has_latency_ms() ? test.latency_ms() : test.latency_s() * 1000.0f;
+    result.downloadMbpsByConnections = { test.download_mbps_1_tcp_conn(), test.download_mbps_4_tcp_conn(),
+                                         test.download_mbps_16_tcp_conn(), test.download_mbps_64_tcp_conn() };
+    result.uploadMbpsByConnections = { test.upload_mbps_1_tcp_conn(), test.upload_mbps_4_tcp_conn(),
+                                       test.upload_mbps_16_tcp_conn(), test.upload_mbps_64_tcp_conn() };
+
+    telemetry_.appendSpeedTest(result);
+    emit speedTestFinished(true, result, QString());
+}
+
+void StarlinkClient::StreamTag::complete(bool ok)
+{
+    StarlinkClient *owner = client;
+    const Type finished = type;
+    const int64_t completedNs = Instrumentation::nowNs();
+    QMetaObject::invokeMethod(owner, [owner, finished, ok, completedNs]() {
+        owner->handleStreamEvent(finished, ok, completedNs);
+    }, Qt::QueuedConnection);
+    owner->operations_.finished();
+}
+
+void StarlinkClient::handleResponse(AsyncCall *call)
+{
+    inFlight_.erase(std::remove(inFlight_.begin(), inFlight_.end(), call), inFlight_.end());
+
+    Instrumentation &instrumentation = Instrumentation::global();
+    const PollScheduler::Request request = scheduledAs(call->kind);
+    const int64_t startNs = Instrumentation::nowNs();
+    instrumentation.record(request, Instrumentation::QueueWait, call->completedNs, startNs);
+    if (call->rawReader) {
+        applyRawResponse(call->kind, call->status, call->raw);
+    } else {
+        applyResponse(call->kind, call->status, *call->response);
+    }
+    instrumentation.record(request, Instrumentation::Apply, startNs, Instrumentation::nowNs());
+
+    if (inFlight_.empty()) {
+        publishSnapshot();
+    }
+}
+
+bool StarlinkClient::applyStatus(RequestKind kind, const Status &status)
+{
+    // Errors like PERMISSION_DENIED for a locked-down get_location still
+    // prove the dish is there; only transport failures count against it
+    if (TransportPool::isUnreachable(status)) {
+        cycleFailed_ = true;
+    }
+    if (status.ok()) {
+        broker_.answered(scheduledAs(kind), PollScheduler::now());
+    }
+    return status.ok();
+}
+
+void StarlinkClient::applyResponse(RequestKind kind, const Status &status,
+                                   const SpaceX::API::Device::Response &response)
+{
+    const bool ok = applyStatus(kind, status);
+    const QString error = QString::fromStdString(status.error_message());
+
+    switch (kind) {
+    // 1. Get Status
+    // An application error still means the dish answered; it shows as an
+    // error on a connected dish rather than as a lost connection
+    case RequestKind::Status:
+        pending_.connected = ok || !TransportPool::isUnreachable(status);
+        pending_.statusError = ok ? QString()
+            : error.isEmpty() ? QString("gRPC code %1").arg(static_cast<int>(status.error_code()))
+            : error;
+        if (ok) {
+            if (response.has_dish_get_status()) {
+                const auto &dish = response.dish_get_status();
+                if (dish.has_device_info()) {
+                    pending_.deviceId = QString::fromStdString(dish.device_info().id());
+                    pending_.hardwareVersion = QString::fromStdString(dish.device_info().hardware_version());
+                }
+
+                const auto &alerts = dish.alerts();
+                pending_.hasStatus = true;
+                pending_.dishState = dish.state();
+                pending_.alerts = (alerts.motors_stuck() ? DishSnapshot::MotorsStuck : 0)
+                                | (alerts.thermal_throttle() ? DishSnapshot::ThermalThrottle : 0)
+                                | (alerts.thermal_shutdown() ? DishSnapshot::ThermalShutdown : 0)
+                                | (alerts.mast_not_near_vertical() ? DishSnapshot::MastNotNearVertical : 0)
+                                | (alerts.unexpected_location() ? DishSnapshot::UnexpectedLocation : 0)
+                                | (alerts.slow_ethernet_speeds() ? DishSnapshot::SlowEthernetSpeeds : 0);
+                pending_.currentlyObstructed = dish.obstruction_stats().currently_obstructed();
+                pending_.fractionObstructed = dish.obstruction_stats().fraction_obstructed();
+                pending_.snr = dish.snr();
+
+                // Only what counts as the dish changing state goes into the
+                // key; throughput and SNR move every second
+                stateKey_ = static_cast<quint32>(pending_.dishState)
+                          | pending_.alerts << 8
+                          | pending_.currentlyObstructed << 14
+                          | dish.stow_requested() << 15;
+            } else if (response.has_get_device_info()) {
+                // Older firmware answers get_status with device info only
+                const auto& info = response.get_device_info().device_info();
+                pending_.deviceId = QString::fromStdString(info.id());
+                pending_.hardwareVersion = QString::fromStdString(info.hardware_version());
+            }
+        } else {
+            qWarning() << "gRPC Status Failed:" << error;
+        }
+        break;
+
+    case RequestKind::DeviceInfo:
+        if (ok && response.has_get_device_info()) {
+            const auto& info = response.get_device_info().device_info();
+            pending_.deviceId = QString::fromStdString(info.id());
+            pending_.hardwareVersion = QString::fromStdString(info.hardware_version());
+        }
+        break;
+
+    // 2. Get Location
+    case RequestKind::Location:
+        if (ok && response.has_get_location()) {
             const auto& loc = response.get_location();
             if (loc.has_lla()) {
-                emit locationUpdated(loc.lla().lat(), loc.lla().lon(), loc.lla().alt());
+                pending_.hasLocation = true;
+                pending_.lat = loc.lla().lat();
+                pending_.lon = loc.lla().lon();
+                pending_.alt = loc.lla().alt();
+            }
+        }
+        break;
+
+    // 3. Get History
+    // Only samples written since the previous poll are decoded; report their
+    // average so the display covers the whole poll interval.
+    case RequestKind::History:
+        if (ok && response.has_dish_get_history()
+            && historyDecoder_.decode(response.dish_get_history(), &newSamples_) > 0) {
+            applyHistorySamples();
+        }
+        break;
+
+    case RequestKind::ObstructionMap:
+        if (ok && response.has_dish_get_obstruction_map()) {
+            const auto &map = response.dish_get_obstruction_map();
+            const int rows = static_cast<int>(map.num_rows());
+            const int cols = static_cast<int>(map.num_cols());
+            if (static_cast<int64_t>(rows) * cols != map.snr_size()) {
+                qWarning("Ignoring %dx%d obstruction map with %d cells", rows, cols, map.snr_size());
+                break;
+            }
+            obstructionMapChanged_ = obstructionMap_.update(rows, cols, map.snr().data());
+        }
+        break;
+
+    // Which cell, POP and gateway serve the dish; zero where it doesn't say
+    case RequestKind::Context:
+        if (ok && response.has_dish_get_context()) {
+            const auto &context = response.dish_get_context();
+            pending_.hasContext = true;
+            pending_.cellId = context.cell_id();
+            pending_.popRackId = context.pop_rack_id();
+            pending_.gatewayId = context.initial_gateway_id();
+            pending_.onBackupBeam = context.on_backup_beam();
+        }
+        break;
+    }
+}
+
+void StarlinkClient::applyRawResponse(RequestKind kind, const Status &status, const grpc::ByteBuffer &raw)
+{
+    if (!status.ok()) {
+        applyResponse(kind, status, SpaceX::API::Device::Response::default_instance());
+        return;
+    }
+
+    // Small replies arrive in one slice and are read where they are
+    grpc::Slice slice;
+    const char *data = nullptr;
+    size_t size = 0;
+    if (raw.TrySingleSlice(&slice).ok()) {
+        data = reinterpret_cast<const char *>(slice.begin());
+        size = slice.size();
+    } else if (raw.Dump(&rawSlices_).ok()) {
+        rawReply_.clear();
+        for (const grpc::Slice &each : rawSlices_) {
+            rawReply_.insert(rawReply_.end(), each.begin(), each.end());
+        }
+        rawSlices_.clear();
+        data = rawReply_.data();
+        size = rawReply_.size();
+    }
+
+    const int64_t startNs = Instrumentation::nowNs();
+    HistoryView view;
+    const WireScanner::Result result = WireScanner::scanHistoryResponse(data, size, &view);
+    if (result == WireScanner::Result::Unsupported) {
+        // Valid protobuf the scanner won't second-guess, or not protobuf at
+        // all; the parser tells which
+        auto *response = google::protobuf::Arena::CreateMessage<SpaceX::API::Device::Response>(arena_.get());
+        if (!response->ParseFromArray(data, static_cast<int>(size))) {
+            applyResponse(kind, Status(grpc::StatusCode::INTERNAL, "Failed to parse history reply"),
+                          SpaceX::API::Device::Response::default_instance());
+            return;
+        }
+        Instrumentation::global().record(scheduledAs(kind), Instrumentation::Parse, startNs, Instrumentation::nowNs());
+        applyResponse(kind, status, *response);
+        return;
+    }
+    Instrumentation::global().record(scheduledAs(kind), Instrumentation::Parse, startNs, Instrumentation::nowNs());
+
+    applyStatus(kind, status);
+    if (result == WireScanner::Result::Found && historyDecoder_.decode(view, &newSamples_) > 0) {
+        applyHistorySamples();
+    }
+}
+
+void StarlinkClient::applyHistorySamples()
+{
+    // The newest sample was taken roughly when we polled, the others one
+    // second apart before it
+    const uint64_t newest = newSamples_.back().index;
+    int stored = 0;
+    for (const HistorySample &sample : newSamples_) {
+        stored += storeSample(pending_.timestampMs - static_cast<int64_t>(newest - sample.index) * 1000, sample);
+    }
+    pending_.newHistorySamples = stored;
+
+    const HistoryDecoder::BatchSummary &batch = historyDecoder_.lastBatch();
+    pending_.hasSpeed = true;
+    pending_.downloadMbps = batch.downlinkBps.mean() / 1e6f;
+    pending_.uploadMbps = batch.uplinkBps.mean() / 1e6f;
+    pending_.latencyMs = batch.latencyMs.mean();
+}
+
+void StarlinkClient::publishSnapshot()
+{
+    const qint64 now = PollScheduler::now();
+    streamDeadline_->stop();
+
+    if (cycleFailed_) {
+        breaker_.recordFailure(now);
+        if (breaker_.state() == CircuitBreaker::State::Open) {
+            pending_.connected = false;
+            watchChannel();
+        }
+    } else {
+        breaker_.recordSuccess();
+    }
+
+    const DishSnapshot &snapshot = pending_;
+
+    if (cycleRequests_ & PollScheduler::bit(PollScheduler::Status)) {
+        scheduler_.statusPolled(now, snapshot.connected, stateKey_);
+    } else if (cycleFailed_) {
+        scheduler_.requestFailed(now);
+    }
+    if ((cycleRequests_ & PollScheduler::bit(PollScheduler::History)) && !cycleFailed_) {
+        scheduler_.historyPolled(now, snapshot.newHistorySamples, historyDecoder_.ringSize());
+    }
+
+    published_ = snapshot;
+    if (snapshot.connected) {
+        stateChanged_ = true;
+        if (now - stateSavedMs_ >= kStateSaveIntervalMs) {
+            saveState();
+        }
+    }
+    Instrumentation::global().dispatched();
+    emit snapshotUpdated(snapshot);
+    if (snapshot.newHistorySamples > 0) {
+        emit telemetryAppended(snapshot.newHistorySamples);
+    }
+
+    emit statusChanged(snapshot.connected, snapshot.statusError);
+    if (snapshot.connected && !snapshot.deviceId.isEmpty()
+        && (cycleRequests_ & (PollScheduler::bit(PollScheduler::Status) | PollScheduler::bit(PollScheduler::DeviceInfo)))) {
+        emit satelliteInfoUpdated(snapshot.deviceId, snapshot.hardwareVersion);
+    }
+    if (snapshot.hasLocation && (cycleRequests_ & PollScheduler::bit(PollScheduler::Location))) {
+        emit locationUpdated(snapshot.lat, snapshot.lon, snapshot.alt);
+    }
+    if (snapshot.newHistorySamples > 0) {
+        emit speedUpdated(snapshot.downloadMbps, snapshot.uploadMbps, snapshot.latencyMs);
+    }
+    if (obstructionMapChanged_) {
+        emit obstructionMapUpdated(obstructionMap_.changedFirstRow(), obstructionMap_.changedRowCount());
+    }
+    broker_.deliver(cycleRequests_, cycleFailed_, snapshot);
+
+    armPollTimer();
+}
+
+void StarlinkClient::watchChannel()
+{
+    if (channelWatch_ || breaker_.state() != CircuitBreaker::State::Open) {
+        return;
+    }
+
+    auto watch = std::make_shared<ChannelWatch>();
+    watch->client = this;
+    watch->self = watch;
+    channelWatch_ = watch;
+
+    const grpc_connectivity_state state = channel_->GetState(true);
+    channel_->NotifyOnStateChange(state, TransportPool::deadlineAfter(kChannelWatchMs), cq_, watch.get());
+}
+
+void StarlinkClient::ChannelWatch::complete(bool ok)
+{
+    // Drop the pool's reference only after the mutex is released
+    std::shared_ptr<ChannelWatch> keep = std::move(self);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (client) {
+        StarlinkClient *owner = client;
+        QMetaObject::invokeMethod(owner, [owner, ok]() {
+            owner->handleChannelChange(ok);
+        }, Qt::QueuedConnection);
+    }
+}
+
+void StarlinkClient::handleChannelChange(bool ok)
+{
+    channelWatch_.reset();
+    if (breaker_.state() != CircuitBreaker::State::Open) {
+        return;
+    }
+
+    // ok means the state changed before the watch expired
+    if (ok && channel_->GetState(false) == GRPC_CHANNEL_READY) {
+        // The dish is back; probe now instead of waiting out the cool-down
+        breaker_.channelReady();
+        armPollTimer();
+        return;
+    }
+    watchChannel();
+}
+
+void StarlinkClient::openStream()
+{
+    streamContext_ = std::make_unique<ClientContext>();
+    stream_ = stub_->PrepareAsyncStream(streamContext_.get(), cq_);
+    streamState_ = StreamState::Opening;
+    operations_.started();
+    stream_->StartCall(&streamStartTag_);
+}
+
+void StarlinkClient::queueStreamRequest(RequestKind kind)
+{
+    const uint64_t id = nextRequestId_++;
+    streamPending_.push_back({ id, kind, 0 });
+    writeQueue_.push_back(id);
+    writeNextStreamRequest();
+}
+
+void StarlinkClient::writeNextStreamRequest()
+{
+    // gRPC allows only one outstanding write per stream
+    if (writing_ || writeQueue_.empty() || streamState_ != StreamState::Open) {
+        return;
+    }
+
+    const uint64_t id = writeQueue_.front();
+    writeQueue_.pop_front();
+    auto pending = std::find_if(streamPending_.begin(), streamPending_.end(),
+                                [id](const StreamRequest &entry) { return entry.id == id; });
+    if (pending == streamPending_.end()) {
+        writeNextStreamRequest();
+        return;
+    }
+
+    // Write() serializes immediately, so the message is free for the next
+    // request of its kind as soon as it returns
+    const int64_t startNs = Instrumentation::nowNs();
+    SpaceX::API::Device::ToDevice &message = streamRequests_[scheduledAs(pending->kind)];
+    if (!message.has_request()) {
+        fillRequest(pending->kind, message.mutable_request());
+    }
+    message.mutable_request()->set_id(id);
+
+    writing_ = true;
+    operations_.started();
+    stream_->Write(message, &streamWriteTag_);
+    pending->sentNs = Instrumentation::nowNs();
+    Instrumentation::global().record(scheduledAs(pending->kind), Instrumentation::Serialize, startNs, pending->sentNs);
+}
+
+void StarlinkClient::handleStreamEvent(StreamTag::Type type, bool ok, int64_t completedNs)
+{
+    switch (type) {
+    case StreamTag::Start:
+        if (!ok) {
+            streamState_ = StreamState::Closing;
+            operations_.started();
+            stream_->Finish(&streamStatus_, &streamFinishTag_);
+            break;
+        }
+        streamState_ = StreamState::Open;
+        operations_.started();
+        stream_->Read(&incoming_, &streamReadTag_);
+        writeNextStreamRequest();
+        break;
+
+    case StreamTag::Read:
+        if (!ok) {
+            // Server closed its side or the call was cancelled
+            if (streamState_ != StreamState::Closing) {
+                streamState_ = StreamState::Closing;
+                operations_.started();
+                stream_->Finish(&streamStatus_, &streamFinishTag_);
             }
+            break;
         }
+        readCompletedNs_ = completedNs;
+        dispatchFromDevice(incoming_);
+        incoming_.Clear();
+        if (streamState_ == StreamState::Open) {
+            operations_.started();
+            stream_->Read(&incoming_, &streamReadTag_);
+        }
+        break;
+
+    case StreamTag::Write:
+        writing_ = false;
+        if (streamState_ == StreamState::Closed) {
+            stream_.reset();
+            streamContext_.reset();
+        } else if (ok) {
+            writeNextStreamRequest();
+        }
+        break;
+
+    case StreamTag::Finish:
+        closeStream();
+        break;
     }
-    
-    // 3. Get History (often used for speed/throughput) or SpeedTest
-    // Note: SpeedTest might be an active test. GetHistory is passive.
-    // Let's try GetHistory for throughput.
-    {
-        ClientContext context;
-        SpaceX::API::Device::Request request;
-        SpaceX::API::Device::Response response;
-
-        request.mutable_get_history();
-
-        Status status = stub_->Handle(&context, request, &response);
-        
-        // Parsing history is complex, for this MVP we might just use a mock speed or 
-        // look for a simpler "current throughput" field if available in Status.
-        // In the mock, we will simulate this.
-        
-        // For now, let's emit dummy speed data if connected, to verify UI.
-        // In a real app, we'd calculate this from the history ring buffer.
-        if (status.ok()) {
-             // Placeholder: 100 Mbps down, 20 Mbps up, 30ms latency
-             emit speedUpdated(100.0f, 20.0f, 30.0f);
+}
+
+void StarlinkClient::dispatchFromDevice(const SpaceX::API::Device::FromDevice &message)
+{
+    switch (message.message_case()) {
+    case SpaceX::API::Device::FromDevice::kResponse: {
+        const SpaceX::API::Device::Response &response = message.response();
+
+        auto it = std::find_if(streamPending_.begin(), streamPending_.end(),
+                               [&response](const StreamRequest &entry) {
+            return entry.id == response.id();
+        });
+        // Firmware that does not echo Request.id answers in order
+        if (it == streamPending_.end() && response.id() == 0 && !streamPending_.empty()) {
+            it = streamPending_.begin();
         }
+        // Late reply to a cycle that was already abandoned
+        if (it == streamPending_.end()) {
+            break;
+        }
+
+        const RequestKind kind = it->kind;
+        const int64_t sentNs = it->sentNs;
+        streamPending_.erase(it);
+
+        // Stream replies are only told apart once read, so the round trip
+        // runs until the read completed
+        Instrumentation &instrumentation = Instrumentation::global();
+        const PollScheduler::Request request = scheduledAs(kind);
+        const int64_t startNs = Instrumentation::nowNs();
+        if (sentNs != 0) {
+            instrumentation.record(request, Instrumentation::RoundTrip, sentNs, readCompletedNs_);
+        }
+        instrumentation.record(request, Instrumentation::QueueWait, readCompletedNs_, startNs);
+
+        // The dish reports errors with gRPC status codes
+        const Status status(static_cast<grpc::StatusCode>(response.status().code()), response.status().message());
+        applyResponse(kind, status, response);
+        instrumentation.record(request, Instrumentation::Apply, startNs, Instrumentation::nowNs());
+
+        if (streamPending_.empty()) {
+            publishSnapshot();
+        }
+        break;
+    }
+
+    case SpaceX::API::Device::FromDevice::kEvent: {
+        const SpaceX::API::Device::Event &event = message.event();
+        switch (event.event_case()) {
+        case SpaceX::API::Device::Event::kWifiNewClientConnected: {
+            const auto &client = event.wifi_new_client_connected().client();
+            emit wifiClientConnected(QString::fromStdString(client.name()),
+                                     QString::fromStdString(client.mac_address()),
+                                     QString::fromStdString(client.ip_address()));
+            break;
+        }
+        case SpaceX::API::Device::Event::kWifiAccountBonding:
+            emit wifiAccountBonded(QString::fromStdString(event.wifi_account_bonding().dish_id()));
+            break;
+        default:
+            break;
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+void StarlinkClient::closeStream()
+{
+    if (!streamStatus_.ok()) {
+        qWarning() << "gRPC Stream closed:" << streamStatus_.error_message().c_str();
+    }
+
+    streamState_ = StreamState::Closed;
+    writeQueue_.clear();
+    if (!writing_) {
+        stream_.reset();
+        streamContext_.reset();
+    }
+
+    // Whatever was still outstanding will never be answered on this stream
+    if (!streamPending_.empty()) {
+        streamPending_.clear();
+        pending_.connected = false;
+        cycleFailed_ = true;
+        publishSnapshot();
     }
 }
@@ -4,45 +4,342 @@
 #include <QObject>
 #include <QString>
 #include <QTimer>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <google/protobuf/arena.h>
+#include <grpcpp/generic/generic_stub.h>
 #include <grpcpp/grpcpp.h>
-
-// Forward declarations for generated protobuf classes
-namespace SpaceX {
-namespace API {
-namespace Device {
-class Device;
-class DeviceInfo;
-class Status;
-class Position;
-}
-}
-}
+#include "circuitbreaker.h"
+#include "dishsnapshot.h"
+#include "historydecoder.h"
+#include "instrumentation.h"
+#include "obstructionmap.h"
+#include "pollscheduler.h"
+#include "requestbroker.h"
+#include "segmentlog.h"
+#include "statecache.h"
+#include "telemetrystore.h"
+#include "transportpool.h"
+#include "spacex/api/device/service.grpc.pb.h"
 
 class StarlinkClient : public QObject
 {
     Q_OBJECT
 
 public:
+    // Unary issues one Handle() call per request. Stream keeps a single
+    // Device::Stream open and multiplexes id-tagged requests over it, which
+    // also lets the dish push events to us.
+    enum class Transport {
+        Unary,
+        Stream
+    };
+
     explicit StarlinkClient(const QString &target = "192.168.100.1:9200", QObject *parent = nullptr);
+    // Shares completion queues, worker threads and channels with every
+    // other client on the same pool
+    StarlinkClient(const QString &target, std::shared_ptr<TransportPool> pool, QObject *parent = nullptr);
     ~StarlinkClient();
 
+    QString target() const { return target_; }
+    std::shared_ptr<TransportPool> pool() const { return pool_; }
+
+    // Polls on the client's own timer, armed for whenever the scheduler
+    // says the next request is due
     void startMonitoring();
     void stopMonitoring();
 
+    // For callers that drive polling themselves, like FleetManager: sends
+    // whatever the scheduler has due at nowMs (PollScheduler::now() time)
+    void pollDue(qint64 nowMs);
+    qint64 nextPollMs() const;
+    PollScheduler &scheduler() { return scheduler_; }
+    const CircuitBreaker &breaker() const { return breaker_; }
+
+    // Slow everything down while nobody is looking
+    void setBackground(bool background);
+
+    void setTransport(Transport transport);
+    Transport transport() const { return transport_; }
+    // "unary" or "stream", as given on command lines
+    static bool parseTransport(const QString &name, Transport *transport);
+
+    // Every history sample received so far, with rolling aggregates.
+    // Changing the capacity discards what has been collected.
+    const TelemetryStore &telemetry() const { return telemetry_; }
+    void setHistoryCapacity(size_t samples);
+
+    // Also writes every history sample to a SegmentLog in directory, and
+    // reloads as much of it as the telemetry store holds, so history
+    // survives restarts. Fails only if directory can't be created.
+    //
+    // Opening the log archives whatever sealed segments an earlier run left
+    // behind, so it and reading the log back happen on QThreadPool's global
+    // pool. log() stays null until that is done and telemetryReloaded() is
+    // emitted, or for good if the log can't be opened, with a warning
+    // saying why. Until then snapshot() and the store hold what the
+    // directory's StateCache had, which is written every so often while the
+    // dish answers and once more when the client goes away; samples polled
+    // meanwhile are written to the log once it is open.
+    bool setLogDirectory(const QString &directory, QString *error = nullptr);
+    QString logDirectory() const { return logDirectory_; }
+    const SegmentLog *log() const { return log_.get(); }
+
+    // Latest obstruction map, once PollScheduler::ObstructionMap is enabled
+    const ObstructionMap &obstructionMap() const { return obstructionMap_; }
+
+    // The snapshot last passed to snapshotUpdated()
+    const DishSnapshot &snapshot() const { return published_; }
+
+    // For consumers that need a value now rather than on the schedule. The
+    // callback gets the latest snapshot once it holds a reply of this kind
+    // no older than maxAgeMs (RequestBroker::defaultMaxAgeMs() if negative):
+    // straight away from the last reply, from the request already on its
+    // way, or from one sent for everybody waiting on it. It runs on
+    // context's thread, and not at all once context is gone. Disabled
+    // requests and an open breaker are answered from what is there.
+    void read(PollScheduler::Request request, qint64 maxAgeMs, QObject *context, RequestBroker::Callback callback);
+
+    // Has the dish run its own speed test, which takes the better part of a
+    // minute and saturates the link; polling carries on meanwhile. A result
+    // goes into the telemetry store before speedTestFinished(). One test at
+    // a time: returns false while one is running.
+    bool runSpeedTest();
+    bool isSpeedTestRunning() const { return speedTest_ != nullptr; }
+
 signals:
-    void statusChanged(bool connected);
+    void snapshotUpdated(const DishSnapshot &snapshot);
+    void telemetryAppended(int samples);
+    // The store was refilled from the log; anything read from it is stale
+    void telemetryReloaded();
+    // error is set when the dish is reachable but refused get_status
+    void statusChanged(bool connected, const QString &error);
     void speedUpdated(float downloadMbps, float uploadMbps, float latencyMs);
     void locationUpdated(double lat, double lon, double alt);
     void satelliteInfoUpdated(const QString &id, const QString &hardwareVersion);
+    // Only when some cell changed; the rows are the band that did
+    void obstructionMapUpdated(int firstRow, int rowCount);
+    // ok is false, with error set, if the dish didn't run the test
+    void speedTestFinished(bool ok, const SpeedTestResult &result, const QString &error);
 
-private slots:
+    // Pushed by the dish over the stream transport only
+    void wifiClientConnected(const QString &name, const QString &macAddress, const QString &ipAddress);
+    void wifiAccountBonded(const QString &dishId);
+
+public slots:
+    // Poll everything right away, regardless of the schedule
     void fetchStatus();
 
 private:
+    enum class RequestKind {
+        Status,
+        DeviceInfo,
+        Location,
+        History,
+        ObstructionMap,
+        Context
+    };
+
+    // One outstanding Handle() call. Owned by the GUI thread until it is
+    // started, by the completion queue while in flight, and handed back to
+    // the GUI thread through a queued invocation once it finishes. The
+    // response belongs to the cycle's arena, not to the call. History comes
+    // back unparsed in raw instead, see applyRawResponse(). gRPC doesn't
+    // allow a ClientContext to be reused, so calls aren't either.
+    struct AsyncCall : CompletionTag {
+        void complete(bool ok) override;
+
+        StarlinkClient *client = nullptr;
+        RequestKind kind;
+        // Instrumentation::nowNs() when the request went out and when its
+        // completion came off the queue
+        int64_t sentNs = 0;
+        int64_t completedNs = 0;
+        grpc::ClientContext context;
+        SpaceX::API::Device::Response *response = nullptr;
+        grpc::Status status;
+        std::unique_ptr<grpc::ClientAsyncResponseReader<SpaceX::API::Device::Response>> reader;
+        grpc::ByteBuffer raw;
+        std::unique_ptr<grpc::GenericClientAsyncResponseReader> rawReader;
+    };
+
+    // Outlives the client like an AsyncCall; the response isn't in the
+    // arena, since the test spans any number of cycles
+    struct SpeedTestCall : CompletionTag {
+        void complete(bool ok) override;
+
+        StarlinkClient *client = nullptr;
+        int64_t startedMs = 0;
+        grpc::ClientContext context;
+        SpaceX::API::Device::Response response;
+        grpc::Status status;
+        std::unique_ptr<grpc::ClientAsyncResponseReader<SpaceX::API::Device::Response>> reader;
+    };
+
+    // The four operations a stream can have outstanding; they live as long
+    // as the client and are reused for every stream it opens
+    struct StreamTag : CompletionTag {
+        enum Type {
+            Start,
+            Read,
+            Write,
+            Finish
+        };
+
+        StreamTag(StarlinkClient *client, Type type) : client(client), type(type) {}
+        void complete(bool ok) override;
+
+        StarlinkClient *client;
+        Type type;
+    };
+
+    // Watches the channel for the connection coming back while the breaker
+    // is open. NotifyOnStateChange() can't be cancelled, so the watch may
+    // outlive the client: the destructor detaches it and the pool deletes
+    // it once the notification finally arrives.
+    struct ChannelWatch : CompletionTag {
+        void complete(bool ok) override;
+
+        std::mutex mutex;
+        StarlinkClient *client = nullptr;  // guarded by mutex
+        std::shared_ptr<ChannelWatch> self;
+    };
+
+    struct StreamRequest {
+        uint64_t id;
+        RequestKind kind;
+        int64_t sentNs;  // 0 until written
+    };
+
+    enum class StreamState {
+        Closed,
+        Opening,
+        Open,
+        Closing
+    };
+
+    static void fillRequest(RequestKind kind, SpaceX::API::Device::Request *request);
+    static const SpaceX::API::Device::Request &prebuiltRequest(RequestKind kind);
+    static int deadlineMs(RequestKind kind);
+    static bool arrivesRaw(RequestKind kind);
+    static PollScheduler::Request scheduledAs(RequestKind kind);
+    void issueRequest(RequestKind kind);
+    void handleResponse(AsyncCall *call);
+    bool applyStatus(RequestKind kind, const grpc::Status &status);
+    void applyResponse(RequestKind kind, const grpc::Status &status,
+                       const SpaceX::API::Device::Response &response);
+    void applyRawResponse(RequestKind kind, const grpc::Status &status, const grpc::ByteBuffer &raw);
+    void applyHistorySamples();
+    void failCycle(PollScheduler::RequestMask requests);
+    void resetArena();
+    void handleSpeedTest(SpeedTestCall *call);
+    void publishSnapshot();
+    void armPollTimer();
+    bool storeSample(int64_t estimatedMs, const HistorySample &sample);
+
+    void ensureChannel();
+    struct Reload;
+    void startReload();
+    void finishReload(int generation, Reload *reload);
+    void saveState();
+
+    void watchChannel();
+    void handleChannelChange(bool ok);
+
+    void openStream();
+    void queueStreamRequest(RequestKind kind);
+    void writeNextStreamRequest();
+    void handleStreamEvent(StreamTag::Type type, bool ok, int64_t completedNs);
+    void dispatchFromDevice(const SpaceX::API::Device::FromDevice &message);
+    void closeStream();
+
+    std::shared_ptr<TransportPool> pool_;
+    grpc::CompletionQueue *cq_;
+    std::shared_ptr<grpc::Channel> channel_;
     std::unique_ptr<SpaceX::API::Device::Device::Stub> stub_;
+    // Handle() without the generated (de)serialization, for history
+    std::unique_ptr<grpc::GenericStub> genericStub_;
+    grpc::ByteBuffer historyRequest_;
+
+    // Operations still owned by the pool; the destructor waits for zero
+    PendingOperations operations_;
+
+    std::vector<AsyncCall *> inFlight_;
+    SpeedTestCall *speedTest_ = nullptr;
+    // Every reply of a cycle is parsed into arena_, which is reset when the
+    // next cycle starts. It begins with arenaBlock_, grown to what the
+    // largest cycle so far needed, so a steady-state cycle doesn't allocate.
+    std::vector<char> arenaBlock_;
+    std::unique_ptr<google::protobuf::Arena> arena_;
+    PollScheduler scheduler_;
+    CircuitBreaker breaker_;
+    RequestBroker broker_;
+    std::shared_ptr<ChannelWatch> channelWatch_;
+    bool monitoring_ = false;
+    // Requests sent in the current cycle, and whether any of them failed
+    // because the dish could not be reached
+    PollScheduler::RequestMask cycleRequests_ = 0;
+    bool cycleFailed_ = false;
+    quint32 stateKey_ = 0;
+    DishSnapshot pending_;
+    DishSnapshot published_;
+    HistoryDecoder historyDecoder_;
+    std::vector<HistorySample> newSamples_;
+    // A raw reply spread over several slices is stitched together here
+    std::vector<grpc::Slice> rawSlices_;
+    std::vector<char> rawReply_;
+    ObstructionMap obstructionMap_;
+    bool obstructionMapChanged_ = false;
+    TelemetryStore telemetry_;
+    QString logDirectory_;
+    std::unique_ptr<SegmentLog> log_;
+    // Bumped whenever the directory changes, so a reload that finishes for
+    // an old one is dropped
+    int reloadGeneration_ = 0;
+    bool reloading_ = false;
+    // Stored while the log was still being opened, waiting to be written
+    std::vector<std::pair<int64_t, HistorySample>> unlogged_;
+    std::unique_ptr<StateCache> stateCache_;
+    bool stateChanged_ = false;
+    qint64 stateSavedMs_ = 0;
+    // Newest sample in the store and log; timestamps only move forward
+    int64_t lastStoredMs_ = std::numeric_limits<int64_t>::min();
+    uint64_t lastStoredIndex_ = 0;
+    bool haveStoredIndex_ = false;
     QTimer *pollTimer_;
+    // Stream requests can't carry their own deadline, so a whole stream
+    // cycle gets one instead
+    QTimer *streamDeadline_;
     QString target_;
+    Transport transport_ = Transport::Unary;
+
+    // Stream transport state; only touched on the GUI thread
+    std::unique_ptr<grpc::ClientContext> streamContext_;
+    std::unique_ptr<grpc::ClientAsyncReaderWriter<SpaceX::API::Device::ToDevice,
+                                                 SpaceX::API::Device::FromDevice>> stream_;
+    StreamState streamState_ = StreamState::Closed;
+    StreamTag streamStartTag_{this, StreamTag::Start};
+    StreamTag streamReadTag_{this, StreamTag::Read};
+    StreamTag streamWriteTag_{this, StreamTag::Write};
+    StreamTag streamFinishTag_{this, StreamTag::Finish};
+    // Read into over and over; Clear() keeps what its fields allocated
+    SpaceX::API::Device::FromDevice incoming_;
+    // Ids of requests still to be written, oldest first
+    std::deque<uint64_t> writeQueue_;
+    // One message per request kind, written again with a new id each time
+    std::array<SpaceX::API::Device::ToDevice, PollScheduler::RequestCount> streamRequests_;
+    bool writing_ = false;
+    grpc::Status streamStatus_;
+    uint64_t nextRequestId_ = 1;
+    std::vector<StreamRequest> streamPending_;
+    // When the read now being dispatched completed
+    int64_t readCompletedNs_ = 0;
 };
 
 #endif // STARLINKCLIENT_H
@@ -0,0 +1,184 @@
+#include "statecache.h"
+#include <QFile>
+#include <QSaveFile>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace {
+
+constexpr char kMagic[8] = { 'S', 'L', 'S', 'T', 'A', 'T', 'E', '\0' };
+constexpr uint32_t kVersion = 1;
+// Device ids and hardware versions are a few dozen bytes
+constexpr int kMaxStringBytes = 1024;
+
+enum Flag : uint8_t {
+    HasStatus = 1 << 0,
+    CurrentlyObstructed = 1 << 1,
+    HasLocation = 1 << 2,
+    HasSpeed = 1 << 3
+};
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t sampleCount;
+    int64_t timestampMs;
+    double lat;
+    double lon;
+    double alt;
+    int32_t dishState;
+    uint32_t alerts;
+    float fractionObstructed;
+    float snr;
+    float downloadMbps;
+    float uploadMbps;
+    float latencyMs;
+    uint16_t deviceIdBytes;
+    uint16_t hardwareVersionBytes;
+    uint8_t flags;
+    uint8_t reserved[7];
+};
+
+static_assert(std::is_trivially_copyable<CacheHeader>::value, "CacheHeader is written as raw bytes");
+
+// Per sample: timestamp, one float per metric, obstruction
+constexpr size_t kSampleBytes = sizeof(int64_t) + TelemetryStore::MetricCount * sizeof(float) + 1;
+
+bool fail(QString *error, const QString &message)
+{
+    if (error) {
+        *error = message;
+    }
+    return false;
+}
+
+}
+
+bool StateCache::save(const DishSnapshot &snapshot, const TelemetryStore &store, QString *error) const
+{
+    const QByteArray deviceId = snapshot.deviceId.toUtf8().left(kMaxStringBytes);
+    const QByteArray hardwareVersion = snapshot.hardwareVersion.toUtf8().left(kMaxStringBytes);
+    const size_t count = std::min(store.size(), kRecentSamples);
+    const size_t first = store.size() - count;
+
+    CacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.sampleCount = static_cast<uint32_t>(count);
+    header.timestampMs = snapshot.timestampMs;
+    header.lat = snapshot.lat;
+    header.lon = snapshot.lon;
+    header.alt = snapshot.alt;
+    header.dishState = snapshot.dishState;
+    header.alerts = snapshot.alerts;
+    header.fractionObstructed = snapshot.fractionObstructed;
+    header.snr = snapshot.snr;
+    header.downloadMbps = snapshot.downloadMbps;
+    header.uploadMbps = snapshot.uploadMbps;
+    header.latencyMs = snapshot.latencyMs;
+    header.deviceIdBytes = static_cast<uint16_t>(deviceId.size());
+    header.hardwareVersionBytes = static_cast<uint16_t>(hardwareVersion.size());
+    header.flags = (snapshot.hasStatus ? HasStatus : 0)
+                 | (snapshot.currentlyObstructed ? CurrentlyObstructed : 0)
+                 | (snapshot.hasLocation ? HasLocation : 0)
+                 | (snapshot.hasSpeed ? HasSpeed : 0);
+
+    QByteArray data;
+    data.reserve(static_cast<qsizetype>(sizeof(header) + deviceId.size() + hardwareVersion.size() + count * kSampleBytes));
+    data.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    data.append(deviceId);
+    data.append(hardwareVersion);
+    for (size_t i = first; i < store.size(); ++i) {
+        const int64_t timestampMs = store.timestampAt(i);
+        data.append(reinterpret_cast<const char *>(&timestampMs), sizeof(timestampMs));
+    }
+    for (int m = 0; m < TelemetryStore::MetricCount; ++m) {
+        for (size_t i = first; i < store.size(); ++i) {
+            const float value = store.valueAt(static_cast<TelemetryStore::Metric>(m), i);
+            data.append(reinterpret_cast<const char *>(&value), sizeof(value));
+        }
+    }
+    for (size_t i = first; i < store.size(); ++i) {
+        data.append(store.obstructedAt(i) ? '\1' : '\0');
+    }
+
+    QSaveFile file(path_);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        return fail(error, file.errorString());
+    }
+    return true;
+}
+
+bool StateCache::load(DishSnapshot *snapshot, TelemetryStore *store, QString *error) const
+{
+    QFile file(path_);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return fail(error, file.errorString());
+    }
+    const QByteArray data = file.readAll();
+
+    CacheHeader header;
+    if (static_cast<size_t>(data.size()) < sizeof(header)) {
+        return fail(error, QString("truncated"));
+    }
+    std::memcpy(&header, data.constData(), sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion) {
+        return fail(error, QString("not a state cache, or from another version"));
+    }
+    const size_t expected = sizeof(header) + header.deviceIdBytes + header.hardwareVersionBytes
+                          + static_cast<size_t>(header.sampleCount) * kSampleBytes;
+    if (static_cast<size_t>(data.size()) != expected || header.sampleCount > kRecentSamples) {
+        return fail(error, QString("truncated"));
+    }
+
+    const char *p = data.constData() + sizeof(header);
+    DishSnapshot restored;
+    restored.timestampMs = header.timestampMs;
+    restored.deviceId = QString::fromUtf8(p, header.deviceIdBytes);
+    p += header.deviceIdBytes;
+    restored.hardwareVersion = QString::fromUtf8(p, header.hardwareVersionBytes);
+    p += header.hardwareVersionBytes;
+    restored.hasStatus = header.flags & HasStatus;
+    restored.dishState = header.dishState;
+    restored.alerts = header.alerts;
+    restored.currentlyObstructed = header.flags & CurrentlyObstructed;
+    restored.fractionObstructed = header.fractionObstructed;
+    restored.snr = header.snr;
+    restored.hasLocation = header.flags & HasLocation;
+    restored.lat = header.lat;
+    restored.lon = header.lon;
+    restored.alt = header.alt;
+    restored.hasSpeed = header.flags & HasSpeed;
+    restored.downloadMbps = header.downloadMbps;
+    restored.uploadMbps = header.uploadMbps;
+    restored.latencyMs = header.latencyMs;
+
+    // Columns are unaligned after the strings, so values are copied out
+    const size_t count = header.sampleCount;
+    const char *timestamps = p;
+    const char *columns = timestamps + count * sizeof(int64_t);
+    const char *obstructed = columns + TelemetryStore::MetricCount * count * sizeof(float);
+    for (size_t i = 0; i < count; ++i) {
+        int64_t timestampMs = 0;
+        float values[TelemetryStore::MetricCount];
+        std::memcpy(&timestampMs, timestamps + i * sizeof(int64_t), sizeof(timestampMs));
+        for (int m = 0; m < TelemetryStore::MetricCount; ++m) {
+            std::memcpy(&values[m], columns + (m * count + i) * sizeof(float), sizeof(float));
+        }
+
+        HistorySample sample;
+        sample.downlinkBps = values[TelemetryStore::Downlink];
+        sample.uplinkBps = values[TelemetryStore::Uplink];
+        sample.latencyMs = values[TelemetryStore::Latency];
+        sample.dropRate = values[TelemetryStore::DropRate];
+        sample.snr = values[TelemetryStore::Snr];
+        sample.obstructed = obstructed[i] != 0;
+        store->append(timestampMs, sample);
+    }
+
+    *snapshot = restored;
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef STATECACHE_H
+#define STATECACHE_H
+
+#include <QString>
+#include <cstddef>
+#include "dishsnapshot.h"
+#include "telemetrystore.h"
+
+// The last thing a client knew about its dish, in one small file next to
+// its SegmentLog, so the next launch has something to show before the dish
+// has answered anything and before the log has been read back.
+//
+// The file is a fixed header with the snapshot's fields, its two strings,
+// then the newest samples of the telemetry store as columns like a
+// segment's. It is always replaced whole through QSaveFile, and anything
+// that doesn't check out on load is ignored rather than half used.
+class StateCache
+{
+public:
+    // About 26 KB, and enough to fill the sparklines' default window
+    static constexpr size_t kRecentSamples = 15 * 60;
+
+    explicit StateCache(const QString &path) : path_(path) {}
+
+    QString path() const { return path_; }
+
+    bool save(const DishSnapshot &snapshot, const TelemetryStore &store, QString *error = nullptr) const;
+
+    // Restores the snapshot, which always comes back disconnected, and
+    // appends the cached samples to store. Both are left alone on failure.
+    bool load(DishSnapshot *snapshot, TelemetryStore *store, QString *error = nullptr) const;
+
+private:
+    QString path_;
+};
+
+#endif // STATECACHE_H
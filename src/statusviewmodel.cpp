@@ -0,0 +1,138 @@
+#include "statusviewmodel.h"
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+// One frame at 60 Hz
+constexpr int kFrameMs = 16;
+
+}
+
+StatusViewModel::StatusViewModel(QObject *parent)
+    : QObject(parent)
+{
+    frameTimer_ = new QTimer(this);
+    frameTimer_->setSingleShot(true);
+    frameTimer_->setInterval(kFrameMs);
+    connect(frameTimer_, &QTimer::timeout, this, &StatusViewModel::flush);
+
+    std::snprintf(scratch_, sizeof(scratch_), "Status: Connecting...");
+    commit(&lines_[Status]);
+    std::snprintf(scratch_, sizeof(scratch_), "Speed: --");
+    commit(&lines_[Speed]);
+    std::snprintf(scratch_, sizeof(scratch_), "Location: --");
+    commit(&lines_[Location]);
+    std::snprintf(scratch_, sizeof(scratch_), "Satellite: --");
+    commit(&lines_[Satellite]);
+}
+
+bool StatusViewModel::commit(Text *text)
+{
+    if (std::strcmp(text->text, scratch_) == 0) {
+        return false;
+    }
+    std::memcpy(text->text, scratch_, sizeof(text->text));
+    text->dirty = true;
+    scheduleFlush();
+    return true;
+}
+
+void StatusViewModel::setVisible(bool visible)
+{
+    visible_ = visible;
+    if (visible_) {
+        // Whatever piled up while hidden goes out with the next frame
+        scheduleFlush();
+    }
+}
+
+void StatusViewModel::setConnected(bool connected, const QString &error)
+{
+    if (connected && !error.isEmpty()) {
+        std::snprintf(scratch_, sizeof(scratch_), "Status: Error: %s", error.toUtf8().constData());
+        commit(&lines_[Status]);
+        std::snprintf(scratch_, sizeof(scratch_), "Starlink: Error");
+        commit(&toolTip_);
+        setConnectedState(true);
+        return;
+    }
+    std::snprintf(scratch_, sizeof(scratch_), "Status: %s", connected ? "Connected" : "Disconnected");
+    commit(&lines_[Status]);
+    std::snprintf(scratch_, sizeof(scratch_), "Starlink: %s", connected ? "Connected" : "Disconnected");
+    commit(&toolTip_);
+    setConnectedState(connected);
+}
+
+void StatusViewModel::setFleetSummary(int connected, int total)
+{
+    std::snprintf(scratch_, sizeof(scratch_), "Dishes: %d/%d connected", connected, total);
+    commit(&lines_[Status]);
+    std::snprintf(scratch_, sizeof(scratch_), "Starlink: %d/%d connected", connected, total);
+    commit(&toolTip_);
+    setConnectedState(total > 0 && connected == total);
+}
+
+void StatusViewModel::setConnectedState(bool connected)
+{
+    const int state = connected ? 1 : 0;
+    if (state != connected_) {
+        connected_ = state;
+        connectedDirty_ = true;
+        scheduleFlush();
+    }
+}
+
+void StatusViewModel::setSpeed(float downloadMbps, float uploadMbps, float latencyMs)
+{
+    std::snprintf(scratch_, sizeof(scratch_), "Down: %.1f Mbps | Up: %.1f Mbps | Ping: %.0f ms",
+                  downloadMbps, uploadMbps, latencyMs);
+    commit(&lines_[Speed]);
+}
+
+void StatusViewModel::setLocation(double lat, double lon, double alt)
+{
+    std::snprintf(scratch_, sizeof(scratch_), "Lat: %.4f | Lon: %.4f | Alt: %.1f m", lat, lon, alt);
+    commit(&lines_[Location]);
+}
+
+void StatusViewModel::setSatelliteInfo(const QString &id, const QString &hardwareVersion)
+{
+    std::snprintf(scratch_, sizeof(scratch_), "ID: %s | HW: %s",
+                  id.toUtf8().constData(), hardwareVersion.toUtf8().constData());
+    commit(&lines_[Satellite]);
+}
+
+void StatusViewModel::scheduleFlush()
+{
+    const bool trayDirty = connectedDirty_ || toolTip_.dirty;
+    if ((visible_ || trayDirty) && !frameTimer_->isActive()) {
+        frameTimer_->start();
+    }
+}
+
+void StatusViewModel::flush()
+{
+    if (connectedDirty_) {
+        connectedDirty_ = false;
+        emit connectionChanged(isConnected());
+    }
+    if (toolTip_.dirty) {
+        toolTip_.dirty = false;
+        emit toolTipChanged(toolTip());
+    }
+
+    if (!visible_) {
+        return;
+    }
+    LineMask changed = 0;
+    for (int i = 0; i < LineCount; ++i) {
+        if (lines_[i].dirty) {
+            lines_[i].dirty = false;
+            changed |= bit(static_cast<Line>(i));
+        }
+    }
+    if (changed) {
+        emit linesChanged(changed);
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef STATUSVIEWMODEL_H
+#define STATUSVIEWMODEL_H
+
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+// What MainWindow's labels and tray icon show, decoupled from how often the
+// clients report it.
+//
+// Setters format into fixed buffers and compare against what is already on
+// screen, so a poll that changes nothing visible costs no allocation and no
+// repaint. Changed lines are flushed together at most once per frame, and
+// not at all while the window is hidden; the tray is the exception, since
+// it stays on screen, but it is only touched when the connection state
+// flips or its tooltip text changes.
+class StatusViewModel : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Line {
+        Status,
+        Speed,
+        Location,
+        Satellite,
+        LineCount
+    };
+
+    using LineMask = unsigned;
+    static constexpr LineMask bit(Line line) { return 1u << line; }
+
+    explicit StatusViewModel(QObject *parent = nullptr);
+
+    void setVisible(bool visible);
+    bool isVisible() const { return visible_; }
+
+    QString text(Line line) const { return QString::fromUtf8(lines_[line].text); }
+    bool isConnected() const { return connected_ == 1; }
+    QString toolTip() const { return QString::fromUtf8(toolTip_.text); }
+
+public slots:
+    // error, if set, is shown in place of Connected
+    void setConnected(bool connected, const QString &error = QString());
+    void setSpeed(float downloadMbps, float uploadMbps, float latencyMs);
+    void setLocation(double lat, double lon, double alt);
+    void setSatelliteInfo(const QString &id, const QString &hardwareVersion);
+    // Fleet mode: connected means every dish is
+    void setFleetSummary(int connected, int total);
+
+signals:
+    // Lines whose text changed since the last flush
+    void linesChanged(StatusViewModel::LineMask lines);
+    // Connected flipped; the tray icon should follow
+    void connectionChanged(bool connected);
+    void toolTipChanged(const QString &toolTip);
+
+private:
+    struct Text {
+        char text[160] = {};
+        bool dirty = false;
+    };
+
+    // Copies scratch_ into text if it differs; returns whether it did
+    bool commit(Text *text);
+    void setConnectedState(bool connected);
+    void scheduleFlush();
+    void flush();
+
+    Text lines_[LineCount];
+    Text toolTip_;
+    char scratch_[sizeof(Text::text)] = {};
+    int connected_ = -1;  // unknown until the first report
+    bool connectedDirty_ = false;
+    bool visible_ = false;
+    QTimer *frameTimer_;
+};
+
+#endif // STATUSVIEWMODEL_H
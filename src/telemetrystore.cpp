@@ -0,0 +1,345 @@
+#include "telemetrystore.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+constexpr int kSubBins = 16;
+constexpr int kMinExponent = -20;  // ~1e-6
+constexpr int kMaxExponent = 40;   // ~1e12
+constexpr int kBinCount = 1 + (kMaxExponent - kMinExponent) * kSubBins;
+
+constexpr size_t kWindowLengths[TelemetryStore::WindowCount] = { 60, 15 * 60, 3600 };
+
+}
+
+TelemetryStore::Histogram::Histogram()
+    : counts_(kBinCount, 0)
+{
+}
+
+int TelemetryStore::Histogram::bin(float value)
+{
+    if (!(value > 0.0f)) {
+        return 0;
+    }
+
+    int exponent = 0;
+    const float mantissa = std::frexp(value, &exponent);  // [0.5, 1)
+    if (exponent < kMinExponent) {
+        return 0;
+    }
+    if (exponent >= kMaxExponent) {
+        return kBinCount - 1;
+    }
+
+    const int sub = std::min(kSubBins - 1, static_cast<int>((mantissa - 0.5f) * 2.0f * kSubBins));
+    return 1 + (exponent - kMinExponent) * kSubBins + sub;
+}
+
+float TelemetryStore::Histogram::binValue(int bin)
+{
+    if (bin == 0) {
+        return 0.0f;
+    }
+    const int exponent = (bin - 1) / kSubBins + kMinExponent;
+    const int sub = (bin - 1) % kSubBins;
+    return std::ldexp(0.5f + (sub + 0.5f) / (2.0f * kSubBins), exponent);
+}
+
+void TelemetryStore::Histogram::add(float value)
+{
+    ++counts_[bin(value)];
+}
+
+void TelemetryStore::Histogram::remove(float value)
+{
+    --counts_[bin(value)];
+}
+
+float TelemetryStore::Histogram::quantile(double q, uint32_t count) const
+{
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * count)));
+    uint64_t seen = 0;
+    for (int i = 0; i < kBinCount; ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            return binValue(i);
+        }
+    }
+    return binValue(kBinCount - 1);
+}
+
+void TelemetryStore::MonotonicQueue::reset(size_t length)
+{
+    entries_.assign(length, 0);
+    head_ = 0;
+    size_ = 0;
+}
+
+void TelemetryStore::MonotonicQueue::popFront()
+{
+    head_ = (head_ + 1) % entries_.size();
+    --size_;
+}
+
+void TelemetryStore::MonotonicQueue::popBack()
+{
+    --size_;
+}
+
+void TelemetryStore::MonotonicQueue::pushBack(uint64_t sequence)
+{
+    entries_[(head_ + size_) % entries_.size()] = sequence;
+    ++size_;
+}
+
+TelemetryStore::TelemetryStore(size_t capacity)
+    : capacity_(std::max(capacity, kWindowLengths[OneHour]))
+{
+    timestamps_.assign(capacity_, 0);
+    for (auto &column : columns_) {
+        column.assign(capacity_, 0.0f);
+    }
+    obstructed_.assign((capacity_ + 63) / 64, 0);
+    speedTests_.resize(kSpeedTestCapacity);
+    clear();
+}
+
+size_t TelemetryStore::windowLength(Window window)
+{
+    return kWindowLengths[window];
+}
+
+void TelemetryStore::clear()
+{
+    size_ = 0;
+    sequence_ = 0;
+    speedTestSequence_ = 0;
+    std::fill(obstructed_.begin(), obstructed_.end(), 0);
+    obstructedCounts_.fill(0);
+
+    for (int w = 0; w < WindowCount; ++w) {
+        for (WindowState &state : windows_[w]) {
+            state.sum = 0.0;
+            state.count = 0;
+            state.minQueue.reset(kWindowLengths[w]);
+            state.maxQueue.reset(kWindowLengths[w]);
+            state.histogram = Histogram();
+        }
+        aggregates_[w].fill(Aggregate());
+    }
+    dirty_ = false;
+}
+
+void TelemetryStore::append(int64_t timestampMs, const HistorySample &sample)
+{
+    const uint64_t sequence = sequence_;
+
+    // Retire the samples that fall out of each window before the ring slot
+    // they occupy can be overwritten
+    for (int w = 0; w < WindowCount; ++w) {
+        if (sequence >= kWindowLengths[w]) {
+            leaveWindow(static_cast<Window>(w), sequence - kWindowLengths[w]);
+        }
+    }
+
+    const size_t at = static_cast<size_t>(sequence % capacity_);
+    timestamps_[at] = timestampMs;
+    columns_[Downlink][at] = sample.downlinkBps;
+    columns_[Uplink][at] = sample.uplinkBps;
+    columns_[Latency][at] = sample.latencyMs;
+    columns_[DropRate][at] = sample.dropRate;
+    columns_[Snr][at] = sample.snr;
+
+    const uint64_t bit = uint64_t(1) << (at % 64);
+    if (sample.obstructed) {
+        obstructed_[at / 64] |= bit;
+    } else {
+        obstructed_[at / 64] &= ~bit;
+    }
+
+    ++sequence_;
+    size_ = std::min(size_ + 1, capacity_);
+
+    for (int w = 0; w < WindowCount; ++w) {
+        enterWindow(static_cast<Window>(w), sequence);
+    }
+    dirty_ = true;
+}
+
+bool TelemetryStore::obstructedAt(size_t i) const
+{
+    const size_t at = slot(i);
+    return (obstructed_[at / 64] >> (at % 64)) & 1;
+}
+
+float TelemetryStore::valueAtSequence(Metric metric, uint64_t sequence) const
+{
+    return columns_[metric][static_cast<size_t>(sequence % capacity_)];
+}
+
+bool TelemetryStore::obstructedAtSequence(uint64_t sequence) const
+{
+    const size_t at = static_cast<size_t>(sequence % capacity_);
+    return (obstructed_[at / 64] >> (at % 64)) & 1;
+}
+
+void TelemetryStore::enterWindow(Window window, uint64_t sequence)
+{
+    if (obstructedAtSequence(sequence)) {
+        ++obstructedCounts_[window];
+    }
+
+    for (int m = 0; m < MetricCount; ++m) {
+        const Metric metric = static_cast<Metric>(m);
+        const float value = valueAtSequence(metric, sequence);
+
+        // Missing samples (e.g. latency while the ping dropped) are NaN
+        if (std::isnan(value)) {
+            continue;
+        }
+
+        WindowState &state = windows_[window][m];
+        state.sum += value;
+        ++state.count;
+        state.histogram.add(value);
+
+        while (!state.minQueue.isEmpty() && valueAtSequence(metric, state.minQueue.back()) >= value) {
+            state.minQueue.popBack();
+        }
+        state.minQueue.pushBack(sequence);
+
+        while (!state.maxQueue.isEmpty() && valueAtSequence(metric, state.maxQueue.back()) <= value) {
+            state.maxQueue.popBack();
+        }
+        state.maxQueue.pushBack(sequence);
+    }
+}
+
+void TelemetryStore::leaveWindow(Window window, uint64_t sequence)
+{
+    if (obstructedAtSequence(sequence)) {
+        --obstructedCounts_[window];
+    }
+
+    for (int m = 0; m < MetricCount; ++m) {
+        const Metric metric = static_cast<Metric>(m);
+        const float value = valueAtSequence(metric, sequence);
+        if (std::isnan(value)) {
+            continue;
+        }
+
+        WindowState &state = windows_[window][m];
+        state.sum -= value;
+        --state.count;
+        state.histogram.remove(value);
+
+        if (!state.minQueue.isEmpty() && state.minQueue.front() == sequence) {
+            state.minQueue.popFront();
+        }
+        if (!state.maxQueue.isEmpty() && state.maxQueue.front() == sequence) {
+            state.maxQueue.popFront();
+        }
+    }
+}
+
+void TelemetryStore::refresh() const
+{
+    for (int w = 0; w < WindowCount; ++w) {
+        for (int m = 0; m < MetricCount; ++m) {
+            const Metric metric = static_cast<Metric>(m);
+            const WindowState &state = windows_[w][m];
+            Aggregate &aggregate = aggregates_[w][m];
+
+            aggregate = Aggregate();
+            if (state.count == 0) {
+                continue;
+            }
+
+            aggregate.count = state.count;
+            aggregate.min = valueAtSequence(metric, state.minQueue.front());
+            aggregate.max = valueAtSequence(metric, state.maxQueue.front());
+            aggregate.mean = static_cast<float>(state.sum / state.count);
+
+            // Bin midpoints can stray just outside the observed range
+            aggregate.p50 = std::clamp(state.histogram.quantile(0.50, state.count), aggregate.min, aggregate.max);
+            aggregate.p95 = std::clamp(state.histogram.quantile(0.95, state.count), aggregate.min, aggregate.max);
+            aggregate.p99 = std::clamp(state.histogram.quantile(0.99, state.count), aggregate.min, aggregate.max);
+        }
+    }
+    dirty_ = false;
+}
+
+Kernels::Summary TelemetryStore::summarize(Metric metric, size_t first, size_t count) const
+{
+    if (first >= size_) {
+        return Kernels::Summary();
+    }
+    count = std::min(count, size_ - first);
+
+    // The range covers at most two contiguous stretches of the ring
+    const float *column = columns_[metric].data();
+    const size_t start = slot(first);
+    const size_t head = std::min(count, capacity_ - start);
+
+    Kernels::Summary summary = Kernels::summarize(column + start, head);
+    if (head < count) {
+        summary.merge(Kernels::summarize(column, count - head));
+    }
+    return summary;
+}
+
+size_t TelemetryStore::lowerBound(int64_t timestampMs) const
+{
+    // Timestamps only ever move forward
+    size_t first = 0;
+    size_t count = size_;
+    while (count > 0) {
+        const size_t half = count / 2;
+        if (timestampAt(first + half) < timestampMs) {
+            first += half + 1;
+            count -= half + 1;
+        } else {
+            count = half;
+        }
+    }
+    return first;
+}
+
+Kernels::Summary TelemetryStore::summarizeBetween(Metric metric, int64_t fromMs, int64_t toMs) const
+{
+    if (toMs < fromMs || toMs == std::numeric_limits<int64_t>::max()) {
+        return Kernels::Summary();
+    }
+    const size_t first = lowerBound(fromMs);
+    const size_t end = lowerBound(toMs + 1);
+    return summarize(metric, first, end - first);
+}
+
+void TelemetryStore::appendSpeedTest(const SpeedTestResult &result)
+{
+    speedTests_[speedTestSequence_ % kSpeedTestCapacity] = result;
+    ++speedTestSequence_;
+}
+
+const SpeedTestResult &TelemetryStore::speedTestAt(size_t i) const
+{
+    const uint64_t first = speedTestSequence_ - speedTestCount();
+    return speedTests_[(first + i) % kSpeedTestCapacity];
+}
+
+const TelemetryStore::Aggregate &TelemetryStore::aggregate(Metric metric, Window window) const
+{
+    if (dirty_) {
+        refresh();
+    }
+    return aggregates_[window][metric];
+}
+
+float TelemetryStore::obstructedFraction(Window window) const
+{
+    const size_t samples = std::min<uint64_t>(sequence_, kWindowLengths[window]);
+    return samples ? static_cast<float>(obstructedCounts_[window]) / samples : 0.0f;
+}
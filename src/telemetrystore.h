@@ -0,0 +1,193 @@
+#ifndef TELEMETRYSTORE_H
+#define TELEMETRYSTORE_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "historydecoder.h"
+#include "kernels.h"
+
+// One run of the dish's own speed test. Times are the store's sample
+// timestamps, so the passive samples taken while it ran can be found.
+struct SpeedTestResult
+{
+    static constexpr int kConnectionCounts[4] = { 1, 4, 16, 64 };
+
+    int64_t startedMs = 0;
+    int64_t finishedMs = 0;
+    float downloadMbps = 0.0f;
+    float uploadMbps = 0.0f;
+    float latencyMs = 0.0f;
+    // Per kConnectionCounts TCP connections; 0 where the dish didn't say
+    std::array<float, 4> downloadMbpsByConnections {};
+    std::array<float, 4> uploadMbpsByConnections {};
+};
+
+// Hours of per-second dish history kept in memory.
+//
+// Samples live in preallocated struct-of-arrays ring buffers, one column per
+// metric plus a timestamp column and an obstruction bitset, so appending is
+// O(1) and never allocates. Alongside the raw rings the store maintains
+// rolling min/max/mean/percentiles over the last 1 min, 15 min and 1 h of
+// samples; the dish records exactly one sample per second, so those windows
+// are counted in samples. Reading an aggregate never rescans raw samples.
+//
+// The most recent speed test results are kept too, in a small ring of
+// their own, to hold against the passive samples.
+class TelemetryStore
+{
+public:
+    enum Metric {
+        Downlink,
+        Uplink,
+        Latency,
+        DropRate,
+        Snr,
+        MetricCount
+    };
+
+    enum Window {
+        OneMinute,
+        FifteenMinutes,
+        OneHour,
+        WindowCount
+    };
+
+    struct Aggregate {
+        uint32_t count = 0;
+        float min = 0.0f;
+        float max = 0.0f;
+        float mean = 0.0f;
+        float p50 = 0.0f;
+        float p95 = 0.0f;
+        float p99 = 0.0f;
+    };
+
+    static constexpr size_t kDefaultCapacity = 24 * 3600;
+    static constexpr size_t kSpeedTestCapacity = 256;
+
+    // capacity is clamped to at least the longest window
+    explicit TelemetryStore(size_t capacity = kDefaultCapacity);
+
+    void append(int64_t timestampMs, const HistorySample &sample);
+    // Forgets speed test results as well
+    void clear();
+
+    size_t capacity() const { return capacity_; }
+    size_t size() const { return size_; }
+    bool isEmpty() const { return size_ == 0; }
+
+    // Total number of samples ever appended; the newest one has sequence
+    // sequence() - 1 and the oldest retained one sequence() - size().
+    uint64_t sequence() const { return sequence_; }
+
+    // Raw access, i = 0 is the oldest retained sample and size() - 1 the newest
+    int64_t timestampAt(size_t i) const { return timestamps_[slot(i)]; }
+    float valueAt(Metric metric, size_t i) const { return columns_[metric][slot(i)]; }
+    bool obstructedAt(size_t i) const;
+
+    // Zero-copy access to a whole ring; logical sample i lives at
+    // (ringStart() + i) % capacity()
+    const float *column(Metric metric) const { return columns_[metric].data(); }
+    const int64_t *timestamps() const { return timestamps_.data(); }
+    size_t ringStart() const { return static_cast<size_t>((sequence_ - size_) % capacity_); }
+
+    // Ad-hoc reduction over logical samples [first, first + count), for
+    // ranges that do not line up with one of the rolling windows
+    Kernels::Summary summarize(Metric metric, size_t first, size_t count) const;
+
+    // Samples with timestamps in [fromMs, toMs]
+    Kernels::Summary summarizeBetween(Metric metric, int64_t fromMs, int64_t toMs) const;
+
+    // Steps down to a multiple of step, for negative times as well, so
+    // buckets cut at different times line up
+    static int64_t alignDown(int64_t timestampMs, int64_t step)
+    {
+        const int64_t remainder = timestampMs % step;
+        return remainder < 0 ? timestampMs - remainder - step : timestampMs - remainder;
+    }
+
+    const Aggregate &aggregate(Metric metric, Window window) const;
+    float obstructedFraction(Window window) const;
+
+    static size_t windowLength(Window window);
+
+    void appendSpeedTest(const SpeedTestResult &result);
+    // i = 0 is the oldest retained result
+    size_t speedTestCount() const { return std::min<uint64_t>(speedTestSequence_, kSpeedTestCapacity); }
+    const SpeedTestResult &speedTestAt(size_t i) const;
+
+private:
+    // Log-linear bins, 16 per octave (about 4% relative error), so one layout
+    // covers drop rates, latencies and throughput alike.
+    class Histogram
+    {
+    public:
+        Histogram();
+        void add(float value);
+        void remove(float value);
+        float quantile(double q, uint32_t count) const;
+
+    private:
+        static int bin(float value);
+        static float binValue(int bin);
+
+        std::vector<uint32_t> counts_;
+    };
+
+    // Sliding-window min or max over sequence numbers, with storage for
+    // exactly one window's worth of entries
+    class MonotonicQueue
+    {
+    public:
+        void reset(size_t length);
+        bool isEmpty() const { return size_ == 0; }
+        uint64_t front() const { return entries_[head_]; }
+        uint64_t back() const { return entries_[(head_ + size_ - 1) % entries_.size()]; }
+        void popFront();
+        void popBack();
+        void pushBack(uint64_t sequence);
+
+    private:
+        std::vector<uint64_t> entries_;
+        size_t head_ = 0;
+        size_t size_ = 0;
+    };
+
+    struct WindowState {
+        double sum = 0.0;
+        uint32_t count = 0;
+        MonotonicQueue minQueue;
+        MonotonicQueue maxQueue;
+        Histogram histogram;
+    };
+
+    size_t slot(size_t i) const { return (ringStart() + i) % capacity_; }
+    size_t lowerBound(int64_t timestampMs) const;
+    float valueAtSequence(Metric metric, uint64_t sequence) const;
+    bool obstructedAtSequence(uint64_t sequence) const;
+    void enterWindow(Window window, uint64_t sequence);
+    void leaveWindow(Window window, uint64_t sequence);
+    void refresh() const;
+
+    size_t capacity_;
+    size_t size_ = 0;
+    uint64_t sequence_ = 0;
+
+    std::vector<int64_t> timestamps_;
+    std::array<std::vector<float>, MetricCount> columns_;
+    std::vector<uint64_t> obstructed_;
+
+    std::array<std::array<WindowState, MetricCount>, WindowCount> windows_;
+    std::array<uint32_t, WindowCount> obstructedCounts_ {};
+
+    mutable std::array<std::array<Aggregate, MetricCount>, WindowCount> aggregates_;
+    mutable bool dirty_ = false;
+
+    std::vector<SpeedTestResult> speedTests_;
+    uint64_t speedTestSequence_ = 0;
+};
+
+#endif // TELEMETRYSTORE_H
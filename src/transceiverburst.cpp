@@ -0,0 +1,377 @@
+#include "transceiverburst.h"
+#include <QDateTime>
+#include <QDir>
+#include <QSaveFile>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include "instrumentation.h"
+
+namespace {
+
+// A telemetry reply later than a few periods is no use to a burst anyway
+constexpr int kTelemetryDeadlineMs = 1000;
+constexpr int kStatusDeadlineMs = 2000;
+constexpr int64_t kStatusIntervalNs = 1000 * 1000 * 1000;
+
+// Four points a second is plenty for a live view
+constexpr int64_t kPreviewIntervalMs = 250;
+
+constexpr float kNaN = std::numeric_limits<float>::quiet_NaN();
+
+}
+
+TransceiverBurst::TransceiverBurst(StarlinkClient *client, QObject *parent)
+    : QObject(parent), client_(client), pool_(client->pool()), target_(client->target())
+{
+    cq_ = pool_->nextQueue();
+
+    telemetryRequest_.mutable_transceiver_get_telemetry();
+    statusRequest_.mutable_transceiver_get_status();
+    telemetryCall_.burst = this;
+    telemetryCall_.kind = Kind::Telemetry;
+    statusCall_.burst = this;
+    statusCall_.kind = Kind::Status;
+
+    tickTimer_ = new QTimer(this);
+    tickTimer_->setTimerType(Qt::PreciseTimer);
+    connect(tickTimer_, &QTimer::timeout, this, &TransceiverBurst::tick);
+}
+
+TransceiverBurst::~TransceiverBurst()
+{
+    tickTimer_->stop();
+    BurstCall *const calls[] = { &telemetryCall_, &statusCall_ };
+    for (BurstCall *call : calls) {
+        if (call->inFlight) {
+            call->context->TryCancel();
+        }
+    }
+    operations_.drain(this);
+}
+
+bool TransceiverBurst::start(const Options &options)
+{
+    if (running_) {
+        return false;
+    }
+    if (!stub_) {
+        stub_ = SpaceX::API::Device::Device::NewStub(pool_->channel(target_.toStdString()));
+    }
+
+    const int rateHz = std::clamp(options.rateHz, 1, kMaxRateHz);
+    const int durationMs = std::clamp(options.durationMs, 1000, kMaxDurationMs);
+    periodMs_ = 1000 / rateHz;
+
+    // The only allocation of the burst, and none at all once a burst this
+    // long has run before
+    capacity_ = static_cast<size_t>(durationMs / periodMs_) + 1;
+    if (offsetsUs_.size() < capacity_) {
+        offsetsUs_.resize(capacity_);
+        for (auto &column : columns_) {
+            column.resize(capacity_);
+        }
+        for (auto &counter : counters_) {
+            counter.resize(capacity_);
+        }
+    }
+    size_ = 0;
+    missed_ = 0;
+    failed_ = 0;
+    modemAsicTemp_ = kNaN;
+    txIfTemp_ = kNaN;
+
+    startMs_ = QDateTime::currentMSecsSinceEpoch();
+    startNs_ = Instrumentation::nowNs();
+    endNs_ = startNs_ + static_cast<int64_t>(durationMs) * 1000 * 1000;
+    statusDueNs_ = startNs_;
+    previewFrom_ = 0;
+    previewMs_ = startMs_;
+
+    running_ = true;
+    stopping_ = false;
+    tickTimer_->start(periodMs_);
+    tick();
+    return true;
+}
+
+void TransceiverBurst::stop()
+{
+    if (!running_ || stopping_) {
+        return;
+    }
+    stopping_ = true;
+    tickTimer_->stop();
+    if (!telemetryCall_.inFlight && !statusCall_.inFlight) {
+        finish();
+    }
+}
+
+void TransceiverBurst::tick()
+{
+    const int64_t nowNs = Instrumentation::nowNs();
+    if (nowNs >= endNs_ || size_ >= capacity_) {
+        stop();
+        return;
+    }
+
+    if (telemetryCall_.inFlight) {
+        ++missed_;
+    } else {
+        issue(&telemetryCall_, telemetryRequest_, kTelemetryDeadlineMs);
+    }
+    if (!statusCall_.inFlight && nowNs >= statusDueNs_) {
+        statusDueNs_ = nowNs + kStatusIntervalNs;
+        issue(&statusCall_, statusRequest_, kStatusDeadlineMs);
+    }
+}
+
+void TransceiverBurst::issue(BurstCall *call, const SpaceX::API::Device::Request &request, int deadlineMs)
+{
+    // The reader lives in the old context's call, so it goes first
+    call->reader.reset();
+    call->context.emplace();
+    call->context->set_deadline(TransportPool::deadlineAfter(deadlineMs));
+    call->response.Clear();
+    call->inFlight = true;
+    call->sentNs = Instrumentation::nowNs();
+
+    operations_.started();
+    call->reader = stub_->PrepareAsyncHandle(&*call->context, request, cq_);
+    call->reader->StartCall();
+    call->reader->Finish(&call->response, &call->status, call);
+}
+
+void TransceiverBurst::BurstCall::complete(bool)
+{
+    completedNs = Instrumentation::nowNs();
+    TransceiverBurst *owner = burst;
+    BurstCall *call = this;
+    QMetaObject::invokeMethod(owner, [owner, call]() {
+        owner->handleResponse(call);
+    }, Qt::QueuedConnection);
+    owner->operations_.finished();
+}
+
+void TransceiverBurst::handleResponse(BurstCall *call)
+{
+    call->inFlight = false;
+    if (!call->status.ok()) {
+        ++failed_;
+    } else if (call->kind == Kind::Status) {
+        if (call->response.has_transceiver_get_status()) {
+            const auto &status = call->response.transceiver_get_status();
+            modemAsicTemp_ = status.has_modem_asic_temp() ? status.modem_asic_temp() : kNaN;
+            txIfTemp_ = status.has_tx_if_temp() ? status.tx_if_temp() : kNaN;
+        }
+    } else if (call->response.has_transceiver_get_telemetry() && size_ < capacity_) {
+        record(*call);
+        const int64_t nowMs = timestampMs(size_ - 1);
+        if (nowMs - previewMs_ >= kPreviewIntervalMs) {
+            emitPreview(nowMs);
+        }
+    }
+
+    if (stopping_ && !telemetryCall_.inFlight && !statusCall_.inFlight) {
+        finish();
+    }
+}
+
+void TransceiverBurst::record(const BurstCall &call)
+{
+    const auto &telemetry = call.response.transceiver_get_telemetry();
+    const size_t i = size_++;
+
+    // Halfway through the round trip is the best guess at when the dish
+    // took the reading
+    offsetsUs_[i] = static_cast<uint32_t>(((call.sentNs + call.completedNs) / 2 - startNs_) / 1000);
+    columns_[RoundTripMs][i] = static_cast<float>(call.completedNs - call.sentNs) / 1e6f;
+    columns_[SnrDb][i] = telemetry.has_snr_db() ? telemetry.snr_db() : kNaN;
+    columns_[L1SnrAvgDb][i] = telemetry.has_l1_snr_avg_db() ? telemetry.l1_snr_avg_db() : kNaN;
+    columns_[L1SnrMinDb][i] = telemetry.has_l1_snr_min_db() ? telemetry.l1_snr_min_db() : kNaN;
+    columns_[L1SnrMaxDb][i] = telemetry.has_l1_snr_max_db() ? telemetry.l1_snr_max_db() : kNaN;
+    columns_[WbRssiPeakMagDb][i] = telemetry.has_wb_rssi_peak_mag_db() ? telemetry.wb_rssi_peak_mag_db() : kNaN;
+    columns_[CeRssiDb][i] = telemetry.has_ce_rssi_db() ? telemetry.ce_rssi_db() : kNaN;
+    columns_[PopPingDropRate][i] = telemetry.has_pop_ping_drop_rate() ? telemetry.pop_ping_drop_rate() : kNaN;
+    columns_[AntennaPitch][i] = telemetry.has_antenna_pitch() ? telemetry.antenna_pitch() : kNaN;
+    columns_[AntennaRoll][i] = telemetry.has_antenna_roll() ? telemetry.antenna_roll() : kNaN;
+    columns_[AntennaRxTheta][i] = telemetry.has_antenna_rx_theta() ? telemetry.antenna_rx_theta() : kNaN;
+    columns_[AntennaTrueHeading][i] = telemetry.has_antenna_true_heading() ? telemetry.antenna_true_heading() : kNaN;
+    columns_[SecondsUntilSlotEnd][i] = telemetry.has_seconds_until_slot_end() ? telemetry.seconds_until_slot_end() : kNaN;
+    columns_[GrantSymbolsAvg][i] = telemetry.has_grant_symbols_avg() ? telemetry.grant_symbols_avg() : kNaN;
+    columns_[ModemAsicTemp][i] = modemAsicTemp_;
+    columns_[TxIfTemp][i] = txIfTemp_;
+
+    counters_[RxChannel][i] = telemetry.rx_channel();
+    counters_[CurrentCellId][i] = telemetry.current_cell_id();
+    counters_[LmacSatelliteId][i] = telemetry.lmac_satellite_id();
+    counters_[TargetSatelliteId][i] = telemetry.target_satellite_id();
+    counters_[GrantMcs][i] = telemetry.grant_mcs();
+    counters_[NumOutOfSeq][i] = telemetry.num_out_of_seq();
+    counters_[NumUlmapDrop][i] = telemetry.num_ulmap_drop();
+    counters_[RfpTotalSynFailed][i] = telemetry.rfp_total_syn_failed();
+}
+
+void TransceiverBurst::emitPreview(int64_t nowMs)
+{
+    Preview preview;
+    preview.timestampMs = nowMs;
+    preview.samples = size_;
+    preview.capacity = capacity_;
+    preview.snrMinDb = kNaN;
+    preview.snrMaxDb = kNaN;
+
+    // NaN readings are left out of everything but the last-value fields
+    float snrSum = 0.0f;
+    int snrCount = 0;
+    for (size_t i = previewFrom_; i < size_; ++i) {
+        const float snr = columns_[SnrDb][i];
+        if (std::isnan(snr)) {
+            continue;
+        }
+        preview.snrMinDb = snrCount == 0 ? snr : std::min(preview.snrMinDb, snr);
+        preview.snrMaxDb = snrCount == 0 ? snr : std::max(preview.snrMaxDb, snr);
+        snrSum += snr;
+        ++snrCount;
+    }
+    preview.snrMeanDb = snrCount > 0 ? snrSum / snrCount : kNaN;
+    preview.rssiDb = columns_[WbRssiPeakMagDb][size_ - 1];
+    preview.dropRate = columns_[PopPingDropRate][size_ - 1];
+    preview.satelliteId = counters_[LmacSatelliteId][size_ - 1];
+
+    previewFrom_ = size_;
+    previewMs_ = nowMs;
+    emit previewUpdated(preview);
+}
+
+void TransceiverBurst::finish()
+{
+    running_ = false;
+    stopping_ = false;
+    if (size_ > previewFrom_) {
+        emitPreview(timestampMs(size_ - 1));
+    }
+
+    QString path;
+    QString error;
+    if (client_ && !client_->logDirectory().isEmpty() && size_ > 0) {
+        const QString name = QString("transceiver-%1.csv")
+                                 .arg(QDateTime::fromMSecsSinceEpoch(startMs_).toString("yyyyMMdd-HHmmss"));
+        path = QDir(client_->logDirectory()).filePath(name);
+        if (!writeCsv(path, &error)) {
+            qWarning("Transceiver burst of %s not written: %s", qPrintable(target_), qPrintable(error));
+            path.clear();
+        }
+    }
+    emit finished(static_cast<int>(size_), path, error);
+}
+
+bool TransceiverBurst::writeCsv(const QString &path, QString *error) const
+{
+    QByteArray data;
+    data.append("timestamp_ms");
+    for (int column = 0; column < ColumnCount; ++column) {
+        data.append(',');
+        data.append(columnName(static_cast<Column>(column)));
+    }
+    for (int counter = 0; counter < CounterCount; ++counter) {
+        data.append(',');
+        data.append(counterName(static_cast<Counter>(counter)));
+    }
+    data.append('\n');
+
+    // Under 300 bytes a row; reserved up front so the rows are appended in
+    // place
+    data.reserve(data.size() + static_cast<qsizetype>(size_) * 320);
+    char field[32];
+    for (size_t i = 0; i < size_; ++i) {
+        data.append(field, std::snprintf(field, sizeof(field), "%lld", static_cast<long long>(timestampMs(i))));
+        for (int column = 0; column < ColumnCount; ++column) {
+            const float value = columns_[column][i];
+            data.append(',');
+            if (!std::isnan(value)) {
+                data.append(field, std::snprintf(field, sizeof(field), "%.6g", value));
+            }
+        }
+        for (int counter = 0; counter < CounterCount; ++counter) {
+            data.append(field, std::snprintf(field, sizeof(field), ",%u", counters_[counter][i]));
+        }
+        data.append('\n');
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        if (error) {
+            *error = file.errorString();
+        }
+        return false;
+    }
+    return true;
+}
+
+const char *TransceiverBurst::columnName(Column column)
+{
+    switch (column) {
+    case RoundTripMs:
+        return "round_trip_ms";
+    case SnrDb:
+        return "snr_db";
+    case L1SnrAvgDb:
+        return "l1_snr_avg_db";
+    case L1SnrMinDb:
+        return "l1_snr_min_db";
+    case L1SnrMaxDb:
+        return "l1_snr_max_db";
+    case WbRssiPeakMagDb:
+        return "wb_rssi_peak_mag_db";
+    case CeRssiDb:
+        return "ce_rssi_db";
+    case PopPingDropRate:
+        return "pop_ping_drop_rate";
+    case AntennaPitch:
+        return "antenna_pitch";
+    case AntennaRoll:
+        return "antenna_roll";
+    case AntennaRxTheta:
+        return "antenna_rx_theta";
+    case AntennaTrueHeading:
+        return "antenna_true_heading";
+    case SecondsUntilSlotEnd:
+        return "seconds_until_slot_end";
+    case GrantSymbolsAvg:
+        return "grant_symbols_avg";
+    case ModemAsicTemp:
+        return "modem_asic_temp";
+    case TxIfTemp:
+        return "tx_if_temp";
+    case ColumnCount:
+        break;
+    }
+    return "";
+}
+
+const char *TransceiverBurst::counterName(Counter counter)
+{
+    switch (counter) {
+    case RxChannel:
+        return "rx_channel";
+    case CurrentCellId:
+        return "current_cell_id";
+    case LmacSatelliteId:
+        return "lmac_satellite_id";
+    case TargetSatelliteId:
+        return "target_satellite_id";
+    case GrantMcs:
+        return "grant_mcs";
+    case NumOutOfSeq:
+        return "num_out_of_seq";
+    case NumUlmapDrop:
+        return "num_ulmap_drop";
+    case RfpTotalSynFailed:
+        return "rfp_total_syn_failed";
+    case CounterCount:
+        break;
+    }
+    return "";
+}
@@ -0,0 +1,197 @@
+#ifndef TRANSCEIVERBURST_H
+#define TRANSCEIVERBURST_H
+
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QTimer>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+#include <grpcpp/grpcpp.h>
+#include "starlinkclient.h"
+#include "transportpool.h"
+#include "spacex/api/device/service.grpc.pb.h"
+
+// Samples one dish's transceiver telemetry at 10-20 Hz for a bounded
+// window, for RF troubleshooting.
+//
+// A burst runs beside the client's polling rather than through it: its own
+// calls over the same channel, paced by a precise timer of its own, so the
+// other requests keep their cadence and nothing waits behind a burst. One
+// telemetry request is out at a time; a tick that finds it still
+// unanswered is counted as missed instead of queueing another. Transceiver
+// status changes far more slowly and is asked for once a second, its
+// temperatures carried into every sample.
+//
+// The columns are sized for the whole window when a burst starts, and the
+// two calls' requests and responses are reused throughout. gRPC still
+// allocates a client context and a response reader for every call. The
+// finished burst is written as CSV into the client's log directory. While it runs,
+// previewUpdated() folds the samples into a few points a second for a live
+// view.
+class TransceiverBurst : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options {
+        int rateHz = 10;
+        int durationMs = 60 * 1000;
+    };
+
+    enum Column {
+        RoundTripMs,
+        SnrDb,
+        L1SnrAvgDb,
+        L1SnrMinDb,
+        L1SnrMaxDb,
+        WbRssiPeakMagDb,
+        CeRssiDb,
+        PopPingDropRate,
+        AntennaPitch,
+        AntennaRoll,
+        AntennaRxTheta,
+        AntennaTrueHeading,
+        SecondsUntilSlotEnd,
+        GrantSymbolsAvg,
+        // From the last status reply, NaN before the first
+        ModemAsicTemp,
+        TxIfTemp,
+        ColumnCount
+    };
+
+    enum Counter {
+        RxChannel,
+        CurrentCellId,
+        LmacSatelliteId,
+        TargetSatelliteId,
+        GrantMcs,
+        NumOutOfSeq,
+        NumUlmapDrop,
+        RfpTotalSynFailed,
+        CounterCount
+    };
+
+    // The samples since the previous preview, folded into one point
+    struct Preview {
+        int64_t timestampMs = 0;
+        size_t samples = 0;  // in the burst so far
+        size_t capacity = 0;
+        float snrMinDb = 0.0f;
+        float snrMaxDb = 0.0f;
+        float snrMeanDb = 0.0f;
+        float rssiDb = 0.0f;
+        float dropRate = 0.0f;
+        uint32_t satelliteId = 0;
+    };
+
+    static constexpr int kMaxRateHz = 20;
+    static constexpr int kMaxDurationMs = 10 * 60 * 1000;
+
+    // Talks to the client's dish over the client's pool; the client may go
+    // away first, the burst then has nowhere to write to
+    explicit TransceiverBurst(StarlinkClient *client, QObject *parent = nullptr);
+    ~TransceiverBurst();
+
+    // Rate and duration are clamped to the limits above. Returns false
+    // while a burst is running.
+    bool start(const Options &options);
+    // Ends the burst early; what was collected is written as usual
+    void stop();
+    bool isRunning() const { return running_; }
+
+    // The current or last burst
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    int64_t timestampMs(size_t i) const { return startMs_ + offsetsUs_[i] / 1000; }
+    float value(Column column, size_t i) const { return columns_[column][i]; }
+    uint32_t counter(Counter counter, size_t i) const { return counters_[counter][i]; }
+    // Ticks skipped because the previous request was still out, and
+    // requests that failed
+    int missed() const { return missed_; }
+    int failed() const { return failed_; }
+
+    // The transceiver.proto field names, used as the CSV header
+    static const char *columnName(Column column);
+    static const char *counterName(Counter counter);
+
+    bool writeCsv(const QString &path, QString *error = nullptr) const;
+
+signals:
+    void previewUpdated(const TransceiverBurst::Preview &preview);
+    // path is empty when nothing was written; error then says why, unless
+    // there was no log directory to write to
+    void finished(int samples, const QString &path, const QString &error);
+
+private:
+    enum class Kind {
+        Telemetry,
+        Status
+    };
+
+    // One per kind, reused for every request of that kind. The destructor
+    // waits for both to come back, so completions can refer to them.
+    struct BurstCall : CompletionTag {
+        void complete(bool ok) override;
+
+        TransceiverBurst *burst = nullptr;
+        Kind kind = Kind::Telemetry;
+        bool inFlight = false;
+        int64_t sentNs = 0;
+        int64_t completedNs = 0;
+        // A ClientContext can't be reused, only made anew in place
+        std::optional<grpc::ClientContext> context;
+        SpaceX::API::Device::Response response;
+        grpc::Status status;
+        std::unique_ptr<grpc::ClientAsyncResponseReader<SpaceX::API::Device::Response>> reader;
+    };
+
+    void tick();
+    void issue(BurstCall *call, const SpaceX::API::Device::Request &request, int deadlineMs);
+    void handleResponse(BurstCall *call);
+    void record(const BurstCall &call);
+    void emitPreview(int64_t nowMs);
+    void finish();
+
+    QPointer<StarlinkClient> client_;
+    std::shared_ptr<TransportPool> pool_;
+    QString target_;
+    grpc::CompletionQueue *cq_;
+    std::unique_ptr<SpaceX::API::Device::Device::Stub> stub_;
+
+    PendingOperations operations_;
+
+    SpaceX::API::Device::Request telemetryRequest_;
+    SpaceX::API::Device::Request statusRequest_;
+    BurstCall telemetryCall_;
+    BurstCall statusCall_;
+    QTimer *tickTimer_;
+
+    bool running_ = false;
+    bool stopping_ = false;
+    int periodMs_ = 100;
+    int64_t startMs_ = 0;
+    int64_t startNs_ = 0;
+    int64_t endNs_ = 0;
+    int64_t statusDueNs_ = 0;
+    float modemAsicTemp_ = 0.0f;
+    float txIfTemp_ = 0.0f;
+
+    // Sized on start() and only ever grown
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+    std::vector<uint32_t> offsetsUs_;
+    std::array<std::vector<float>, ColumnCount> columns_;
+    std::array<std::vector<uint32_t>, CounterCount> counters_;
+    int missed_ = 0;
+    int failed_ = 0;
+
+    size_t previewFrom_ = 0;
+    int64_t previewMs_ = 0;
+};
+
+#endif // TRANSCEIVERBURST_H
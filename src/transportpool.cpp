@@ -0,0 +1,85 @@
+#include "transportpool.h"
+#include <QCoreApplication>
+#include <grpcpp/create_channel.h>
+#include <algorithm>
+
+TransportPool::TransportPool(int threads)
+{
+    threads = std::max(1, threads);
+    for (int i = 0; i < threads; ++i) {
+        queues_.push_back(std::make_unique<grpc::CompletionQueue>());
+    }
+    for (auto &queue : queues_) {
+        threads_.emplace_back(&TransportPool::drain, queue.get());
+    }
+}
+
+TransportPool::~TransportPool()
+{
+    // Clients wait for their own operations before they go away, so by now
+    // the queues only need to be told to stop
+    for (auto &queue : queues_) {
+        queue->Shutdown();
+    }
+    for (std::thread &thread : threads_) {
+        thread.join();
+    }
+}
+
+grpc::CompletionQueue *TransportPool::nextQueue()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    grpc::CompletionQueue *queue = queues_[nextQueue_].get();
+    nextQueue_ = (nextQueue_ + 1) % queues_.size();
+    return queue;
+}
+
+std::shared_ptr<grpc::Channel> TransportPool::channel(const std::string &target)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::shared_ptr<grpc::Channel> &channel = channels_[target];
+    if (!channel) {
+        // gRPC's default reconnect backoff grows to two minutes, far longer
+        // than a dish takes to reboot
+        grpc::ChannelArguments args;
+        args.SetInt(GRPC_ARG_INITIAL_RECONNECT_BACKOFF_MS, 1000);
+        args.SetInt(GRPC_ARG_MIN_RECONNECT_BACKOFF_MS, 1000);
+        args.SetInt(GRPC_ARG_MAX_RECONNECT_BACKOFF_MS, 10 * 1000);
+        channel = grpc::CreateCustomChannel(target, grpc::InsecureChannelCredentials(), args);
+    }
+    return channel;
+}
+
+void TransportPool::drain(grpc::CompletionQueue *queue)
+{
+    void *tag = nullptr;
+    bool ok = false;
+
+    while (queue->Next(&tag, &ok)) {
+        static_cast<CompletionTag *>(tag)->complete(ok);
+    }
+}
+
+void PendingOperations::started()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++count_;
+}
+
+void PendingOperations::finished()
+{
+    // Notify under the lock so drain() cannot return in between
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--count_ == 0) {
+        done_.notify_all();
+    }
+}
+
+void PendingOperations::drain(QObject *owner)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this]() { return count_ == 0; });
+    }
+    QCoreApplication::removePostedEvents(owner);
+}
@@ -0,0 +1,88 @@
+#ifndef TRANSPORTPOOL_H
+#define TRANSPORTPOOL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <grpcpp/grpcpp.h>
+
+class QObject;
+
+// Anything handed to one of the pool's completion queues as a tag
+class CompletionTag
+{
+public:
+    virtual ~CompletionTag() = default;
+
+    // Runs on a pool worker thread once the operation finishes
+    virtual void complete(bool ok) = 0;
+};
+
+// The operations one owner has outstanding on a pool's queue. The queue is
+// shared, so an owner going away cancels what it has in flight and then
+// drains its own operations rather than shutting the queue down.
+class PendingOperations
+{
+public:
+    void started();
+    void finished();
+
+    // Waits until every started operation has finished, then discards any
+    // completion posted to owner that never got delivered
+    void drain(QObject *owner);
+
+private:
+    std::mutex mutex_;
+    std::condition_variable done_;
+    int count_ = 0;
+};
+
+// Completion queues, the worker threads that drain them and the gRPC
+// channels, shared by any number of StarlinkClients. A fleet of hundreds of
+// dishes runs on a handful of threads this way instead of one per dish.
+class TransportPool
+{
+public:
+    explicit TransportPool(int threads = 1);
+    ~TransportPool();
+
+    TransportPool(const TransportPool &) = delete;
+    TransportPool &operator=(const TransportPool &) = delete;
+
+    int threadCount() const { return static_cast<int>(queues_.size()); }
+
+    // Queues are handed out round-robin; a client sticks to the one it got
+    grpc::CompletionQueue *nextQueue();
+
+    // One channel per target, created on first use and reused afterwards
+    std::shared_ptr<grpc::Channel> channel(const std::string &target);
+
+    // For every call on the pool's channels
+    static std::chrono::system_clock::time_point deadlineAfter(int ms)
+    {
+        return std::chrono::system_clock::now() + std::chrono::milliseconds(ms);
+    }
+    // Nobody answered, as opposed to an answer that was an error
+    static bool isUnreachable(const grpc::Status &status)
+    {
+        return status.error_code() == grpc::StatusCode::UNAVAILABLE
+            || status.error_code() == grpc::StatusCode::DEADLINE_EXCEEDED;
+    }
+
+private:
+    static void drain(grpc::CompletionQueue *queue);
+
+    std::vector<std::unique_ptr<grpc::CompletionQueue>> queues_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    size_t nextQueue_ = 0;
+    std::unordered_map<std::string, std::shared_ptr<grpc::Channel>> channels_;
+};
+
+#endif // TRANSPORTPOOL_H
@@ -0,0 +1,185 @@
+#include "wificlienttable.h"
+#include <algorithm>
+#include <limits>
+#include "spacex/api/device/wifi.pb.h"
+
+namespace {
+
+constexpr float kNaN = std::numeric_limits<float>::quiet_NaN();
+
+int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+WifiClientTable::Interface interfaceOf(SpaceX::API::Device::WifiClient::Interface iface)
+{
+    switch (iface) {
+    case SpaceX::API::Device::WifiClient::ETH:
+        return WifiClientTable::Ethernet;
+    case SpaceX::API::Device::WifiClient::RF_2GHZ:
+        return WifiClientTable::Wifi2Ghz;
+    case SpaceX::API::Device::WifiClient::RF_5GHZ:
+        return WifiClientTable::Wifi5Ghz;
+    default:
+        return WifiClientTable::Unknown;
+    }
+}
+
+// Bits per second between two readings of a byte counter; a counter that
+// went backwards was reset, and says nothing about this interval
+float rate(uint64_t before, uint64_t after, int64_t elapsedMs)
+{
+    if (elapsedMs <= 0 || after < before) {
+        return kNaN;
+    }
+    return static_cast<float>(static_cast<double>(after - before) * 8000.0 / static_cast<double>(elapsedMs));
+}
+
+}
+
+uint64_t WifiClientTable::parseMac(const std::string &mac)
+{
+    if (mac.size() != 17) {
+        return 0;
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < mac.size(); i += 3) {
+        const int high = hexDigit(mac[i]);
+        const int low = hexDigit(mac[i + 1]);
+        if (high < 0 || low < 0 || (i + 2 < mac.size() && mac[i + 2] != ':' && mac[i + 2] != '-')) {
+            return 0;
+        }
+        value = (value << 8) | static_cast<uint64_t>(high << 4 | low);
+    }
+    return value;
+}
+
+void WifiClientTable::clear()
+{
+    index_.clear();
+    macs_.clear();
+    names_.clear();
+    ipAddresses_.clear();
+    connected_.clear();
+    interfaces_.clear();
+    lastSeenMs_.clear();
+    signalStrengths_.clear();
+    snrs_.clear();
+    rxBytes_.clear();
+    txBytes_.clear();
+    rxBps_.clear();
+    txBps_.clear();
+    rxErrors_.clear();
+    connectedCount_ = 0;
+    lastUpdateMs_ = 0;
+}
+
+WifiClientTable::Id WifiClientTable::find(uint64_t mac) const
+{
+    const auto it = std::lower_bound(index_.begin(), index_.end(), std::make_pair(mac, Id(0)));
+    return it != index_.end() && it->first == mac ? it->second : kNoClient;
+}
+
+WifiClientTable::Id WifiClientTable::add(uint64_t mac)
+{
+    Id id = kNoClient;
+    if (macs_.size() < kMaxClients) {
+        id = static_cast<Id>(macs_.size());
+        macs_.push_back(mac);
+        names_.emplace_back();
+        ipAddresses_.emplace_back();
+        connected_.push_back(0);
+        interfaces_.push_back(Unknown);
+        lastSeenMs_.push_back(0);
+        signalStrengths_.push_back(kNaN);
+        snrs_.push_back(kNaN);
+        rxBytes_.push_back(0);
+        txBytes_.push_back(0);
+        rxBps_.push_back(kNaN);
+        txBps_.push_back(kNaN);
+        rxErrors_.push_back(0);
+    } else {
+        // The row offline the longest; none if every device is connected
+        for (Id candidate = 0; candidate < macs_.size(); ++candidate) {
+            if (!connected_[candidate] && (id == kNoClient || lastSeenMs_[candidate] < lastSeenMs_[id])) {
+                id = candidate;
+            }
+        }
+        if (id == kNoClient) {
+            return kNoClient;
+        }
+        index_.erase(std::lower_bound(index_.begin(), index_.end(), std::make_pair(macs_[id], id)));
+        macs_[id] = mac;
+        names_[id].clear();
+        ipAddresses_[id].clear();
+        interfaces_[id] = Unknown;
+        signalStrengths_[id] = kNaN;
+        snrs_[id] = kNaN;
+        rxBytes_[id] = 0;
+        txBytes_[id] = 0;
+        rxBps_[id] = kNaN;
+        txBps_[id] = kNaN;
+        rxErrors_[id] = 0;
+    }
+    index_.insert(std::lower_bound(index_.begin(), index_.end(), std::make_pair(mac, id)), std::make_pair(mac, id));
+    return id;
+}
+
+void WifiClientTable::update(int64_t nowMs, const SpaceX::API::Device::WifiGetClientsResponse &response)
+{
+    // Seen at the previous update means the counters make an interval
+    const int64_t previousMs = lastUpdateMs_;
+    std::fill(connected_.begin(), connected_.end(), 0);
+    connectedCount_ = 0;
+
+    for (const auto &client : response.clients()) {
+        const uint64_t mac = parseMac(client.mac_address());
+        if (mac == 0) {
+            continue;
+        }
+        Id id = find(mac);
+        const bool continuing = id != kNoClient && previousMs > 0 && lastSeenMs_[id] == previousMs;
+        if (id == kNoClient && (id = add(mac)) == kNoClient) {
+            continue;
+        }
+        if (connected_[id]) {
+            continue;  // listed twice, e.g. on two interfaces
+        }
+
+        if (names_[id] != client.name()) {
+            names_[id] = client.name();
+        }
+        if (ipAddresses_[id] != client.ip_address()) {
+            ipAddresses_[id] = client.ip_address();
+        }
+
+        const Interface iface = interfaceOf(client.iface());
+        const bool wireless = iface == Wifi2Ghz || iface == Wifi5Ghz;
+        interfaces_[id] = iface;
+        signalStrengths_[id] = wireless && client.has_signal_strength() ? client.signal_strength() : kNaN;
+        snrs_[id] = wireless && client.has_snr() ? client.snr() : kNaN;
+
+        const uint64_t rx = client.rx_stats().bytes();
+        const uint64_t tx = client.tx_stats().bytes();
+        rxBps_[id] = continuing ? rate(rxBytes_[id], rx, nowMs - previousMs) : kNaN;
+        txBps_[id] = continuing ? rate(txBytes_[id], tx, nowMs - previousMs) : kNaN;
+        rxBytes_[id] = rx;
+        txBytes_[id] = tx;
+        rxErrors_[id] = client.rx_stats().count_errors();
+
+        lastSeenMs_[id] = nowMs;
+        connected_[id] = 1;
+        ++connectedCount_;
+    }
+    lastUpdateMs_ = nowMs;
+}
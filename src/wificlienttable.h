@@ -0,0 +1,97 @@
+#ifndef WIFICLIENTTABLE_H
+#define WIFICLIENTTABLE_H
+
+#include <QString>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace SpaceX {
+namespace API {
+namespace Device {
+class WifiGetClientsResponse;
+}
+}
+}
+
+// Everything the router says about the devices on its LAN, one row per
+// device.
+//
+// Devices are identified by their MAC address packed into 48 bits. That
+// key gives each one a small dense id for as long as the table remembers
+// it, and every per-device value lives in a column indexed by that id, as
+// in TelemetryStore. A poll looks each device up once through a sorted
+// index and updates its columns in place, so there is no per-poll
+// allocation and no map of strings. Names and addresses are kept as the
+// router sent them and only copied when they change.
+//
+// Throughput is worked out from the byte counters of consecutive polls.
+// A device the router stops listing is kept as offline. Once the table is
+// full, the row the longest offline is reused.
+class WifiClientTable
+{
+public:
+    using Id = uint32_t;
+    static constexpr Id kNoClient = UINT32_MAX;
+    static constexpr size_t kMaxClients = 1024;
+
+    enum Interface : uint8_t {
+        Unknown,
+        Ethernet,
+        Wifi2Ghz,
+        Wifi5Ghz
+    };
+
+    // "aa:bb:cc:dd:ee:ff" (or with dashes) to its 48 bits, 0 if malformed
+    static uint64_t parseMac(const std::string &mac);
+
+    void update(int64_t nowMs, const SpaceX::API::Device::WifiGetClientsResponse &response);
+    void clear();
+
+    // Ids run from 0 to size() - 1
+    size_t size() const { return macs_.size(); }
+    Id find(uint64_t mac) const;
+    int connectedCount() const { return connectedCount_; }
+    int64_t lastUpdateMs() const { return lastUpdateMs_; }
+
+    uint64_t macAt(Id id) const { return macs_[id]; }
+    QString nameAt(Id id) const { return QString::fromStdString(names_[id]); }
+    QString ipAddressAt(Id id) const { return QString::fromStdString(ipAddresses_[id]); }
+    bool isConnected(Id id) const { return connected_[id] != 0; }
+    Interface interfaceAt(Id id) const { return static_cast<Interface>(interfaces_[id]); }
+    int64_t lastSeenMs(Id id) const { return lastSeenMs_[id]; }
+    // dBm and dB as the router reports them; NaN for wired devices
+    float signalStrengthAt(Id id) const { return signalStrengths_[id]; }
+    float snrAt(Id id) const { return snrs_[id]; }
+    // Since the previous poll; NaN until a device has been seen twice
+    float rxBpsAt(Id id) const { return rxBps_[id]; }
+    float txBpsAt(Id id) const { return txBps_[id]; }
+    uint64_t rxErrorsAt(Id id) const { return rxErrors_[id]; }
+
+private:
+    Id add(uint64_t mac);
+
+    // Sorted by MAC, for lookups
+    std::vector<std::pair<uint64_t, Id>> index_;
+
+    std::vector<uint64_t> macs_;
+    std::vector<std::string> names_;
+    std::vector<std::string> ipAddresses_;
+    std::vector<uint8_t> connected_;
+    std::vector<uint8_t> interfaces_;
+    std::vector<int64_t> lastSeenMs_;
+    std::vector<float> signalStrengths_;
+    std::vector<float> snrs_;
+    std::vector<uint64_t> rxBytes_;
+    std::vector<uint64_t> txBytes_;
+    std::vector<float> rxBps_;
+    std::vector<float> txBps_;
+    std::vector<uint64_t> rxErrors_;
+
+    int connectedCount_ = 0;
+    int64_t lastUpdateMs_ = 0;
+};
+
+#endif // WIFICLIENTTABLE_H
@@ -0,0 +1,249 @@
+#include "wirescanner.h"
+#include "spacex/api/device/device.pb.h"
+#include "spacex/api/device/dish.pb.h"
+#include <cstring>
+
+using SpaceX::API::Device::DishGetHistoryResponse;
+using SpaceX::API::Device::Response;
+
+namespace {
+
+enum WireType {
+    Varint = 0,
+    Fixed64 = 1,
+    LengthDelimited = 2,
+    Fixed32 = 5
+};
+
+// Every field in Response's oneof is numbered from 1000 up
+constexpr uint32_t kFirstOneofField = 1000;
+
+class Reader
+{
+public:
+    Reader(const char *data, size_t size)
+        : p_(reinterpret_cast<const uint8_t *>(data)), end_(p_ + size)
+    {
+    }
+
+    bool atEnd() const { return p_ == end_; }
+
+    bool varint(uint64_t *value)
+    {
+        uint64_t result = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p_ == end_) {
+                return false;
+            }
+            const uint8_t byte = *p_++;
+            result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                *value = result;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool tag(uint32_t *field, int *wireType)
+    {
+        uint64_t key = 0;
+        if (!varint(&key) || key >> 32) {
+            return false;
+        }
+        *field = static_cast<uint32_t>(key >> 3);
+        *wireType = static_cast<int>(key & 7);
+        return *field != 0;
+    }
+
+    bool bytes(const char **data, size_t *size)
+    {
+        uint64_t length = 0;
+        if (!varint(&length) || length > static_cast<uint64_t>(end_ - p_)) {
+            return false;
+        }
+        *data = reinterpret_cast<const char *>(p_);
+        *size = static_cast<size_t>(length);
+        p_ += length;
+        return true;
+    }
+
+    // Groups are long deprecated and never sent by the dish
+    bool skip(int wireType)
+    {
+        uint64_t ignored = 0;
+        const char *data = nullptr;
+        size_t size = 0;
+        switch (wireType) {
+        case Varint:
+            return varint(&ignored);
+        case Fixed64:
+            return advance(8);
+        case LengthDelimited:
+            return bytes(&data, &size);
+        case Fixed32:
+            return advance(4);
+        default:
+            return false;
+        }
+    }
+
+private:
+    bool advance(size_t n)
+    {
+        if (static_cast<size_t>(end_ - p_) < n) {
+            return false;
+        }
+        p_ += n;
+        return true;
+    }
+
+    const uint8_t *p_;
+    const uint8_t *end_;
+};
+
+bool takeFloats(const char *data, size_t size, PackedFloats *out)
+{
+    // A second chunk of the same ring would have to be stitched on
+    if (!out->empty() || size % 4 != 0 || size / 4 > INT32_MAX) {
+        return false;
+    }
+    *out = PackedFloats(data, static_cast<int>(size / 4));
+    return true;
+}
+
+bool takeBools(const char *data, size_t size, PackedBools *out)
+{
+    // Canonical encoders write every bool as a single 0 or 1 byte. The
+    // bytes aren't checked here, as that would read the whole ring on every
+    // poll; only the slots a decode reads are ever looked at.
+    if (!out->empty() || size > INT32_MAX) {
+        return false;
+    }
+    *out = PackedBools(data, static_cast<int>(size));
+    return true;
+}
+
+}
+
+float PackedFloats::Get(int i) const
+{
+    float value;
+    copy(i, 1, &value);
+    return value;
+}
+
+void PackedFloats::copy(int i, int count, float *out) const
+{
+    const char *from = data_ + static_cast<size_t>(i) * 4;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (int k = 0; k < count; ++k, from += 4) {
+        const uint32_t bits = static_cast<uint32_t>(static_cast<uint8_t>(from[0]))
+                            | static_cast<uint32_t>(static_cast<uint8_t>(from[1])) << 8
+                            | static_cast<uint32_t>(static_cast<uint8_t>(from[2])) << 16
+                            | static_cast<uint32_t>(static_cast<uint8_t>(from[3])) << 24;
+        std::memcpy(out + k, &bits, 4);
+    }
+#else
+    std::memcpy(out, from, static_cast<size_t>(count) * 4);
+#endif
+}
+
+size_t PackedBools::countTrue(int i, int count) const
+{
+    size_t total = 0;
+    for (int k = i; k < i + count; ++k) {
+        total += data_[k] != 0;
+    }
+    return total;
+}
+
+namespace WireScanner {
+
+Result scanHistoryResponse(const char *data, size_t size, HistoryView *view)
+{
+    Reader reader(data, size);
+    const char *history = nullptr;
+    size_t historySize = 0;
+    bool found = false;
+
+    while (!reader.atEnd()) {
+        uint32_t field = 0;
+        int wireType = 0;
+        if (!reader.tag(&field, &wireType)) {
+            return Result::Unsupported;
+        }
+        if (field == Response::kDishGetHistoryFieldNumber) {
+            // A repeated occurrence would be merged into the first one
+            if (wireType != LengthDelimited || found || !reader.bytes(&history, &historySize)) {
+                return Result::Unsupported;
+            }
+            found = true;
+            continue;
+        }
+        // Another oneof member later on replaces the history
+        if (field >= kFirstOneofField) {
+            found = false;
+            history = nullptr;
+        }
+        if (!reader.skip(wireType)) {
+            return Result::Unsupported;
+        }
+    }
+
+    if (!found) {
+        return Result::Absent;
+    }
+    return scanHistory(history, historySize, view);
+}
+
+Result scanHistory(const char *data, size_t size, HistoryView *view)
+{
+    *view = HistoryView();
+    Reader reader(data, size);
+
+    while (!reader.atEnd()) {
+        uint32_t field = 0;
+        int wireType = 0;
+        if (!reader.tag(&field, &wireType)) {
+            return Result::Unsupported;
+        }
+
+        if (field == DishGetHistoryResponse::kCurrentFieldNumber) {
+            if (wireType != Varint || !reader.varint(&view->current_)) {
+                return Result::Unsupported;
+            }
+            continue;
+        }
+
+        PackedFloats *floats = nullptr;
+        PackedBools *bools = nullptr;
+        switch (field) {
+        case DishGetHistoryResponse::kPopPingDropRateFieldNumber: floats = &view->popPingDropRate_; break;
+        case DishGetHistoryResponse::kPopPingLatencyMsFieldNumber: floats = &view->popPingLatencyMs_; break;
+        case DishGetHistoryResponse::kDownlinkThroughputBpsFieldNumber: floats = &view->downlinkThroughputBps_; break;
+        case DishGetHistoryResponse::kUplinkThroughputBpsFieldNumber: floats = &view->uplinkThroughputBps_; break;
+        case DishGetHistoryResponse::kSnrFieldNumber: floats = &view->snr_; break;
+        case DishGetHistoryResponse::kScheduledFieldNumber: bools = &view->scheduled_; break;
+        case DishGetHistoryResponse::kObstructedFieldNumber: bools = &view->obstructed_; break;
+        default:
+            if (!reader.skip(wireType)) {
+                return Result::Unsupported;
+            }
+            continue;
+        }
+
+        // Unpacked elements arrive one tag each, legal but not zero-copy
+        const char *payload = nullptr;
+        size_t length = 0;
+        if (wireType != LengthDelimited || !reader.bytes(&payload, &length)) {
+            return Result::Unsupported;
+        }
+        if (floats ? !takeFloats(payload, length, floats) : !takeBools(payload, length, bools)) {
+            return Result::Unsupported;
+        }
+    }
+    return Result::Found;
+}
+
+}
@@ -0,0 +1,88 @@
+#ifndef WIRESCANNER_H
+#define WIRESCANNER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// A packed repeated float referenced in place in a serialized message. The
+// payload is little-endian and has no particular alignment, so values are
+// only ever read one at a time.
+class PackedFloats
+{
+public:
+    PackedFloats() = default;
+    PackedFloats(const char *data, int count) : data_(data), count_(count) {}
+
+    int size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    float Get(int i) const;
+    // Copies count values from i on
+    void copy(int i, int count, float *out) const;
+
+private:
+    const char *data_ = nullptr;
+    int count_ = 0;
+};
+
+// A packed repeated bool, one byte per value; any byte but 0 reads as true
+class PackedBools
+{
+public:
+    PackedBools() = default;
+    PackedBools(const char *data, int count) : data_(data), count_(count) {}
+
+    int size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    bool Get(int i) const { return data_[i] != 0; }
+    size_t countTrue(int i, int count) const;
+
+private:
+    const char *data_ = nullptr;
+    int count_ = 0;
+};
+
+// DishGetHistoryResponse without parsing it: the rings point straight into
+// the serialized reply, which has to outlive the view. Accessors are named
+// after the generated ones so HistoryDecoder reads either the same way.
+struct HistoryView
+{
+    uint64_t current() const { return current_; }
+    const PackedFloats &pop_ping_drop_rate() const { return popPingDropRate_; }
+    const PackedFloats &pop_ping_latency_ms() const { return popPingLatencyMs_; }
+    const PackedFloats &downlink_throughput_bps() const { return downlinkThroughputBps_; }
+    const PackedFloats &uplink_throughput_bps() const { return uplinkThroughputBps_; }
+    const PackedFloats &snr() const { return snr_; }
+    const PackedBools &scheduled() const { return scheduled_; }
+    const PackedBools &obstructed() const { return obstructed_; }
+
+    uint64_t current_ = 0;
+    PackedFloats popPingDropRate_;
+    PackedFloats popPingLatencyMs_;
+    PackedFloats downlinkThroughputBps_;
+    PackedFloats uplinkThroughputBps_;
+    PackedFloats snr_;
+    PackedBools scheduled_;
+    PackedBools obstructed_;
+};
+
+// Finds fields in protobuf wire format without building messages, for the
+// replies too large to be worth parsing whole. Field numbers come from the
+// generated code. Anything the scanner doesn't expect, like a ring sent
+// unpacked or split into several chunks, makes it give up so the caller can
+// fall back to a full parse; it never guesses.
+namespace WireScanner {
+
+enum class Result {
+    Found,
+    Absent,       // well-formed, but not the reply looked for
+    Unsupported   // parse it properly instead
+};
+
+// data is a serialized Response, *view is filled from its dish_get_history
+Result scanHistoryResponse(const char *data, size_t size, HistoryView *view);
+// data is a serialized DishGetHistoryResponse
+Result scanHistory(const char *data, size_t size, HistoryView *view);
+
+}
+
+#endif // WIRESCANNER_H
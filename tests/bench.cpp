@@ -0,0 +1,309 @@
+// Benchmarks for the polling pipeline, from a full client tick against the
+// mock dish down to the individual kernels. Run with
+//   starlink-bench --benchmark_out=results.json --benchmark_out_format=json
+// and compare runs with Google Benchmark's tools/compare.py.
+
+#include "historycodec.h"
+#include "historydecoder.h"
+#include "instrumentation.h"
+#include "kernels.h"
+#include "mockdish.h"
+#include "obstructionmap.h"
+#include "starlinkclient.h"
+#include "statusviewmodel.h"
+#include "telemetrystore.h"
+#include "wirescanner.h"
+#include "spacex/api/device/device.pb.h"
+#include "spacex/api/device/dish.pb.h"
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+
+std::vector<float> randomSeries(size_t count, float lo, float hi, double nanFraction = 0.0)
+{
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> value(lo, hi);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    std::vector<float> series(count);
+    for (float &v : series) {
+        v = coin(rng) < nanFraction ? NAN : value(rng);
+    }
+    return series;
+}
+
+// One full poll: fetchStatus() until the snapshot is published, with the
+// mock dish on loopback. Every tick sends status, device info, location
+// and history, the heaviest cycle the scheduler produces; over unary calls
+// with stream:0, over one Device::Stream with stream:1.
+void BM_ClientTick(benchmark::State &state)
+{
+    MockDishServer server(std::make_shared<MockDish>());
+    std::string error;
+    if (!server.start("127.0.0.1:0", &error)) {
+        state.SkipWithError(error.c_str());
+        return;
+    }
+
+    StarlinkClient client(QString("127.0.0.1:%1").arg(server.port()));
+    client.setTransport(state.range(0) ? StarlinkClient::Transport::Stream : StarlinkClient::Transport::Unary);
+    QEventLoop loop;
+    QObject::connect(&client, &StarlinkClient::snapshotUpdated, &loop, &QEventLoop::quit);
+
+    // The first poll connects and reads the whole ring
+    client.fetchStatus();
+    loop.exec();
+
+    for (auto _ : state) {
+        client.fetchStatus();
+        loop.exec();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ClientTick)->ArgName("stream")->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+void BM_HistoryDecodeFullRing(benchmark::State &state)
+{
+    MockDish dish;
+    SpaceX::API::Device::DishGetHistoryResponse history;
+    dish.fillHistory(dish.current(), &history);
+
+    HistoryDecoder decoder;
+    std::vector<HistorySample> samples;
+    for (auto _ : state) {
+        decoder.reset();
+        benchmark::DoNotOptimize(decoder.decode(history, &samples));
+    }
+    state.SetItemsProcessed(state.iterations() * MockDish::kRingSize);
+}
+BENCHMARK(BM_HistoryDecodeFullRing);
+
+// A steady-state poll only decodes what the dish wrote since the last one
+void BM_HistoryDecodeIncremental(benchmark::State &state)
+{
+    const int step = static_cast<int>(state.range(0));
+    MockDish dish;
+    SpaceX::API::Device::DishGetHistoryResponse history;
+    uint64_t current = dish.current();
+    dish.fillHistory(current, &history);
+
+    HistoryDecoder decoder;
+    std::vector<HistorySample> samples;
+    decoder.decode(history, &samples);
+    for (auto _ : state) {
+        current += step;
+        history.set_current(current);
+        benchmark::DoNotOptimize(decoder.decode(history, &samples));
+    }
+    state.SetItemsProcessed(state.iterations() * step);
+}
+BENCHMARK(BM_HistoryDecodeIncremental)->Arg(1)->Arg(5)->Arg(60);
+
+// From the serialized reply to decoded samples: parsing a whole Response
+// against scanning it in place
+void BM_HistoryReplyParse(benchmark::State &state)
+{
+    MockDish dish;
+    SpaceX::API::Device::Response reply;
+    dish.fillHistory(dish.current(), reply.mutable_dish_get_history());
+    const std::string wire = reply.SerializeAsString();
+
+    HistoryDecoder decoder;
+    std::vector<HistorySample> samples;
+    SpaceX::API::Device::Response response;
+    for (auto _ : state) {
+        response.ParseFromString(wire);
+        decoder.reset();
+        benchmark::DoNotOptimize(decoder.decode(response.dish_get_history(), &samples));
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(wire.size()));
+}
+BENCHMARK(BM_HistoryReplyParse);
+
+void BM_HistoryReplyScan(benchmark::State &state)
+{
+    MockDish dish;
+    SpaceX::API::Device::Response reply;
+    dish.fillHistory(dish.current(), reply.mutable_dish_get_history());
+    const std::string wire = reply.SerializeAsString();
+
+    HistoryDecoder decoder;
+    std::vector<HistorySample> samples;
+    HistoryView view;
+    for (auto _ : state) {
+        WireScanner::scanHistoryResponse(wire.data(), wire.size(), &view);
+        decoder.reset();
+        benchmark::DoNotOptimize(decoder.decode(view, &samples));
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(wire.size()));
+}
+BENCHMARK(BM_HistoryReplyScan);
+
+void BM_Summarize(benchmark::State &state)
+{
+    const std::vector<float> values = randomSeries(static_cast<size_t>(state.range(0)), 0.0f, 150e6f, 0.01);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Kernels::summarize(values.data(), values.size()));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetLabel(Kernels::implementation());
+}
+BENCHMARK(BM_Summarize)->Arg(900)->Arg(3600)->Arg(86400);
+
+void BM_CountAtLeast(benchmark::State &state)
+{
+    const std::vector<float> values = randomSeries(static_cast<size_t>(state.range(0)), 0.0f, 1.0f);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Kernels::countAtLeast(values.data(), values.size(), 1.0f));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetLabel(Kernels::implementation());
+}
+BENCHMARK(BM_CountAtLeast)->Arg(900)->Arg(86400);
+
+void BM_Quantiles(benchmark::State &state)
+{
+    const std::vector<float> values = randomSeries(static_cast<size_t>(state.range(0)), 20.0f, 80.0f, 0.01);
+    const double qs[] = { 0.5, 0.95, 0.99 };
+    float out[3];
+    std::vector<float> scratch;
+    for (auto _ : state) {
+        Kernels::quantiles(values.data(), values.size(), qs, out, 3, &scratch);
+        benchmark::DoNotOptimize(out);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Quantiles)->Arg(900)->Arg(3600);
+
+void BM_SnrToArgb(benchmark::State &state)
+{
+    const size_t cells = static_cast<size_t>(MockDish::kMapSize) * MockDish::kMapSize;
+    const std::vector<float> snr = randomSeries(cells, -1.0f, 1.0f);
+    std::vector<uint32_t> pixels(cells);
+    for (auto _ : state) {
+        Kernels::snrToArgb(snr.data(), cells, pixels.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * cells);
+    state.SetLabel(Kernels::implementation());
+}
+BENCHMARK(BM_SnrToArgb);
+
+void BM_ObstructionMapDiff(benchmark::State &state)
+{
+    MockDish dish;
+    SpaceX::API::Device::DishGetObstructionMapResponse map;
+    dish.fillObstructionMap(&map);
+
+    ObstructionMap current;
+    for (auto _ : state) {
+        // Alternate between two maps that differ in one cell
+        map.set_snr(0, map.snr(0) == -1.0f ? 0.5f : -1.0f);
+        benchmark::DoNotOptimize(current.update(MockDish::kMapSize, MockDish::kMapSize, map.snr().data()));
+    }
+}
+BENCHMARK(BM_ObstructionMapDiff);
+
+void BM_TelemetryAppend(benchmark::State &state)
+{
+    TelemetryStore store;
+    HistorySample sample;
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> value(0.0f, 100.0f);
+    int64_t timestampMs = 0;
+    for (auto _ : state) {
+        sample.downlinkBps = value(rng) * 1e6f;
+        sample.latencyMs = value(rng);
+        sample.snr = value(rng) / 10.0f;
+        store.append(timestampMs += 1000, sample);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TelemetryAppend);
+
+void BM_HistoryCodec(benchmark::State &state)
+{
+    const size_t count = 1024;
+    std::vector<uint32_t> offsets(count);
+    for (size_t i = 0; i < count; ++i) {
+        offsets[i] = static_cast<uint32_t>(i * 1000);
+    }
+    std::vector<float> columns[TelemetryStore::MetricCount];
+    SegmentLog::Span span;
+    span.timestampOffsets = offsets.data();
+    for (int m = 0; m < TelemetryStore::MetricCount; ++m) {
+        columns[m] = randomSeries(count, 0.0f, 100.0f);
+        span.columns[m] = columns[m].data();
+    }
+    std::vector<uint64_t> obstructed((count + 63) / 64, 0);
+    span.obstructed = obstructed.data();
+    span.count = count;
+
+    std::vector<uint8_t> encoded;
+    HistoryCodec::DecodedBlock decoded;
+    for (auto _ : state) {
+        encoded.clear();
+        HistoryCodec::encodeBlock(span, &encoded);
+        benchmark::DoNotOptimize(decoded.decode(encoded.data(), encoded.size(), count));
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+    state.counters["bytes_per_record"] = static_cast<double>(encoded.size()) / count;
+}
+BENCHMARK(BM_HistoryCodec);
+
+// What every RPC pays for being measured, from as many threads as the pool
+// has; the trace ring is off as it is by default
+void BM_InstrumentationRecord(benchmark::State &state)
+{
+    Instrumentation &instrumentation = Instrumentation::global();
+    int64_t ns = 0;
+    for (auto _ : state) {
+        instrumentation.record(PollScheduler::Status, Instrumentation::RoundTrip, 0, ns);
+        ns = (ns + 7919) & 0xfffff;
+    }
+}
+BENCHMARK(BM_InstrumentationRecord)->Threads(1)->Threads(4);
+
+// What the window pays per client report; most reports change nothing
+// visible and should cost next to nothing
+void BM_ViewModelUnchanged(benchmark::State &state)
+{
+    StatusViewModel view;
+    view.setVisible(true);
+    for (auto _ : state) {
+        view.setConnected(true);
+        view.setSpeed(123.4f, 12.3f, 31.0f);
+    }
+}
+BENCHMARK(BM_ViewModelUnchanged);
+
+void BM_ViewModelChanged(benchmark::State &state)
+{
+    StatusViewModel view;
+    view.setVisible(true);
+    float download = 0.0f;
+    for (auto _ : state) {
+        view.setSpeed(download += 0.1f, 12.3f, 31.0f);
+        QCoreApplication::processEvents();
+    }
+}
+BENCHMARK(BM_ViewModelChanged);
+
+}
+
+int main(int argc, char *argv[])
+{
+    // StarlinkClient and the view model need an application for their timers
+    QCoreApplication app(argc, argv);
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
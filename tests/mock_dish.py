@@ -11,27 +11,34 @@ sys.path.append(os.path.join(os.path.dirname(__file__), '../protos'))
 
 import spacex.api.device.device_pb2 as device_pb2
 import spacex.api.device.device_pb2_grpc as device_pb2_grpc
+import spacex.api.device.dish_pb2 as dish_pb2
 import spacex.api.common.status.status_pb2 as status_pb2
 
+HISTORY_RING_SIZE = 900
+
 class DeviceServicer(device_pb2_grpc.DeviceServicer):
+    def __init__(self):
+        self.started = time.time()
+
+    def fill_device_info(self, dev_info):
+        dev_info.id = "ut-12345678"
+        dev_info.hardware_version = "rev3_proto2"
+
     def Handle(self, request, context):
         response = device_pb2.Response()
         
         if request.HasField('get_status'):
             print("Received GetStatus request")
-            response.get_status.CopyFrom(device_pb2.GetStatusRequest())
-            # In a real response, status is often in the 'status' field of Response or specific sub-messages
-            # For this mock, we'll populate device_info as a sign of connection
-            
-            # Also populate the top-level status
-            response.status.uptime_s = int(time.time())
-            
-            # And device info
-            dev_info = device_pb2.DeviceInfo()
-            dev_info.id = "ut-12345678"
-            dev_info.hardware_version = "rev3_proto2"
-            response.get_device_info.device_info.CopyFrom(dev_info)
-            
+            status = response.dish_get_status
+            self.fill_device_info(status.device_info)
+            status.state = dish_pb2.CONNECTED
+            status.snr = random.uniform(8.0, 10.0)
+            status.pop_ping_latency_ms = random.uniform(20.0, 60.0)
+
+        elif request.HasField('get_device_info'):
+            print("Received GetDeviceInfo request")
+            self.fill_device_info(response.get_device_info.device_info)
+
         elif request.HasField('get_location'):
             print("Received GetLocation request")
             # Mock location (SpaceX HQ)
@@ -40,14 +47,22 @@ class DeviceServicer(device_pb2_grpc.DeviceServicer):
             response.get_location.lla.alt = 15.0
             
         elif request.HasField('get_history'):
-            print("Received GetHistory request (simulating speed)")
-            # We use this to trigger speed updates in our client
-            # In reality, client parses history. Here we just return success
-            # and let the client mock the speed values for now, 
-            # OR we could try to populate history data if we knew the format well.
-            # For the MVP client, we just check for success.
-            pass
-            
+            print("Received GetHistory request")
+            # One sample per second since start, kept in fixed-size rings the
+            # way the dish does; the client only reads what is new since its
+            # last poll, so the values themselves can be random.
+            current = int(time.time() - self.started) + 1
+            history = response.dish_get_history
+            history.current = current
+            for _ in range(HISTORY_RING_SIZE):
+                history.downlink_throughput_bps.append(random.uniform(50e6, 150e6))
+                history.uplink_throughput_bps.append(random.uniform(5e6, 25e6))
+                history.pop_ping_latency_ms.append(random.uniform(20.0, 60.0))
+                history.pop_ping_drop_rate.append(0.0 if random.random() > 0.02 else 1.0)
+                history.snr.append(random.uniform(8.0, 10.0))
+                history.obstructed.append(random.random() < 0.01)
+                history.scheduled.append(True)
+
         return response
 
 def serve():
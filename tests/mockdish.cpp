@@ -0,0 +1,457 @@
+#include "mockdish.h"
+#include "spacex/api/device/service.grpc.pb.h"
+#include <grpcpp/alarm.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+
+using SpaceX::API::Device::FromDevice;
+using SpaceX::API::Device::Request;
+using SpaceX::API::Device::Response;
+using SpaceX::API::Device::ToDevice;
+
+namespace {
+
+// The dish has been up for half a day when the mock starts, so the rings
+// are full from the first poll on
+constexpr uint64_t kBootSamples = 12 * 3600;
+
+constexpr double kPi = 3.14159265358979323846;
+
+// How long a lost request is held when the caller set no deadline
+constexpr int kLostHoldMs = 60 * 1000;
+
+uint64_t mix(uint64_t x)
+{
+    // splitmix64's finaliser
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// Answers stream requests in order, one write in flight at a time
+class StreamReactor : public grpc::ServerBidiReactor<ToDevice, FromDevice>
+{
+public:
+    StreamReactor(std::shared_ptr<const MockDish> dish, std::atomic<uint64_t> *requests)
+        : dish_(std::move(dish)), requests_(requests)
+    {
+        StartRead(&incoming_);
+    }
+
+    void OnReadDone(bool ok) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!ok) {
+            reading_ = false;
+            finishIfIdle();
+            return;
+        }
+
+        ++*requests_;
+        FromDevice message;
+        Response *response = message.mutable_response();
+        const grpc::Status status = dish_->handle(incoming_.request(), response);
+        response->set_id(incoming_.request().id());
+        if (!status.ok()) {
+            response->mutable_status()->set_code(static_cast<int>(status.error_code()));
+            response->mutable_status()->set_message(status.error_message());
+        }
+        outgoing_.push_back(std::move(message));
+        writeNext();
+        StartRead(&incoming_);
+    }
+
+    void OnWriteDone(bool ok) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        writing_ = false;
+        outgoing_.pop_front();
+        if (!ok) {
+            outgoing_.clear();
+        }
+        writeNext();
+        finishIfIdle();
+    }
+
+    void OnDone() override
+    {
+        delete this;
+    }
+
+private:
+    void writeNext()
+    {
+        if (!writing_ && !outgoing_.empty()) {
+            writing_ = true;
+            StartWrite(&outgoing_.front());
+        }
+    }
+
+    void finishIfIdle()
+    {
+        if (!reading_ && !writing_ && !finished_) {
+            finished_ = true;
+            Finish(grpc::Status::OK);
+        }
+    }
+
+    std::shared_ptr<const MockDish> dish_;
+    std::atomic<uint64_t> *requests_;
+    std::mutex mutex_;
+    ToDevice incoming_;
+    std::deque<FromDevice> outgoing_;
+    bool reading_ = true;
+    bool writing_ = false;
+    bool finished_ = false;
+};
+
+}
+
+MockDish::MockDish(uint64_t seed)
+    : seed_(seed)
+{
+    // Dishes in a fleet shouldn't all record their samples on the same
+    // tick, so each one is part of a second into its current sample
+    started_ = std::chrono::steady_clock::now() - std::chrono::milliseconds(mix(seed) % 1000);
+}
+
+uint64_t MockDish::current() const
+{
+    using namespace std::chrono;
+    const auto elapsed = duration_cast<seconds>(steady_clock::now() - started_).count();
+    return kBootSamples + static_cast<uint64_t>(elapsed);
+}
+
+double MockDish::uniform(uint64_t index, uint64_t stream) const
+{
+    return (mix(seed_ ^ mix(index ^ (stream << 56))) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+MockDish::Sample MockDish::sample(uint64_t index) const
+{
+    Sample s;
+
+    // Throughput follows the time of day with noise on top
+    const double daily = 0.6 + 0.4 * std::sin(2.0 * kPi * static_cast<double>(index % 86400) / 86400.0);
+    s.downlinkBps = static_cast<float>(daily * 120e6 + uniform(index, 1) * 60e6);
+    s.uplinkBps = static_cast<float>(daily * 12e6 + uniform(index, 2) * 10e6);
+
+    // Latency with the occasional spike
+    s.latencyMs = static_cast<float>(24.0 + uniform(index, 3) * 18.0 + (uniform(index, 4) < 0.01 ? 150.0 : 0.0));
+
+    // Mostly clean, with rare full outages and a little partial loss
+    const double loss = uniform(index, 5);
+    s.dropRate = loss < 0.01 ? 1.0f : (loss < 0.04 ? static_cast<float>(uniform(index, 6) * 0.2) : 0.0f);
+
+    // Obstructions come in runs of half a minute
+    s.obstructed = uniform(index / 30, 7) < 0.03;
+    s.snr = static_cast<float>((s.obstructed ? 5.0 : 9.0) + uniform(index, 8));
+    return s;
+}
+
+void MockDish::fillDeviceInfo(SpaceX::API::Device::DeviceInfo *info) const
+{
+    char id[32];
+    std::snprintf(id, sizeof(id), "ut%016llx", static_cast<unsigned long long>(mix(seed_)));
+    info->set_id(id);
+    info->set_hardware_version("rev3_proto2");
+    info->set_software_version("mock-1.0");
+    info->set_country_code("US");
+    info->set_utc_offset_s(0);
+}
+
+void MockDish::fillStatus(SpaceX::API::Device::DishGetStatusResponse *status) const
+{
+    const uint64_t now = current();
+    const Sample latest = sample(now - 1);
+
+    fillDeviceInfo(status->mutable_device_info());
+    status->mutable_device_state()->set_uptime_s(now);
+    status->set_state(SpaceX::API::Device::CONNECTED);
+    status->set_snr(latest.snr);
+    status->set_seconds_to_first_nonempty_slot(0.0f);
+    status->set_pop_ping_drop_rate(latest.dropRate);
+    status->set_downlink_throughput_bps(latest.downlinkBps);
+    status->set_uplink_throughput_bps(latest.uplinkBps);
+    status->set_pop_ping_latency_ms(latest.latencyMs);
+
+    // An alert every now and then, lasting ten minutes
+    auto *alerts = status->mutable_alerts();
+    alerts->set_thermal_throttle(uniform(now / 600, 9) < 0.05);
+
+    auto *obstruction = status->mutable_obstruction_stats();
+    obstruction->set_currently_obstructed(latest.obstructed);
+    obstruction->set_fraction_obstructed(static_cast<float>(0.005 + uniform(0, 10) * 0.03));
+    obstruction->set_valid_s(static_cast<float>(now));
+    for (int wedge = 0; wedge < 12; ++wedge) {
+        obstruction->add_wedge_fraction_obstructed(static_cast<float>(uniform(wedge, 11) < 0.2 ? uniform(wedge, 12) * 0.1 : 0.0));
+    }
+}
+
+void MockDish::fillHistory(uint64_t current, SpaceX::API::Device::DishGetHistoryResponse *history) const
+{
+    history->set_current(current);
+
+    // Slot i holds the newest sample whose index is i modulo the ring size
+    auto *downlink = history->mutable_downlink_throughput_bps();
+    auto *uplink = history->mutable_uplink_throughput_bps();
+    auto *latency = history->mutable_pop_ping_latency_ms();
+    auto *dropRate = history->mutable_pop_ping_drop_rate();
+    auto *snr = history->mutable_snr();
+    auto *obstructed = history->mutable_obstructed();
+    auto *scheduled = history->mutable_scheduled();
+    downlink->Resize(kRingSize, 0.0f);
+    uplink->Resize(kRingSize, 0.0f);
+    latency->Resize(kRingSize, 0.0f);
+    dropRate->Resize(kRingSize, 0.0f);
+    snr->Resize(kRingSize, 0.0f);
+    obstructed->Resize(kRingSize, false);
+    scheduled->Resize(kRingSize, false);
+
+    for (uint64_t index = current - kRingSize; index < current; ++index) {
+        const int slot = static_cast<int>(index % kRingSize);
+        const Sample s = sample(index);
+        downlink->Set(slot, s.downlinkBps);
+        uplink->Set(slot, s.uplinkBps);
+        latency->Set(slot, s.latencyMs);
+        dropRate->Set(slot, s.dropRate);
+        snr->Set(slot, s.snr);
+        obstructed->Set(slot, s.obstructed);
+        scheduled->Set(slot, true);
+    }
+}
+
+void MockDish::fillObstructionMap(SpaceX::API::Device::DishGetObstructionMapResponse *map) const
+{
+    map->set_num_rows(kMapSize);
+    map->set_num_cols(kMapSize);
+
+    // Cells fill in over the first hour, the way a new dish maps its sky;
+    // a stand of trees blocks one sector near the horizon
+    using namespace std::chrono;
+    const double minutes = duration_cast<seconds>(steady_clock::now() - started_).count() / 60.0;
+    const double revealed = std::min(1.0, 0.2 + minutes / 60.0);
+    const double treesFrom = uniform(0, 13) * 2.0 * kPi;
+    const double centre = (kMapSize - 1) / 2.0;
+
+    auto *snr = map->mutable_snr();
+    snr->Reserve(kMapSize * kMapSize);
+    for (int r = 0; r < kMapSize; ++r) {
+        for (int c = 0; c < kMapSize; ++c) {
+            const uint64_t cell = static_cast<uint64_t>(r) * kMapSize + c;
+            const double dx = c - centre;
+            const double dy = r - centre;
+            const double radius = std::sqrt(dx * dx + dy * dy);
+            if (radius > centre || uniform(cell, 14) > revealed) {
+                snr->Add(-1.0f);
+                continue;
+            }
+            double angle = std::atan2(dy, dx) - treesFrom;
+            angle -= 2.0 * kPi * std::floor(angle / (2.0 * kPi));
+            const bool blocked = angle < 0.5 && radius > centre * 0.7;
+            snr->Add(static_cast<float>(blocked ? uniform(cell, 15) * 0.3 : 0.8 + uniform(cell, 15) * 0.2));
+        }
+    }
+}
+
+grpc::Status MockDish::handle(const Request &request, Response *response) const
+{
+    switch (request.request_case()) {
+    case Request::kGetStatus:
+        fillStatus(response->mutable_dish_get_status());
+        break;
+    case Request::kGetDeviceInfo:
+        fillDeviceInfo(response->mutable_get_device_info()->mutable_device_info());
+        break;
+    case Request::kGetLocation: {
+        auto *lla = response->mutable_get_location()->mutable_lla();
+        lla->set_lat(33.9207 + (uniform(0, 16) - 0.5));
+        lla->set_lon(-118.3278 + (uniform(0, 17) - 0.5));
+        lla->set_alt(15.0 + uniform(0, 18) * 100.0);
+        break;
+    }
+    case Request::kGetHistory:
+        fillHistory(current(), response->mutable_dish_get_history());
+        break;
+    case Request::kDishGetObstructionMap:
+        fillObstructionMap(response->mutable_dish_get_obstruction_map());
+        break;
+    case Request::kDishGetContext: {
+        // A handful of POPs and gateways, so a simulated fleet shares them
+        auto *context = response->mutable_dish_get_context();
+        context->set_cell_id(static_cast<uint32_t>(mix(seed_) % 100000));
+        context->set_pop_rack_id(static_cast<uint32_t>(1 + mix(seed_ ^ 29) % 4));
+        context->set_initial_gateway_id(static_cast<uint32_t>(1 + mix(seed_ ^ 30) % 16));
+        context->set_on_backup_beam(uniform(current() / 600, 31) < 0.05);
+        break;
+    }
+    case Request::kSpeedTest: {
+        // Answered at once; a real dish takes most of a minute
+        auto *test = response->mutable_speed_test();
+        test->set_download_mbps(static_cast<float>(150.0 + uniform(current(), 19) * 100.0));
+        test->set_upload_mbps(static_cast<float>(15.0 + uniform(current(), 20) * 10.0));
+        test->set_latency_ms(static_cast<float>(25.0 + uniform(current(), 21) * 15.0));
+        break;
+    }
+    case Request::kTransceiverGetTelemetry: {
+        // Varies every 50 ms rather than every sample, as a burst would see
+        // it; everything slower follows the sample counter
+        using namespace std::chrono;
+        const uint64_t now = current();
+        const uint64_t tick = static_cast<uint64_t>(duration_cast<milliseconds>(steady_clock::now() - started_).count() / 50);
+        auto *telemetry = response->mutable_transceiver_get_telemetry();
+        telemetry->set_snr_db(static_cast<float>(8.0 + uniform(now, 22) * 2.0 + (uniform(tick, 23) - 0.5)));
+        telemetry->set_wb_rssi_peak_mag_db(static_cast<float>(-60.0 + uniform(now, 24) * 5.0));
+        telemetry->set_pop_ping_drop_rate(static_cast<float>(uniform(now, 25) < 0.05 ? uniform(now, 26) : 0.0));
+        telemetry->set_lmac_satellite_id(static_cast<uint32_t>(1000 + now / 15 % 400));
+        telemetry->set_current_cell_id(static_cast<uint32_t>(mix(seed_) % 100000));
+        telemetry->set_rx_channel(static_cast<uint32_t>(1 + now / 15 % 8));
+        break;
+    }
+    case Request::kTransceiverGetStatus: {
+        auto *status = response->mutable_transceiver_get_status();
+        status->set_modem_asic_temp(static_cast<float>(55.0 + uniform(current(), 27) * 5.0));
+        status->set_tx_if_temp(static_cast<float>(45.0 + uniform(current(), 28) * 5.0));
+        break;
+    }
+    default:
+        return grpc::Status(grpc::StatusCode::UNIMPLEMENTED, "not simulated");
+    }
+    return grpc::Status::OK;
+}
+
+class MockDishServer::Service : public SpaceX::API::Device::Device::CallbackService
+{
+public:
+    Service(std::shared_ptr<const MockDish> dish, const Faults &faults, std::atomic<uint64_t> *requests)
+        : dish_(std::move(dish)), faults_(faults), requests_(requests)
+    {
+    }
+
+    grpc::ServerUnaryReactor *Handle(grpc::CallbackServerContext *context, const Request *request,
+                                     Response *response) override
+    {
+        ++*requests_;
+        grpc::ServerUnaryReactor *reactor = context->DefaultReactor();
+        const grpc::Status status = dish_->handle(*request, response);
+
+        const auto now = std::chrono::system_clock::now();
+        std::chrono::system_clock::time_point replyAt = now;
+        if (faults_.lossRate > 0.0 && chance() < faults_.lossRate) {
+            replyAt = std::min(context->deadline(), now + std::chrono::milliseconds(kLostHoldMs));
+        } else if (faults_.latencyMs > 0 || faults_.jitterMs > 0) {
+            const int jitter = faults_.jitterMs > 0 ? static_cast<int>(chance() * faults_.jitterMs) : 0;
+            replyAt = now + std::chrono::milliseconds(faults_.latencyMs + jitter);
+        }
+        if (replyAt <= now) {
+            reactor->Finish(status);
+            return reactor;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            reactor->Finish(status);
+            return reactor;
+        }
+        // The alarm is dropped from pending_ once it has fired, or fires
+        // early, cancelled, when close() takes them all
+        auto alarm = std::make_unique<grpc::Alarm>();
+        grpc::Alarm *key = alarm.get();
+        pending_.emplace(key, std::move(alarm));
+        key->Set(replyAt, [this, key, reactor, status](bool) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                pending_.erase(key);
+            }
+            // Last, since the service may be gone once every call finished
+            reactor->Finish(status);
+        });
+        return reactor;
+    }
+
+    // Answers every delayed call right away; the server can't shut down
+    // while any is outstanding
+    void close()
+    {
+        std::unordered_map<grpc::Alarm *, std::unique_ptr<grpc::Alarm>> pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            pending.swap(pending_);
+        }
+        for (auto &entry : pending) {
+            entry.second->Cancel();
+        }
+    }
+
+    grpc::ServerBidiReactor<ToDevice, FromDevice> *Stream(grpc::CallbackServerContext *) override
+    {
+        return new StreamReactor(dish_, requests_);
+    }
+
+private:
+    static double chance()
+    {
+        thread_local std::minstd_rand rng(std::random_device{}());
+        return std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+    }
+
+    std::shared_ptr<const MockDish> dish_;
+    Faults faults_;
+    std::atomic<uint64_t> *requests_;
+
+    std::mutex mutex_;
+    bool closed_ = false;
+    std::unordered_map<grpc::Alarm *, std::unique_ptr<grpc::Alarm>> pending_;
+};
+
+MockDishServer::MockDishServer(std::shared_ptr<const MockDish> dish)
+    : dish_(std::move(dish))
+{
+}
+
+MockDishServer::~MockDishServer()
+{
+    shutdown();
+}
+
+bool MockDishServer::start(const std::string &address, std::string *error)
+{
+    shutdown();
+
+    service_ = std::make_unique<Service>(dish_, faults_, &requests_);
+    grpc::ServerBuilder builder;
+    builder.AddListeningPort(address, grpc::InsecureServerCredentials(), &port_);
+    builder.RegisterService(service_.get());
+    server_ = builder.BuildAndStart();
+    if (!server_ || port_ == 0) {
+        if (error) {
+            *error = "can't listen on " + address;
+        }
+        server_.reset();
+        service_.reset();
+        port_ = 0;
+        return false;
+    }
+    return true;
+}
+
+void MockDishServer::shutdown()
+{
+    if (server_) {
+        // Delayed replies go out now, open streams are cancelled rather
+        // than waited for
+        service_->close();
+        server_->Shutdown(std::chrono::system_clock::now() + std::chrono::milliseconds(100));
+        server_->Wait();
+        server_.reset();
+    }
+    service_.reset();
+    port_ = 0;
+}
@@ -0,0 +1,99 @@
+#ifndef MOCKDISH_H
+#define MOCKDISH_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <grpcpp/grpcpp.h>
+#include "spacex/api/device/device.pb.h"
+
+// A simulated dish that answers the requests StarlinkClient sends with fully
+// populated replies: status with alerts and obstruction stats, device info,
+// location, the obstruction map and 900-sample history rings that advance
+// at 1 Hz like the real thing.
+//
+// Every sample is a pure function of its index and the dish's seed, so
+// polls that overlap agree with each other and two runs with the same
+// seed see the same data. handle() is safe to call from any thread.
+class MockDish
+{
+public:
+    static constexpr int kRingSize = 900;
+    static constexpr int kMapSize = 123;
+
+    explicit MockDish(uint64_t seed = 1);
+
+    grpc::Status handle(const SpaceX::API::Device::Request &request, SpaceX::API::Device::Response *response) const;
+
+    // Samples recorded so far; what the history reply reports as current
+    uint64_t current() const;
+
+    void fillStatus(SpaceX::API::Device::DishGetStatusResponse *status) const;
+    void fillHistory(uint64_t current, SpaceX::API::Device::DishGetHistoryResponse *history) const;
+    void fillObstructionMap(SpaceX::API::Device::DishGetObstructionMapResponse *map) const;
+    void fillDeviceInfo(SpaceX::API::Device::DeviceInfo *info) const;
+
+private:
+    struct Sample {
+        float downlinkBps;
+        float uplinkBps;
+        float latencyMs;
+        float dropRate;
+        float snr;
+        bool obstructed;
+    };
+
+    Sample sample(uint64_t index) const;
+    double uniform(uint64_t index, uint64_t stream) const;
+
+    uint64_t seed_;
+    std::chrono::steady_clock::time_point started_;
+};
+
+// Serves a MockDish over the same Device service the real dish exposes,
+// unary Handle() and the bidirectional Stream() alike, on gRPC's callback
+// API so that a single process can answer at a high rate.
+//
+// Faults make it behave like a dish on a bad link: every unary reply is
+// held back by latency plus up to jitter, and a lost request is never
+// answered before the caller's deadline. Delays run on gRPC alarms, so a
+// slow dish doesn't tie up a thread per call.
+class MockDishServer
+{
+public:
+    struct Faults {
+        int latencyMs = 0;
+        int jitterMs = 0;
+        double lossRate = 0.0;
+    };
+
+    explicit MockDishServer(std::shared_ptr<const MockDish> dish);
+    ~MockDishServer();
+
+    // Takes effect from the next start()
+    void setFaults(const Faults &faults) { faults_ = faults; }
+    const Faults &faults() const { return faults_; }
+
+    // address is host:port; port 0 picks a free one, see port()
+    bool start(const std::string &address, std::string *error = nullptr);
+    void shutdown();
+    bool isRunning() const { return server_ != nullptr; }
+
+    int port() const { return port_; }
+    // Requests answered across every start()
+    uint64_t requestCount() const { return requests_.load(); }
+
+private:
+    class Service;
+
+    std::shared_ptr<const MockDish> dish_;
+    Faults faults_;
+    std::atomic<uint64_t> requests_{0};
+    std::unique_ptr<Service> service_;
+    std::unique_ptr<grpc::Server> server_;
+    int port_ = 0;
+};
+
+#endif // MOCKDISH_H
@@ -0,0 +1,116 @@
+#include "mockfleet.h"
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+namespace {
+
+constexpr int kReportIntervalS = 10;
+
+void usage(const char *program)
+{
+    std::fprintf(stderr,
+                 "Usage: %s [--address host] [--port port] [--seed n] [--dishes n]\n"
+                 "          [--latency ms] [--jitter ms] [--loss fraction]\n"
+                 "          [--storm-interval s] [--storm-duration s] [--storm-fraction f]\n"
+                 "          [--targets-file path]\n"
+                 "Serves simulated Starlink dishes on consecutive ports from --port\n"
+                 "(default one dish on 0.0.0.0:9200). --targets-file writes a list\n"
+                 "for starlink-monitord --targets.\n",
+                 program);
+}
+
+bool writeTargets(const std::string &path, const MockFleet &fleet, const std::string &host)
+{
+    FILE *file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+    // The fleet may listen on a wildcard address, so only its ports are kept
+    for (const std::string &target : fleet.targets()) {
+        std::fprintf(file, "%s%s\n", host.c_str(), target.substr(target.rfind(':')).c_str());
+    }
+    return std::fclose(file) == 0;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    MockFleet::Options options;
+    options.address = "0.0.0.0";
+    std::string targetsFile;
+
+    for (int i = 1; i < argc; ++i) {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--address") == 0 && hasValue) {
+            options.address = argv[++i];
+        } else if (std::strcmp(argv[i], "--port") == 0 && hasValue) {
+            options.basePort = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--seed") == 0 && hasValue) {
+            options.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--dishes") == 0 && hasValue) {
+            options.dishes = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--latency") == 0 && hasValue) {
+            options.faults.latencyMs = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--jitter") == 0 && hasValue) {
+            options.faults.jitterMs = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--loss") == 0 && hasValue) {
+            options.faults.lossRate = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--storm-interval") == 0 && hasValue) {
+            options.stormIntervalMs = std::atoi(argv[++i]) * 1000;
+        } else if (std::strcmp(argv[i], "--storm-duration") == 0 && hasValue) {
+            options.stormDurationMs = std::atoi(argv[++i]) * 1000;
+        } else if (std::strcmp(argv[i], "--storm-fraction") == 0 && hasValue) {
+            options.stormFraction = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--targets-file") == 0 && hasValue) {
+            targetsFile = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    // Blocked before gRPC starts its threads, so only sigtimedwait() sees them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    MockFleet fleet(options);
+    std::string error;
+    if (!fleet.start(&error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    if (!targetsFile.empty()) {
+        const std::string host = options.address == "0.0.0.0" ? "127.0.0.1" : options.address;
+        if (!writeTargets(targetsFile, fleet, host)) {
+            std::fprintf(stderr, "Can't write %s\n", targetsFile.c_str());
+            return 1;
+        }
+    }
+    std::printf("%d mock dish(es) on %s:%d-%d\n", fleet.size(), options.address.c_str(), options.basePort,
+                options.basePort + fleet.size() - 1);
+    std::fflush(stdout);
+
+    // A line every few seconds instead of one per request, which would cost
+    // more than answering at fleet scale
+    const timespec interval = {kReportIntervalS, 0};
+    uint64_t lastRequests = 0;
+    while (sigtimedwait(&signals, nullptr, &interval) < 0) {
+        const uint64_t requests = fleet.requestCount();
+        std::printf("%d/%d online, %.1f requests/s\n", fleet.onlineCount(), fleet.size(),
+                    static_cast<double>(requests - lastRequests) / kReportIntervalS);
+        std::fflush(stdout);
+        lastRequests = requests;
+    }
+
+    std::printf("Served %llu requests\n", static_cast<unsigned long long>(fleet.requestCount()));
+    fleet.stop();
+    return 0;
+}
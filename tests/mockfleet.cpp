@@ -0,0 +1,133 @@
+#include "mockfleet.h"
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+namespace {
+
+// Ports can take a moment to free up after a storm; a dish that can't
+// listen again yet is retried this often
+constexpr int kRestartRetryMs = 500;
+
+}
+
+MockFleet::MockFleet(const Options &options)
+    : options_(options)
+{
+    const int dishes = std::max(1, options_.dishes);
+    servers_.reserve(dishes);
+    for (int i = 0; i < dishes; ++i) {
+        auto server = std::make_unique<MockDishServer>(std::make_shared<MockDish>(options_.seed + i));
+        server->setFaults(options_.faults);
+        servers_.push_back(std::move(server));
+    }
+}
+
+MockFleet::~MockFleet()
+{
+    stop();
+}
+
+bool MockFleet::start(std::string *error)
+{
+    stop();
+
+    for (int i = 0; i < size(); ++i) {
+        if (!servers_[i]->start(target(i), error)) {
+            stop();
+            return false;
+        }
+    }
+
+    if (options_.stormIntervalMs > 0) {
+        stopping_ = false;
+        storms_ = std::thread(&MockFleet::runStorms, this);
+    }
+    return true;
+}
+
+void MockFleet::stop()
+{
+    if (storms_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        storms_.join();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &server : servers_) {
+        server->shutdown();
+    }
+}
+
+std::vector<std::string> MockFleet::targets() const
+{
+    std::vector<std::string> targets;
+    targets.reserve(servers_.size());
+    for (int i = 0; i < size(); ++i) {
+        targets.push_back(target(i));
+    }
+    return targets;
+}
+
+uint64_t MockFleet::requestCount() const
+{
+    uint64_t requests = 0;
+    for (const auto &server : servers_) {
+        requests += server->requestCount();
+    }
+    return requests;
+}
+
+int MockFleet::onlineCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return static_cast<int>(std::count_if(servers_.begin(), servers_.end(),
+                                          [](const auto &server) { return server->isRunning(); }));
+}
+
+std::string MockFleet::target(int dish) const
+{
+    return options_.address + ":" + std::to_string(options_.basePort + dish);
+}
+
+void MockFleet::runStorms()
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::mt19937_64 rng(options_.seed);
+    std::vector<int> order(servers_.size());
+    std::iota(order.begin(), order.end(), 0);
+    const int stormSize = std::clamp(static_cast<int>(options_.stormFraction * size() + 0.5), 1, size());
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    Clock::time_point nextStorm = Clock::now() + std::chrono::milliseconds(options_.stormIntervalMs);
+    Clock::time_point restoreAt;
+    std::vector<int> down;
+
+    while (!stopping_) {
+        const Clock::time_point until = down.empty() ? nextStorm : restoreAt;
+        if (wake_.wait_until(lock, until, [this] { return stopping_; })) {
+            break;
+        }
+
+        if (down.empty()) {
+            std::shuffle(order.begin(), order.end(), rng);
+            down.assign(order.begin(), order.begin() + stormSize);
+            for (int dish : down) {
+                servers_[dish]->shutdown();
+            }
+            restoreAt = Clock::now() + std::chrono::milliseconds(options_.stormDurationMs);
+            nextStorm = Clock::now() + std::chrono::milliseconds(options_.stormIntervalMs);
+            continue;
+        }
+
+        down.erase(std::remove_if(down.begin(), down.end(),
+                                  [this](int dish) { return servers_[dish]->start(target(dish)); }),
+                   down.end());
+        restoreAt = Clock::now() + std::chrono::milliseconds(kRestartRetryMs);
+    }
+}
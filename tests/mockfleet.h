@@ -0,0 +1,65 @@
+#ifndef MOCKFLEET_H
+#define MOCKFLEET_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mockdish.h"
+
+// Any number of simulated dishes, each on its own port from basePort up,
+// for exercising fleet mode at the scale of hundreds of dishes. Every dish
+// has its own seed, so their rings and link quality evolve independently.
+//
+// Disconnect storms take a random share of the fleet down at once, every
+// stormIntervalMs for stormDurationMs, by shutting their servers down so
+// that clients see refused connections rather than errors.
+class MockFleet
+{
+public:
+    struct Options {
+        int dishes = 1;
+        std::string address = "127.0.0.1";
+        int basePort = 9200;
+        uint64_t seed = 1;
+        MockDishServer::Faults faults;
+
+        // 0 disables storms
+        int stormIntervalMs = 0;
+        int stormDurationMs = 10 * 1000;
+        double stormFraction = 0.1;
+    };
+
+    explicit MockFleet(const Options &options);
+    ~MockFleet();
+
+    MockFleet(const MockFleet &) = delete;
+    MockFleet &operator=(const MockFleet &) = delete;
+
+    bool start(std::string *error = nullptr);
+    void stop();
+
+    int size() const { return static_cast<int>(servers_.size()); }
+    // host:port of every dish, in the format FleetManager reads targets in
+    std::vector<std::string> targets() const;
+
+    uint64_t requestCount() const;
+    int onlineCount() const;
+
+private:
+    std::string target(int dish) const;
+    void runStorms();
+
+    Options options_;
+    std::vector<std::unique_ptr<MockDishServer>> servers_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread storms_;
+};
+
+#endif // MOCKFLEET_H